@@ -1,5 +1,6 @@
 #pragma once
 #include <iostream>
+#include <vector>
 
 #include <glad\glad.h>
 #include <GLFW\glfw3.h>
@@ -114,6 +115,31 @@ public:
 		glActiveTexture(GL_TEXTURE0);
 	}
 
+	// Plane readback, bottom row first. Used to compare against the software renderer
+	void ReadPositionBuffer(std::vector<float>& out) {
+		out.resize((size_t)this->width * this->height * 3);
+		glBindTexture(GL_TEXTURE_2D, this->gPosition);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &out[0]);
+	}
+
+	void ReadNormalBuffer(std::vector<float>& out) {
+		out.resize((size_t)this->width * this->height * 3);
+		glBindTexture(GL_TEXTURE_2D, this->gNormal);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &out[0]);
+	}
+
+	void ReadInfoBuffer(std::vector<unsigned int>& out) {
+		out.resize((size_t)this->width * this->height);
+		glBindTexture(GL_TEXTURE_2D, this->gMapInfo);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &out[0]);
+	}
+
+	void ReadOriginBuffer(std::vector<float>& out) {
+		out.resize((size_t)this->width * this->height * 2);
+		glBindTexture(GL_TEXTURE_2D, this->gOrigin);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, &out[0]);
+	}
+
 	void Bind() {
 		glViewport(0, 0, this->width, this->height);
 		glBindFramebuffer(GL_FRAMEBUFFER, this->gBuffer ); //Set as active draw target
@@ -182,6 +208,14 @@ public:
 		glActiveTexture(GL_TEXTURE0);
 	}
 
+	// Mask readback, bottom row first
+	void ReadMaskBuffer(std::vector<unsigned char>& out) {
+		out.resize((size_t)this->width * this->height);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, this->gMask);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &out[0]);
+	}
+
 	void Bind() {
 		glViewport(0, 0, this->width, this->height);
 		glBindFramebuffer(GL_FRAMEBUFFER, this->gBuffer); //Set as active draw target
@@ -37,9 +37,10 @@ public:
 	GradientTexture(Color255 _c0, Color255 _c1, Color255 _c2) {
 		this->c0 = _c0; this->c1 = _c1; this->c2 = _c2;
 
-		glGenTextures(1, &this->texture_id);
-
-		unsigned char* data = (unsigned char*)malloc(256*4);
+		this->width = 256; this->height = 1;
+		this->clamp = true; this->linear = true;
+		this->pixels.resize(256 * 4);
+		unsigned char* data = &this->pixels[0];
 
 		// Do texture generation
 		for (int i = 0; i < 256; i++) {
@@ -54,6 +55,9 @@ public:
 			data[i * 4 + 3] = lerpT(a->a, b->a, (float)(i % 128) / 128.0f);
 		}
 
+		if (render::headless()) return;
+
+		glGenTextures(1, &this->texture_id);
 		glBindTexture(GL_TEXTURE_2D, this->texture_id);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 
@@ -62,8 +66,6 @@ public:
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		free(data);
 	}
 
 	/*void bindOnSlot(int slot = 0) {
@@ -100,8 +102,10 @@ public:
 		std::map<float, Color255>::iterator it_next = colorMap.begin();
 		it_next++;
 		
-		glGenTextures(1, &this->texture_id);
-		unsigned char* data = (unsigned char*)malloc(2048 * 4);
+		this->width = 2048; this->height = 1;
+		this->clamp = true; this->linear = true;
+		this->pixels.resize(2048 * 4);
+		unsigned char* data = &this->pixels[0];
 
 		for (int i = 0; i < 2048; i++) {
 			float pc = (float)i / (float)2048;
@@ -122,6 +126,9 @@ public:
 			data[i * 4 + 3] = lerpT<float>(it->second.a, it_next->second.a, subpc);
 		}
 
+		if (render::headless()) return;
+
+		glGenTextures(1, &this->texture_id);
 		glBindTexture(GL_TEXTURE_2D, this->texture_id);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2048, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 
@@ -130,7 +137,5 @@ public:
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		free(data);
 	}
 };
\ No newline at end of file
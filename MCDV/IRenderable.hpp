@@ -3,7 +3,7 @@
 #include <glm\gtc\matrix_transform.hpp>
 #include <glm\gtc\type_ptr.hpp>
 
-#include "Shader.hpp"
+#include "render.hpp"
 
 class IRenderable {
 public:
@@ -12,11 +12,11 @@ public:
 
 	Mesh* m_mesh = NULL;
 
-	virtual void _Draw(Shader* shader, std::vector<glm::mat4> transform_stack = {}) = 0;
+	virtual void _Draw(render::context* ctx, std::vector<glm::mat4> transform_stack = {}) = 0;
 	virtual void SetupDrawable() = 0;
 
-	void Draw(Shader* shader) {
+	void Draw(render::context* ctx) {
 		if (this->m_mesh == NULL) SetupDrawable();
-		this->_Draw(shader);
+		this->_Draw(ctx);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+#include <iostream>
+#include <algorithm>
+
+#include <glad\glad.h>
+#include <GLFW\glfw3.h>
+
+#include "Shader.hpp"
+#include "Mesh.hpp"
+
+/* Jump flood on the GPU: every texel ends up holding the texel coordinates of (nearly) the closest seed, so outlines
+   come from one distance instead of a kernel the size of the outline. Two RG32F targets, ping ponged log2(size) times */
+class JumpFlood {
+	unsigned int gBuffer[2];
+	unsigned int gSeeds[2];
+	int result = 0;
+
+	int width;
+	int height;
+
+public:
+	JumpFlood(int window_width, int window_height) {
+		this->width = window_width;
+		this->height = window_height;
+
+		glGenFramebuffers(2, this->gBuffer);
+		glGenTextures(2, this->gSeeds);
+		for (int i = 0; i < 2; i++) {
+			glBindFramebuffer(GL_FRAMEBUFFER, this->gBuffer[i]);
+
+			glBindTexture(GL_TEXTURE_2D, this->gSeeds[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, window_width, window_height, 0, GL_RG, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->gSeeds[i], 0);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	/* The seed shader must be in use with its inputs bound. Leaves the viewport, blending and frame buffer as it
+	   found them */
+	void Run(Shader* seed, Shader* step, Mesh* quad) {
+		GLint viewport[4], framebuffer;
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		GLboolean blend = glIsEnabled(GL_BLEND);
+
+		glDisable(GL_BLEND);
+		glViewport(0, 0, this->width, this->height);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->gBuffer[0]);
+		quad->Draw();
+		this->result = 0;
+
+		step->use();
+		step->setInt("jfa_seeds", 0);
+		for (int jump = std::max(this->width, this->height) / 2; jump >= 1; jump /= 2) {
+			glBindFramebuffer(GL_FRAMEBUFFER, this->gBuffer[this->result ^ 1]);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, this->gSeeds[this->result]);
+			step->setInt("jump", jump);
+			quad->Draw();
+			this->result ^= 1;
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		if (blend) glEnable(GL_BLEND);
+	}
+
+	void BindSeedsToTexSlot(int slot = 0) {
+		glActiveTexture(GL_TEXTURE0 + slot);
+		glBindTexture(GL_TEXTURE_2D, this->gSeeds[this->result]);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	~JumpFlood() {
+		glDeleteFramebuffers(2, this->gBuffer);
+		glDeleteTextures(2, this->gSeeds);
+	}
+};
@@ -6,8 +6,14 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <array>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
 
 #include "GLFWUtil.hpp"
+#include "render.hpp"
 
 #include <glm\glm.hpp>
 #include <glm\gtc\matrix_transform.hpp>
@@ -19,15 +25,64 @@ enum MeshMode {
 	SCREEN_SPACE_UV
 };
 
+/* Deduplicated POS_XYZ_NORMAL_XYZ vertices and the triangles over them. CPU only: brushes, displacements and models are
+   built in this form, then handed to a Mesh or MeshBatch */
+class IndexedMesh {
+	typedef std::array<uint32_t, 6> vertex_bits;
+
+	struct vertex_hash {
+		size_t operator()(const vertex_bits& v) const {
+			size_t h = 14695981039346656037ULL;
+			for (uint32_t x : v) h = (h ^ x) * 1099511628211ULL;
+			return h;
+		}
+	};
+
+public:
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+
+	/* Appends flat triangle data, merging vertices whose position and normal are the same bits */
+	void weld(const float* data, size_t vertex_count) {
+		std::unordered_map<vertex_bits, uint32_t, vertex_hash> seen;
+		seen.reserve(vertex_count);
+
+		for (size_t i = 0; i < vertex_count; i++) {
+			vertex_bits key;
+			std::memcpy(&key[0], data + i * 6, sizeof(key));
+
+			auto added = seen.emplace(key, (uint32_t)(this->vertices.size() / 6));
+			if (added.second) this->vertices.insert(this->vertices.end(), data + i * 6, data + i * 6 + 6);
+			this->indices.push_back(added.first->second);
+		}
+	}
+
+	bool empty() const { return this->indices.empty(); }
+
+	void clear() {
+		std::vector<float>().swap(this->vertices);
+		std::vector<uint32_t>().swap(this->indices);
+	}
+
+	size_t bytes() const { return this->vertices.size() * sizeof(float) + this->indices.size() * sizeof(uint32_t); }
+
+	/* What the same triangles took as flat POS_XYZ_NORMAL_XYZ data */
+	size_t unindexed_bytes() const { return this->indices.size() * 6 * sizeof(float); }
+};
+
 class Mesh {
 	int elementCount;
 
 public:
-	unsigned int VBO, VAO;
+	unsigned int VBO, VAO, EBO;
+	unsigned int instanceVAO = 0, instanceVBO = 0;	// Made by the first DrawInstanced
 
 	std::vector<float> vertices;
+	std::vector<uint32_t> indices;	// Drawn indexed when there are any
+	MeshMode mode = POS_XYZ_NORMAL_XYZ;
 
 	Mesh() {
+		if (render::headless()) return;
 		glGenVertexArrays(1, &this->VAO);
 		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
 	}
@@ -36,6 +91,14 @@ public:
 		if (vertices.size() <= 0)
 			return;
 
+		this->mode = mode;
+
+		// No GL without a context, the vertices are all the software renderer needs
+		if (render::headless()) {
+			this->vertices = vertices;
+			return;
+		}
+
 		if (mode == MeshMode::POS_XYZ_TEXCOORD_UV) {
 			this->vertices = vertices;
 			this->elementCount = vertices.size() / 5;
@@ -100,6 +163,7 @@ public:
 
 		this->vertices = vertices;
 		this->elementCount = vertices.size() / 6;
+		if (render::headless()) return;
 
 		// first, configure the cube's VAO (and VBO)
 		glGenVertexArrays(1, &this->VAO);
@@ -119,14 +183,178 @@ public:
 		glEnableVertexAttribArray(1);
 	}
 
+	Mesh(const IndexedMesh& indexed) : Mesh(indexed.vertices, MeshMode::POS_XYZ_NORMAL_XYZ) {
+		if (indexed.empty()) return;
+
+		this->indices = indexed.indices;
+		this->elementCount = (int)indexed.indices.size();
+		if (render::headless()) return;
+
+		glBindVertexArray(this->VAO);
+		glGenBuffers(1, &this->EBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(uint32_t), &this->indices[0], GL_STATIC_DRAW);
+		glBindVertexArray(0);
+	}
+
 	~Mesh() {
+		if (render::headless()) return;
 		glDeleteVertexArrays(1, &this->VAO);
 		glDeleteBuffers(1, &this->VBO);
+		if (!this->indices.empty()) glDeleteBuffers(1, &this->EBO);
+		if (this->instanceVAO != 0) {
+			glDeleteVertexArrays(1, &this->instanceVAO);
+			glDeleteBuffers(1, &this->instanceVBO);
+		}
 	}
 
 	void Draw() {
+		if (render::headless()) return;
 		glBindVertexArray(this->VAO);
-		glDrawArrays(GL_TRIANGLES, 0, this->elementCount);
+		if (this->indices.empty()) glDrawArrays(GL_TRIANGLES, 0, this->elementCount);
+		else glDrawElements(GL_TRIANGLES, this->elementCount, GL_UNSIGNED_INT, (void*)0);
+	}
+
+	/* Every instance in one draw. They go through a second vertex array over the same buffers, where attribute 2 (the
+	   G buffer origin) and 3-6 (a model matrix) step once per instance. POS_XYZ_NORMAL_XYZ meshes only */
+	void DrawInstanced(const std::vector<render::instance>& instances) {
+		if (render::headless() || instances.empty() || this->mode != MeshMode::POS_XYZ_NORMAL_XYZ || this->vertices.empty()) return;
+
+		if (this->instanceVAO == 0) {
+			glGenVertexArrays(1, &this->instanceVAO);
+			glGenBuffers(1, &this->instanceVBO);
+			glBindVertexArray(this->instanceVAO);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+			glEnableVertexAttribArray(1);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(render::instance), (void*)offsetof(render::instance, origin));
+			glEnableVertexAttribArray(2);
+			glVertexAttribDivisor(2, 1);
+
+			// A mat4 attribute takes four locations, one column each
+			for (int c = 0; c < 4; c++) {
+				glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(render::instance), (void*)(offsetof(render::instance, model) + c * sizeof(glm::vec4)));
+				glEnableVertexAttribArray(3 + c);
+				glVertexAttribDivisor(3 + c, 1);
+			}
+
+			if (!this->indices.empty()) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		}
+
+		glBindVertexArray(this->instanceVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(render::instance), &instances[0], GL_STREAM_DRAW);
+
+		if (this->indices.empty()) glDrawArraysInstanced(GL_TRIANGLES, 0, this->elementCount, (GLsizei)instances.size());
+		else glDrawElementsInstanced(GL_TRIANGLES, this->elementCount, GL_UNSIGNED_INT, (void*)0, (GLsizei)instances.size());
+		glBindVertexArray(0);
+	}
+};
+
+/* Many indexed meshes in one vertex and index buffer, so any selection of them is one glMultiDrawElements instead of a
+   draw each. The G buffer origin of each part goes in a second buffer as vertex attribute 2, which plain meshes leave
+   at its default of zero, so parts need no uniforms set between them */
+class MeshBatch {
+public:
+	struct part {
+		unsigned int first;	// In indices
+		unsigned int count;
+		unsigned int first_vertex;
+		unsigned int vertex_count;
+		glm::vec2 origin;
+	};
+
+	unsigned int VBO, originVBO, EBO, VAO;
+
+	std::vector<float> vertices;	// POS_XYZ_NORMAL_XYZ, every part back to back, kept for the software renderer
+	std::vector<uint32_t> indices;	// Into the whole of vertices
+	std::vector<part> parts;
+
+	/* Starts a new part, Append adds to it. Returns its index */
+	int AddPart(glm::vec2 origin) {
+		part p;
+		p.first = (unsigned int)this->indices.size();
+		p.count = 0;
+		p.first_vertex = (unsigned int)(this->vertices.size() / 6);
+		p.vertex_count = 0;
+		p.origin = origin;
+		this->parts.push_back(p);
+		return (int)this->parts.size() - 1;
+	}
+
+	void Append(const IndexedMesh& mesh) {
+		uint32_t base = (uint32_t)(this->vertices.size() / 6);
+		this->vertices.insert(this->vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		for (uint32_t i : mesh.indices) this->indices.push_back(base + i);
+
+		this->parts.back().count += (unsigned int)mesh.indices.size();
+		this->parts.back().vertex_count += (unsigned int)(mesh.vertices.size() / 6);
+	}
+
+	/* Once every part is in */
+	void Upload() {
+		if (render::headless() || this->vertices.empty()) return;
+
+		std::vector<float> origins;
+		origins.reserve(this->vertices.size() / 3);
+		for (auto && p : this->parts)
+			for (unsigned int i = 0; i < p.vertex_count; i++) {
+				origins.push_back(p.origin.x);
+				origins.push_back(p.origin.y);
+			}
+
+		glGenVertexArrays(1, &this->VAO);
+		glGenBuffers(1, &this->VBO);
+		glGenBuffers(1, &this->originVBO);
+		glGenBuffers(1, &this->EBO);
+
+		glBindVertexArray(this->VAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(float), &this->vertices[0], GL_STATIC_DRAW);
+
+		// position attribute
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+
+		// Normal vector
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		// Origin
+		glBindBuffer(GL_ARRAY_BUFFER, this->originVBO);
+		glBufferData(GL_ARRAY_BUFFER, origins.size() * sizeof(float), &origins[0], GL_STATIC_DRAW);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(2);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(uint32_t), &this->indices[0], GL_STATIC_DRAW);
+
+		glBindVertexArray(0);
+	}
+
+	~MeshBatch() {
+		if (render::headless() || this->vertices.empty()) return;
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->originVBO);
+		glDeleteBuffers(1, &this->EBO);
+	}
+
+	/* Index ranges, in order */
+	void Draw(const std::vector<GLint>& firsts, const std::vector<GLsizei>& counts) {
+		if (render::headless() || firsts.empty()) return;
+
+		std::vector<const void*> offsets(firsts.size());
+		for (size_t i = 0; i < firsts.size(); i++) offsets[i] = (const void*)((size_t)firsts[i] * sizeof(uint32_t));
+
+		glBindVertexArray(this->VAO);
+		glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT, &offsets[0], (GLsizei)firsts.size());
 	}
 };
 
@@ -31,8 +31,10 @@ std::vector<glm::vec3> get_ssao_samples(int numSamples = 64) {
 
 class ssao_rotations_texture : public Texture {
 public:
+	std::vector<glm::vec3> noise; // 256x256, kept for the software compositor
+
 	ssao_rotations_texture(int x = 4, int y = 4) {
-		std::vector<glm::vec3> noise;
+		this->width = 256; this->height = 256;
 
 		for (int i = 0; i < 65536; i++) {
 			glm::vec3 s(
@@ -40,12 +42,14 @@ public:
 				randomFloats(generator) * 2.0 - 1.0,
 				0.0f
 			);
-			noise.push_back(s);
+			this->noise.push_back(s);
 		}
 
+		if (render::headless()) return;
+
 		glGenTextures(1, &this->texture_id);
 		glBindTexture(GL_TEXTURE_2D, this->texture_id);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 256, 256, 0, GL_RGB, GL_FLOAT, &noise[0]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 256, 256, 0, GL_RGB, GL_FLOAT, &this->noise[0]);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
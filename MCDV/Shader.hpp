@@ -2,6 +2,7 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <unordered_map>
 
 #include <glad\glad.h>
 #include <GLFW\glfw3.h>
@@ -15,8 +16,18 @@ bool USE_DEBUG = false;
 //Prototype functions
 unsigned int LoadShader(std::string path, GLint shaderType, int* load_success);
 
+/* A uniform's location, looked up once with Shader::getUniform. -1 when the program has no such uniform, which the
+   setters ignore like GL does */
+struct UniformHandle {
+	int location = -1;
+};
+
 class Shader
 {
+	std::unordered_map<std::string, int> m_uniforms; // Every active uniform outside a block, filled at link time
+
+	void cacheUniforms();
+
 public:
 	unsigned int programID;
 
@@ -44,6 +55,19 @@ public:
 	void setFragDataLocation(const std::string& name, unsigned int location) const;
 
 	unsigned int getUniformLocation(const std::string &name) const;
+
+	//Handle based setters, for uniforms set often
+	UniformHandle getUniform(const std::string& name) const;
+	void setInt(UniformHandle uniform, int value) const;
+	void setUnsigned(UniformHandle uniform, unsigned int value) const;
+	void setFloat(UniformHandle uniform, float value) const;
+	void setMatrix(UniformHandle uniform, const glm::mat4& matrix) const;
+	void setVec2(UniformHandle uniform, glm::vec2 vector) const;
+	void setVec3(UniformHandle uniform, glm::vec3 vector) const;
+	void setVec4(UniformHandle uniform, glm::vec4 vector) const;
+
+	//Point a uniform block at a UniformBuffer's binding
+	void bindUniformBlock(const std::string& name, unsigned int binding) const;
 };
 
 
@@ -79,6 +103,40 @@ Shader::Shader(std::string pVertexShader, std::string pFragmentShader)
 
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
+
+	if (!this->compileUnsuccessful) this->cacheUniforms();
+}
+
+/* Arrays are listed once, as name[0], so every element gets its own entry along with the bare name */
+void Shader::cacheUniforms()
+{
+	int count = 0;
+	glGetProgramiv(this->programID, GL_ACTIVE_UNIFORMS, &count);
+
+	char name[256];
+	for (int i = 0; i < count; i++) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(this->programID, (GLuint)i, sizeof(name), &length, &size, &type, name);
+
+		std::string uniform(name, length);
+		int location = glGetUniformLocation(this->programID, uniform.c_str());
+		if (location < 0) continue; // In a uniform block
+
+		size_t bracket = uniform.find('[');
+		if (bracket == std::string::npos) {
+			this->m_uniforms[uniform] = location;
+			continue;
+		}
+
+		std::string base = uniform.substr(0, bracket);
+		this->m_uniforms[base] = location;
+		for (int e = 0; e < size; e++) {
+			std::string element = base + "[" + std::to_string(e) + "]";
+			this->m_uniforms[element] = glGetUniformLocation(this->programID, element.c_str());
+		}
+	}
 }
 
 unsigned int LoadShader(std::string path, GLint shaderType, int* load_success)
@@ -134,32 +192,32 @@ void Shader::use()
 //Setter functions
 void Shader::setBool(const std::string &name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(this->programID, name.c_str()), (int)value);
+	glUniform1i(this->getUniform(name).location, (int)value);
 }
 
 void Shader::setInt(const std::string &name, int value) const
 {
-	glUniform1i(glGetUniformLocation(this->programID, name.c_str()), value);
+	glUniform1i(this->getUniform(name).location, value);
 }
 
 void Shader::setUnsigned(const std::string &name, unsigned int value) const
 {
-	glUniform1ui(glGetUniformLocation(this->programID, name.c_str()), value);
+	glUniform1ui(this->getUniform(name).location, value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const
 {
-	glUniform1f(glGetUniformLocation(this->programID, name.c_str()), value);
+	glUniform1f(this->getUniform(name).location, value);
 }
 
 unsigned int Shader::getUniformLocation(const std::string &name) const
 {
-	return glGetUniformLocation(this->programID, name.c_str());
+	return this->getUniform(name).location;
 }
 
 void Shader::setMatrix(const std::string &name, glm::mat4 matrix) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(this->programID, name.c_str()),
+	glUniformMatrix4fv(this->getUniform(name).location,
 		1,
 		GL_FALSE,
 		glm::value_ptr(matrix));
@@ -167,35 +225,84 @@ void Shader::setMatrix(const std::string &name, glm::mat4 matrix) const
 
 void Shader::setVec2(const std::string& name, glm::vec2 vector) const
 {
-	glUniform2fv(glGetUniformLocation(this->programID, name.c_str()),
+	glUniform2fv(this->getUniform(name).location,
 		1,
 		glm::value_ptr(vector));
 }
 
 void Shader::setVec3(const std::string &name, glm::vec3 vector) const
 {
-	glUniform3fv(glGetUniformLocation(this->programID, name.c_str()),
+	glUniform3fv(this->getUniform(name).location,
 		1,
 		glm::value_ptr(vector));
 }
 
 void Shader::setVec3(const std::string &name, float v1, float v2, float v3) const
 {
-	glUniform3f(glGetUniformLocation(this->programID, name.c_str()), v1, v2, v3);
+	glUniform3f(this->getUniform(name).location, v1, v2, v3);
 }
 
 void Shader::setVec4(const std::string &name, float v1, float v2, float v3, float v4) const
 {
-	glUniform4f(glGetUniformLocation(this->programID, name.c_str()), v1, v2, v3, v4);
+	glUniform4f(this->getUniform(name).location, v1, v2, v3, v4);
 }
 
 void Shader::setVec4(const std::string &name, glm::vec4 vector) const
 {
-	glUniform4fv(glGetUniformLocation(this->programID, name.c_str()),
+	glUniform4fv(this->getUniform(name).location,
 		1,
 		glm::value_ptr(vector));
 }
 
+UniformHandle Shader::getUniform(const std::string& name) const
+{
+	UniformHandle handle;
+	auto it = this->m_uniforms.find(name);
+	if (it != this->m_uniforms.end()) handle.location = it->second;
+	return handle;
+}
+
+void Shader::setInt(UniformHandle uniform, int value) const
+{
+	glUniform1i(uniform.location, value);
+}
+
+void Shader::setUnsigned(UniformHandle uniform, unsigned int value) const
+{
+	glUniform1ui(uniform.location, value);
+}
+
+void Shader::setFloat(UniformHandle uniform, float value) const
+{
+	glUniform1f(uniform.location, value);
+}
+
+void Shader::setMatrix(UniformHandle uniform, const glm::mat4& matrix) const
+{
+	glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(matrix));
+}
+
+void Shader::setVec2(UniformHandle uniform, glm::vec2 vector) const
+{
+	glUniform2fv(uniform.location, 1, glm::value_ptr(vector));
+}
+
+void Shader::setVec3(UniformHandle uniform, glm::vec3 vector) const
+{
+	glUniform3fv(uniform.location, 1, glm::value_ptr(vector));
+}
+
+void Shader::setVec4(UniformHandle uniform, glm::vec4 vector) const
+{
+	glUniform4fv(uniform.location, 1, glm::value_ptr(vector));
+}
+
+void Shader::bindUniformBlock(const std::string& name, unsigned int binding) const
+{
+	unsigned int index = glGetUniformBlockIndex(this->programID, name.c_str());
+	if (index != GL_INVALID_INDEX) glUniformBlockBinding(this->programID, index, binding);
+}
+
 void Shader::setFragDataLocation(const std::string& name, unsigned int location) const {
 	glBindFragDataLocation(this->programID,
 		location,
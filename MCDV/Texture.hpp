@@ -2,10 +2,13 @@
 #include <string>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <glad\glad.h>
 #include <GLFW\glfw3.h>
 
+#include "render.hpp"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -14,6 +17,14 @@ class Texture
 {
 public:
 	unsigned int texture_id;
+
+	/* CPU copy of what was uploaded, RGBA8 bottom row first, and how GL samples it. The software compositor reads these */
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+	bool clamp = false;
+	bool linear = false;
+
 	Texture(std::string filepath, bool clamp = false);
 	Texture() {};
 
@@ -32,13 +43,29 @@ Texture::Texture(std::string filepath, bool clamp)
 {
 	stbi_set_flip_vertically_on_load(true);
 
-	glGenTextures(1, &this->texture_id);
+	this->texture_id = 0;
+	this->clamp = clamp;
+	if (!render::headless()) glGenTextures(1, &this->texture_id);
 
 	//Load texture using stb_image
 	int width, height, nrChannels;
 	unsigned char* data = stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
 	if (data)
 	{
+		// Stored as GL_RGB: missing channels read as 0, alpha as 1
+		this->width = width;
+		this->height = height;
+		this->pixels.assign((size_t)width * height * 4, 0);
+		for (size_t i = 0; i < (size_t)width * height; i++) {
+			for (int c = 0; c < nrChannels && c < 3; c++) this->pixels[i * 4 + c] = data[i * nrChannels + c];
+			this->pixels[i * 4 + 3] = 255;
+		}
+
+		if (render::headless()) { // Nothing to upload to
+			stbi_image_free(data);
+			return;
+		}
+
 		GLenum format;
 		if (nrChannels == 1)
 			format = GL_RED;
@@ -91,10 +118,12 @@ Texture::~Texture()
 
 void Texture::bind()
 {
+	if (render::headless()) return;
 	glBindTexture(GL_TEXTURE_2D, this->texture_id);
 }
 
 void Texture::bindOnSlot(int slot = 0) {
+	if (render::headless()) return;
 	glActiveTexture(GL_TEXTURE0 + slot);
 	glBindTexture(GL_TEXTURE_2D, this->texture_id);
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#include <glad\glad.h>
+#include <GLFW\glfw3.h>
+
+/* Storage for a std140 uniform block, bound to one binding point for every program that uses the block (see
+   Shader::bindUniformBlock). The data is uploaded once and stays on the GPU, instead of being set uniform by uniform
+   on each program every frame */
+class UniformBuffer {
+public:
+	unsigned int UBO;
+	unsigned int binding;
+	size_t size;
+
+	UniformBuffer(unsigned int binding, size_t size) {
+		this->binding = binding;
+		this->size = size;
+
+		glGenBuffers(1, &this->UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+		glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STATIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, this->UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	~UniformBuffer() {
+		glDeleteBuffers(1, &this->UBO);
+	}
+
+	/* data has to be laid out the way std140 lays out the block */
+	void Upload(const void* data, size_t bytes, size_t offset = 0) {
+		glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, bytes, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+/* Bump allocator. Memory is handed out from large chunks and only released all at once
+   when the arena is destroyed, so it should only hold trivially destructible types. */
+class arena {
+	std::vector<std::unique_ptr<char[]>> m_chunks;
+	size_t m_chunk_size;
+	char* m_cur = NULL;
+	size_t m_left = 0;
+	size_t m_reserved = 0;
+
+	static inline size_t padding(const char* p, size_t align) {
+		return (align - (reinterpret_cast<uintptr_t>(p) & (align - 1))) & (align - 1);
+	}
+
+public:
+	arena(size_t chunk_size = 1 << 20) : m_chunk_size(chunk_size) {}
+
+	arena(const arena&) = delete;
+	arena& operator=(const arena&) = delete;
+
+	void* alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+		size_t pad = padding(this->m_cur, align);
+
+		if (this->m_cur == NULL || pad + size > this->m_left) {
+			size_t chunk = std::max(size + align, this->m_chunk_size);
+			this->m_chunks.emplace_back(new char[chunk]);
+			this->m_cur = this->m_chunks.back().get();
+			this->m_left = chunk;
+			this->m_reserved += chunk;
+			pad = padding(this->m_cur, align);
+		}
+
+		char* p = this->m_cur + pad;
+		this->m_cur += pad + size;
+		this->m_left -= pad + size;
+		return p;
+	}
+
+	template<typename T>
+	T* alloc_array(size_t count) {
+		if (count == 0) return NULL;
+		return static_cast<T*>(this->alloc(sizeof(T) * count, alignof(T)));
+	}
+
+	/* Copy of a string, NUL terminated */
+	const char* copy_string(std::string_view str) {
+		char* p = static_cast<char*>(this->alloc(str.size() + 1, 1));
+		memcpy(p, str.data(), str.size());
+		p[str.size()] = 0x00;
+		return p;
+	}
+
+	/* Total bytes taken from the heap */
+	size_t reserved() const { return this->m_reserved; }
+};
+
+/* Maps repeated strings to small integer IDs. The text is stored once, inside the arena */
+class string_table {
+	arena* m_arena;
+	std::unordered_map<std::string_view, unsigned int> m_ids;
+	std::vector<const char*> m_names;
+
+public:
+	string_table(arena* a) : m_arena(a) {}
+
+	string_table(const string_table&) = delete;
+	string_table& operator=(const string_table&) = delete;
+
+	unsigned int intern(std::string_view str) {
+		auto it = this->m_ids.find(str);
+		if (it != this->m_ids.end()) return it->second;
+
+		const char* stored = this->m_arena->copy_string(str);
+		unsigned int id = static_cast<unsigned int>(this->m_names.size());
+		this->m_names.push_back(stored);
+		this->m_ids.insert({ std::string_view(stored, str.size()), id });
+		return id;
+	}
+
+	/* Returns -1 if the string was never interned */
+	int find(std::string_view str) const {
+		auto it = this->m_ids.find(str);
+		if (it == this->m_ids.end()) return -1;
+		return static_cast<int>(it->second);
+	}
+
+	const char* name(unsigned int id) const { return this->m_names[id]; }
+
+	size_t size() const { return this->m_names.size(); }
+};
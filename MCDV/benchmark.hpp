@@ -0,0 +1,745 @@
+#pragma once
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdarg>
+#include <cctype>
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include "vmf_new.hpp"
+#include "brush.hpp"
+#include "GBuffer.hpp"
+#include "soft_render.hpp"
+#include "soft_composite.hpp"
+#include "tar_config.hpp"
+#include "perf.hpp"
+#include "gl_calls.hpp"
+#include "Texture.hpp" // stb_image
+#include "stb_image_write.h"
+#include "../AutoRadar_installer/FileSystemHelper.h"
+
+#ifdef _WIN32
+#define bench_popen _popen
+#define bench_pclose _pclose
+#else
+#define bench_popen popen
+#define bench_pclose pclose
+#endif
+
+namespace bench
+{
+	const char* tree_mode_names[] = { "datablock", "arena", "stream" };
+
+	/* printf into a string, for the result tables */
+	std::string format(const char* fmt, ...) {
+		char row[512];
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(row, sizeof(row), fmt, args);
+		va_end(args);
+		return row;
+	}
+
+	/* Fastest of runs calls to f, in ms */
+	template<typename F>
+	double best_of(int runs, F f) {
+		double best = 1e30;
+		for (int run = 0; run < std::max(runs, 1); run++) {
+			perf::timer t;
+			f();
+			best = std::min(best, t.ms_precise());
+		}
+		return best;
+	}
+
+	double per_second(size_t count, double ms) { return count * 1000.0 / std::max(ms, 0.001); }
+
+	/* Last line of a check, and the exit code for it */
+	int verdict(const std::string& what, bool ok) {
+		std::cout << what << (ok ? " match\n" : " DIFFER\n");
+		return ok ? 0 : 1;
+	}
+
+	struct decoder_result {
+		size_t mismatched = 0;
+		double decode_ms = 0;
+		double reference_ms = 0;
+	};
+
+	/* Runs a decoder and the reader it replaced on every file and lists the files where they return different things,
+	   then times each over all the files, best of runs */
+	template<typename Decode, typename Reference>
+	decoder_result compare_decoders(const std::vector<std::string>& names, const std::vector<std::vector<char>>& files, int runs, Decode decode, Reference reference) {
+		decoder_result r;
+		for (size_t i = 0; i < files.size(); i++) {
+			if (decode(files[i]) == reference(files[i])) continue;
+			r.mismatched++;
+			std::cout << "  differs: " << names[i] << "\n";
+		}
+
+		r.decode_ms = best_of(runs, [&] { for (auto && f : files) decode(f); });
+		r.reference_ms = best_of(runs, [&] { for (auto && f : files) reference(f); });
+		return r;
+	}
+
+	/* The timing rows and verdict for compare_decoders */
+	int print_decoders(const std::string& what, size_t models, const decoder_result& r) {
+		std::cout << format("  stream reader %9.2fms %12.0f models/s\n  decoder       %9.2fms %12.0f models/s\n",
+			r.reference_ms, per_second(models, r.reference_ms), r.decode_ms, per_second(models, r.decode_ms));
+		return verdict(what, r.mismatched == 0);
+	}
+
+	struct load_result {
+		bool ok = false;
+		long long ms = 0;
+		size_t peak = 0;		// Peak working set of the process
+		size_t baseline = 0;	// Peak working set before the map was read
+		size_t solids = 0;
+		size_t entities = 0;
+	};
+
+	/* Load one map and print a result line for load_modes to pick up. Runs in its own process so the peak is not shared */
+	int load_once(const std::string& path, kv::tree_mode mode) {
+		size_t baseline = perf::peak_rss();
+
+		perf::timer t;
+		vmf* v = vmf::from_file(path, {}, mode);
+		long long ms = t.ms();
+
+		std::cout << "BENCH_LOAD " << ms << " " << perf::peak_rss() << " " << baseline << " " << v->m_solids.size() << " " << v->m_entities.size() << std::endl;
+		return 0;
+	}
+
+	load_result run_child(const std::string& exe, const std::string& path, kv::tree_mode mode, unsigned threads) {
+		std::string cmd = "\"" + exe + "\" --benchLoadRun " + std::to_string((int)mode) + " --threads " + std::to_string(threads) + " --benchFile \"" + path + "\"";
+#ifdef _WIN32
+		cmd = "\"" + cmd + "\""; // cmd.exe strips the outer quotes
+#endif
+
+		load_result r;
+		FILE* pipe = bench_popen(cmd.c_str(), "r");
+		if (pipe == NULL) return r;
+
+		char line[1024];
+		while (fgets(line, sizeof(line), pipe)) {
+			std::istringstream ss(line);
+			std::string tag;
+			ss >> tag;
+			if (tag != "BENCH_LOAD") continue;
+
+			ss >> r.ms >> r.peak >> r.baseline >> r.solids >> r.entities;
+			r.ok = !ss.fail();
+		}
+
+		bench_pclose(pipe);
+		return r;
+	}
+
+	/* Time every KV loader on each map, best of N runs. Every run is a child process of exe, parsing with the given thread count */
+	int load_modes(const std::string& exe, std::vector<std::string> files, unsigned threads, int runs = 3) {
+		if (files.empty()) {
+			std::cout << "No map files to benchmark\n";
+			return 1;
+		}
+
+		bool all_ok = true;
+		for (auto && file : files) {
+			std::cout << "\n" << file << " (" << (threads == 0 ? "all" : std::to_string(threads)) << " threads)\n";
+			std::cout << "  mode        time      peak RSS   load RSS   solids  entities\n";
+
+			for (int m = kv::TREE_DATABLOCK; m <= kv::TREE_NONE; m++) {
+				load_result best;
+				size_t peak = 0;
+				bool failed = false;
+				for (int i = 0; i < runs; i++) {
+					load_result r = run_child(exe, file, (kv::tree_mode)m, threads);
+					if (!r.ok) { failed = true; break; }
+
+					peak = std::max(peak, r.peak);
+					if (!best.ok || r.ms < best.ms) best = r;
+				}
+				best.peak = peak;
+
+				if (failed) {
+					std::cout << "  " << tree_mode_names[m] << ": failed\n";
+					all_ok = false;
+					continue;
+				}
+
+				std::cout << format("  %-10s %6lldms %10s %10s %8zu %9zu\n", tree_mode_names[m], best.ms,
+					perf::format_mb(best.peak).c_str(), perf::format_mb(best.peak - best.baseline).c_str(), best.solids, best.entities);
+			}
+		}
+
+		return all_ok ? 0 : 1;
+	}
+
+	/* Convex brush made of planes tangent to a lumpy sphere around the origin. Normals point inwards.
+	   The first six are tilted axis planes so the brush is always closed */
+	std::vector<Plane> random_brush(std::mt19937& rng, int sides) {
+		std::normal_distribution<float> dir(0.0f, 1.0f);
+		std::uniform_real_distribution<float> tilt(-0.3f, 0.3f);
+		std::uniform_real_distribution<float> radius(384.0f, 640.0f);
+
+		std::vector<Plane> planes;
+		while (planes.size() < sides) {
+			glm::vec3 n(dir(rng), dir(rng), dir(rng));
+			if (planes.size() < 6) {
+				n = glm::vec3(tilt(rng), tilt(rng), tilt(rng));
+				n[planes.size() / 2] = planes.size() % 2 ? -1.0f : 1.0f;
+			}
+			if (glm::length(n) < 0.001f) continue;
+
+			n = glm::normalize(n);
+			planes.push_back(Plane(-n, -radius(rng)));
+		}
+		return planes;
+	}
+
+	std::vector<Plane> box_brush(glm::vec3 min, glm::vec3 max) {
+		return {
+			Plane(glm::vec3(1, 0, 0), min.x), Plane(glm::vec3(-1, 0, 0), -max.x),
+			Plane(glm::vec3(0, 1, 0), min.y), Plane(glm::vec3(0, -1, 0), -max.y),
+			Plane(glm::vec3(0, 0, 1), min.z), Plane(glm::vec3(0, 0, -1), -max.z)
+		};
+	}
+
+	/* Number of faces where the clipped winding differs from the triple intersection one. Where an edge is shorter than the
+	   weld distance the two kernels can keep different ends of it, so points only need to agree to within that */
+	size_t compare_windings(const std::vector<Plane>& planes) {
+		std::vector<std::vector<glm::vec3>> a = brush::windings(planes);
+		std::vector<std::vector<glm::vec3>> b = brush::reference_windings(planes);
+
+		size_t diff = 0;
+		for (size_t i = 0; i < planes.size(); i++)
+			if (!brush::same_winding(a[i], b[i], brush::weld_distance)) diff++;
+		return diff;
+	}
+
+	/* Time both brush kernels on generated brushes with 6, 20 and 60 sides, and check they give the same faces.
+	   With a map file, every solid in it is compared too */
+	int brush_kernels(const std::string& file, int brushes = 200, int runs = 3) {
+		std::mt19937 rng(1337);
+		bool all_ok = true;
+		size_t faces = 0;
+
+		std::cout << "  sides   brushes   triple      clip    speedup   mismatched faces\n";
+		for (int sides : { 6, 20, 60 }) {
+			std::vector<std::vector<Plane>> set;
+			for (int i = 0; i < brushes; i++) {
+				if (sides == 6 && i % 2 == 0) {
+					glm::vec3 min(float(i * 64 % 4096), float(i * 16 % 1024), float(i % 256));
+					set.push_back(box_brush(min, min + glm::vec3(64 + i % 128, 32 + i % 96, 16 + i % 64)));
+				}
+				else set.push_back(random_brush(rng, sides));
+			}
+
+			double ref_ms = best_of(runs, [&] { for (auto && planes : set) faces += brush::reference_windings(planes).size(); });
+			double clip_ms = best_of(runs, [&] { for (auto && planes : set) faces += brush::windings(planes).size(); });
+
+			size_t diff = 0;
+			for (auto && planes : set) diff += compare_windings(planes);
+			if (diff) all_ok = false;
+
+			std::cout << format("  %5d %9d %8.2fms %8.2fms %8.1fx %10zu\n", sides, brushes, ref_ms, clip_ms, ref_ms / std::max(clip_ms, 0.001), diff);
+		}
+
+		if (!file.empty()) {
+			vmf* v = vmf::from_file(file);
+
+			std::vector<std::vector<Plane>> solids;
+			size_t diff = 0, sides = 0;
+			for (auto && s : v->m_solids) {
+				std::vector<Plane> planes;
+				for (auto && side : s.m_sides) planes.push_back(side->m_plane);
+				sides += planes.size();
+				diff += compare_windings(planes);
+				solids.push_back(planes);
+			}
+			if (diff) all_ok = false;
+
+			double ref_ms = best_of(runs, [&] { for (auto && planes : solids) faces += brush::reference_windings(planes).size(); });
+			double clip_ms = best_of(runs, [&] { for (auto && planes : solids) faces += brush::windings(planes).size(); });
+
+			std::cout << "\n" << file << ": " << v->m_solids.size() << " solids, " << sides << " sides\n";
+			std::cout << "  triple " << ref_ms << "ms, clip " << clip_ms << "ms, " << diff << " mismatched faces\n";
+		}
+
+		return verdict("Brush kernels", all_ok);
+	}
+
+	/* Pixels where the GL frame buffers and the software renderer disagree */
+	struct raster_diff {
+		size_t info = 0;		// Different Info value
+		size_t position = 0;	// Position more than one half float step apart
+		size_t normal = 0;		// Normal more than 0.01 apart
+		size_t mask = 0;		// Different mask value, all masks together
+	};
+
+	/* Half floats are exact in the float readback, so one step of rounding difference is allowed */
+	inline bool half_close(float gl, uint16_t soft) {
+		uint16_t a = render::to_half(gl);
+		if (a == soft) return true;
+		if ((a & 0x8000) != (soft & 0x8000)) return (a & 0x7fff) + (soft & 0x7fff) <= 1;
+		return (a > soft ? a - soft : soft - a) <= 1;
+	}
+
+	/* with_info off skips the Info plane, for buffers cleared with a float colour (undefined for integer planes in GL) */
+	inline void compare_gbuffer(GBuffer* gl, const render::soft_gbuffer& soft, raster_diff& diff, bool with_info = true) {
+		std::vector<float> position, normal;
+		std::vector<unsigned int> info;
+		gl->ReadPositionBuffer(position);
+		gl->ReadNormalBuffer(normal);
+		gl->ReadInfoBuffer(info);
+
+		for (size_t i = 0; i < info.size(); i++) {
+			if (with_info && info[i] != soft.info[i]) diff.info++;
+
+			bool position_ok = true, normal_ok = true;
+			for (int k = 0; k < 3; k++) {
+				position_ok &= half_close(position[i * 3 + k], soft.position[i * 3 + k]);
+				normal_ok &= std::abs(normal[i * 3 + k] - render::from_half(soft.normal[i * 3 + k])) <= 0.01f;
+			}
+			if (!position_ok) diff.position++;
+			if (!normal_ok) diff.normal++;
+		}
+	}
+
+	inline void compare_mask(MBuffer* gl, const render::soft_mask& soft, raster_diff& diff) {
+		std::vector<unsigned char> mask;
+		gl->ReadMaskBuffer(mask);
+
+		for (size_t i = 0; i < mask.size(); i++)
+			if (mask[i] != soft.mask[i]) diff.mask++;
+	}
+
+	/* One row of the --benchRaster table */
+	inline void print_raster_row(int size, double gl_ms, double soft_ms, const raster_diff& diff) {
+		double pixels = (double)size * size;
+		std::cout << format("  %5d %9.1fms %9.1fms %9.4f%% %9.4f%% %9.4f%% %9.4f%%\n", size, gl_ms, soft_ms,
+			100.0 * diff.info / pixels, 100.0 * diff.position / (2 * pixels), 100.0 * diff.normal / (2 * pixels), 100.0 * diff.mask / (3 * pixels));
+	}
+
+	/* An RGBA8 image (bottom row first) against a png on disk. Pixels more than two steps off in any channel count as
+	   different; by default up to 1% of them may be, rounding and the odd ssao sample landing on the other texel move
+	   edges around */
+	bool compare_reference(const std::vector<uint8_t>& rgba, int width, int height, const std::string& path, double allowed = 0.01) {
+		int w, h, n;
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char* ref = stbi_load(path.c_str(), &w, &h, &n, 4);
+		if (ref == NULL) {
+			std::cout << "Could not read reference " << path << "\n";
+			return false;
+		}
+
+		if (w != width || h != height) {
+			std::cout << "Reference " << path << " is " << w << "x" << h << ", radar is " << width << "x" << height << "\n";
+			stbi_image_free(ref);
+			return false;
+		}
+
+		size_t pixels = (size_t)width * height, different = 0;
+		int largest = 0;
+		double total = 0.0;
+		for (size_t i = 0; i < pixels; i++) {
+			int d = 0;
+			for (int c = 0; c < 4; c++) d = std::max(d, std::abs((int)rgba[i * 4 + c] - (int)ref[i * 4 + c]));
+			if (d > 2) different++;
+			largest = std::max(largest, d);
+			total += d;
+		}
+		stbi_image_free(ref);
+
+		std::cout << format("Reference %s: %zu pixels (%.3f%%) differ, largest difference %d, mean %.3f\n",
+			path.c_str(), different, 100.0 * different / pixels, largest, total / pixels);
+
+		bool ok = different <= pixels * allowed;
+		std::cout << (ok ? "Reference match\n" : "Reference DIFFERS\n");
+		return ok;
+	}
+
+	/* A png as a soft_image, bottom row first */
+	bool load_image(const std::string& path, render::soft_image& image) {
+		int w, h, n;
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char* data = stbi_load(path.c_str(), &w, &h, &n, 4);
+		if (data == NULL) return false;
+
+		image = render::soft_image(w, h);
+		std::copy(data, data + image.rgba.size(), image.rgba.begin());
+		stbi_image_free(data);
+		return true;
+	}
+
+	/* Runs the passes after the layer composite on fixed inputs: the layer images checked in next to the program
+	   (layer0.png, layer1.png, ...) make one radar each, the way render_headless does it. Every other layer is blended
+	   in inactive, then the radar's own layer, the final stage over textures/grid.png with the outline on, then FXAA.
+	   Each radar is compared against testcomposite/comp<n>.png, or written there with write set. The references come
+	   from these passes, so this catches changes to them rather than differences from the shaders */
+	int composite(bool write, int runs = 3) {
+		std::vector<render::soft_image> layers;
+		for (render::soft_image layer; load_image("layer" + std::to_string(layers.size()) + ".png", layer);) layers.push_back(layer);
+
+		std::cout << layers.size() << " layer images\n";
+		if (layers.empty()) return 1;
+
+		Texture background("textures/grid.png", true);
+		const glm::vec4 color_outline(204 / 255.0f, 204 / 255.0f, 204 / 255.0f, 153 / 255.0f);
+
+		bool all_ok = true;
+		for (size_t i = 0; i < layers.size(); i++) {
+			int w = layers[i].width, h = layers[i].height;
+			render::soft_image generic(w, h), generic1(w, h), radar(w, h);
+
+			double ms = best_of(runs, [&] {
+				generic.clear();
+				for (size_t x = 0; x < layers.size(); x++) {
+					size_t l = layers.size() - x - 1;
+					if (l != i) render::soft_blend_layer(layers[l], false, generic);
+				}
+				render::soft_blend_layer(layers[i], true, generic);
+
+				generic1.clear();
+				render::soft_final_stage(generic, &background, 1.0f, color_outline, 2, generic1);
+				render::soft_fxaa(generic1, radar);
+			});
+			std::cout << format("  radar %zu: %dx%d %9.2fms\n", i, w, h, ms);
+
+			std::string path = "testcomposite/comp" + std::to_string(i) + ".png";
+			if (write) {
+				stbi_flip_vertically_on_write(true);
+				if (!stbi_write_png(path.c_str(), w, h, 4, &radar.rgba[0], w * 4)) all_ok = false;
+				std::cout << "  wrote " << path << "\n";
+			}
+			else if (!compare_reference(radar.rgba, w, h, path, 0.0)) all_ok = false; // Same passes on the same input, nothing may move
+		}
+
+		return write ? (all_ok ? 0 : 1) : verdict("Composite passes", all_ok);
+	}
+
+	/* Takes draws and throws them away, counting what it was given. Lets --benchDraw time only the loops that make the
+	   draws */
+	class null_context : public render::context {
+	public:
+		size_t draws = 0;
+		size_t parts = 0;
+
+		void bind(render::target* t) override {}
+		void clear(float value) override {}
+		void clear_depth() override {}
+		void set_culling(bool cull_back) override {}
+		void use(render::program p) override {}
+		void set_matrix(const std::string& name, const glm::mat4& value) override {}
+		void set_unsigned(const std::string& name, unsigned int value) override {}
+		void set_vec2(const std::string& name, const glm::vec2& value) override {}
+		void draw(Mesh* mesh) override { this->draws++; this->parts++; }
+		void draw_batch(MeshBatch* batch, const std::vector<render::batch_draw>& draws) override { this->draws++; this->parts += draws.size(); }
+		void draw_instances(Mesh* mesh, const std::vector<render::instance>& instances) override { this->draws++; this->parts += instances.size(); }
+		void finish() override {}
+	};
+
+	/* Time DrawWorld and DrawEntities on their own, through the filters one radar layer's G buffer passes use, with
+	   nothing behind the context. The GPU and rasterizer cost is left out, this is what every pass pays to submit */
+	int draw_loop(vmf* map, const tar_config* config, int runs = 20) {
+		std::vector<std::set<std::string>> visgroups = {
+			{},
+			{ config->m_visgroup_layout, config->m_visgroup_mask },
+			{ config->m_visgroup_cover },
+			{ config->m_visgroup_overlap }
+		};
+
+		null_context ctx;
+		map->SetMinMax(10000, -10000);
+
+		double world_ms = best_of(runs, [&] {
+			ctx.draws = ctx.parts = 0;
+			for (auto && v : visgroups) {
+				map->SetFilters(v, { "func_detail", "prop_static" });
+				map->DrawWorld(&ctx);
+			}
+		});
+		size_t world_draws = ctx.draws, world_parts = ctx.parts;
+
+		double entities_ms = best_of(runs, [&] {
+			ctx.draws = ctx.parts = 0;
+			for (auto && v : visgroups) {
+				map->SetFilters(v, { "func_detail", "prop_static" });
+				map->DrawEntities(&ctx);
+			}
+		});
+
+		std::cout << format("%zu passes, best of %d\n  DrawWorld    %9.3fms %8zu draws %8zu parts\n  DrawEntities %9.3fms %8zu draws %8zu parts\n",
+			visgroups.size(), runs, world_ms, world_draws, world_parts, entities_ms, ctx.draws, ctx.parts);
+		return 0;
+	}
+
+	/* Load a vpk directory a few times, then look up every path in it through the hash table (in upper case, with
+	   backslashes) and a sample of paths by linear search, and check both find the same entries */
+	int vpk_lookups(const std::string& file, int runs = 3) {
+		vpk::index* dir = NULL;
+		double load_ms = best_of(runs, [&] {
+			delete dir;
+			dir = new vpk::index(file);
+		});
+
+		std::vector<std::string> names;
+		for (auto && e : dir->entries) {
+			std::string name(e.entryString);
+			for (auto && c : name) c = c == '/' ? '\\' : (char)toupper(c);
+			names.push_back(name);
+		}
+
+		size_t sample = std::min(names.size(), (size_t)200);
+		size_t stride = std::max(names.size() / std::max(sample, (size_t)1), (size_t)1);
+
+		size_t hash_missed = 0, linear_missed = 0;
+		double hash_ms = best_of(runs, [&] {
+			hash_missed = 0;
+			for (size_t i = 0; i < names.size(); i++)
+				if (dir->find(names[i]) != &dir->entries[i]) hash_missed++;
+		});
+		double linear_ms = best_of(runs, [&] {
+			linear_missed = 0;
+			for (size_t i = 0; i < sample; i++)
+				if (dir->find_linear(names[i * stride]) != dir->find(names[i * stride])) linear_missed++;
+		});
+
+		std::cout << format("%zu entries, load %.2fms (best of %d)\n  hashed: %zu lookups %.2fms (%.3fus each)\n  linear: %zu lookups %.2fms (%.3fus each)\n",
+			dir->entries.size(), load_ms, runs, names.size(), hash_ms, hash_ms * 1000.0 / std::max(names.size(), (size_t)1),
+			sample, linear_ms, linear_ms * 1000.0 / std::max(sample, (size_t)1));
+
+		delete dir;
+		return verdict("VPK lookups", hash_missed + linear_missed == 0);
+	}
+
+	/* Every file with extension ext under a folder, and in a vpk directory if one is given, read into memory */
+	void collect_files(const std::string& folder, const std::string& vpk_file, const std::string& ext,
+		std::vector<std::string>& names, std::vector<std::vector<char>>& files) {
+		for (auto && f : fs::getFilesInDirectoryRecursive(folder)) {
+			std::string path = folder + f;
+			if (path.size() < ext.size() || path.substr(path.size() - ext.size()) != ext) continue;
+
+			mapped_file file(path);
+			if (!file.good()) continue;
+			names.push_back(path);
+			files.push_back(std::vector<char>(file.data(), file.data() + file.size()));
+		}
+
+		if (!vpk_file.empty()) {
+			vpk::index dir(vpk_file);
+			for (auto && e : dir.entries) {
+				if (e.entryString.size() < ext.size() || e.entryString.substr(e.entryString.size() - ext.size()) != ext) continue;
+
+				vpk::file contents = dir.open(e);
+				if (!contents.good) continue;
+				names.push_back(std::string(e.entryString));
+				files.push_back(std::vector<char>(contents.data, contents.data + contents.size));
+			}
+		}
+	}
+
+	/* Decode every .vtx under a folder, and every .vtx in a vpk directory if one is given, with vtx_mesh and with the
+	   stream reader it replaced. Reports models per second for each and checks they give the same LOD 0 triangles (the
+	   decoder reads every LOD, the stream reader only LOD 0) */
+	int vtx_decode(const std::string& folder, const std::string& vpk_file, int runs = 5) {
+		std::vector<std::string> names;
+		std::vector<std::vector<char>> files;
+		collect_files(folder, vpk_file, ".vtx", names, files);
+
+		std::cout << files.size() << " vtx files\n";
+		if (files.empty()) return 1;
+
+		size_t broken = 0, indices = 0;
+		for (auto && f : files) {
+			span_reader r(f.data(), f.size());
+			vtx_mesh decoded(&r);
+			if (!decoded.read_success) broken++;
+			indices += decoded.lods[0].vertexSequence.size();
+		}
+		std::cout << "  " << indices << " indices, " << broken << " broken\n";
+
+		decoder_result r = compare_decoders(names, files, runs,
+			[](const std::vector<char>& f) {
+				span_reader r(f.data(), f.size());
+				vtx_mesh decoded(&r);
+				return std::move(decoded.lods[0].vertexSequence);
+			},
+			[](const std::vector<char>& f) {
+				std::vector<uint32_t> reference;
+				span_reader s(f.data(), f.size());
+				try { vtx_mesh::reference_sequence(&s, reference); }
+				catch (std::exception&) { reference.clear(); }
+				return reference;
+			});
+		return print_decoders("VTX decoders", files.size(), r);
+	}
+
+	/* A three LOD .vvd with fixups that take the six vertices out of order: LOD 0 sees 4 5 0 1 2 3, LOD 1 sees 0 1 2 3
+	   and LOD 2 sees 0 1. Vertex i is at (i, 10 + i, 20 + i) with normal (0.5, i + 0.25, -1) */
+	std::vector<char> vvd_fixture() {
+		VVD::Fixup fixups[] = { { 0, 4, 2 }, { 2, 0, 2 }, { 1, 2, 2 } };
+
+		VVD::Header header = {};
+		header.id = 0x56534449; // IDSV
+		header.version = 4;
+		header.numLods = 3;
+		header.numLodVertexes[0] = 6;
+		header.numLodVertexes[1] = 4;
+		header.numLodVertexes[2] = 2;
+		header.numFixups = 3;
+		header.fixupTableStart = sizeof(header);
+		header.vertexDataStart = sizeof(header) + sizeof(fixups);
+
+		std::vector<char> file((char*)&header, (char*)&header + sizeof(header));
+		file.insert(file.end(), (char*)fixups, (char*)fixups + sizeof(fixups));
+		for (int i = 0; i < 6; i++) {
+			VVD::Vertex vert = {};
+			vert.m_vecPosition = glm::vec3((float)i, 10.0f + i, 20.0f + i);
+			vert.m_vecNormal = glm::vec3(0.5f, i + 0.25f, -1.0f);
+			file.insert(file.end(), (char*)&vert, (char*)&vert + sizeof(vert));
+		}
+		return file;
+	}
+
+	/* Number of LODs where vvd_fixture decodes to something other than the vertices written out by hand, or where
+	   LOD 0's lod_remap does not point at them */
+	size_t check_vvd_fixture() {
+		const std::vector<std::vector<uint32_t>> order = { { 4, 5, 0, 1, 2, 3 }, { 0, 1, 2, 3 }, { 0, 1 } };
+		const std::vector<std::vector<uint32_t>> remap = { { 0, 1, 2, 3, 4, 5 }, { 2, 3, 4, 5 }, { 2, 3 } };
+		std::vector<char> file = vvd_fixture();
+
+		span_reader r0(file.data(), file.size());
+		vvd_data lod0(&r0, 0);
+
+		size_t wrong = 0;
+		for (int lod = 0; lod < 3; lod++) {
+			span_reader r(file.data(), file.size());
+			vvd_data decoded(&r, lod);
+
+			std::vector<float> expected;
+			for (uint32_t i : order[lod]) {
+				float v[6] = { -(float)i, 20.0f + i, 10.0f + i, -0.5f, -1.0f, i + 0.25f };
+				expected.insert(expected.end(), v, v + 6);
+			}
+
+			if (!decoded.read_success || decoded.vertices != expected || lod0.lod_remap(lod) != remap[lod]) {
+				wrong++;
+				std::cout << "  differs: fixture lod " << lod << "\n";
+			}
+		}
+		return wrong;
+	}
+
+	/* Same for the .vvd files at LOD 0, against the reader that ignored fixups (every LOD 0 starts at the top of the
+	   vertex block). Coarser LODs go through the fixups, which are checked on vvd_fixture instead */
+	int vvd_decode(const std::string& folder, const std::string& vpk_file, int runs = 5) {
+		std::vector<std::string> names;
+		std::vector<std::vector<char>> files;
+		collect_files(folder, vpk_file, ".vvd", names, files);
+
+		std::cout << files.size() << " vvd files\n";
+		if (files.empty()) return 1;
+
+		size_t broken = 0, vertices = 0;
+		for (auto && f : files) {
+			span_reader r(f.data(), f.size());
+			vvd_data decoded(&r, 0);
+			if (!decoded.read_success) broken++;
+			vertices += decoded.vertex_count();
+		}
+		std::cout << "  " << vertices << " vertices, " << broken << " broken\n";
+
+		decoder_result r = compare_decoders(names, files, runs,
+			[](const std::vector<char>& f) {
+				span_reader r(f.data(), f.size());
+				vvd_data decoded(&r, 0);
+				return std::move(decoded.vertices);
+			},
+			[](const std::vector<char>& f) {
+				std::vector<float> reference;
+				span_reader s(f.data(), f.size());
+				try { vvd_data::reference_vertices(&s, reference); }
+				catch (std::exception&) { reference.clear(); }
+				return reference;
+			});
+		r.mismatched += check_vvd_fixture();
+		return print_decoders("VVD decoders", files.size(), r);
+	}
+
+	/* Names of the gl* functions a source file calls. Comments and string literals are skipped */
+	std::set<std::string> gl_calls_in(const char* p, const char* end) {
+		std::set<std::string> names;
+		while (p < end) {
+			if (p + 1 < end && p[0] == '/' && p[1] == '/') { while (p < end && *p != '\n') p++; continue; }
+			if (p + 1 < end && p[0] == '/' && p[1] == '*') {
+				p += 2;
+				while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) p++;
+				p += 2;
+				continue;
+			}
+			if (*p == '"' || *p == '\'') {
+				char quote = *p++;
+				while (p < end && *p != quote) p += *p == '\\' ? 2 : 1;
+				p++;
+				continue;
+			}
+
+			bool ident = isalnum((unsigned char)*p) || *p == '_';
+			if (!ident) { p++; continue; }
+
+			const char* start = p;
+			while (p < end && (isalnum((unsigned char)*p) || *p == '_')) p++;
+			if (p - start < 3 || start[0] != 'g' || start[1] != 'l' || !isupper((unsigned char)start[2])) continue;
+
+			const char* q = p;
+			while (q < end && isspace((unsigned char)*q)) q++;
+			if (q < end && *q == '(') names.insert(std::string(start, p));
+		}
+		return names;
+	}
+
+	/* Check that count_gl_calls hooks every GL entry point the given sources call. Entry points added to the code but
+	   not to GL_COUNTED would otherwise go uncounted without anyone noticing */
+	int gl_hooks(const std::vector<std::string>& sources) {
+		// Only called before count_gl_calls installs the hooks
+		const std::set<std::string> before_hooks = { "glGetString" };
+
+		std::set<std::string> hooked(render::gl_counted().begin(), render::gl_counted().end());
+		std::set<std::string> used;
+		for (auto && path : sources) {
+			mapped_file file(path);
+			if (!file.good()) {
+				std::cout << "Could not read " << path << "\n";
+				return 1;
+			}
+
+			for (auto && name : gl_calls_in(file.data(), file.data() + file.size())) {
+				used.insert(name);
+				if (!hooked.count(name) && !before_hooks.count(name)) std::cout << "  not counted: " << name << " (" << path << ")\n";
+			}
+		}
+
+		size_t missing = 0;
+		for (auto && name : used) if (!hooked.count(name) && !before_hooks.count(name)) missing++;
+		for (auto && name : hooked) if (!used.count(name)) std::cout << "  counted but not called: " << name << "\n";
+
+		std::cout << sources.size() << " files, " << used.size() << " entry points called, " << hooked.size() << " counted\n";
+		std::cout << (missing ? "GL call counters MISS entry points\n" : "GL call counters cover every entry point\n");
+		return missing ? 1 : 0;
+	}
+
+	/* VMF and VMX files in a folder, recursively */
+	std::vector<std::string> find_maps(const std::string& folder) {
+		std::vector<std::string> maps;
+		for (auto && f : fs::getFilesInDirectoryRecursive(folder)) {
+			std::string path = folder + f;
+			std::string ext = path.size() > 4 ? path.substr(path.size() - 4) : "";
+			if (ext == ".vmf" || ext == ".vmx") maps.push_back(path);
+		}
+		return maps;
+	}
+}
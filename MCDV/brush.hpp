@@ -0,0 +1,189 @@
+#pragma once
+#include <vector>
+#include <cmath>
+
+#include <glm\glm.hpp>
+
+#include "plane.h"
+
+/* Turns brush planes into face polygons.
+
+   Every face starts out as a quad on its plane, far bigger than the map, and is clipped against the other planes
+   one at a time (Sutherland-Hodgman). The result is already in order and each face only costs one pass per plane,
+   instead of intersecting every triple of planes and testing each point against all of them. */
+namespace brush
+{
+	const double quad_size = 262144.0;	// Half width of the starting quad. Hammer maps stay inside +-16384
+	const double clip_epsilon = 0.01;	// Points this far outside a plane still count, same as the polarity checks
+	const float weld_distance = 0.5f;	// Points closer than this become one
+
+	struct dvec3 {
+		double x, y, z;
+	};
+
+	inline dvec3 operator+(const dvec3& a, const dvec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline dvec3 operator-(const dvec3& a, const dvec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline dvec3 operator*(const dvec3& a, double s) { return { a.x * s, a.y * s, a.z * s }; }
+	inline double dot(const dvec3& a, const dvec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline dvec3 cross(const dvec3& a, const dvec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+	inline dvec3 normalize(const dvec3& a) {
+		double len = std::sqrt(dot(a, a));
+		return len > 0.0 ? a * (1.0 / len) : a;
+	}
+
+	struct dplane {
+		dvec3 normal;
+		double offset;
+
+		dplane(const Plane& p) :
+			normal({ p.normal.x, p.normal.y, p.normal.z }),
+			offset(p.offset) {}
+
+		// Positive inside the brush, same sign as Plane::EvalPointPolarity
+		double distance(const dvec3& p) const { return dot(this->normal, p) - this->offset; }
+	};
+
+	/* Quad covering the whole plane, clockwise around the normal like Plane::OrderCoplanarClockWise */
+	inline std::vector<dvec3> base_quad(const dplane& plane) {
+		const dvec3& n = plane.normal;
+
+		// Axis least aligned with the normal, so the cross product is well conditioned
+		dvec3 axis = { 0, 0, 1 };
+		if (std::abs(n.z) >= std::abs(n.x) && std::abs(n.z) >= std::abs(n.y)) axis = { 1, 0, 0 };
+
+		dvec3 u = normalize(cross(n, axis));
+		dvec3 v = cross(n, u);
+		dvec3 c = n * plane.offset;
+
+		u = u * quad_size;
+		v = v * quad_size;
+		return { c + u + v, c + u - v, c - u - v, c - u + v };
+	}
+
+	/* Keeps the part of the polygon on the inside of plane. Order is preserved */
+	inline void clip(std::vector<dvec3>& poly, const dplane& plane, std::vector<dvec3>& scratch) {
+		scratch.clear();
+
+		size_t n = poly.size();
+		for (size_t i = 0; i < n; i++) {
+			const dvec3& a = poly[i];
+			const dvec3& b = poly[(i + 1) % n];
+			double da = plane.distance(a);
+			double db = plane.distance(b);
+
+			bool a_in = da >= -clip_epsilon;
+			bool b_in = db >= -clip_epsilon;
+
+			if (a_in) scratch.push_back(a);
+			if (a_in != b_in) {
+				// An inside point may be up to clip_epsilon behind the plane, which puts the crossing outside the edge
+				double t = glm::clamp(da / (da - db), 0.0, 1.0);
+				scratch.push_back(a + (b - a) * t);
+			}
+		}
+
+		poly.swap(scratch);
+	}
+
+	/* Drops points within weld_distance of the one before them, wrapping around */
+	inline std::vector<glm::vec3> weld(const std::vector<dvec3>& poly) {
+		std::vector<glm::vec3> out;
+		for (auto && p : poly) {
+			glm::vec3 v((float)p.x, (float)p.y, (float)p.z);
+			if (!out.empty() && glm::distance(out.back(), v) < weld_distance) continue;
+			out.push_back(v);
+		}
+
+		while (out.size() > 1 && glm::distance(out.back(), out.front()) < weld_distance) out.pop_back();
+		return out;
+	}
+
+	/* One polygon per plane, in the same order. Vertices go clockwise around the plane normal.
+	   Faces that end up with less than 3 points (clipped away, or duplicated planes) are left empty. */
+	inline std::vector<std::vector<glm::vec3>> windings(const std::vector<Plane>& planes) {
+		std::vector<dplane> dplanes;
+		for (auto && p : planes) dplanes.push_back(dplane(p));
+
+		std::vector<std::vector<glm::vec3>> faces(planes.size());
+		std::vector<dvec3> poly, scratch;
+
+		for (size_t i = 0; i < dplanes.size(); i++) {
+			poly = base_quad(dplanes[i]);
+
+			for (size_t j = 0; j < dplanes.size() && poly.size() >= 3; j++) {
+				if (j == i) continue;
+				clip(poly, dplanes[j], scratch);
+			}
+
+			if (poly.size() < 3) continue;
+
+			faces[i] = weld(poly);
+			if (faces[i].size() < 3) faces[i].clear();
+		}
+
+		return faces;
+	}
+
+	/* The triple plane intersection used before windings(), kept to check the new output against */
+	inline std::vector<std::vector<glm::vec3>> reference_windings(const std::vector<Plane>& planes) {
+		std::vector<std::vector<glm::vec3>> faces(planes.size());
+
+		for (int i = 0; i < planes.size(); i++) {
+			for (int j = 0; j < planes.size(); j++) {
+				for (int k = 0; k < planes.size(); k++) {
+					if (i == j || i == k || j == k) continue;
+
+					glm::vec3 p(0, 0, 0);
+					if (!Plane::FinalThreePlaneIntersection(planes[i], planes[j], planes[k], &p)) continue;
+
+					bool valid = true;
+					for (int m = 0; m < planes.size(); m++) {
+						if (Plane::EvalPointPolarity(planes[m], p) < -0.01f) {
+							valid = false;
+							break;
+						}
+					}
+					if (!valid) continue;
+
+					faces[i].push_back(p);
+					faces[j].push_back(p);
+					faces[k].push_back(p);
+				}
+			}
+		}
+
+		for (int i = 0; i < faces.size(); i++) {
+			std::vector<glm::vec3> unique;
+			for (auto && p : faces[i]) {
+				bool found = false;
+				for (auto && u : unique)
+					if (glm::distance(u, p) < weld_distance) { found = true; break; }
+				if (!found) unique.push_back(p);
+			}
+
+			if (unique.size() < 3) { faces[i].clear(); continue; }
+			faces[i] = Plane::OrderCoplanarClockWise(planes[i], unique);
+		}
+
+		return faces;
+	}
+
+	/* Same polygon, same direction, allowing a different starting vertex */
+	inline bool same_winding(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b, float tolerance = 0.1f) {
+		if (a.size() != b.size()) return false;
+		if (a.empty()) return true;
+
+		size_t n = a.size();
+		for (size_t start = 0; start < n; start++) {
+			if (glm::distance(a[0], b[start]) > tolerance) continue;
+
+			bool match = true;
+			for (size_t k = 1; k < n && match; k++)
+				match = glm::distance(a[k], b[(start + k) % n]) <= tolerance;
+			if (match) return true;
+		}
+
+		return false;
+	}
+}
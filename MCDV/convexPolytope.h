@@ -11,6 +11,7 @@
 #include <unordered_set>
 
 #include "plane.h"
+#include "brush.hpp"
 #include "Mesh.hpp"
 
 struct BrushPolygon {
@@ -146,96 +147,42 @@ public:
 
 	Polytope(std::vector<Plane> planes, bool gen_gl_mesh = true, bool dbg = false)
 	{
-		std::vector<glm::vec3> intersecting;
+		std::vector<std::vector<glm::vec3>> windings = brush::windings(planes);
 
 		//Set up polygon structure
 		for (int i = 0; i < planes.size(); i++) {
 			this->ngons.push_back(BrushPolygon(planes[i]));
-		}
-
-		// Do plane intersections
-		for (int i = 0; i < planes.size(); i++) {
-			for (int j = 0; j < planes.size(); j++) {
-				for (int k = 0; k < planes.size(); k++) {
-					if (i == j || i == k || j == k) continue; //Skip invalid checks
-
-					glm::vec3 p(0, 0, 0);
-
-					if (!Plane::FinalThreePlaneIntersection(planes[i], planes[j], planes[k], &p)) { continue; };
-
-					bool valid = true;
-					//Check if point is outside object
-					for (int m = 0; m < planes.size(); m++)
-					{
-						if (Plane::EvalPointPolarity(planes[m], p) < -0.01f)
-						{
-							valid = false;
-							break;
-						}
-					}
-
-					if (!valid) continue;
-
-					intersecting.push_back(p);
-
-					//Add verts
-					this->ngons[i].vertices.push_back(p);
-					this->ngons[j].vertices.push_back(p);
-					this->ngons[k].vertices.push_back(p);
-				}
-			}
+			this->ngons[i].vertices = windings[i];
 		}
 
 		std::vector<float> generatedMesh;
 
-		float x = this->ngons[0].vertices[0].x;
-		float _x = this->ngons[0].vertices[0].x;
-		float y = this->ngons[0].vertices[0].y;
-		float _y = this->ngons[0].vertices[0].y;
-		float z = this->ngons[0].vertices[0].z;
-		float _z = this->ngons[0].vertices[0].z;
+		float x = 0, _x = 0, y = 0, _y = 0, z = 0, _z = 0;
+		bool first = true;
 
-		//Remove polygon vertex duplicates
 		for (int i = 0; i < this->ngons.size(); i++) {
-
-			std::vector<glm::vec3> newlist;
-
-			//Cleanup and find bounds
-
-			for (int j = 0; j < this->ngons[i].vertices.size(); j++)
-			{
-				bool found = false;
-
-				for (int k = 0; k < newlist.size(); k++)
-				{
-					if (glm::distance(newlist[k], this->ngons[i].vertices[j]) < 0.5f) //Throw out dupe points (within half a unit)
-					{
-						found = true; break;
-					}
+			//Find bounds
+			for (auto && v : this->ngons[i].vertices) {
+				if (first) {
+					x = _x = v.x; y = _y = v.y; z = _z = v.z;
+					first = false;
 				}
 
-				if (found) continue;
-
-				newlist.push_back(this->ngons[i].vertices[j]);
+				x = v.x > x ? v.x : x;
+				_x = v.x < _x ? v.x : _x;
 
-				x = this->ngons[i].vertices[j].x > x ? this->ngons[i].vertices[j].x : x;
-				_x = this->ngons[i].vertices[j].x < _x ? this->ngons[i].vertices[j].x : _x;
+				y = v.y > y ? v.y : y;
+				_y = v.y < _y ? v.y : _y;
 
-				y = this->ngons[i].vertices[j].y > y ? this->ngons[i].vertices[j].y : y;
-				_y = this->ngons[i].vertices[j].y < _y ? this->ngons[i].vertices[j].y : _y;
-
-				z = this->ngons[i].vertices[j].z > z ? this->ngons[i].vertices[j].z : z;
-				_z = this->ngons[i].vertices[j].z < _z ? this->ngons[i].vertices[j].z : _z;
+				z = v.z > z ? v.z : z;
+				_z = v.z < _z ? v.z : _z;
 			}
 
-			this->ngons[i].vertices = newlist;
-
-			//Reorder vertices
+			//Windings are already ordered
 			if (this->ngons[i].vertices.size() < 3)
 				continue;
 
-			std::vector<glm::vec3> points = Plane::OrderCoplanarClockWise(this->ngons[i].plane, this->ngons[i].vertices);
-			this->ngons[i].vertices = points;
+			const std::vector<glm::vec3>& points = this->ngons[i].vertices;
 			for (int j = 0; j < points.size() - 2; j++) {
 				glm::vec3 a = points[0];
 				glm::vec3 b = points[j + 1];
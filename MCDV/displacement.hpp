@@ -0,0 +1,206 @@
+#pragma once
+#include <vector>
+#include <cstdlib>
+
+#include <glm\glm.hpp>
+
+#include "interpolation.h"
+
+/* Displacement grids and their tessellation, shared by both vmf loaders.
+
+   A grid is (2^power + 1)^2 points, kept row after row in one buffer. Tessellation builds the displaced points into a
+   per-thread scratch buffer and writes triangles straight into a buffer the caller sized with float_count(), so
+   displacements can be processed on any thread without allocating. */
+namespace displacement
+{
+	const int floats_per_vertex = 6; // POS_XYZ_NORMAL_XYZ
+
+	class grid {
+	public:
+		int power = 0;
+		int size = 0;	// Points per row
+
+		std::vector<glm::vec3> normals;
+		std::vector<float> distances;
+
+		/* Sizes and zeroes the grid. Rows have to be read after this */
+		void resize(int _power) {
+			this->power = _power;
+			this->size = _power >= 0 ? (1 << _power) + 1 : 0;
+			this->normals.assign((size_t)this->size * this->size, glm::vec3(0, 0, 0));
+			this->distances.assign((size_t)this->size * this->size, 0.0f);
+		}
+
+		bool empty() const { return this->size == 0; }
+
+		// Indexed the way the vmf writes them: "rowN" then column
+		const glm::vec3& normal(int row, int col) const { return this->normals[row * this->size + col]; }
+		float distance(int row, int col) const { return this->distances[row * this->size + col]; }
+
+		/* Read one "rowN" value of the normals block. Missing values stay zero */
+		void read_normals(int row, const char* str) {
+			if (row < 0 || row >= this->size) return;
+
+			float* out = &this->normals[row * this->size].x;
+			char* end;
+			for (int i = 0; i < this->size * 3; i++) {
+				double v = strtod(str, &end);
+				if (end == str) break;
+				out[i] = (float)v;
+				str = end;
+			}
+		}
+
+		/* Read one "rowN" value of the distances block. Missing values stay zero */
+		void read_distances(int row, const char* str) {
+			if (row < 0 || row >= this->size) return;
+
+			float* out = &this->distances[row * this->size];
+			char* end;
+			for (int i = 0; i < this->size; i++) {
+				float v = strtof(str, &end);
+				if (end == str) break;
+				out[i] = v;
+				str = end;
+			}
+		}
+	};
+
+	/* Vertices in the triangle list of a grid, two triangles per cell */
+	inline size_t vertex_count(const grid& g) {
+		return g.size < 2 ? 0 : (size_t)(g.size - 1) * (g.size - 1) * 6;
+	}
+
+	inline size_t float_count(const grid& g) {
+		return vertex_count(g) * floats_per_vertex;
+	}
+
+	/* Index of the face vertex closest to startposition, which is where the grid starts */
+	inline int start_corner(const glm::vec3* face, int count, const glm::vec3& startposition) {
+		int best = 0;
+		float best_distance = glm::distance(startposition, face[0]);
+		for (int i = 1; i < count; i++) {
+			float d = glm::distance(startposition, face[i]);
+			if (d < best_distance) { best = i; best_distance = d; }
+		}
+		return best;
+	}
+
+	inline std::vector<glm::vec3>& scratch() {
+		thread_local std::vector<glm::vec3> points;
+		return points;
+	}
+
+	/* Displaced points in source space. face is the clockwise four point winding of the side,
+	   SW is its vertex closest to startposition and the rest follow around the winding. */
+	inline const glm::vec3* build_points(const grid& g, const glm::vec3* face, const glm::vec3& startposition) {
+		int pos = start_corner(face, 4, startposition);
+		const glm::vec3& SW = face[pos];
+		const glm::vec3& NW = face[(pos + 1) % 4];
+		const glm::vec3& NE = face[(pos + 2) % 4];
+		const glm::vec3& SE = face[(pos + 3) % 4];
+
+		std::vector<glm::vec3>& points = scratch();
+		if (points.size() < g.normals.size()) points.resize(g.normals.size());
+
+		int n = g.size;
+		for (int row = 0; row < n; row++) {
+			for (int col = 0; col < n; col++) {
+				float dx = (float)col / (float)(n - 1); //Time values for linear interpolation
+				float dy = (float)row / (float)(n - 1);
+
+				glm::vec3 LWR = lerp(SW, SE, dx);
+				glm::vec3 UPR = lerp(NW, NE, dx);
+				glm::vec3 P = lerp(LWR, UPR, dy); // Original point location
+
+				// The vmf rows run along dy
+				points[row * n + col] = P + g.normal(col, row) * g.distance(col, row);
+			}
+		}
+
+		return points.data();
+	}
+
+	/* Cells alternate their diagonal like a checkerboard */
+	inline bool first_diagonal(int size, int row, int col) {
+		return ((row * size) + col) % 2 == 0;
+	}
+
+	inline float* put(float* out, const glm::vec3& p, const glm::vec3& n) {
+		out[0] = -p.x; out[1] = p.z; out[2] = p.y;
+		out[3] = -n.x; out[4] = n.z; out[5] = n.y;
+		return out + floats_per_vertex;
+	}
+
+	/* Triangles using the grid's own normals per vertex (vmf::vmf). out needs float_count(g) floats */
+	inline void tessellate_smooth(const grid& g, const glm::vec3* points, float* out) {
+		int n = g.size;
+		for (int row = 0; row < n - 1; row++) {
+			for (int col = 0; col < n - 1; col++) {
+				int sw = (row * n) + col, se = sw + 1, nw = sw + n, ne = nw + 1;
+
+				const glm::vec3& SW_N = g.normal(col, row);
+				const glm::vec3& SE_N = g.normal(col + 1, row);
+				const glm::vec3& NW_N = g.normal(col, row + 1);
+				const glm::vec3& NE_N = g.normal(col + 1, row + 1);
+
+				if (first_diagonal(n, row, col)) {
+					out = put(out, points[sw], SW_N);
+					out = put(out, points[nw], NW_N);
+					out = put(out, points[ne], NE_N);
+					out = put(out, points[sw], SW_N);
+					out = put(out, points[ne], NE_N);
+					out = put(out, points[se], SE_N);
+				}
+				else {
+					out = put(out, points[sw], SW_N);
+					out = put(out, points[nw], NW_N);
+					out = put(out, points[se], SE_N);
+					out = put(out, points[nw], NW_N);
+					out = put(out, points[ne], NE_N);
+					out = put(out, points[se], SE_N);
+				}
+			}
+		}
+	}
+
+	inline glm::vec3 face_normal(const glm::vec3& A, const glm::vec3& B, const glm::vec3& C) {
+		return glm::normalize(glm::cross(A - C, B - C));
+	}
+
+	/* Triangles with one flat normal each (vmf_new). out needs float_count(g) floats */
+	inline void tessellate_flat(const grid& g, const glm::vec3* points, float* out) {
+		int n = g.size;
+		for (int row = 0; row < n - 1; row++) {
+			for (int col = 0; col < n - 1; col++) {
+				const glm::vec3& SW = points[(row * n) + col];
+				const glm::vec3& SE = points[(row * n) + col + 1];
+				const glm::vec3& NW = points[((row + 1) * n) + col];
+				const glm::vec3& NE = points[((row + 1) * n) + col + 1];
+
+				if (first_diagonal(n, row, col)) {
+					glm::vec3 n1 = face_normal(SW, NW, NE);
+					out = put(out, NE, n1);
+					out = put(out, NW, n1);
+					out = put(out, SW, n1);
+
+					glm::vec3 n2 = face_normal(SW, NE, SE);
+					out = put(out, SE, n2);
+					out = put(out, NE, n2);
+					out = put(out, SW, n2);
+				}
+				else {
+					glm::vec3 n1 = face_normal(SW, NW, SE);
+					out = put(out, SE, n1);
+					out = put(out, NW, n1);
+					out = put(out, SW, n1);
+
+					glm::vec3 n2 = face_normal(NW, NE, SE);
+					out = put(out, SE, n2);
+					out = put(out, NE, n2);
+					out = put(out, NW, n2);
+				}
+			}
+		}
+	}
+}
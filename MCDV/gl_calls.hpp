@@ -0,0 +1,180 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <glad\glad.h>
+
+/* Counts of the GL calls made, by kind, to see what each stage of a frame costs in driver calls. count_gl_calls swaps
+   the glad entry points below for counting wrappers, so calls made straight from main2 are counted along with the
+   ones in Shader, Mesh and the buffers. Nothing is counted until it runs */
+namespace render
+{
+	struct gl_calls {
+		size_t draws = 0;
+		size_t uniforms = 0;	// glUniform*
+		size_t lookups = 0;		// Uniform locations, block indices and active uniforms
+		size_t binds = 0;		// Programs, frame and render buffers, textures, vertex arrays and buffers
+		size_t uploads = 0;		// Buffer and texture data
+		size_t state = 0;		// Clears, viewport, capabilities, blending, vertex attributes and attachments
+		size_t reads = 0;		// Read backs, queries and glFinish
+		size_t objects = 0;		// Creating, compiling and deleting GL objects
+
+		size_t total() const {
+			return this->draws + this->uniforms + this->lookups + this->binds + this->uploads + this->state + this->reads + this->objects;
+		}
+
+		gl_calls operator-(const gl_calls& o) const {
+			gl_calls d;
+			d.draws = this->draws - o.draws;
+			d.uniforms = this->uniforms - o.uniforms;
+			d.lookups = this->lookups - o.lookups;
+			d.binds = this->binds - o.binds;
+			d.uploads = this->uploads - o.uploads;
+			d.state = this->state - o.state;
+			d.reads = this->reads - o.reads;
+			d.objects = this->objects - o.objects;
+			return d;
+		}
+
+		std::string format() const {
+			std::ostringstream ss;
+			ss << this->total() << " (" << this->draws << " draws, " << this->uniforms << " uniforms, " << this->lookups << " lookups, "
+				<< this->binds << " binds, " << this->uploads << " uploads, " << this->state << " state, " << this->reads << " reads, " << this->objects << " objects)";
+			return ss.str();
+		}
+	};
+
+	/* Totals since count_gl_calls, take a copy before a stage and subtract it after */
+	inline gl_calls& gl_counts() {
+		static gl_calls counts;
+		return counts;
+	}
+
+	/* The wrapper for one entry point keeps the function glad loaded in a static of its own instantiation */
+	template<typename F>
+	struct gl_hook;
+
+	template<typename R, typename... A>
+	struct gl_hook<R (APIENTRYP)(A...)> {
+		typedef R (APIENTRYP function)(A...);
+
+		template<function* entry>
+		static function& original() {
+			static function f = NULL;
+			return f;
+		}
+
+		template<function* entry, size_t gl_calls::* kind>
+		static R APIENTRY call(A... args) {
+			gl_counts().*kind += 1;
+			return original<entry>()(args...);
+		}
+
+		template<function* entry, size_t gl_calls::* kind>
+		static void install() {
+			if (*entry == NULL || original<entry>() != NULL) return;
+			original<entry>() = *entry;
+			*entry = &call<entry, kind>;
+		}
+	};
+
+/* Every entry point the tree calls once glad is loaded (gladLoadGLLoader), with the kind it counts as. It is kept by
+   hand, so a new one has to be added here to be counted. --benchGlCalls checks the list against the sources */
+#define GL_COUNTED(X) \
+	X(glDrawArrays, draws) \
+	X(glDrawElements, draws) \
+	X(glMultiDrawElements, draws) \
+	X(glDrawArraysInstanced, draws) \
+	X(glDrawElementsInstanced, draws) \
+	X(glUniform1i, uniforms) \
+	X(glUniform1ui, uniforms) \
+	X(glUniform1f, uniforms) \
+	X(glUniform2fv, uniforms) \
+	X(glUniform3f, uniforms) \
+	X(glUniform3fv, uniforms) \
+	X(glUniform4f, uniforms) \
+	X(glUniform4fv, uniforms) \
+	X(glUniformMatrix4fv, uniforms) \
+	X(glUniformBlockBinding, uniforms) \
+	X(glGetUniformLocation, lookups) \
+	X(glGetUniformBlockIndex, lookups) \
+	X(glGetActiveUniform, lookups) \
+	X(glUseProgram, binds) \
+	X(glBindFramebuffer, binds) \
+	X(glBindRenderbuffer, binds) \
+	X(glActiveTexture, binds) \
+	X(glBindTexture, binds) \
+	X(glBindVertexArray, binds) \
+	X(glBindBuffer, binds) \
+	X(glBindBufferBase, binds) \
+	X(glBufferData, uploads) \
+	X(glBufferSubData, uploads) \
+	X(glTexImage2D, uploads) \
+	X(glGenerateMipmap, uploads) \
+	X(glClear, state) \
+	X(glClearColor, state) \
+	X(glViewport, state) \
+	X(glEnable, state) \
+	X(glDisable, state) \
+	X(glCullFace, state) \
+	X(glFrontFace, state) \
+	X(glPolygonMode, state) \
+	X(glBlendFunc, state) \
+	X(glBlendEquation, state) \
+	X(glDrawBuffers, state) \
+	X(glPixelStorei, state) \
+	X(glTexParameteri, state) \
+	X(glVertexAttribPointer, state) \
+	X(glEnableVertexAttribArray, state) \
+	X(glVertexAttribDivisor, state) \
+	X(glFramebufferTexture2D, state) \
+	X(glFramebufferRenderbuffer, state) \
+	X(glRenderbufferStorage, state) \
+	X(glReadPixels, reads) \
+	X(glGetTexImage, reads) \
+	X(glFinish, reads) \
+	X(glGetIntegerv, reads) \
+	X(glIsEnabled, reads) \
+	X(glCheckFramebufferStatus, reads) \
+	X(glGetProgramiv, reads) \
+	X(glGetShaderiv, reads) \
+	X(glGetProgramInfoLog, reads) \
+	X(glGetShaderInfoLog, reads) \
+	X(glGenBuffers, objects) \
+	X(glGenFramebuffers, objects) \
+	X(glGenRenderbuffers, objects) \
+	X(glGenTextures, objects) \
+	X(glGenVertexArrays, objects) \
+	X(glDeleteBuffers, objects) \
+	X(glDeleteFramebuffers, objects) \
+	X(glDeleteTextures, objects) \
+	X(glDeleteVertexArrays, objects) \
+	X(glCreateProgram, objects) \
+	X(glCreateShader, objects) \
+	X(glShaderSource, objects) \
+	X(glCompileShader, objects) \
+	X(glAttachShader, objects) \
+	X(glLinkProgram, objects) \
+	X(glBindFragDataLocation, objects) \
+	X(glDeleteProgram, objects) \
+	X(glDeleteShader, objects)
+
+#define GL_COUNT(name, kind) render::gl_hook<decltype(glad_##name)>::install<&glad_##name, &render::gl_calls::kind>();
+#define GL_NAME(name, kind) #name,
+
+	/* Needs the GL functions loaded */
+	inline void count_gl_calls() {
+		GL_COUNTED(GL_COUNT)
+	}
+
+	/* Names of the entry points count_gl_calls hooks */
+	inline const std::vector<std::string>& gl_counted() {
+		static const std::vector<std::string> names = { GL_COUNTED(GL_NAME) };
+		return names;
+	}
+
+#undef GL_NAME
+#undef GL_COUNT
+#undef GL_COUNTED
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <glad\glad.h>
+#include <GLFW\glfw3.h>
+
+#include "render.hpp"
+#include "GBuffer.hpp"
+#include "Shader.hpp"
+#include "Mesh.hpp"
+
+/* The OpenGL backend, a thin layer over the frame buffers, shaders and meshes main2 already had */
+namespace render
+{
+	class gl_target : public target {
+	public:
+		GBuffer* gbuffer = NULL;
+		MBuffer* mask = NULL;
+
+		gl_target(GBuffer* _gbuffer, int _width, int _height) : target(TARGET_GBUFFER, _width, _height), gbuffer(_gbuffer) {}
+		gl_target(MBuffer* _mask, int _width, int _height) : target(TARGET_MASK, _width, _height), mask(_mask) {}
+
+		void bind() {
+			if (this->gbuffer != NULL) this->gbuffer->Bind();
+			else this->mask->Bind();
+		}
+	};
+
+	class gl_context : public context {
+		Shader* m_programs[2];
+		Shader* m_current = NULL;
+
+		// Set on every batch and instanced draw, so looked up once per program
+		UniformHandle m_origin[2];
+		UniformHandle m_instanced[2];
+		program m_program = PROGRAM_GBUFFER;
+
+		std::vector<GLint> m_firsts;
+		std::vector<GLsizei> m_counts;
+
+	public:
+		gl_context(Shader* gbuffer, Shader* mask) {
+			this->m_programs[PROGRAM_GBUFFER] = gbuffer;
+			this->m_programs[PROGRAM_MASK] = mask;
+
+			for (int p = 0; p < 2; p++) {
+				this->m_origin[p] = this->m_programs[p]->getUniform("origin");
+				this->m_instanced[p] = this->m_programs[p]->getUniform("instanced");
+			}
+		}
+
+		void bind(target* t) override {
+			if (t == NULL) GBuffer::Unbind();
+			else static_cast<gl_target*>(t)->bind();
+		}
+
+		void clear(float value) override {
+			glClearColor(value, value, value, 1.0);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
+
+		void clear_depth() override {
+			glClear(GL_DEPTH_BUFFER_BIT);
+		}
+
+		void set_culling(bool cull_back) override {
+			if (cull_back) {
+				glEnable(GL_CULL_FACE);
+				glCullFace(GL_BACK);
+			}
+			else glDisable(GL_CULL_FACE);
+		}
+
+		void use(program p) override {
+			this->m_program = p;
+			this->m_current = this->m_programs[p];
+			this->m_current->use();
+		}
+
+		void set_matrix(const std::string& name, const glm::mat4& value) override { this->m_current->setMatrix(name, value); }
+		void set_unsigned(const std::string& name, unsigned int value) override { this->m_current->setUnsigned(name, value); }
+		void set_vec2(const std::string& name, const glm::vec2& value) override { this->m_current->setVec2(name, value); }
+
+		void draw(Mesh* mesh) override {
+			mesh->Draw();
+		}
+
+		void draw_batch(MeshBatch* batch, const std::vector<batch_draw>& draws) override {
+			this->m_firsts.clear();
+			this->m_counts.clear();
+
+			// Parts next to each other in the buffer merge into one range
+			for (auto && d : draws) {
+				const MeshBatch::part& p = batch->parts[d.part];
+				if (p.count == 0) continue;
+
+				if (!this->m_firsts.empty() && this->m_firsts.back() + this->m_counts.back() == (GLint)p.first) this->m_counts.back() += p.count;
+				else {
+					this->m_firsts.push_back(p.first);
+					this->m_counts.push_back(p.count);
+				}
+			}
+
+			this->m_current->setVec2(this->m_origin[this->m_program], glm::vec2(0.0f)); // Comes from the vertices instead
+			batch->Draw(this->m_firsts, this->m_counts);
+		}
+
+		/* One target, so layers only matter in that instances with none are not drawn */
+		void draw_instances(Mesh* mesh, const std::vector<instance>& instances) override {
+			if (instances.empty()) return;
+
+			this->m_current->setVec2(this->m_origin[this->m_program], glm::vec2(0.0f)); // Comes from the instances instead
+			this->m_current->setInt(this->m_instanced[this->m_program], 1);
+			mesh->DrawInstanced(instances);
+			this->m_current->setInt(this->m_instanced[this->m_program], 0);
+		}
+
+		void finish() override {
+			glFinish();
+		}
+	};
+}
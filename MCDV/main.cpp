@@ -19,6 +19,7 @@
 
 // Valve header files
 #include "vmf.hpp"
+#include "vmfc.hpp"
 
 // Util
 #include "cxxopts.hpp"
@@ -113,6 +114,9 @@ uint32_t m_renderWidth = 1024;
 uint32_t m_renderHeight = 1024;
 bool m_enable_maskgen_supersample = true;
 
+kv::tree_mode m_kv_tree = kv::TREE_DATABLOCK;
+bool m_use_vmf_cache = true;
+
 bool tar_cfg_enableAO = true;
 int tar_cfg_aoSzie = 16;
 
@@ -149,6 +153,11 @@ int app(int argc, const char** argv) {
 		("useVBSP", "Use VBSP.exe to pre-process brush unions automatically")
 		("useLightmaps", "Use lightmaps generated by vvis in the VBSP. (If this flag is set, Auto Radar must be ran after vvis.exe)")
 
+		// Diagnostics
+		("kvArena", "Read the map file into the arena backed KV document instead of DataBlocks")
+		("threads", "Threads used to parse the map file (0 = one per hardware thread)", cxxopts::value<uint32_t>()->default_value("0"))
+		("noCache", "Always parse the map file, ignoring and not writing the compiled vmf cache (map_file.vmfc)")
+
 		("positional", "Positional parameters", cxxopts::value<std::vector<std::string>>());
 
 	options.parse_positional("positional");
@@ -181,6 +190,10 @@ int app(int argc, const char** argv) {
 	m_comp_ao_enable = result["ao"].as<bool>();
 	m_comp_shadows_enable = result["shadows"].as<bool>();
 
+	if (result["kvArena"].as<bool>()) m_kv_tree = kv::TREE_ARENA;
+	threadpool::set_global_threads(result["threads"].as<uint32_t>());
+	m_use_vmf_cache = !result["noCache"].as<bool>();
+
 #endif
 
 	//Derive the ones
@@ -320,14 +333,30 @@ int app(int argc, const char** argv) {
 
 	std::cout << "Loading map file...\n";
 
-	vmf::vmf vmf_main(m_mapfile_path + ".vmf");
-	//vmf_main.setup_main();
-	//vmf_main.genVMFReferences(); // Load all our func_instances
+	// Compiled copy of the map, stored next to the resources folder
+	std::string vmf_path = m_mapfile_path + ".vmf";
+	std::string vmfc_path = m_overviews_folder + m_mapfile_name + ".vmfc";
+
+	vmfc::source_key vmf_key;
+	if (m_use_vmf_cache) vmf_key = vmfc::key_for(vmf_path);
+
+	// Edited maps only have their changed solids and entities reparsed
+	bool vmf_cache_exact = false;
+	vmf::vmf* vmf_loaded = m_use_vmf_cache ? vmfc::load(vmfc_path, vmf_path, vmf_key, &vmf_cache_exact) : NULL;
+	if (vmf_loaded == NULL) {
+		vmf_loaded = new vmf::vmf(vmf_path, m_kv_tree);
+		//vmf_main.setup_main();
+		//vmf_main.genVMFReferences(); // Load all our func_instances
+
+		//std::cout << "Generating Meshes...\n";
 
-	//std::cout << "Generating Meshes...\n";
+		vmf_loaded->ComputeGLMeshes();
+		vmf_loaded->ComputeDisplacements();
+	}
+
+	if (m_use_vmf_cache && !vmf_cache_exact) vmfc::save(*vmf_loaded, vmfc_path, vmf_path, vmf_key);
 
-	vmf_main.ComputeGLMeshes();
-	vmf_main.ComputeDisplacements();
+	vmf::vmf& vmf_main = *vmf_loaded;
 
 	// TAR entities
 	std::vector<vmf::Entity*> tavr_ent_tar_config = vmf_main.findEntitiesByClassName("tar_config");
@@ -453,7 +482,7 @@ int app(int argc, const char** argv) {
 	// Render entire map first
 	for (auto && brush : tavr_entire_brushlist) {
 		shader_depth.setFloat("write_cover", brush->temp_mark ? 1.0f : 0.0f);
-		brush->mesh->Draw();
+		if (brush->mesh != NULL) brush->mesh->Draw();
 	}
 	glClear(GL_DEPTH_BUFFER_BIT);
 
@@ -461,8 +490,9 @@ int app(int argc, const char** argv) {
 	shader_depth.setFloat("write_playable", 1.0f);
 	for (auto && s_solid : tavr_solids) {
 		shader_depth.setFloat("write_cover", s_solid->temp_mark ? 1.0f : 0.0f);
-		if (!s_solid->containsDisplacements)
-			s_solid->mesh->Draw();
+		if (!s_solid->containsDisplacements) {
+			if (s_solid->mesh != NULL) s_solid->mesh->Draw();
+		}
 		else {
 			for (auto && f : s_solid->faces) {
 				if (f.displacement != NULL) {
@@ -489,8 +519,9 @@ int app(int argc, const char** argv) {
 
 		for (auto && solid : vmf_main.subvmf_references[mapname]->getAllBrushesInVisGroup("tar_cover")) {
 			shader_depth.setFloat("write_cover", solid->temp_mark ? 1.0f : 1.0f);
-			if (!solid->containsDisplacements)
-				solid->mesh->Draw();
+			if (!solid->containsDisplacements) {
+				if (solid->mesh != NULL) solid->mesh->Draw();
+			}
 			else {
 				for (auto && f : solid->faces) {
 					if (f.displacement != NULL) {
@@ -526,8 +557,9 @@ int app(int argc, const char** argv) {
 	shader_depth.setFloat("write_playable", 0.0f);
 	for (auto && s_solid : tavr_solids_negative) {
 		shader_depth.setFloat("write_cover", s_solid->temp_mark ? 1.0f : 0.0f);
-		if (!s_solid->containsDisplacements)
-			s_solid->mesh->Draw();
+		if (!s_solid->containsDisplacements) {
+			if (s_solid->mesh != NULL) s_solid->mesh->Draw();
+		}
 		else {
 			for (auto && f : s_solid->faces) {
 				if (f.displacement != NULL) {
@@ -555,8 +587,9 @@ int app(int argc, const char** argv) {
 	shader_depth.setFloat("write_playable", 0.0f);
 
 	for (auto && s_solid : tavr_solids) {
-		if (!s_solid->containsDisplacements)
-			s_solid->mesh->Draw();
+		if (!s_solid->containsDisplacements) {
+			if (s_solid->mesh != NULL) s_solid->mesh->Draw();
+		}
 		else {
 			for (auto && f : s_solid->faces) {
 				if (f.displacement != NULL) {
@@ -625,7 +658,7 @@ int app(int argc, const char** argv) {
 	shader_unlit.setVec3("color", 0.0f, 1.0f, 0.0f);
 
 	for (auto && s_solid : tavr_buyzones) {
-		s_solid->mesh->Draw();
+		if (s_solid->mesh != NULL) s_solid->mesh->Draw();
 	}
 
 	fb_comp_1.Bind();
@@ -634,7 +667,7 @@ int app(int argc, const char** argv) {
 	shader_unlit.setVec3("color", 1.0f, 0.0f, 0.0f);
 
 	for (auto && s_solid : tavr_bombtargets) {
-		s_solid->mesh->Draw();
+		if (s_solid->mesh != NULL) s_solid->mesh->Draw();
 	}
 
 	// Apply diffusion
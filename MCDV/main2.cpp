@@ -14,12 +14,20 @@
 #include <vector>
 
 #include "GBuffer.hpp"
+#include "JumpFlood.hpp"
+#include "render.hpp"
+#include "gl_render.hpp"
+#include "gl_calls.hpp"
+#include "soft_render.hpp"
+#include "soft_composite.hpp"
 #include "Shader.hpp"
+#include "UniformBuffer.hpp"
 #include "Mesh.hpp"
 #include "Texture.hpp"
 #include "GradientMap.hpp"
 #include "SSAOKernel.hpp"
 #include "tar_config.hpp"
+#include "benchmark.hpp"
 #include "dds.hpp"
 
 #include "cxxopts.hpp"
@@ -40,8 +48,52 @@ std::string g_folder_resources;
 
 bool		g_onlyMasks = false;
 bool		g_Masks		= false;
+bool		g_kvCompare = false;
+bool		g_headless	= false;
+bool		g_benchRaster = false;
+bool		g_benchDraw = false;
+bool		g_glCalls = false;
+bool		g_jumpFlood = false;
+bool		g_dumpVpk = false;
+std::string g_model_cache_dir = "cache";
+float		g_lod_pixels = 1.0f;
+std::string g_reference;
+kv::tree_mode g_kvTree = kv::TREE_DATABLOCK;
+
+/* The composite uniform block of fullscreenbase.fs, laid out for std140. None of it changes during a run */
+struct composite_block {
+	glm::vec4 samples[TAR_AO_SAMPLES];	// xyz
+	glm::vec4 bounds_NWU;				// xyz
+	glm::vec4 bounds_SEL;				// xyz
+	glm::vec4 color_objective;
+	glm::vec4 color_buyzone;
+	glm::vec4 color_cover;
+	glm::vec4 color_cover2;
+	glm::vec4 color_ao;
+};
+
+const unsigned int composite_block_binding = 0;
+
+/* Everything the geometry passes of one layer draw into */
+struct radar_targets {
+	render::target* gbuffer;
+	render::target* gbuffer_clean;
+	render::target* playspace;
+	render::target* objectives;
+	render::target* buyzone;
+};
 
 void render_config(tar_config_layer layer, const std::string& layerName, FBuffer* drawTarget = NULL);
+void layer_view(tar_config_layer& layer, glm::mat4* projm, glm::mat4* viewm);
+void render_geometry(render::context* ctx, const radar_targets& targets, const glm::mat4& projm, const glm::mat4& viewm);
+void upload_composite_block();
+void report_gl_calls(const char* stage);
+int render_headless(vfilesys* filesys);
+int bench_raster();
+render::composite_uniforms composite_uniforms(const glm::mat4& projm, const glm::mat4& viewm);
+void write_radar_images(vfilesys* filesys, int layer, const std::vector<uint8_t>& rgba);
+bool check_reference(int layer, const std::vector<uint8_t>& rgba);
+void write_radar_txt(vfilesys* filesys);
 
 //glm::mat4 g_mat4_viewm;
 //glm::mat4 g_mat4_projm;
@@ -53,6 +105,10 @@ Shader* g_shader_multilayer_blend;
 Shader* g_shader_multilayer_final;
 Shader* g_shader_fxaa;
 Shader* g_shader_msaa;
+Shader* g_shader_jfa_seed_mask;
+Shader* g_shader_jfa_seed_alpha;
+Shader* g_shader_jfa_step;
+UniformBuffer* g_ubo_composite;
 
 GBuffer* g_gbuffer;
 GBuffer* g_gbuffer_clean;
@@ -61,6 +117,12 @@ MBuffer* g_mask_buyzone;
 MBuffer* g_mask_objectives;
 FBuffer* g_fbuffer_generic;
 FBuffer* g_fbuffer_generic1;
+JumpFlood* g_jfa_objectives = NULL;	// Only with --jumpFlood
+JumpFlood* g_jfa_buyzone = NULL;
+JumpFlood* g_jfa_layer = NULL;
+
+render::context* g_render;
+radar_targets g_targets;
 
 vmf* g_vmf_file;
 tar_config* g_tar_config;
@@ -75,8 +137,10 @@ uint32_t g_renderWidth = 1024;
 uint32_t g_renderHeight = 1024;
 uint32_t g_msaa_mul = 1;
 
-void render_to_png(int x, int y, const char* filepath);
-void save_to_dds(int x, int y, const char* filepath, IMG imgmode = IMG::MODE_DXT1);
+const size_t headless_layer_budget = (size_t)1 << 30; // Bytes of software geometry targets, caps the layers per pass
+
+void write_png(int x, int y, const uint8_t* data, const char* filepath);
+void write_dds(int x, int y, const uint8_t* data, const char* filepath, IMG imgmode = IMG::MODE_DXT1);
 
 //#define _DEBUG
 
@@ -92,11 +156,67 @@ int app(int argc, const char** argv) {
 		("d,dumpMasks", "Toggles whether auto radar should output mask images (resources/map_file.resources/)")
 		("o,onlyMasks", "Specift whether auto radar should only output mask images and do nothing else (resources/map_file.resources)")
 
+		("kvCompare", "Parse the map file with both KV parsers, compare their output and timings, then exit")
+		("kvArena", "Read the map file into the arena backed KV document instead of DataBlocks")
+		("kvStream", "Build the map straight from parser events, without a KV tree")
+		("threads", "Threads used to parse the map file (0 = one per hardware thread)", cxxopts::value<uint32_t>()->default_value("0"))
+		("benchLoad", "Time each map loader and report peak memory on every map in sample_stuff (or --benchFile), then exit")
+		("benchFile", "Map file for --benchLoad and --benchBrush, pak01_dir.vpk for --benchVpk and --benchModels", cxxopts::value<std::string>())
+		("benchLoadRun", "Used by --benchLoad: load --benchFile once with the given loader and report", cxxopts::value<int>())
+		("benchBrush", "Time the brush face kernels on generated brushes (and --benchFile) and check they agree, then exit")
+		("benchVpk", "Time loading --benchFile as a vpk directory and looking up every path in it, then exit")
+		("benchModels", "Time decoding the .vtx and .vvd files in testmodels (and in --benchFile) and check them against the old readers, then exit")
+		("benchRaster", "Render the map's geometry passes with OpenGL and the software renderer at 1024 and 4096, compare them, then exit")
+		("benchDraw", "Time the loops that submit the map's world and entity draws, without rendering them, then exit")
+		("benchComposite", "Composite the checked in layer images into radars on the CPU and compare them with testcomposite, then exit")
+		("benchCompositeWrite", "Write the --benchComposite radars to testcomposite as the new references, then exit")
+		("glCalls", "Count the OpenGL calls made in each stage of a frame and print them")
+		("benchGlCalls", "Check that --glCalls counts every OpenGL function the renderer's sources call, then exit")
+		("headless", "Render without a window or GPU, using the software renderer. Only this path draws every layer in one shared geometry pass")
+		("reference", "Compare the first radar image against this png and report the pixels that differ", cxxopts::value<std::string>())
+		("jumpFlood", "Draw the OpenGL outlines from jump flooded distance fields instead of kernel filters")
+		("dumpVpk", "Write every path in pak01_dir.vpk to vpk.txt")
+		("modelCache", "Folder to keep processed model geometry in between runs (empty turns it off)", cxxopts::value<std::string>()->default_value("cache"))
+		("lodPixels", "Use the coarsest prop LOD that stays within this many radar pixels of the full model (0 = always LOD 0)", cxxopts::value<float>()->default_value("1"))
+
 		("positional", "Positional parameters", cxxopts::value<std::vector<std::string>>());
 
 	options.parse_positional("positional");
 	auto result = options.parse(argc, argv);
 
+	threadpool::set_global_threads(result["threads"].as<uint32_t>());
+
+	/* Benchmarks, these do not need a game */
+	if (result.count("benchLoadRun"))
+		return bench::load_once(result["benchFile"].as<std::string>(), (kv::tree_mode)result["benchLoadRun"].as<int>());
+
+	if (result["benchBrush"].as<bool>())
+		return bench::brush_kernels(result.count("benchFile") ? result["benchFile"].as<std::string>() : "");
+
+	if (result["benchVpk"].as<bool>()) {
+		if (!result.count("benchFile")) throw cxxopts::option_required_exception("benchFile"); // The vpk to load
+		return bench::vpk_lookups(result["benchFile"].as<std::string>());
+	}
+
+	if (result["benchModels"].as<bool>()) {
+		std::string vpk_file = result.count("benchFile") ? result["benchFile"].as<std::string>() : "";
+		int vtx = bench::vtx_decode("testmodels", vpk_file);
+		int vvd = bench::vvd_decode("testmodels", vpk_file);
+		return vtx | vvd;
+	}
+
+	if (result["benchComposite"].as<bool>() || result["benchCompositeWrite"].as<bool>()) {
+		render::headless() = true; // CPU copies of the textures, no GL
+		return bench::composite(result["benchCompositeWrite"].as<bool>());
+	}
+
+	if (result["benchGlCalls"].as<bool>())
+		return bench::gl_hooks({ "main2.cpp", "FrameBuffer.hpp", "GBuffer.hpp", "GradientMap.hpp", "JumpFlood.hpp", "Mesh.hpp",
+			"SSAOKernel.hpp", "Shader.hpp", "Texture.hpp", "UniformBuffer.hpp", "gl_render.hpp", "soft_render.hpp", "soft_composite.hpp" });
+
+	if (result["benchLoad"].as<bool>())
+		return bench::load_modes(argv[0], result.count("benchFile") ? std::vector<std::string>{ result["benchFile"].as<std::string>() } : bench::find_maps("sample_stuff"), result["threads"].as<uint32_t>());
+
 	/* Check required parameters */
 	if (result.count("game")) g_game_path = sutil::ReplaceAll(result["game"].as<std::string>(), "\n", "");
 	else throw cxxopts::option_required_exception("game");
@@ -116,6 +236,19 @@ int app(int argc, const char** argv) {
 	/* Check the rest of the flags */
 	g_onlyMasks = result["onlyMasks"].as<bool>();
 	g_Masks = result["dumpMasks"].as<bool>() || g_onlyMasks;
+	g_kvCompare = result["kvCompare"].as<bool>();
+	if (result["kvArena"].as<bool>()) g_kvTree = kv::TREE_ARENA;
+	if (result["kvStream"].as<bool>()) g_kvTree = kv::TREE_NONE;
+	g_headless = result["headless"].as<bool>();
+	g_benchRaster = result["benchRaster"].as<bool>();
+	g_benchDraw = result["benchDraw"].as<bool>();
+	g_glCalls = result["glCalls"].as<bool>();
+	g_jumpFlood = result["jumpFlood"].as<bool>();
+	g_dumpVpk = result["dumpVpk"].as<bool>();
+	g_model_cache_dir = result["modelCache"].as<std::string>();
+	g_lod_pixels = result["lodPixels"].as<float>();
+	if (result.count("reference")) g_reference = result["reference"].as<std::string>();
+	render::headless() = g_headless;
 
 	/* Render options */
 	//m_renderWidth = result["width"].as<uint32_t>();
@@ -127,42 +260,66 @@ int app(int argc, const char** argv) {
 	g_folder_overviews = g_game_path + "/resource/overviews/";
 	g_folder_resources = g_folder_overviews + g_mapfile_name + ".resources/";
 
+	if (g_kvCompare) {
+		mapped_file file(g_mapfile_path + ".vmf");
+		if (!file.good()) throw std::exception("VMF File read error.");
+
+		return kv::compare_parsers(file.data(), file.size()) ? 0 : 1;
+	}
+
 #pragma region opengl_setup
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	if (!g_headless) {
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
-	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
 
-	GLFWwindow* window = glfwCreateWindow(g_renderWidth, g_renderHeight, "Ceci n'est pas une window", NULL, NULL);
+		GLFWwindow* window = glfwCreateWindow(g_renderWidth, g_renderHeight, "Ceci n'est pas une window", NULL, NULL);
 
-	if (window == NULL) {
-		printf("GLFW died\n");
-		glfwTerminate();
-		return -1;
-	}
+		if (window == NULL) {
+			printf("GLFW died\n");
+			glfwTerminate();
+			return -1;
+		}
 
-	glfwMakeContextCurrent(window);
+		glfwMakeContextCurrent(window);
 
-	// Deal with GLAD
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		printf("GLAD died\n");
-		return -1;
-	}
+		// Deal with GLAD
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+			printf("GLAD died\n");
+			return -1;
+		}
+
+		const unsigned char* glver = glGetString(GL_VERSION);
+		printf("(required: min core 3.3.0) opengl version: %s\n", glver);
 
-	const unsigned char* glver = glGetString(GL_VERSION);
-	printf("(required: min core 3.3.0) opengl version: %s\n", glver);
+		if (g_glCalls) render::count_gl_calls();
+	}
 #pragma endregion
 
 	vfilesys* filesys = new vfilesys(g_game_path + "/gameinfo.txt");
+	if (g_dumpVpk && filesys->vpkIndex != NULL) filesys->vpkIndex->dump("vpk.txt");
 
 	vmf::LinkVFileSystem(filesys);
-	g_vmf_file = vmf::from_file(g_mapfile_path + ".vmf");
-	g_vmf_file->InitModelDict();
+	if (!g_model_cache_dir.empty()) vmf::LinkModelCache(new models::cache(g_model_cache_dir));
+	g_vmf_file = vmf::from_file(g_mapfile_path + ".vmf", {}, g_kvTree);
+	g_vmf_file->upload_meshes();
 	g_tar_config = new tar_config(g_vmf_file);
 
+	if(g_tar_config->m_sampling_mode == sampling_mode::MSAA4x ||
+		g_tar_config->m_sampling_mode == sampling_mode::MSAA16x)
+	g_msaa_mul = g_tar_config->m_sampling_mode;
+
+	// Props only need the detail that shows up at the size of a pixel in the biggest target they are drawn to
+	g_vmf_file->InitModelDict(g_lod_pixels * g_tar_config->m_render_ortho_scale / (g_renderWidth * g_msaa_mul));
+
+	if (g_benchDraw) return bench::draw_loop(g_vmf_file, g_tar_config);
+
+	if (g_headless) return render_headless(filesys);
+
 #pragma region opengl_extra
 
 	std::vector<float> __meshData = {
@@ -183,10 +340,9 @@ int app(int argc, const char** argv) {
 	g_shader_multilayer_final = new Shader("shaders/fullscreenbase.vs", "shaders/ss_comp_multilayer_finalstage.fs");
 	g_shader_fxaa =		new Shader("shaders/fullscreenbase.vs", "shaders/ss_fxaa.fs");
 	g_shader_msaa =		new Shader("shaders/fullscreenbase.vs", "shaders/ss_msaa.fs");
-
-	if(g_tar_config->m_sampling_mode == sampling_mode::MSAA4x ||
-		g_tar_config->m_sampling_mode == sampling_mode::MSAA16x)
-	g_msaa_mul = g_tar_config->m_sampling_mode;
+	g_shader_jfa_seed_mask = new Shader("shaders/fullscreenbase.vs", "shaders/ss_jfa_seed_mask.fs");
+	g_shader_jfa_seed_alpha = new Shader("shaders/fullscreenbase.vs", "shaders/ss_jfa_seed_alpha.fs");
+	g_shader_jfa_step =	new Shader("shaders/fullscreenbase.vs", "shaders/ss_jfa_step.fs");
 
 	// Set up draw buffers
 	g_mask_playspace =	new MBuffer(g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
@@ -196,6 +352,18 @@ int app(int argc, const char** argv) {
 	g_gbuffer_clean =   new GBuffer(g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
 	g_fbuffer_generic = new FBuffer(g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
 	g_fbuffer_generic1 =new FBuffer(g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+	if (g_jumpFlood) {
+		g_jfa_objectives =	new JumpFlood(g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+		g_jfa_buyzone =		new JumpFlood(g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+		g_jfa_layer =		new JumpFlood(g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+	}
+
+	g_render = new render::gl_context(g_shader_gBuffer, g_shader_iBuffer);
+	g_targets.gbuffer =		new render::gl_target(g_gbuffer, g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+	g_targets.gbuffer_clean = new render::gl_target(g_gbuffer_clean, g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+	g_targets.playspace =	new render::gl_target(g_mask_playspace, g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+	g_targets.objectives =	new render::gl_target(g_mask_objectives, g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
+	g_targets.buyzone =		new render::gl_target(g_mask_buyzone, g_renderWidth * g_msaa_mul, g_renderHeight * g_msaa_mul);
 
 	// Setup camera projection matrices
 	//g_mat4_projm = glm::ortho(-2000.0f, 2000.0f, -2000.0f, 2000.0f, -1024.0f, 1024.0f);
@@ -206,6 +374,7 @@ int app(int argc, const char** argv) {
 	g_texture_modulate = new Texture("textures/modulate.png");
 	g_ssao_samples = get_ssao_samples(TAR_AO_SAMPLES);
 	g_ssao_rotations = new ssao_rotations_texture();
+	upload_composite_block();
 
 	glEnable(GL_DEPTH_TEST);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -213,11 +382,15 @@ int app(int argc, const char** argv) {
 
 #pragma endregion
 
+	if (g_benchRaster) return bench_raster();
+	report_gl_calls("setup");
+
 #pragma region render
 
 	std::map<tar_config_layer*, FBuffer*> _flayers;
 
-	// Render all map segments
+	// Render all map segments. Unlike render_headless, this redraws the whole map for every layer: one shared pass would
+	// need layered (array texture) G buffers and masks, and composite shaders that read them
 	int c = 0;
 	for (auto && layer : g_tar_config->layers){
 		_flayers.insert({ &layer, new FBuffer(g_renderWidth, g_renderHeight) });
@@ -237,6 +410,7 @@ int app(int argc, const char** argv) {
 	///g_gbuffer->BindPositionBufferToTexSlot(0);
 	///g_shader_multilayer_blend->setInt("gbuffer_position", 0);
 
+	bool reference_ok = true;
 	int i = 0;
 	for (auto && megalayer : g_tar_config->layers){
 		g_fbuffer_generic->Bind();
@@ -251,6 +425,9 @@ int app(int argc, const char** argv) {
 		g_shader_multilayer_blend->setFloat("active", 0.0f);
 
 		bool above = false;
+		UniformHandle u_layer_target = g_shader_multilayer_blend->getUniform("layer_target");
+		UniformHandle u_layer_min = g_shader_multilayer_blend->getUniform("layer_min");
+		UniformHandle u_layer_max = g_shader_multilayer_blend->getUniform("layer_max");
 
 		for(int x = 0; x < g_tar_config->layers.size(); x++)
 		{
@@ -260,9 +437,9 @@ int app(int argc, const char** argv) {
 			_flayers[l]->BindRTToTexSlot(1);
 			_flayers[l]->BindHeightToTexSlot(0);
 
-			g_shader_multilayer_blend->setFloat("layer_target", !above? l->layer_min: l->layer_max);
-			g_shader_multilayer_blend->setFloat("layer_min", l->layer_min);
-			g_shader_multilayer_blend->setFloat("layer_max", l->layer_max);
+			g_shader_multilayer_blend->setFloat(u_layer_target, !above? l->layer_min: l->layer_max);
+			g_shader_multilayer_blend->setFloat(u_layer_min, l->layer_min);
+			g_shader_multilayer_blend->setFloat(u_layer_max, l->layer_max);
 			
 			g_mesh_screen_quad->Draw();
 		}
@@ -280,6 +457,14 @@ int app(int argc, const char** argv) {
 		
 		FBuffer::Unbind();
 
+		if (g_jumpFlood) {
+			g_shader_jfa_seed_alpha->use();
+			g_fbuffer_generic->BindRTToTexSlot(0);
+			g_shader_jfa_seed_alpha->setInt("tex_layer", 0);
+			g_jfa_layer->Run(g_shader_jfa_seed_alpha, g_shader_jfa_step, g_mesh_screen_quad);
+		}
+		report_gl_calls("layer blend");
+
 		g_fbuffer_generic1->Bind();
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -294,6 +479,12 @@ int app(int argc, const char** argv) {
 
 		g_fbuffer_generic->BindRTToTexSlot(1);
 		g_shader_multilayer_final->setInt("tex_layer", 1);
+
+		if (g_jumpFlood) {
+			g_jfa_layer->BindSeedsToTexSlot(2);
+			g_shader_multilayer_final->setInt("jfa_layer", 2);
+		}
+		g_shader_multilayer_final->setInt("use_jfa", g_jumpFlood? 1: 0);
 		g_mesh_screen_quad->Draw();
 
 		// Apply FXAA
@@ -319,106 +510,37 @@ int app(int argc, const char** argv) {
 		}
 
 		// final composite
-		//render_to_png(1024, 1024, ("comp" + std::to_string(i++) + ".png").c_str());
-
-		if (i == 0) {
-			if(g_tar_config->m_write_dds)
-				save_to_dds(g_renderWidth, g_renderHeight, filesys->create_output_filepath("resource/overviews/" + g_mapfile_name +"_radar.dds", true).c_str(), g_tar_config->m_dds_img_mode);
+		std::vector<uint8_t> radar(g_renderWidth * g_renderHeight * 4);
+		glReadPixels(0, 0, g_renderWidth, g_renderHeight, GL_RGBA, GL_UNSIGNED_BYTE, &radar[0]);
 
-			if(g_tar_config->m_write_png)
-				render_to_png(g_renderWidth, g_renderHeight, filesys->create_output_filepath("resource/overviews/" + g_mapfile_name + "_radar.png", true).c_str());
-
-			i++;
-		}
-		else {
-			if (g_tar_config->m_write_dds)
-				save_to_dds(g_renderWidth, g_renderHeight, filesys->create_output_filepath("resource/overviews/" + g_mapfile_name + "_layer" + std::to_string(i) + "_radar.dds", true).c_str(), g_tar_config->m_dds_img_mode);
+		report_gl_calls("final");
 
-			if (g_tar_config->m_write_png)
-				render_to_png(g_renderWidth, g_renderHeight, filesys->create_output_filepath("resource/overviews/" + g_mapfile_name + "_layer" + std::to_string(i) + "_radar.png", true).c_str());
+		write_radar_images(filesys, i, radar);
+		if (!check_reference(i, radar)) reference_ok = false;
+		i++;
 
-			i++;
-		}
 		FBuffer::Unbind();
 	}
 
 #pragma endregion
-	if (g_tar_config->m_write_txt)
-	{
-		std::cout << "Generating radar .TXT... ";
-
-		kv::DataBlock node_radar = kv::DataBlock();
-		node_radar.name = "\"" + g_mapfile_name + "\"";
-		node_radar.Values.insert({ "material", "overviews/" + g_mapfile_name });
-
-		node_radar.Values.insert({ "pos_x", std::to_string(g_tar_config->m_view_origin.x) });
-		node_radar.Values.insert({ "pos_y", std::to_string(g_tar_config->m_view_origin.y) });
-		node_radar.Values.insert({ "scale", std::to_string(g_tar_config->m_render_ortho_scale / g_renderWidth) });
-
-		if (g_tar_config->layers.size() > 1) {
-			kv::DataBlock node_vsections = kv::DataBlock();
-			node_vsections.name = "\"verticalsections\"";
-
-			int ln = 0;
-			for (auto && layer : g_tar_config->layers) {
-				kv::DataBlock node_layer = kv::DataBlock();
-				if (ln == 0) {
-					node_layer.name = "\"default\""; ln++;
-				}
-				else node_layer.name = "\"layer" + std::to_string(ln++) + "\"";
-
-				node_layer.Values.insert({ "AltitudeMin", std::to_string(layer.layer_max) });
-				node_layer.Values.insert({ "AltitudeMax", std::to_string(layer.layer_min) });
-
-				node_vsections.SubBlocks.push_back(node_layer);
-			}
-
-			node_radar.SubBlocks.push_back(node_vsections);
-		}
-
-		// Try resolve spawn positions
-		glm::vec3* loc_spawnCT = g_vmf_file->calculateSpawnAVG_PMIN("info_player_counterterrorist");
-		glm::vec3* loc_spawnT = g_vmf_file->calculateSpawnAVG_PMIN("info_player_terrorist");
-
-		if (loc_spawnCT != NULL) {
-			node_radar.Values.insert({ "CTSpawn_x", std::to_string(util::roundf(remap(loc_spawnCT->x, g_tar_config->m_view_origin.x, g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
-			node_radar.Values.insert({ "CTSpawn_y", std::to_string(util::roundf(remap(loc_spawnCT->z, g_tar_config->m_view_origin.y, g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
-		}
-		if (loc_spawnT != NULL) {
-			node_radar.Values.insert({ "TSpawn_x", std::to_string(util::roundf(remap(loc_spawnT->x, g_tar_config->m_view_origin.x, g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
-			node_radar.Values.insert({ "TSpawn_y", std::to_string(util::roundf(remap(loc_spawnT->z, g_tar_config->m_view_origin.y, g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
-		}
-
-		int hostn = 1;
-		for (auto && hostage : g_vmf_file->get_entities_by_classname("info_hostage_spawn")) {
-			node_radar.Values.insert({ "Hostage" + std::to_string(hostn) + "_x", std::to_string(util::roundf(remap(hostage->m_origin.x, g_tar_config->m_view_origin.x, g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
-			node_radar.Values.insert({ "Hostage" + std::to_string(hostn++) + "_y", std::to_string(util::roundf(remap(hostage->m_origin.z, g_tar_config->m_view_origin.y, g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
-		}
-
-		std::ofstream out(filesys->create_output_filepath("resource/overviews/" + g_mapfile_name + ".txt", true).c_str());
-		out << "// TAVR - AUTO RADAR. v 2.5.0a\n";
-		node_radar.Serialize(out);
-		out.close();
-	}
+	if (g_tar_config->m_write_txt) write_radar_txt(filesys);
 
 	IL_EXIT:
 	glfwTerminate();
 #ifdef _DEBUG
 	system("PAUSE");
 #endif
-	return 0;
+	return reference_ok ? 0 : 1;
 }
 
 #endif
 
 #define __RENDERCLIP
 
-void render_config(tar_config_layer layer, const std::string& layerName, FBuffer* drawTarget) {
-	// G BUFFER GENERATION ======================================================================================
-#pragma region buffer_gen_geo
-
+/* Projection and view for a layer. Also sets the height range the vmf draws */
+void layer_view(tar_config_layer& layer, glm::mat4* projm, glm::mat4* viewm) {
 #ifdef RENDERCLIP
-	glm::mat4 l_mat4_projm = glm::ortho(
+	*projm = glm::ortho(
 		g_tar_config->m_view_origin.x,										// -X
 		g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale,	// +X
 		g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale,	// -Y
@@ -426,14 +548,14 @@ void render_config(tar_config_layer layer, const std::string& layerName, FBuffer
 		0.0f, //g_tar_config->m_map_bounds.NWU.y,									// NEARZ
 		glm::abs(layer.layer_max - layer.layer_min));// g_tar_config->m_map_bounds.SEL.y);									// FARZ
 
-	glm::mat4 l_mat4_viewm = glm::lookAt(
+	*viewm = glm::lookAt(
 		glm::vec3(0, -layer.layer_max, 0), 
 		glm::vec3(0.0f, -layer.layer_max -1.0f, 0.0f),
 		glm::vec3(0, 0, 1));
 
 	g_vmf_file->SetMinMax(10000, -10000);
 #else
-	glm::mat4 l_mat4_projm = glm::ortho(
+	*projm = glm::ortho(
 		g_tar_config->m_view_origin.x,										// -X
 		g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale,	// +X
 		g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale,	// -Y
@@ -441,7 +563,7 @@ void render_config(tar_config_layer layer, const std::string& layerName, FBuffer
 		-10000.0f, //g_tar_config->m_map_bounds.NWU.y,									// NEARZ
 		10000.0f);// g_tar_config->m_map_bounds.SEL.y);									// FARZ
 
-	glm::mat4 l_mat4_viewm = glm::lookAt(
+	*viewm = glm::lookAt(
 		glm::vec3(0, 0, 0),
 		glm::vec3(0.0f, -1.0f, 0.0f),
 		glm::vec3(0, 0, 1));
@@ -451,111 +573,133 @@ void render_config(tar_config_layer layer, const std::string& layerName, FBuffer
 
 	g_vmf_file->SetMinMax(layer.layer_min, layer.layer_max);
 #endif
+}
 
-	g_gbuffer->Bind();
+/* G buffers and masks for one layer. Works on any render::context, GL or software */
+void render_geometry(render::context* ctx, const radar_targets& targets, const glm::mat4& projm, const glm::mat4& viewm) {
+	// G BUFFER GENERATION ======================================================================================
+#pragma region buffer_gen_geo
 
-	glClearColor(-10000.0, -10000.0, -10000.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	ctx->bind(targets.gbuffer);
+	ctx->clear(-10000.0f);
+	ctx->set_culling(true);
 
-	g_shader_gBuffer->use();
-	g_shader_gBuffer->setMatrix("projection", l_mat4_projm);
-	g_shader_gBuffer->setMatrix("view", l_mat4_viewm);
+	ctx->use(render::PROGRAM_GBUFFER);
+	ctx->set_matrix("projection", projm);
+	ctx->set_matrix("view", viewm);
 
 	glm::mat4 model = glm::mat4();
-	g_shader_gBuffer->setMatrix("model", model);
+	ctx->set_matrix("model", model);
 
 	// Draw everything
 	g_vmf_file->SetFilters({}, { "func_detail", "prop_static" });
-	g_vmf_file->DrawWorld(g_shader_gBuffer);
-	g_vmf_file->DrawEntities(g_shader_gBuffer);
+	g_vmf_file->DrawWorld(ctx);
+	g_vmf_file->DrawEntities(ctx);
 
 	// Clear depth
-	glClear(GL_DEPTH_BUFFER_BIT);
+	ctx->clear_depth();
 
 	// Render again BUT JUST THE IMPORTANT BITS
 	g_vmf_file->SetFilters({ g_tar_config->m_visgroup_layout, g_tar_config->m_visgroup_mask }, { "func_detail", "prop_static" });
-	g_vmf_file->DrawWorld(g_shader_gBuffer);
-	g_vmf_file->DrawEntities(g_shader_gBuffer);
+	g_vmf_file->DrawWorld(ctx);
+	g_vmf_file->DrawEntities(ctx);
 
 	//// Draw cover with cover flag set
 	//g_vmf_file->SetFilters({ g_tar_config->m_visgroup_cover }, { "func_detail", "prop_static" });
-	//g_vmf_file->DrawWorld(g_shader_gBuffer, {}, TAR_MIBUFFER_COVER0);
-	//g_vmf_file->DrawEntities(g_shader_gBuffer, {}, TAR_MIBUFFER_COVER0);
+	//g_vmf_file->DrawWorld(ctx, {}, TAR_MIBUFFER_COVER0);
+	//g_vmf_file->DrawEntities(ctx, {}, TAR_MIBUFFER_COVER0);
 
-	GBuffer::Unbind();
-
-	g_gbuffer_clean->Bind();
-	glClearColor(0.0, 0.0, 0.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ctx->bind(targets.gbuffer_clean);
+	ctx->clear(0.0f);
 
 	
 	g_vmf_file->SetFilters({ g_tar_config->m_visgroup_layout, g_tar_config->m_visgroup_mask }, { "func_detail", "prop_static" });
-	g_vmf_file->DrawWorld(g_shader_gBuffer);
-	g_vmf_file->DrawEntities(g_shader_gBuffer);
+	g_vmf_file->DrawWorld(ctx);
+	g_vmf_file->DrawEntities(ctx);
 
 	g_vmf_file->SetFilters({ g_tar_config->m_visgroup_cover }, { "func_detail", "prop_static" });
-	g_vmf_file->DrawWorld(g_shader_gBuffer, {}, TAR_MIBUFFER_COVER0);
-	g_vmf_file->DrawEntities(g_shader_gBuffer, {}, TAR_MIBUFFER_COVER0);
+	g_vmf_file->DrawWorld(ctx, {}, TAR_MIBUFFER_COVER0);
+	g_vmf_file->DrawEntities(ctx, {}, TAR_MIBUFFER_COVER0);
 
 	g_vmf_file->SetFilters({ g_tar_config->m_visgroup_overlap }, { "func_detail", "prop_static" });
-	g_vmf_file->DrawWorld(g_shader_gBuffer, {}, TAR_MIBUFFER_OVERLAP);
-	g_vmf_file->DrawEntities(g_shader_gBuffer, {}, TAR_MIBUFFER_OVERLAP);
-
-	GBuffer::Unbind();
+	g_vmf_file->DrawWorld(ctx, {}, TAR_MIBUFFER_OVERLAP);
+	g_vmf_file->DrawEntities(ctx, {}, TAR_MIBUFFER_OVERLAP);
 
 #pragma endregion
 
 #pragma region mask_gen
 
-	g_mask_playspace->Bind();
-	glClearColor(0.0, 0.0, 0.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ctx->bind(targets.playspace);
+	ctx->clear(0.0f);
 
-	g_shader_iBuffer->use();
-	g_shader_iBuffer->setMatrix("projection", l_mat4_projm);
-	g_shader_iBuffer->setMatrix("view", l_mat4_viewm);
+	ctx->use(render::PROGRAM_MASK);
+	ctx->set_matrix("projection", projm);
+	ctx->set_matrix("view", viewm);
 
 	// LAYOUT ================================================================
 
-	g_shader_iBuffer->setUnsigned("srcChr", 0x1U);
+	ctx->set_unsigned("srcChr", 0x1U);
 	g_vmf_file->SetFilters({ g_tar_config->m_visgroup_layout }, { "func_detail", "prop_static" });
-	g_vmf_file->DrawWorld(g_shader_iBuffer);
-	g_vmf_file->DrawEntities(g_shader_iBuffer);
+	g_vmf_file->DrawWorld(ctx);
+	g_vmf_file->DrawEntities(ctx);
 
 	// Subtractive brushes
-	g_shader_iBuffer->setUnsigned("srcChr", 0x0U);
+	ctx->set_unsigned("srcChr", 0x0U);
 	g_vmf_file->SetFilters({ g_tar_config->m_visgroup_mask }, { "func_detail", "prop_static" });
-	g_vmf_file->DrawWorld(g_shader_iBuffer);
-	g_vmf_file->DrawEntities(g_shader_iBuffer);
+	g_vmf_file->DrawWorld(ctx);
+	g_vmf_file->DrawEntities(ctx);
 
 	// OBJECTIVES ============================================================
 
-	g_mask_objectives->Bind();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ctx->bind(targets.objectives);
+	ctx->clear(0.0f);
 
-	g_shader_iBuffer->setUnsigned("srcChr", 0x1U);
+	ctx->set_unsigned("srcChr", 0x1U);
 	g_vmf_file->SetFilters({}, { "func_bomb_target", "func_hostage_rescue" });
-	g_vmf_file->DrawEntities(g_shader_iBuffer);
+	g_vmf_file->DrawEntities(ctx);
 
 	// BUY ZONES =============================================================
 
-	g_mask_buyzone->Bind();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ctx->bind(targets.buyzone);
+	ctx->clear(0.0f);
 
-	g_shader_iBuffer->setUnsigned("srcChr", 0x1U);
+	ctx->set_unsigned("srcChr", 0x1U);
 	g_vmf_file->SetFilters({}, { "func_buyzone" });
-	g_vmf_file->DrawEntities(g_shader_iBuffer);
+	g_vmf_file->DrawEntities(ctx);
+
+	ctx->bind(NULL); // Release any frame buffer
 
 #pragma endregion
+}
+
+/* One layer with OpenGL: every geometry pass, then the composite into drawTarget. Layers do not share geometry passes
+   here, see render_headless for the path that does */
+void render_config(tar_config_layer layer, const std::string& layerName, FBuffer* drawTarget) {
+	glm::mat4 l_mat4_projm, l_mat4_viewm;
+	layer_view(layer, &l_mat4_projm, &l_mat4_viewm);
+
+	render_geometry(g_render, g_targets, l_mat4_projm, l_mat4_viewm);
+	report_gl_calls("geometry");
+
+	// Distance fields for the outlines, seeded from the masks just drawn
+	if (g_jumpFlood) {
+		g_shader_jfa_seed_mask->use();
+		g_mask_playspace->BindMaskBufferToTexSlot(1);
+		g_shader_jfa_seed_mask->setInt("umask_playspace", 1);
+		g_shader_jfa_seed_mask->setInt("umask", 0);
+
+		g_mask_objectives->BindMaskBufferToTexSlot(0);
+		g_jfa_objectives->Run(g_shader_jfa_seed_mask, g_shader_jfa_step, g_mesh_screen_quad);
+
+		g_shader_jfa_seed_mask->use();
+		g_mask_buyzone->BindMaskBufferToTexSlot(0);
+		g_jfa_buyzone->Run(g_shader_jfa_seed_mask, g_shader_jfa_step, g_mesh_screen_quad);
+		report_gl_calls("jump flood");
+	}
 
 	// FINAL COMPOSITE ===============================================================
 #pragma region final_composite
 
-	MBuffer::Unbind(); // Release any frame buffer
-
 	if(drawTarget != NULL)
 		drawTarget->Bind();
 
@@ -609,29 +753,325 @@ void render_config(tar_config_layer layer, const std::string& layerName, FBuffer
 	g_shader_comp->setMatrix("projection", l_mat4_projm);
 	g_shader_comp->setMatrix("view", l_mat4_viewm);
 
-	for (int i = 0; i < TAR_AO_SAMPLES; i++) {
-		g_shader_comp->setVec3("samples[" + std::to_string(i) + "]", g_ssao_samples[i]);
-	}
-
-	// Bind uniforms
-	g_shader_comp->setVec3("bounds_NWU", g_tar_config->m_map_bounds.NWU);
-	g_shader_comp->setVec3("bounds_SEL", g_tar_config->m_map_bounds.SEL);
-
-	g_shader_comp->setVec4("color_objective",	g_tar_config->m_color_objective);
-	g_shader_comp->setVec4("color_buyzone",		g_tar_config->m_color_buyzone);
-	g_shader_comp->setVec4("color_cover",		g_tar_config->m_color_cover);
-	g_shader_comp->setVec4("color_cover2",		g_tar_config->m_color_cover2);
-	g_shader_comp->setVec4("color_ao",			g_tar_config->m_color_ao);
+	// Bind uniforms, the kernel, bounds and colors are in g_ubo_composite
 	g_shader_comp->setFloat("blend_objective_stripes", g_tar_config->m_outline_stripes_enable? 0.0f: 1.0f);
 	g_shader_comp->setFloat("blend_ao", g_tar_config->m_ao_enable? 1.0f: 0.0f);
 	g_shader_comp->setInt("mssascale", g_msaa_mul);
 
+	if (g_jumpFlood) {
+		g_jfa_objectives->BindSeedsToTexSlot(13);
+		g_shader_comp->setInt("jfa_objectives", 13);
+		g_jfa_buyzone->BindSeedsToTexSlot(14);
+		g_shader_comp->setInt("jfa_buyzone", 14);
+	}
+	g_shader_comp->setInt("use_jfa", g_jumpFlood? 1: 0);
+
 	g_mesh_screen_quad->Draw();
+	report_gl_calls("composite");
 
 	//render_to_png(g_renderWidth, g_renderHeight, layerName.c_str());
 #pragma endregion
 }
 
+/* Everything in composite_block into g_ubo_composite, and g_shader_comp pointed at it. Once per run */
+void upload_composite_block() {
+	composite_block block;
+	for (int i = 0; i < TAR_AO_SAMPLES; i++) block.samples[i] = glm::vec4(g_ssao_samples[i], 0.0f);
+	block.bounds_NWU = glm::vec4(g_tar_config->m_map_bounds.NWU, 0.0f);
+	block.bounds_SEL = glm::vec4(g_tar_config->m_map_bounds.SEL, 0.0f);
+	block.color_objective = g_tar_config->m_color_objective;
+	block.color_buyzone = g_tar_config->m_color_buyzone;
+	block.color_cover = g_tar_config->m_color_cover;
+	block.color_cover2 = g_tar_config->m_color_cover2;
+	block.color_ao = g_tar_config->m_color_ao;
+
+	g_ubo_composite = new UniformBuffer(composite_block_binding, sizeof(block));
+	g_ubo_composite->Upload(&block, sizeof(block));
+	g_shader_comp->bindUniformBlock("composite", composite_block_binding);
+}
+
+/* With --glCalls, the GL calls made since the last report, under the name of the stage that made them */
+void report_gl_calls(const char* stage) {
+	static render::gl_calls last;
+	if (!g_glCalls) return;
+
+	render::gl_calls now = render::gl_counts();
+	std::cout << "GL calls, " << stage << ": " << (now - last).format() << "\n";
+	last = now;
+}
+
+/* Mask plane as a black and white png, flipped the right way up */
+void write_mask_png(const render::soft_mask& mask, const std::string& filepath) {
+	std::vector<unsigned char> data(mask.mask.size());
+	for (size_t i = 0; i < data.size(); i++) data[i] = mask.mask[i] ? 255 : 0;
+
+	stbi_flip_vertically_on_write(true);
+	stbi_write_png(filepath.c_str(), mask.width, mask.height, 1, &data[0], mask.width);
+}
+
+/* Uniforms of the final composite for one layer, as render_config sets them on g_shader_comp */
+render::composite_uniforms composite_uniforms(const glm::mat4& projm, const glm::mat4& viewm) {
+	render::composite_uniforms u;
+	u.bounds_NWU = g_tar_config->m_map_bounds.NWU;
+	u.bounds_SEL = g_tar_config->m_map_bounds.SEL;
+	u.tex_gradient = g_tar_config->m_texture_gradient;
+	u.tex_modulate = g_texture_modulate;
+	u.samples = &g_ssao_samples;
+	u.ssaoRotations = &static_cast<ssao_rotations_texture*>(g_ssao_rotations)->noise;
+	u.ssaoScale = g_tar_config->m_ao_scale;
+	u.mssascale = g_msaa_mul;
+	u.projection = projm;
+	u.view = viewm;
+	u.color_objective = g_tar_config->m_color_objective;
+	u.color_buyzone = g_tar_config->m_color_buyzone;
+	u.color_cover = g_tar_config->m_color_cover;
+	u.color_cover2 = g_tar_config->m_color_cover2;
+	u.color_ao = g_tar_config->m_color_ao;
+	u.blend_objective_stripes = g_tar_config->m_outline_stripes_enable ? 0.0f : 1.0f;
+	u.blend_ao = g_tar_config->m_ao_enable ? 1.0f : 0.0f;
+	return u;
+}
+
+/* Without a window or GPU: every pass of the GL path runs on the CPU, geometry on the software renderer and the
+   screen space passes on the software compositor */
+int render_headless(vfilesys* filesys) {
+	int width = g_renderWidth * g_msaa_mul;
+	int height = g_renderHeight * g_msaa_mul;
+
+	g_texture_modulate = new Texture("textures/modulate.png");
+	g_ssao_samples = get_ssao_samples(TAR_AO_SAMPLES);
+	g_ssao_rotations = new ssao_rotations_texture();
+
+	// Layers seen through the same view share one geometry pass, as many as fit in the budget at a time
+	size_t count = g_tar_config->layers.size();
+	size_t slice_bytes = (size_t)width * height * (2 * 24 + 3 * 5);
+	size_t slices = std::min(count, std::max<size_t>(1, std::min<size_t>(32, headless_layer_budget / slice_bytes)));
+
+	render::soft_context ctx;
+	std::vector<render::soft_gbuffer> gbuffer(slices, render::soft_gbuffer(width, height));
+	std::vector<render::soft_gbuffer> gbuffer_clean(slices, render::soft_gbuffer(width, height));
+	std::vector<render::soft_mask> playspace(slices, render::soft_mask(width, height));
+	std::vector<render::soft_mask> objectives(slices, render::soft_mask(width, height));
+	std::vector<render::soft_mask> buyzone(slices, render::soft_mask(width, height));
+	g_render = &ctx;
+
+	std::vector<render::soft_image> layers;
+	for (size_t first = 0; first < count;) {
+		glm::mat4 projm, viewm;
+		layer_view(g_tar_config->layers[first], &projm, &viewm);
+
+		std::vector<glm::vec2> ranges = { glm::vec2(g_tar_config->layers[first].layer_min, g_tar_config->layers[first].layer_max) };
+		while (ranges.size() < slices && first + ranges.size() < count) {
+			tar_config_layer& layer = g_tar_config->layers[first + ranges.size()];
+			glm::mat4 layer_projm, layer_viewm;
+			layer_view(layer, &layer_projm, &layer_viewm);
+			if (layer_projm != projm || layer_viewm != viewm) break;
+
+			ranges.push_back(glm::vec2(layer.layer_min, layer.layer_max));
+		}
+		size_t n = ranges.size();
+
+		auto slices_of = [n](auto& targets) {
+			std::vector<render::soft_target*> out;
+			for (size_t i = 0; i < n; i++) out.push_back(&targets[i]);
+			return out;
+		};
+		render::soft_layered l_gbuffer(slices_of(gbuffer)), l_gbuffer_clean(slices_of(gbuffer_clean));
+		render::soft_layered l_playspace(slices_of(playspace)), l_objectives(slices_of(objectives)), l_buyzone(slices_of(buyzone));
+
+		perf::timer t;
+		g_vmf_file->SetLayers(ranges);
+		g_targets = { &l_gbuffer, &l_gbuffer_clean, &l_playspace, &l_objectives, &l_buyzone };
+		render_geometry(&ctx, g_targets, projm, viewm);
+		ctx.finish();
+		std::cout << "Software geometry, layers " << first << "-" << first + n - 1 << ": " << t.ms() << "ms (" << width << "x" << height << ", " << threadpool::global()->size() << " threads)\n";
+
+		for (size_t i = 0; i < n; i++) {
+			int c = (int)layers.size();
+
+			t.reset();
+			render::composite_uniforms u = composite_uniforms(projm, viewm);
+			u.gbuffer = &gbuffer[i];
+			u.gbuffer_clean = &gbuffer_clean[i];
+			u.umask_playspace = &playspace[i];
+			u.umask_objectives = &objectives[i];
+			u.umask_buyzone = &buyzone[i];
+
+			layers.push_back(render::soft_image(g_renderWidth, g_renderHeight));
+			render::soft_composite(u, layers.back());
+			std::cout << "Software layer " << c << ": composite " << t.ms() << "ms\n";
+
+			if (g_Masks) {
+				std::string prefix = "resource/overviews/" + g_mapfile_name + ".resources/layer" + std::to_string(c) + "_";
+				write_mask_png(playspace[i], filesys->create_output_filepath(prefix + "playspace.png", true));
+				write_mask_png(objectives[i], filesys->create_output_filepath(prefix + "objectives.png", true));
+				write_mask_png(buyzone[i], filesys->create_output_filepath(prefix + "buyzones.png", true));
+			}
+		}
+
+		first += n;
+	}
+
+	if (ctx.dropped()) std::cout << "Software renderer dropped " << ctx.dropped() << " triangles outside the guard band\n";
+
+	// Same passes as the multilayer loop in app()
+	render::soft_image generic(width, height), generic1(width, height), radar(g_renderWidth, g_renderHeight);
+	bool reference_ok = true;
+	for (size_t i = 0; i < layers.size(); i++) {
+		perf::timer t;
+		generic.clear();
+		for (size_t x = 0; x < layers.size(); x++) {
+			size_t l = layers.size() - x - 1;
+			if (l != i) render::soft_blend_layer(layers[l], false, generic);
+		}
+		render::soft_blend_layer(layers[i], true, generic);
+
+		generic1.clear();
+		render::soft_final_stage(generic, g_tar_config->m_texture_background, g_tar_config->m_outline_enable ? 1.0f : 0.0f,
+			g_tar_config->m_color_outline, g_tar_config->m_outline_width * g_msaa_mul, generic1);
+
+		if (g_tar_config->m_sampling_mode == sampling_mode::FXAA) render::soft_fxaa(generic1, radar);
+		else if (g_msaa_mul > 1) render::soft_resolve(generic1, radar);
+		else radar = generic1;
+
+		std::cout << "Software radar " << i << ": " << t.ms() << "ms\n";
+
+		write_radar_images(filesys, (int)i, radar.rgba);
+		if (!check_reference((int)i, radar.rgba)) reference_ok = false;
+	}
+
+	if (g_tar_config->m_write_txt) write_radar_txt(filesys);
+
+	g_render = NULL;
+	return reference_ok ? 0 : 1;
+}
+
+/* Radar image of one layer to the formats the config asks for. rgba is bottom row first */
+void write_radar_images(vfilesys* filesys, int layer, const std::vector<uint8_t>& rgba) {
+	std::string name = layer == 0 ? "_radar" : "_layer" + std::to_string(layer) + "_radar";
+
+	if (g_tar_config->m_write_dds)
+		write_dds(g_renderWidth, g_renderHeight, &rgba[0], filesys->create_output_filepath("resource/overviews/" + g_mapfile_name + name + ".dds", true).c_str(), g_tar_config->m_dds_img_mode);
+
+	if (g_tar_config->m_write_png)
+		write_png(g_renderWidth, g_renderHeight, &rgba[0], filesys->create_output_filepath("resource/overviews/" + g_mapfile_name + name + ".png", true).c_str());
+}
+
+/* --reference: the first layer's radar against a png written earlier, by either renderer */
+bool check_reference(int layer, const std::vector<uint8_t>& rgba) {
+	if (g_reference.empty() || layer != 0) return true;
+	return bench::compare_reference(rgba, g_renderWidth, g_renderHeight, g_reference);
+}
+
+/* Geometry passes of the first layer on both renderers at 1024 and 4096, timed and compared pixel for pixel */
+int bench_raster() {
+	glm::mat4 projm, viewm;
+	layer_view(g_tar_config->layers[0], &projm, &viewm);
+
+	render::gl_context gl(g_shader_gBuffer, g_shader_iBuffer);
+	render::soft_context soft;
+
+	std::cout << "   size        GL       CPU      info  position    normal      mask\n";
+	bool all_ok = true;
+	for (int size : { 1024, 4096 }) {
+		GBuffer gl_gbuffer(size, size), gl_gbuffer_clean(size, size);
+		MBuffer gl_playspace(size, size), gl_objectives(size, size), gl_buyzone(size, size);
+		render::gl_target t0(&gl_gbuffer, size, size), t1(&gl_gbuffer_clean, size, size);
+		render::gl_target t2(&gl_playspace, size, size), t3(&gl_objectives, size, size), t4(&gl_buyzone, size, size);
+		radar_targets gl_targets = { &t0, &t1, &t2, &t3, &t4 };
+
+		render::soft_gbuffer soft_gbuffer(size, size), soft_gbuffer_clean(size, size);
+		render::soft_mask soft_playspace(size, size), soft_objectives(size, size), soft_buyzone(size, size);
+		radar_targets soft_targets = { &soft_gbuffer, &soft_gbuffer_clean, &soft_playspace, &soft_objectives, &soft_buyzone };
+
+		// Warm up both, then time a second run
+		render_geometry(&gl, gl_targets, projm, viewm); gl.finish();
+		perf::timer t;
+		render_geometry(&gl, gl_targets, projm, viewm); gl.finish();
+		double gl_ms = t.ms_precise();
+
+		render_geometry(&soft, soft_targets, projm, viewm); soft.finish();
+		t.reset();
+		render_geometry(&soft, soft_targets, projm, viewm); soft.finish();
+		double soft_ms = t.ms_precise();
+
+		bench::raster_diff diff;
+		bench::compare_gbuffer(&gl_gbuffer, soft_gbuffer, diff, false);
+		bench::compare_gbuffer(&gl_gbuffer_clean, soft_gbuffer_clean, diff);
+		bench::compare_mask(&gl_playspace, soft_playspace, diff);
+		bench::compare_mask(&gl_objectives, soft_objectives, diff);
+		bench::compare_mask(&gl_buyzone, soft_buyzone, diff);
+
+		bench::print_raster_row(size, gl_ms, soft_ms, diff);
+
+		// Edge pixels may go either way, anything more than that is a bug
+		double pixels = (double)size * size;
+		if (diff.info > pixels * 0.01 || diff.mask > pixels * 0.03) all_ok = false;
+	}
+
+	int status = bench::verdict("Renderers", all_ok);
+	glfwTerminate();
+	return status;
+}
+
+void write_radar_txt(vfilesys* filesys) {
+	std::cout << "Generating radar .TXT... ";
+
+	kv::DataBlock node_radar = kv::DataBlock();
+	node_radar.name = "\"" + g_mapfile_name + "\"";
+	node_radar.Values.insert({ "material", "overviews/" + g_mapfile_name });
+
+	node_radar.Values.insert({ "pos_x", std::to_string(g_tar_config->m_view_origin.x) });
+	node_radar.Values.insert({ "pos_y", std::to_string(g_tar_config->m_view_origin.y) });
+	node_radar.Values.insert({ "scale", std::to_string(g_tar_config->m_render_ortho_scale / g_renderWidth) });
+
+	if (g_tar_config->layers.size() > 1) {
+		kv::DataBlock node_vsections = kv::DataBlock();
+		node_vsections.name = "\"verticalsections\"";
+
+		int ln = 0;
+		for (auto && layer : g_tar_config->layers) {
+			kv::DataBlock node_layer = kv::DataBlock();
+			if (ln == 0) {
+				node_layer.name = "\"default\""; ln++;
+			}
+			else node_layer.name = "\"layer" + std::to_string(ln++) + "\"";
+
+			node_layer.Values.insert({ "AltitudeMin", std::to_string(layer.layer_max) });
+			node_layer.Values.insert({ "AltitudeMax", std::to_string(layer.layer_min) });
+
+			node_vsections.SubBlocks.push_back(node_layer);
+		}
+
+		node_radar.SubBlocks.push_back(node_vsections);
+	}
+
+	// Try resolve spawn positions
+	glm::vec3* loc_spawnCT = g_vmf_file->calculateSpawnAVG_PMIN("info_player_counterterrorist");
+	glm::vec3* loc_spawnT = g_vmf_file->calculateSpawnAVG_PMIN("info_player_terrorist");
+
+	if (loc_spawnCT != NULL) {
+		node_radar.Values.insert({ "CTSpawn_x", std::to_string(util::roundf(remap(loc_spawnCT->x, g_tar_config->m_view_origin.x, g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
+		node_radar.Values.insert({ "CTSpawn_y", std::to_string(util::roundf(remap(loc_spawnCT->z, g_tar_config->m_view_origin.y, g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
+	}
+	if (loc_spawnT != NULL) {
+		node_radar.Values.insert({ "TSpawn_x", std::to_string(util::roundf(remap(loc_spawnT->x, g_tar_config->m_view_origin.x, g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
+		node_radar.Values.insert({ "TSpawn_y", std::to_string(util::roundf(remap(loc_spawnT->z, g_tar_config->m_view_origin.y, g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
+	}
+
+	int hostn = 1;
+	for (auto && hostage : g_vmf_file->get_entities_by_classname("info_hostage_spawn")) {
+		node_radar.Values.insert({ "Hostage" + std::to_string(hostn) + "_x", std::to_string(util::roundf(remap(hostage->m_origin.x, g_tar_config->m_view_origin.x, g_tar_config->m_view_origin.x + g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
+		node_radar.Values.insert({ "Hostage" + std::to_string(hostn++) + "_y", std::to_string(util::roundf(remap(hostage->m_origin.z, g_tar_config->m_view_origin.y, g_tar_config->m_view_origin.y - g_tar_config->m_render_ortho_scale, 0.0f, 1.0f), 0.01f)) });
+	}
+
+	std::ofstream out(filesys->create_output_filepath("resource/overviews/" + g_mapfile_name + ".txt", true).c_str());
+	out << "// TAVR - AUTO RADAR. v 2.5.0a\n";
+	node_radar.Serialize(out);
+	out.close();
+}
+
+
 int main(int argc, const char** argv) {
 	try {
 		return app(argc, argv);
@@ -644,26 +1084,17 @@ int main(int argc, const char** argv) {
 }
 
 
-void render_to_png(int x, int y, const char* filepath){
-	void* data = malloc(4 * x * y);
-
-	glReadPixels(0, 0, x, y, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
+void write_png(int x, int y, const uint8_t* data, const char* filepath){
 	stbi_flip_vertically_on_write(true);
 	stbi_write_png(filepath, x, y, 4, data, x * 4);
-
-	free(data);
 }
 
-void save_to_dds(int x, int y, const char* filepath, IMG imgmode)
+void write_dds(int x, int y, const uint8_t* data, const char* filepath, IMG imgmode)
 {
-	void* data = malloc(6 * x * y);
-
-	glReadPixels(0, 0, x, y, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-	dds_write((uint8_t*)data, filepath, x, y, imgmode);
+	std::vector<uint8_t> buffer(6 * x * y); // dds_write reads past the image in RGB888 mode
+	memcpy(&buffer[0], data, 4 * x * y);
 
-	free(data);
+	dds_write(&buffer[0], filepath, x, y, imgmode);
 }
 
 
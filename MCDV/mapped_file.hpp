@@ -0,0 +1,129 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+
+// Windows.h defines these and breaks std::min / glm::max
+#undef min
+#undef max
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* Read only view of a whole file. The file is memory mapped where possible, otherwise it is read
+   into a buffer in one go. Either way the contents are one contiguous block that lives as long as this does. */
+class mapped_file {
+	const char* m_data = NULL;
+	size_t m_size = 0;
+	bool m_good = false;
+	bool m_mapped = false;
+
+	std::vector<char> m_buffer; // Fallback storage
+
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = NULL;
+#endif
+
+	bool map(const std::string& path) {
+#ifdef _WIN32
+		this->m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (this->m_file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(this->m_file, &size) || size.QuadPart == 0) return false; // Empty files can't be mapped
+
+		this->m_mapping = CreateFileMappingA(this->m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->m_mapping == NULL) return false;
+
+		const void* view = MapViewOfFile(this->m_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == NULL) return false;
+
+		this->m_data = static_cast<const char*>(view);
+		this->m_size = static_cast<size_t>(size.QuadPart);
+		return true;
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return false; }
+
+		void* view = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd); // The mapping keeps its own reference
+		if (view == MAP_FAILED) return false;
+
+		madvise(view, st.st_size, MADV_SEQUENTIAL);
+		this->m_data = static_cast<const char*>(view);
+		this->m_size = static_cast<size_t>(st.st_size);
+		return true;
+#endif
+	}
+
+	void unmap() {
+#ifdef _WIN32
+		if (this->m_mapped) UnmapViewOfFile(this->m_data);
+		if (this->m_mapping != NULL) CloseHandle(this->m_mapping);
+		if (this->m_file != INVALID_HANDLE_VALUE) CloseHandle(this->m_file);
+		this->m_mapping = NULL;
+		this->m_file = INVALID_HANDLE_VALUE;
+#else
+		if (this->m_mapped) munmap(const_cast<char*>(this->m_data), this->m_size);
+#endif
+		this->m_mapped = false;
+	}
+
+	bool read(const std::string& path) {
+		std::ifstream ifs(path, std::ios::in | std::ios::binary | std::ios::ate);
+		if (!ifs) return false;
+
+		std::streamoff size = ifs.tellg();
+		if (size < 0) return false;
+
+		this->m_buffer.resize(static_cast<size_t>(size));
+		ifs.seekg(0);
+		if (size > 0 && !ifs.read(this->m_buffer.data(), size)) return false;
+
+		this->m_data = this->m_buffer.data();
+		this->m_size = this->m_buffer.size();
+		return true;
+	}
+
+public:
+	mapped_file(const std::string& path) {
+		if (this->map(path)) {
+			this->m_mapped = true;
+			this->m_good = true;
+			return;
+		}
+
+		this->unmap();
+		this->m_data = NULL;
+		this->m_size = 0;
+		this->m_good = this->read(path);
+	}
+
+	~mapped_file() {
+		this->unmap();
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	/* False if the file could not be opened */
+	bool good() const { return this->m_good; }
+
+	/* True if the view is a memory mapping rather than a buffered copy */
+	bool is_mapped() const { return this->m_mapped; }
+
+	const char* data() const { return this->m_data; }
+	size_t size() const { return this->m_size; }
+	std::string_view view() const { return std::string_view(this->m_data, this->m_size); }
+};
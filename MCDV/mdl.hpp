@@ -6,6 +6,7 @@
 
 #include "util.h"
 #include "vector.h"
+#include "span_reader.hpp"
 
 namespace mdl
 {
@@ -155,32 +156,30 @@ class mdl_model : public verboseControl
 public:
 	mdl::header header;
 
-	mdl_model(std::string mdl, bool verbose)
+	mdl_model(span_reader* reader, bool verbose = false)
 	{
 		this->use_verbose = verbose;
-		std::ifstream reader(mdl, std::ios::in | std::ios::binary);
 
-		if (!reader) {
+		reader->read((char*)&this->header, sizeof(this->header));
+		if (reader->fail()) {
 			throw std::exception("MDL::LOAD FAILED"); return;
 		}
 
-
-		reader.read((char*)&this->header, sizeof(this->header));
 		this->debug("Version", this->header.version);
 
 		//Read texture data
-		reader.seekg(this->header.cdtextureindex);
+		reader->seekg(this->header.cdtextureindex);
 
 		mdl::textureHeader test;
-		reader.read((char*)&test, sizeof(test));
+		reader->read((char*)&test, sizeof(test));
 
-		reader.seekg(test.name_offset - sizeof(mdl::textureHeader), std::ios::cur);
+		reader->seekg(test.name_offset - sizeof(mdl::textureHeader), std::ios::cur);
 
 		std::string name = "";
 		while (true)
 		{
 			char c;
-			reader.read(&c, 1);
+			reader->read(&c, 1);
 
 			if (c == (char)0)
 				break;
@@ -189,9 +188,6 @@ public:
 		}
 
 		this->debug(name);
-
-
-		reader.close();
 	}
 
 	virtual ~mdl_model() {}
@@ -0,0 +1,276 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include <glm\glm.hpp>
+
+#include "mapped_file.hpp"
+#include "Mesh.hpp"
+#include "../AutoRadar_installer/FileSystemHelper.h"
+
+namespace models
+{
+	const uint32_t max_lods = 8;
+
+	/* One level of detail a model has, whether or not it is the one that was loaded */
+	struct lod_info {
+		float switch_point = 0.0f;	// From the .vtx
+		float error = 0.0f;			// Furthest the LOD's surface gets from LOD 0, in model units (see lod_error)
+		uint32_t triangles = 0;
+	};
+
+	/* Model geometry ready to upload, with its bounds (in the same space as the vertices) */
+	struct geometry {
+		IndexedMesh mesh;
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+
+		uint32_t lod = 0;				// Which one mesh holds
+		std::vector<lod_info> lods;		// Every LOD of the model, at most max_lods
+
+		void compute_bounds() {
+			const std::vector<float>& v = this->mesh.vertices;
+			if (v.empty()) return;
+
+			this->min = this->max = glm::vec3(v[0], v[1], v[2]);
+			for (size_t i = 0; i + 5 < v.size(); i += 6) {
+				glm::vec3 p(v[i], v[i + 1], v[i + 2]);
+				this->min = glm::min(this->min, p);
+				this->max = glm::max(this->max, p);
+			}
+		}
+	};
+
+	/* Which files a cached model was built from. Only models found in the vpk get one, since the entry CRCs are what
+	   tells a stale copy apart */
+	struct cache_key {
+		std::string name;	// Normalized model path
+		uint32_t lod = 0;
+		uint32_t crc_vtx = 0;
+		uint32_t crc_vvd = 0;
+	};
+
+	/* Processed model geometry from previous runs, in one append only pack file (models.pack in the cache folder).
+	   The pack is memory mapped while looking models up. New models are appended in one go by flush, and a record
+	   for a key that is already in the pack replaces the older one */
+	class cache {
+		static const uint32_t pack_magic = 0x434c444d; // MDLC
+		static const uint32_t pack_version = 2;
+		static const uint32_t record_magic = 0x3143524d; // MRC1
+
+		struct record_header {
+			uint32_t magic;
+			uint32_t size;	// Bytes after this header
+			uint32_t lod;
+			uint32_t crc_vtx;
+			uint32_t crc_vvd;
+			uint32_t name_length;
+			uint32_t vertex_count;
+			uint32_t index_count;
+			float min[3];
+			float max[3];
+			uint32_t lod_count;
+			lod_info lods[max_lods];
+		};
+
+		struct record {
+			const record_header* header;
+			const char* name;
+			const float* vertices;
+			const uint32_t* indices;
+		};
+
+		std::string m_path;
+		std::unique_ptr<mapped_file> m_pack;
+		std::unordered_map<std::string, record> m_records; // name + lod -> newest record
+		std::unordered_map<std::string, record> m_newest; // name -> newest record of any LOD, for its LOD table
+		size_t m_valid_bytes = 0; // Pack header and complete records, anything after is dropped by the next flush
+
+		std::vector<std::pair<cache_key, const geometry*>> m_pending;
+
+		static std::string lookup_name(const std::string& name, uint32_t lod) {
+			return name + "#" + std::to_string(lod);
+		}
+
+		static size_t pad4(size_t n) { return (n + 3) & ~(size_t)3; }
+
+		static bool indices_in_range(const record& r) {
+			for (uint32_t i = 0; i < r.header->index_count; i++)
+				if (r.indices[i] >= r.header->vertex_count) return false;
+			return true;
+		}
+
+		/* Index every complete record. Anything after the first broken one (an interrupted write, or an index past the
+		   record's vertices) is ignored */
+		void read_pack() {
+			const char* p = this->m_pack->data();
+			const char* end = p + this->m_pack->size();
+
+			this->m_valid_bytes = 0;
+
+			uint32_t head[2];
+			if (end - p < (ptrdiff_t)sizeof(head)) return;
+			memcpy(head, p, sizeof(head));
+			if (head[0] != pack_magic || head[1] != pack_version) return;
+			p += sizeof(head);
+			this->m_valid_bytes = sizeof(head);
+
+			while (end - p >= (ptrdiff_t)sizeof(record_header)) {
+				record r;
+				r.header = (const record_header*)p;
+				if (r.header->magic != record_magic || (size_t)(end - p) - sizeof(record_header) < r.header->size) break;
+
+				size_t name_bytes = pad4(r.header->name_length);
+				size_t needed = name_bytes + (size_t)r.header->vertex_count * 6 * sizeof(float) + (size_t)r.header->index_count * sizeof(uint32_t);
+				if (needed > r.header->size) break;
+
+				r.name = p + sizeof(record_header);
+				r.vertices = (const float*)(r.name + name_bytes);
+				r.indices = (const uint32_t*)(r.vertices + (size_t)r.header->vertex_count * 6);
+				if (!indices_in_range(r)) break;
+
+				std::string name(r.name, r.header->name_length);
+				this->m_records[lookup_name(name, r.header->lod)] = r;
+				this->m_newest[name] = r;
+				p += sizeof(record_header) + r.header->size;
+				this->m_valid_bytes = p - this->m_pack->data();
+			}
+		}
+
+		static void copy_lods(const record_header& h, std::vector<lod_info>& out) {
+			out.assign(h.lods, h.lods + std::min(h.lod_count, max_lods));
+		}
+
+		void open() {
+			this->m_records.clear();
+			this->m_newest.clear();
+			this->m_pack.reset();
+			this->m_valid_bytes = 0;
+
+			if (fs::checkFileExist(this->m_path.c_str())) {
+				this->m_pack.reset(new mapped_file(this->m_path));
+				if (this->m_pack->good()) this->read_pack();
+			}
+		}
+
+	public:
+		size_t hits = 0;
+		size_t misses = 0;
+
+		cache(const std::string& folder) {
+			fs::mkdr(folder.c_str());
+			this->m_path = folder + "/models.pack";
+			this->open();
+		}
+
+		cache(const cache&) = delete;
+		cache& operator=(const cache&) = delete;
+
+		size_t size() const { return this->m_records.size(); }
+
+		/* The LOD table of a model, from whichever of its LODs was cached last. False if none were, for these files. Lets
+		   the caller pick a LOD before asking for it */
+		bool find_lods(const cache_key& key, std::vector<lod_info>& out) const {
+			auto it = this->m_newest.find(key.name);
+			if (it == this->m_newest.end() || it->second.header->crc_vtx != key.crc_vtx || it->second.header->crc_vvd != key.crc_vvd) return false;
+
+			copy_lods(*it->second.header, out);
+			return true;
+		}
+
+		/* Copy a cached model out of the pack. False if there is none for these exact files */
+		bool find(const cache_key& key, geometry& out) {
+			auto it = this->m_records.find(lookup_name(key.name, key.lod));
+			if (it == this->m_records.end() || it->second.header->crc_vtx != key.crc_vtx || it->second.header->crc_vvd != key.crc_vvd) {
+				this->misses++;
+				return false;
+			}
+
+			const record& r = it->second;
+			out.mesh.vertices.assign(r.vertices, r.vertices + (size_t)r.header->vertex_count * 6);
+			out.mesh.indices.assign(r.indices, r.indices + r.header->index_count);
+			out.min = glm::vec3(r.header->min[0], r.header->min[1], r.header->min[2]);
+			out.max = glm::vec3(r.header->max[0], r.header->max[1], r.header->max[2]);
+			out.lod = r.header->lod;
+			copy_lods(*r.header, out.lods);
+
+			this->hits++;
+			return true;
+		}
+
+		/* Queue a model to be written by flush. data must stay alive until then */
+		void add(const cache_key& key, const geometry* data) {
+			this->m_pending.push_back({ key, data });
+		}
+
+		/* Append everything queued since the last flush, then map the pack again. It has to be unmapped while it is
+		   written to, which is fine since find hands out copies */
+		void flush() {
+			if (this->m_pending.empty()) return;
+
+			// A pack with a broken tail is written again from its good part, so new records are not stuck behind it
+			std::vector<char> keep;
+			bool rewrite = this->m_valid_bytes == 0 || this->m_valid_bytes != this->m_pack->size();
+			if (rewrite && this->m_valid_bytes != 0)
+				keep.assign(this->m_pack->data(), this->m_pack->data() + this->m_valid_bytes);
+
+			this->m_records.clear();
+			this->m_newest.clear();
+			this->m_pack.reset();
+
+			std::ofstream f(this->m_path, std::ios::out | std::ios::binary | (rewrite ? std::ios::trunc : std::ios::app));
+			if (!f) {
+				this->m_pending.clear();
+				this->open();
+				return;
+			}
+
+			if (!keep.empty()) f.write(keep.data(), keep.size());
+			else if (rewrite) {
+				uint32_t head[2] = { pack_magic, pack_version };
+				f.write((const char*)head, sizeof(head));
+			}
+
+			for (auto && p : this->m_pending) {
+				const cache_key& key = p.first;
+				const geometry& g = *p.second;
+
+				record_header h;
+				h.magic = record_magic;
+				h.lod = key.lod;
+				h.crc_vtx = key.crc_vtx;
+				h.crc_vvd = key.crc_vvd;
+				h.name_length = (uint32_t)key.name.size();
+				h.vertex_count = (uint32_t)(g.mesh.vertices.size() / 6);
+				h.index_count = (uint32_t)g.mesh.indices.size();
+				for (int i = 0; i < 3; i++) {
+					h.min[i] = g.min[i];
+					h.max[i] = g.max[i];
+				}
+				h.lod_count = (uint32_t)std::min(g.lods.size(), (size_t)max_lods);
+				for (uint32_t i = 0; i < max_lods; i++) h.lods[i] = i < h.lod_count ? g.lods[i] : lod_info();
+
+				size_t name_bytes = pad4(key.name.size());
+				h.size = (uint32_t)(name_bytes + (size_t)h.vertex_count * 6 * sizeof(float) + g.mesh.indices.size() * sizeof(uint32_t));
+
+				std::string name = key.name;
+				name.resize(name_bytes, '\0');
+
+				f.write((const char*)&h, sizeof(h));
+				f.write(name.data(), name.size());
+				f.write((const char*)g.mesh.vertices.data(), (size_t)h.vertex_count * 6 * sizeof(float));
+				f.write((const char*)g.mesh.indices.data(), g.mesh.indices.size() * sizeof(uint32_t));
+			}
+
+			f.close();
+			this->m_pending.clear();
+			this->open();
+		}
+	};
+}
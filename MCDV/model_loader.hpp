@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <exception>
+
+#include "vfilesys.hpp"
+#include "vtx.hpp"
+#include "vvd.hpp"
+#include "threadpool.hpp"
+#include "perf.hpp"
+
+/* Loads the vtx/vvd pair of many models at once. Every model is looked up, parsed and handed to a build function on the
+   shared thread pool, so whatever build makes should be plain CPU data; GL uploads happen afterwards on the caller */
+namespace models
+{
+	template<typename T>
+	struct load {
+		std::string name;	// As written in the map, models/x.mdl
+		T data;				// Filled by build
+		bool ok = false;
+		std::string error;	// Why ok is false
+		double ms = 0.0;	// Time spent on this model by its worker
+	};
+
+	struct load_stats {
+		size_t loaded = 0;
+		size_t failed = 0;
+		double ms = 0.0;		// Wall time for the whole set
+		double model_ms = 0.0;	// Per model times added up
+		unsigned threads = 1;
+	};
+
+	/* Load every model in names (which should already be unique). build runs on a worker thread with both files parsed,
+	   and they are freed right after, so it can take the vvd vertices instead of copying them */
+	template<typename T>
+	std::vector<load<T>> load_all(vfilesys* filesystem, const std::vector<std::string>& names,
+		const std::function<void(const std::string& name, const vtx_mesh& vtx, vvd_data& vvd, T& out)>& build, load_stats* stats = NULL) {
+		std::vector<load<T>> loads(names.size());
+
+		perf::timer total;
+		threadpool* pool = threadpool::global();
+		pool->parallel_for(names.size(), [&](size_t i) {
+			load<T>& l = loads[i];
+			l.name = names[i];
+
+			perf::timer t;
+			try {
+				std::string baseName = l.name.substr(0, l.name.find('.'));
+
+				std::unique_ptr<vtx_mesh> vtx(filesystem->get_resource_handle<vtx_mesh>(baseName + ".dx90.vtx"));
+				std::unique_ptr<vvd_data> vvd(filesystem->get_resource_handle<vvd_data>(baseName + ".vvd"));
+
+				if (vtx == nullptr || vvd == nullptr) l.error = vtx == nullptr ? "no .dx90.vtx" : "no .vvd";
+				else if (!vtx->read_success) l.error = "broken .dx90.vtx";
+				else if (!vvd->read_success) l.error = "broken .vvd";
+				else {
+					build(l.name, *vtx, *vvd, l.data);
+					l.ok = true;
+				}
+			}
+			catch (std::exception& e) {
+				l.error = e.what();
+			}
+			l.ms = t.ms_precise();
+		});
+
+		if (stats != NULL) {
+			*stats = load_stats();
+			stats->ms = total.ms_precise();
+			stats->threads = pool->size();
+			for (auto && l : loads) {
+				if (l.ok) stats->loaded++;
+				else stats->failed++;
+				stats->model_ms += l.ms;
+			}
+		}
+
+		return loads;
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#include <glm\glm.hpp>
+
+#include "vtx.hpp"
+#include "vvd.hpp"
+#include "model_cache.hpp"
+
+/* Picking a level of detail for props. The radar is one orthographic view from above, so a model only needs as much
+   detail as shows up at the size of a pixel there. Each LOD gets a measured error against LOD 0 instead of trusting
+   its switch point, which is tuned for the game's perspective camera */
+namespace models
+{
+	inline glm::vec3 vertex_position(const std::vector<float>& vertices, uint32_t i) {
+		return glm::vec3(vertices[i * 6 + 0], vertices[i * 6 + 1], vertices[i * 6 + 2]);
+	}
+
+	/* Closest point to p on the triangle abc (Ericson, Real-Time Collision Detection 5.1.5) */
+	inline glm::vec3 closest_on_triangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+		glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) return b;
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) return c;
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		float denom = va + vb + vc;
+		if (denom == 0.0f) return a; // Degenerate, all three points in a line
+		return a + ab * (vb / denom) + ac * (vc / denom);
+	}
+
+	/* How far the surface of a LOD gets from the full model: the largest distance from a vertex of full to the closest
+	   triangle of lod. Both index the same vertices. The triangles are bucketed in a uniform grid and searched ring by
+	   ring outwards, stopping once no further ring could hold anything closer */
+	inline float lod_error(const std::vector<float>& vertices, const std::vector<uint32_t>& full, const std::vector<uint32_t>& lod) {
+		size_t triangles = lod.size() / 3;
+		if (triangles == 0) return full.empty() ? 0.0f : std::numeric_limits<float>::max();
+
+		glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+		for (auto && i : lod) {
+			glm::vec3 p = vertex_position(vertices, i);
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+
+		// Around one triangle per cell, and no more than 64 cells a side
+		glm::vec3 extent = hi - lo;
+		float longest = glm::max(extent.x, glm::max(extent.y, extent.z));
+		float cell = glm::max(longest / glm::max(1.0f, std::cbrt((float)triangles)), longest / 63.0f);
+		if (!(cell > 0.0f)) cell = 1.0f;
+
+		glm::ivec3 dims = glm::clamp(glm::ivec3(extent / cell) + 1, 1, 64);
+		auto cell_of = [&](glm::vec3 p) { return glm::clamp(glm::ivec3(glm::floor((p - lo) / cell)), glm::ivec3(0), dims - 1); };
+		auto cell_index = [&](glm::ivec3 c) { return (size_t)((c.z * dims.y + c.y) * dims.x + c.x); };
+
+		// Triangles per cell, every cell a triangle's bounds touch
+		std::vector<uint32_t> start((size_t)dims.x * dims.y * dims.z + 1, 0);
+		std::vector<uint32_t> bucketed;
+		for (int pass = 0; pass < 2; pass++) {
+			if (pass == 1) {
+				for (size_t i = 1; i < start.size(); i++) start[i] += start[i - 1];
+				bucketed.resize(start.back());
+			}
+
+			for (uint32_t t = 0; t < triangles; t++) {
+				glm::vec3 a = vertex_position(vertices, lod[t * 3 + 0]);
+				glm::vec3 b = vertex_position(vertices, lod[t * 3 + 1]);
+				glm::vec3 c = vertex_position(vertices, lod[t * 3 + 2]);
+				glm::ivec3 c0 = cell_of(glm::min(a, glm::min(b, c)));
+				glm::ivec3 c1 = cell_of(glm::max(a, glm::max(b, c)));
+
+				for (int z = c0.z; z <= c1.z; z++)
+					for (int y = c0.y; y <= c1.y; y++)
+						for (int x = c0.x; x <= c1.x; x++) {
+							size_t i = cell_index(glm::ivec3(x, y, z));
+							if (pass == 0) start[i + 1]++;
+							else bucketed[--start[i + 1]] = t;
+						}
+			}
+		}
+		// The fill counted each cell's end back down to its start, which leaves start shifted one place
+		start.erase(start.begin());
+		start.push_back((uint32_t)bucketed.size());
+
+		int widest = glm::max(dims.x, glm::max(dims.y, dims.z));
+		std::vector<char> seen(vertices.size() / 6, 0);
+		float worst = 0.0f;
+
+		for (auto && v : full) {
+			if (seen[v]) continue;
+			seen[v] = 1;
+
+			glm::vec3 p = vertex_position(vertices, v);
+			glm::ivec3 home = cell_of(p);
+			float best = std::numeric_limits<float>::max(); // Squared
+
+			for (int r = 0; r <= widest; r++) {
+				glm::ivec3 c0 = glm::max(home - r, glm::ivec3(0));
+				glm::ivec3 c1 = glm::min(home + r, dims - 1);
+
+				for (int z = c0.z; z <= c1.z; z++)
+					for (int y = c0.y; y <= c1.y; y++)
+						for (int x = c0.x; x <= c1.x; x++) {
+							glm::ivec3 d = glm::abs(glm::ivec3(x, y, z) - home);
+							if (glm::max(d.x, glm::max(d.y, d.z)) != r) continue; // Inner rings are done already
+
+							size_t i = cell_index(glm::ivec3(x, y, z));
+							for (uint32_t k = start[i]; k < start[i + 1]; k++) {
+								uint32_t t = bucketed[k];
+								glm::vec3 q = closest_on_triangle(p, vertex_position(vertices, lod[t * 3 + 0]),
+									vertex_position(vertices, lod[t * 3 + 1]), vertex_position(vertices, lod[t * 3 + 2]));
+								glm::vec3 e = q - p;
+								best = glm::min(best, glm::dot(e, e));
+							}
+						}
+
+				// Ring r + 1 is at least r cells away. Stop as well once this vertex can not be the worst one
+				float reach = r * cell;
+				if (best <= reach * reach || best <= worst * worst) break;
+			}
+
+			worst = glm::max(worst, std::sqrt(best));
+		}
+
+		return worst;
+	}
+
+	/* The coarsest LOD whose error is under tolerance (model units). LOD 0 when tolerance is 0 */
+	inline uint32_t select_lod(const std::vector<lod_info>& lods, float tolerance) {
+		uint32_t selected = 0;
+		for (uint32_t i = 1; i < lods.size(); i++)
+			if (lods[i].error < tolerance) selected = i;
+		return selected;
+	}
+
+	/* Fill out with the LOD select_lod picks for tolerance, and the table of every LOD. The vvd has to be read at LOD 0,
+	   its vertices are moved into out. Coarser LODs only keep the vertices they use. Throws if LOD 0 indexes past the
+	   vvd; a broken coarser LOD is just never picked */
+	inline void build_geometry(const vtx_mesh& vtx, vvd_data& vvd, float tolerance, geometry& out) {
+		size_t count = vvd.vertex_count();
+		const std::vector<uint32_t>& full = vtx.lods[0].vertexSequence;
+		for (auto && index : full)
+			if (index >= count) throw std::exception("vtx index past the end of the .vvd");
+
+		size_t lod_count = std::min(std::min(vtx.lods.size(), (size_t)std::max(vvd.header.numLods, 1)), (size_t)max_lods);
+		std::vector<std::vector<uint32_t>> indices(lod_count);
+		out.lods.assign(lod_count, lod_info());
+
+		for (size_t lod = 0; lod < lod_count; lod++) {
+			out.lods[lod].switch_point = vtx.lods[lod].switchPoint;
+			if (lod == 0) {
+				out.lods[lod].triangles = (uint32_t)(full.size() / 3);
+				continue;
+			}
+
+			// Into LOD 0's vertices, which hold every LOD's
+			std::vector<uint32_t> remap = vvd.lod_remap((int)lod);
+			bool ok = true;
+			for (auto && index : vtx.lods[lod].vertexSequence) {
+				if (index >= remap.size()) {
+					ok = false;
+					break;
+				}
+				indices[lod].push_back(remap[index]);
+			}
+
+			out.lods[lod].triangles = (uint32_t)(indices[lod].size() / 3);
+			out.lods[lod].error = ok ? lod_error(vvd.vertices, full, indices[lod]) : std::numeric_limits<float>::max();
+		}
+
+		out.lod = select_lod(out.lods, tolerance);
+
+		// LOD 0 uses every vertex there is
+		IndexedMesh& mesh = out.mesh;
+		if (out.lod == 0) {
+			mesh.vertices = std::move(vvd.vertices);
+			mesh.indices.assign(full.begin(), full.end());
+		}
+		else {
+			std::vector<uint32_t> moved(count, UINT32_MAX);
+			for (auto && index : indices[out.lod]) {
+				if (moved[index] == UINT32_MAX) {
+					moved[index] = (uint32_t)(mesh.vertices.size() / 6);
+					mesh.vertices.insert(mesh.vertices.end(), vvd.vertices.begin() + index * 6, vvd.vertices.begin() + index * 6 + 6);
+				}
+				mesh.indices.push_back(moved[index]);
+			}
+		}
+
+		out.compute_bounds();
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <iomanip>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+
+// Windows.h defines these and breaks std::min / glm::max
+#undef min
+#undef max
+#else
+#include <sys/resource.h>
+#endif
+
+namespace perf
+{
+	/* Peak working set of this process, in bytes */
+	inline size_t peak_rss() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS pmc;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+			return pmc.PeakWorkingSetSize;
+#else
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+			return (size_t)usage.ru_maxrss * 1024; // kilobytes on linux
+#endif
+		return 0;
+	}
+
+	/* Current working set of this process, in bytes */
+	inline size_t current_rss() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS pmc;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+			return pmc.WorkingSetSize;
+#endif
+		return 0;
+	}
+
+	inline std::string format_mb(size_t bytes) {
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(1) << (bytes / (1024.0 * 1024.0)) << "MB";
+		return ss.str();
+	}
+
+	class timer {
+		std::chrono::high_resolution_clock::time_point m_start;
+	public:
+		timer() : m_start(std::chrono::high_resolution_clock::now()) {}
+
+		void reset() { this->m_start = std::chrono::high_resolution_clock::now(); }
+
+		long long ms() const {
+			return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - this->m_start).count();
+		}
+
+		double ms_precise() const {
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - this->m_start).count();
+		}
+	};
+}
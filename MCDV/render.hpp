@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm\glm.hpp>
+
+class Mesh;
+class MeshBatch;
+
+/* What the radar passes need from a renderer: bind a target, clear it, pick a program, set its uniforms and draw meshes.
+   gl_render.hpp does this with OpenGL, soft_render.hpp does it on the CPU with no window or GPU. */
+namespace render
+{
+	/* Set before any Mesh or Texture is made to keep everything on the CPU (no GL context exists) */
+	inline bool& headless() {
+		static bool enabled = false;
+		return enabled;
+	}
+
+	enum program {
+		PROGRAM_GBUFFER,	// gBuffer.vs + gBuffer.fs: position, normal, Info, origin
+		PROGRAM_MASK		// gBuffer.vs + iBuffer.fs: srcChr into an 8 bit mask
+	};
+
+	enum target_type {
+		TARGET_GBUFFER,
+		TARGET_MASK
+	};
+
+	/* One part of a MeshBatch and the layer slices it goes to */
+	struct batch_draw {
+		int part;
+		uint32_t layers;
+	};
+
+	/* One copy of a mesh in an instanced draw. The GL path uploads these as they are, model and origin are per instance
+	   vertex attributes */
+	struct instance {
+		glm::mat4 model;
+		glm::vec2 origin;
+		uint32_t layers;	// Slices it goes to, like set_layers
+	};
+
+	class target {
+	public:
+		target_type type;
+		int width;
+		int height;
+
+		target(target_type _type, int _width, int _height) : type(_type), width(_width), height(_height) {}
+		virtual ~target() {}
+	};
+
+	class context {
+	public:
+		virtual ~context() {}
+
+		/* Draws go to t from now on. NULL releases the current target */
+		virtual void bind(target* t) = 0;
+
+		/* Every plane of the bound target to value, depth to far */
+		virtual void clear(float value) = 0;
+		virtual void clear_depth() = 0;
+
+		virtual void set_culling(bool cull_back) = 0;
+
+		/* Uniforms belong to the program in use, like they do in GL */
+		virtual void use(program p) = 0;
+		virtual void set_matrix(const std::string& name, const glm::mat4& value) = 0;
+		virtual void set_unsigned(const std::string& name, unsigned int value) = 0;
+		virtual void set_vec2(const std::string& name, const glm::vec2& value) = 0;
+
+		/* Slices of a layered target the next draws go to, bit i for slice i. Only the software renderer has layered
+		   targets, everything else draws to the one target it has */
+		virtual void set_layers(uint32_t mask) {}
+
+		virtual void draw(Mesh* mesh) = 0;
+
+		/* Parts of a batch in the order given, as if each was drawn on its own with the origin the batch keeps for it.
+		   The model matrix has to be identity */
+		virtual void draw_batch(MeshBatch* batch, const std::vector<batch_draw>& draws) = 0;
+
+		/* The mesh once per instance, in order, as if the model matrix was multiplied by the instance's and origin and
+		   layers were set to its own before each */
+		virtual void draw_instances(Mesh* mesh, const std::vector<instance>& instances) = 0;
+
+		/* Blocks until everything drawn so far is in the targets */
+		virtual void finish() = 0;
+	};
+}
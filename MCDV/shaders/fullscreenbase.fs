@@ -10,9 +10,19 @@ layout (location = 1) out float hData;
 
 //                                        UNIFORMS
 // Vector Information _________________________________________________________________________
-//    ( A bunch of vectors that give you the location of different entities )
-uniform vec3 bounds_NWU;	// North-West-Upper coordinate of the playspace (worldspace)
-uniform vec3 bounds_SEL;	// South-East-Lower coordinate of the playspace (worldspace)
+//    ( Everything that stays the same for the whole run, uploaded once: composite_block in main2.cpp )
+layout (std140) uniform composite
+{
+	vec4 samples[256];		// SSAO kernel, xyz
+	vec4 bounds_NWU;		// North-West-Upper coordinate of the playspace (worldspace), xyz
+	vec4 bounds_SEL;		// South-East-Lower coordinate of the playspace (worldspace), xyz
+
+	vec4 color_objective;
+	vec4 color_buyzone;
+	vec4 color_cover;
+	vec4 color_cover2;
+	vec4 color_ao;
+};
 
 //                                     SAMPLER UNIFORMS
 // Image Inputs _______________________________________________________________________________
@@ -28,7 +38,10 @@ uniform usampler2D umask_playspace;
 uniform usampler2D umask_objectives;
 uniform usampler2D umask_buyzone;
 
-uniform vec3 samples[256];
+uniform int use_jfa;				// Outlines from the jump flooded seeds instead of the kernels
+uniform sampler2D jfa_objectives;
+uniform sampler2D jfa_buyzone;
+
 uniform sampler2D ssaoRotations;
 uniform float ssaoScale;
 uniform int mssascale;
@@ -37,12 +50,6 @@ uniform mat4 view;
 
 const vec2 noiseScale = vec2(1024.0/256.0, 1024.0/256.0);
 
-uniform vec4 color_objective;
-uniform vec4 color_buyzone;
-uniform vec4 color_cover;
-uniform vec4 color_cover2;
-uniform vec4 color_ao;
-
 uniform float blend_objective_stripes;
 uniform float blend_ao;
 
@@ -210,6 +217,22 @@ float _kernel_filter_outline(usampler2D sampler, usampler2D samplerMask, int sam
 	return float(max(min(sT, 1U) - (texture(sampler, TexCoords).r * texture(samplerMask, TexCoords).r), 0U));
 }
 
+// Distance in texels to the closest seed of a jump flood, -1 when there are none
+float seed_distance(sampler2D seeds)
+{
+	vec2 s = texture(seeds, TexCoords).xy;
+	if(s.x < 0) return -1;
+	return length(s - TexCoords * vec2(textureSize(seeds, 0)));
+}
+
+// _kernel_filter_outline from the distance to the mask: solid within sample_size - 1 texels, fading over the next
+float distance_outline(sampler2D seeds, usampler2D sampler, usampler2D samplerMask, int sample_size)
+{
+	float d = seed_distance(seeds);
+	if(d < 0) return 0;
+	return max(clamp(sample_size - d, 0, 1) - float(texture(sampler, TexCoords).r * texture(samplerMask, TexCoords).r), 0);
+}
+
 void main()
 {
 	//vec4 s_background = texture(tex_background, TexCoords);
@@ -295,7 +318,7 @@ void main()
 	float occlusion = 0.0;
 	for(int i = 0; i < 256; i++)
 	{
-		vec3 sample = TBN * samples[i];
+		vec3 sample = TBN * samples[i].xyz;
 		sample =
 		lerp
 		(
@@ -339,7 +362,7 @@ void main()
 		)
 		+ 
 		(
-		_kernel_filter_outline(umask_objectives, umask_playspace, 3 * mssascale) * 0.9
+		(use_jfa == 1? distance_outline(jfa_objectives, umask_objectives, umask_playspace, 3 * mssascale): _kernel_filter_outline(umask_objectives, umask_playspace, 3 * mssascale)) * 0.9
 		* ( 1 - float((s_info >> 7) & 0x1U)) * clamp(s_modulate_1_5.r + blend_objective_stripes, 0, 1)
 		)
 		+
@@ -359,7 +382,7 @@ void main()
 		)
 		+ 
 		(
-		_kernel_filter_outline(umask_buyzone, umask_playspace, 3 * mssascale) * 0.9
+		(use_jfa == 1? distance_outline(jfa_buyzone, umask_buyzone, umask_playspace, 3 * mssascale): _kernel_filter_outline(umask_buyzone, umask_playspace, 3 * mssascale)) * 0.9
 		* ( 1 - float((s_info >> 7) & 0x1U))
 		)
 		+
@@ -3,7 +3,7 @@
 in vec3 FragPos;
 in vec3 Normal;
 uniform uint Info;
-uniform vec2 origin;
+flat in vec2 Origin;
 
 layout (location = 0) out vec3 gPosition;
 layout (location = 1) out vec3 gNormal;
@@ -15,5 +15,5 @@ void main()
 	gPosition = FragPos;
 	gNormal = normalize(Normal);
 	gInfo = Info;
-	gOrigin = origin;
+	gOrigin = Origin;
 }
\ No newline at end of file
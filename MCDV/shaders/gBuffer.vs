@@ -1,20 +1,27 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aOrigin;	// Batched meshes and instances only, zero otherwise
+layout (location = 3) in mat4 aInstance;	// Model matrix of each instance, instanced draws only
 
 out vec3 FragPos;
 out vec3 Normal;
+flat out vec2 Origin;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec2 origin;
+uniform bool instanced;
 
 void main()
 {
-	FragPos = vec3(model * vec4(aPos, 1.0));
+	mat4 world = instanced ? model * aInstance : model;
+	FragPos = vec3(world * vec4(aPos, 1.0));
 
-	mat3 normalMatrix = transpose(inverse(mat3(model)));
+	mat3 normalMatrix = transpose(inverse(mat3(world)));
     Normal = normalMatrix * aNormal;
+	Origin = origin + aOrigin;
 
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = projection * view * world * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -12,6 +12,9 @@ uniform float blend_outline;
 uniform vec4 color_outline;
 uniform int outline_width;
 
+uniform int use_jfa;				// Outline from the jump flooded seeds instead of the kernel
+uniform sampler2D jfa_layer;
+
 //                                       SHADER HELPERS
 // ____________________________________________________________________________________________
 // --------------------------------------- Blend modes ----------------------------------------
@@ -90,6 +93,16 @@ float kernel_filter_outline(sampler2D sampler, int channelID, int sample_size)
 	return max(min(sT, 1) - texture(sampler, TexCoords)[channelID], 0);
 }
 
+// Given the jump flooded seeds of a mask, return the same outline from the distance to it
+float distance_outline(sampler2D seeds, sampler2D sampler, int channelID, int sample_size)
+{
+	vec2 s = texture(seeds, TexCoords).xy;
+	if(s.x < 0) return 0;
+
+	float d = length(s - TexCoords * vec2(textureSize(seeds, 0)));
+	return max(clamp(sample_size - d, 0, 1) - texture(sampler, TexCoords)[channelID], 0);
+}
+
 //                                       SHADER PROGRAM
 // ____________________________________________________________________________________________
 //     ( Write all your shader code & functions here )
@@ -102,7 +115,7 @@ void main()
 
 	vec4 final = s_background;
 	final = blend_normal(final, vec4(0,0,0,1), kernel_filter_glow(tex_layer, 3, 16, 0));// Drop shadow
-	final = blend_normal(final, color_outline, kernel_filter_outline(tex_layer, 3, outline_width) * blend_outline); // outline
+	final = blend_normal(final, color_outline, (use_jfa == 1? distance_outline(jfa_layer, tex_layer, 3, outline_width): kernel_filter_outline(tex_layer, 3, outline_width)) * blend_outline); // outline
 	final = blend_normal(final, s_layer, 1.0);
 
 	FragColor = final;
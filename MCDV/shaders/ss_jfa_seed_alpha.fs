@@ -0,0 +1,10 @@
+#version 330 core
+// Jump flood seeds: texels where the layer is at least half covered point at themselves, the rest at nothing (-1)
+uniform sampler2D tex_layer;
+
+in vec2 TexCoords;
+out vec2 Seed;
+
+void main(){
+	Seed = texture(tex_layer, TexCoords).a >= 0.5 ? gl_FragCoord.xy : vec2(-1);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+// Jump flood seeds: texels inside mask * playspace point at themselves, the rest at nothing (-1)
+uniform usampler2D umask;
+uniform usampler2D umask_playspace;
+
+in vec2 TexCoords;
+out vec2 Seed;
+
+void main(){
+	uint inside = texture(umask, TexCoords).r * texture(umask_playspace, TexCoords).r;
+	Seed = inside != 0U ? gl_FragCoord.xy : vec2(-1);
+}
@@ -0,0 +1,32 @@
+#version 330 core
+// One jump flood pass: keep the closest of the seeds found 'jump' texels away in the 8 directions
+uniform sampler2D jfa_seeds;
+uniform int jump;
+
+out vec2 Seed;
+
+void main(){
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(jfa_seeds, 0);
+
+	vec2 best = vec2(-1);
+	float best_d = 1e30;
+
+	for(int x = -1; x <= 1; x++){
+		for(int y = -1; y <= 1; y++){
+			ivec2 q = p + ivec2(x, y) * jump;
+			if(q.x < 0 || q.y < 0 || q.x >= size.x || q.y >= size.y) continue;
+
+			vec2 s = texelFetch(jfa_seeds, q, 0).xy;
+			if(s.x < 0) continue;
+
+			vec2 d = s - gl_FragCoord.xy;
+			if(dot(d, d) < best_d){
+				best = s;
+				best_d = dot(d, d);
+			}
+		}
+	}
+
+	Seed = best;
+}
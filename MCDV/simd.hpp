@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+/* Four floats at a time. SSE2 where the compiler targets it (every x64 build), plain loops otherwise, so code written
+   against this builds everywhere and gives the same results either way. There is no AVX version: the SSAO loop spends
+   its time on the per lane height lookups, which eight lanes would not make any cheaper */
+namespace simd
+{
+#ifdef SIMD_SSE2
+	struct f4 {
+		__m128 v;
+
+		f4() {}
+		f4(__m128 _v) : v(_v) {}
+		f4(float f) : v(_mm_set1_ps(f)) {}
+		f4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+		static f4 load(const float* p) { return _mm_loadu_ps(p); }
+		void store(float* p) const { _mm_storeu_ps(p, this->v); }
+	};
+
+	inline f4 operator+(f4 a, f4 b) { return _mm_add_ps(a.v, b.v); }
+	inline f4 operator-(f4 a, f4 b) { return _mm_sub_ps(a.v, b.v); }
+	inline f4 operator*(f4 a, f4 b) { return _mm_mul_ps(a.v, b.v); }
+	inline f4 min(f4 a, f4 b) { return _mm_min_ps(a.v, b.v); }
+	inline f4 max(f4 a, f4 b) { return _mm_max_ps(a.v, b.v); }
+
+	/* Lanes of a in the order given: shuffle<2, 1, 0, 3>(a) = (a2, a1, a0, a3) */
+	template<int i0, int i1, int i2, int i3>
+	inline f4 shuffle(f4 a) { return _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(i3, i2, i1, i0)); }
+
+	/* Rounds toward minus infinity, for values that fit an int */
+	inline f4 floor(f4 a) {
+		__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+	}
+
+	/* Truncated toward zero */
+	inline void store_int(f4 a, int32_t* p) { _mm_storeu_si128((__m128i*)p, _mm_cvttps_epi32(a.v)); }
+
+	/* Bit i set where lane i of a >= b */
+	inline int mask_ge(f4 a, f4 b) { return _mm_movemask_ps(_mm_cmpge_ps(a.v, b.v)); }
+#else
+	struct f4 {
+		float v[4];
+
+		f4() {}
+		f4(float f) { for (int i = 0; i < 4; i++) this->v[i] = f; }
+		f4(float a, float b, float c, float d) { this->v[0] = a; this->v[1] = b; this->v[2] = c; this->v[3] = d; }
+
+		static f4 load(const float* p) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+		void store(float* p) const { for (int i = 0; i < 4; i++) p[i] = this->v[i]; }
+	};
+
+#define SIMD_LANES(expr) f4 r; for (int i = 0; i < 4; i++) r.v[i] = (expr); return r;
+	inline f4 operator+(f4 a, f4 b) { SIMD_LANES(a.v[i] + b.v[i]) }
+	inline f4 operator-(f4 a, f4 b) { SIMD_LANES(a.v[i] - b.v[i]) }
+	inline f4 operator*(f4 a, f4 b) { SIMD_LANES(a.v[i] * b.v[i]) }
+	inline f4 min(f4 a, f4 b) { SIMD_LANES(b.v[i] < a.v[i] ? b.v[i] : a.v[i]) }
+	inline f4 max(f4 a, f4 b) { SIMD_LANES(b.v[i] > a.v[i] ? b.v[i] : a.v[i]) }
+	inline f4 floor(f4 a) { SIMD_LANES(std::floor(a.v[i])) }
+#undef SIMD_LANES
+
+	template<int i0, int i1, int i2, int i3>
+	inline f4 shuffle(f4 a) { return f4(a.v[i0], a.v[i1], a.v[i2], a.v[i3]); }
+
+	inline void store_int(f4 a, int32_t* p) { for (int i = 0; i < 4; i++) p[i] = (int32_t)a.v[i]; }
+
+	inline int mask_ge(f4 a, f4 b) {
+		int m = 0;
+		for (int i = 0; i < 4; i++) if (a.v[i] >= b.v[i]) m |= 1 << i;
+		return m;
+	}
+#endif
+
+	/* a * b + c */
+	inline f4 madd(f4 a, f4 b, f4 c) { return a * b + c; }
+
+	inline int count_bits(int mask) {
+		static const int bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+		return bits[mask & 15];
+	}
+}
@@ -0,0 +1,593 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <glm\glm.hpp>
+
+#include "soft_render.hpp"
+#include "Texture.hpp"
+#include "threadpool.hpp"
+#include "simd.hpp"
+
+/* CPU versions of the screen space passes that turn the geometry planes into the radar: fullscreenbase.fs,
+   ss_comp_multilayer_blend.fs, ss_comp_multilayer_finalstage.fs, ss_fxaa.fs and ss_msaa.fs.
+
+   Every texture is sampled the way main2 sets it up for GL (nearest or linear, repeat or clamp) and results go through
+   the same RGBA8 targets and alpha blending, so output matches the GL path to within rounding. Rows are shaded on the
+   thread pool. The kernel filters are the expensive part of the shaders, and their sizes come from the config; here
+   the glows are sliding window sums and the outlines come from an exact distance transform of the mask, so neither
+   costs more as the kernels grow. */
+namespace render
+{
+	/* RGBA8 colour plane, bottom row first like FBuffer */
+	class soft_image {
+	public:
+		int width;
+		int height;
+		std::vector<uint8_t> rgba;
+
+		soft_image(int _width = 0, int _height = 0) : width(_width), height(_height), rgba((size_t)_width * _height * 4) {}
+
+		void clear() { std::fill(this->rgba.begin(), this->rgba.end(), 0); }
+	};
+
+	/* Uniforms of fullscreenbase.fs */
+	struct composite_uniforms {
+		glm::vec3 bounds_NWU;
+		glm::vec3 bounds_SEL;
+
+		const Texture* tex_gradient = NULL;
+		const Texture* tex_modulate = NULL;
+		const soft_gbuffer* gbuffer = NULL;			// gbuffer_position, gbuffer_normal
+		const soft_gbuffer* gbuffer_clean = NULL;	// gbuffer_clean_position, gbuffer_clean_normal, gbuffer_info, gbuffer_origin
+		const soft_mask* umask_playspace = NULL;
+		const soft_mask* umask_objectives = NULL;
+		const soft_mask* umask_buyzone = NULL;
+
+		const std::vector<glm::vec3>* samples = NULL;
+		const std::vector<glm::vec3>* ssaoRotations = NULL;	// 256x256, RGB16F in GL
+		float ssaoScale = 1000.0f;
+		int mssascale = 1;
+		glm::mat4 projection;
+		glm::mat4 view;
+
+		glm::vec4 color_objective;
+		glm::vec4 color_buyzone;
+		glm::vec4 color_cover;
+		glm::vec4 color_cover2;
+		glm::vec4 color_ao;
+
+		float blend_objective_stripes = 0.0f;
+		float blend_ao = 1.0f;
+	};
+
+	namespace composite
+	{
+		const int ao_samples = 256; // fullscreenbase.fs always loops over all of them
+
+		inline const float* half_table() {
+			static std::vector<float> table = [] {
+				std::vector<float> t(65536);
+				for (int i = 0; i < 65536; i++) t[i] = from_half((uint16_t)i);
+				return t;
+			}();
+			return &table[0];
+		}
+
+		inline float lerp(float a, float b, float w) { return a + w * (b - a); }
+		inline glm::vec3 lerp(const glm::vec3& a, const glm::vec3& b, float w) { return a + (b - a) * w; }
+		inline glm::vec4 lerp(const glm::vec4& a, const glm::vec4& b, float w) { return a + (b - a) * w; }
+		inline float clamp01(float v) { return v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f; } // NaN goes to 0 like a unorm store
+
+		inline glm::vec4 blend_normal(const glm::vec4& a, const glm::vec4& b, float s) {
+			glm::vec3 rgb = lerp(glm::vec3(a.x, a.y, a.z), glm::vec3(b.x, b.y, b.z), b.w * s);
+			return glm::vec4(rgb.x, rgb.y, rgb.z, a.w + b.w * s);
+		}
+
+		inline int wrap(int i, int size) {
+			i %= size;
+			return i < 0 ? i + size : i;
+		}
+
+		/* Texel a nearest sample at s lands on */
+		inline int texel_repeat(float s, int size) {
+			float f = s - std::floor(s);
+			int i = (int)(f * size);
+			return i < size ? (i < 0 ? 0 : i) : size - 1;
+		}
+
+		inline int texel_clamp(float s, int size) {
+			float f = std::floor(s * size);
+			return f < 0.0f ? 0 : (f >= size ? size - 1 : (int)f);
+		}
+
+		inline glm::vec4 fetch(const uint8_t* rgba, size_t i) {
+			return glm::vec4(rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2], rgba[i * 4 + 3]) * (1.0f / 255.0f);
+		}
+
+		inline void store(uint8_t* rgba, size_t i, const glm::vec4& c) {
+			rgba[i * 4 + 0] = (uint8_t)(clamp01(c.x) * 255.0f + 0.5f);
+			rgba[i * 4 + 1] = (uint8_t)(clamp01(c.y) * 255.0f + 0.5f);
+			rgba[i * 4 + 2] = (uint8_t)(clamp01(c.z) * 255.0f + 0.5f);
+			rgba[i * 4 + 3] = (uint8_t)(clamp01(c.w) * 255.0f + 0.5f);
+		}
+
+		/* glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) on all four channels */
+		inline void store_blended(uint8_t* rgba, size_t i, const glm::vec4& c) {
+			glm::vec4 src(clamp01(c.x), clamp01(c.y), clamp01(c.z), clamp01(c.w));
+			store(rgba, i, src * src.w + fetch(rgba, i) * (1.0f - src.w));
+		}
+
+		/* Bilinear, GL_REPEAT */
+		inline glm::vec4 sample_linear(const uint8_t* rgba, int width, int height, float u, float v) {
+			float sx = u * width - 0.5f, sy = v * height - 0.5f;
+			float fx = std::floor(sx), fy = std::floor(sy);
+			float ax = sx - fx, ay = sy - fy;
+			int x0 = wrap((int)fx, width), x1 = wrap((int)fx + 1, width);
+			int y0 = wrap((int)fy, height), y1 = wrap((int)fy + 1, height);
+
+			glm::vec4 bottom = lerp(fetch(rgba, (size_t)y0 * width + x0), fetch(rgba, (size_t)y0 * width + x1), ax);
+			glm::vec4 top = lerp(fetch(rgba, (size_t)y1 * width + x0), fetch(rgba, (size_t)y1 * width + x1), ax);
+			return lerp(bottom, top, ay);
+		}
+
+		inline glm::vec4 sample(const soft_image& image, float u, float v) {
+			return sample_linear(&image.rgba[0], image.width, image.height, u, v);
+		}
+
+		/* With the filter and wrap mode the texture was uploaded with */
+		inline glm::vec4 sample(const Texture* texture, float u, float v) {
+			if (texture == NULL || texture->pixels.empty()) return glm::vec4(0, 0, 0, 1); // Incomplete texture
+
+			int w = texture->width, h = texture->height;
+			if (!texture->linear) {
+				int x = texture->clamp ? texel_clamp(u, w) : texel_repeat(u, w);
+				int y = texture->clamp ? texel_clamp(v, h) : texel_repeat(v, h);
+				return fetch(&texture->pixels[0], (size_t)y * w + x);
+			}
+
+			if (!texture->clamp) return sample_linear(&texture->pixels[0], w, h, u, v);
+
+			float sx = std::min(std::max(u, 0.0f), 1.0f) * w - 0.5f, sy = std::min(std::max(v, 0.0f), 1.0f) * h - 0.5f;
+			float fx = std::floor(sx), fy = std::floor(sy);
+			float ax = sx - fx, ay = sy - fy;
+			int x0 = std::max((int)fx, 0), x1 = std::min((int)fx + 1, w - 1);
+			int y0 = std::max((int)fy, 0), y1 = std::min((int)fy + 1, h - 1);
+
+			const uint8_t* p = &texture->pixels[0];
+			glm::vec4 bottom = lerp(fetch(p, (size_t)y0 * w + x0), fetch(p, (size_t)y0 * w + x1), ax);
+			glm::vec4 top = lerp(fetch(p, (size_t)y1 * w + x0), fetch(p, (size_t)y1 * w + x1), ax);
+			return lerp(bottom, top, ay);
+		}
+
+		/* Sum of the (2r + 1)^2 window around every (xs[i], ys[j]) with GL_REPEAT wrapping, into out[j * xs.size() + i].
+		   Unsigned like the shader sums. Rows then columns, each from prefix sums */
+		inline void window_sums(const std::vector<uint32_t>& plane, int width, int height, int r,
+			const std::vector<int>& xs, const std::vector<int>& ys, std::vector<uint32_t>& out) {
+			size_t nx = xs.size();
+			int span = 2 * r + 1;
+
+			// Sum of len values of prefix from start on, going round as many times as needed
+			auto wrapped = [](const uint32_t* prefix, int size, int start, int len) {
+				start = wrap(start, size);
+				uint32_t s = (uint32_t)(len / size) * prefix[size];
+				int end = start + len % size;
+				if (end <= size) return s + prefix[end] - prefix[start];
+				return s + prefix[size] - prefix[start] + prefix[end - size];
+			};
+
+			std::vector<uint32_t> rows((size_t)height * nx);
+			threadpool::global()->parallel_for(height, [&](size_t y) {
+				std::vector<uint32_t> prefix(width + 1);
+				const uint32_t* row = &plane[y * width];
+				prefix[0] = 0;
+				for (int x = 0; x < width; x++) prefix[x + 1] = prefix[x] + row[x];
+
+				for (size_t i = 0; i < nx; i++) rows[y * nx + i] = wrapped(&prefix[0], width, xs[i] - r, span);
+			});
+
+			out.resize(ys.size() * nx);
+			threadpool::global()->parallel_for(nx, [&](size_t i) {
+				std::vector<uint32_t> prefix(height + 1);
+				prefix[0] = 0;
+				for (int y = 0; y < height; y++) prefix[y + 1] = prefix[y] + rows[(size_t)y * nx + i];
+
+				for (size_t j = 0; j < ys.size(); j++) out[j * nx + i] = wrapped(&prefix[0], height, ys[j] - r, span);
+			});
+		}
+
+		/* Squared distance from every texel to the nearest texel where inside is set, or distance_none if there is none.
+		   Exact Euclidean distance transform (Felzenszwalb & Huttenlocher): lower envelopes of parabolas down every
+		   column, then along every row, linear in the texel count. Edges wrap, the same as window_sums and the GL_REPEAT
+		   kernel sums the shaders outline with */
+		const int32_t distance_none = 0x3fffffff;
+
+		inline void distance_transform_1d(const int32_t* f, int n, int32_t* d, int* v, double* z) {
+			int k = 0;
+			v[0] = 0;
+			z[0] = -1e30; z[1] = 1e30;
+			for (int q = 1; q < n; q++) {
+				double s;
+				while (true) {
+					int p = v[k];
+					s = ((f[q] + (double)q * q) - (f[p] + (double)p * p)) / (2.0 * (q - p));
+					if (s > z[k] || k == 0) break;
+					k--;
+				}
+				if (s <= z[k]) { v[0] = q; z[1] = 1e30; continue; } // Only reachable with k == 0: q hides everything before it
+				k++;
+				v[k] = q;
+				z[k] = s;
+				z[k + 1] = 1e30;
+			}
+
+			k = 0;
+			for (int q = 0; q < n; q++) {
+				while (z[k + 1] < q) k++;
+				int64_t dq = q - v[k];
+				d[q] = (int32_t)std::min<int64_t>(dq * dq + f[v[k]], distance_none);
+			}
+		}
+
+		/* One row or column, wrapped: the nearest texel is never more than a whole period away, so the transform runs over
+		   three copies and the middle one is kept */
+		inline void distance_transform_wrapped(const int32_t* f, int n, int32_t* d, std::vector<int32_t>& f3, std::vector<int32_t>& d3,
+			std::vector<int>& v, std::vector<double>& z) {
+			for (int q = 0; q < 3 * n; q++) f3[q] = f[q % n];
+			distance_transform_1d(&f3[0], 3 * n, &d3[0], &v[0], &z[0]);
+			for (int q = 0; q < n; q++) d[q] = d3[n + q];
+		}
+
+		template<typename T>
+		inline void distance_transform(const std::vector<T>& inside, int width, int height, std::vector<int32_t>& out) {
+			std::vector<int32_t> columns((size_t)width * height);
+			threadpool::global()->parallel_for(width, [&](size_t x) {
+				std::vector<int32_t> f(height), d(height), f3(3 * height), d3(3 * height);
+				std::vector<int> v(3 * height);
+				std::vector<double> z(3 * height + 1);
+				for (int y = 0; y < height; y++) f[y] = inside[(size_t)y * width + x] ? 0 : distance_none;
+
+				distance_transform_wrapped(&f[0], height, &d[0], f3, d3, v, z);
+				for (int y = 0; y < height; y++) columns[(size_t)y * width + x] = d[y];
+			});
+
+			out.resize((size_t)width * height);
+			threadpool::global()->parallel_for(height, [&](size_t y) {
+				std::vector<int32_t> f3(3 * width), d3(3 * width);
+				std::vector<int> v(3 * width);
+				std::vector<double> z(3 * width + 1);
+				distance_transform_wrapped(&columns[y * width], width, &out[y * width], f3, d3, v, z);
+			});
+		}
+
+		/* kernel_filter_outline from the distance field: the kernel sum reaches 1 within r - 1 texels of the mask and
+		   fades out over the texel after that */
+		inline float outline(int32_t distance_sq, int r, float center) {
+			if (distance_sq == distance_none) return 0.0f;
+			return std::max(clamp01((float)r - std::sqrt((float)distance_sq)) - center, 0.0f);
+		}
+
+		/* Kernel sums of one of the umask_objectives / umask_buyzone planes multiplied by umask_playspace */
+		struct zone_kernels {
+			std::vector<uint32_t> inside;		// mask * playspace
+			std::vector<uint32_t> glow_in;		// Window sums of (1 - mask) * playspace, kernel_filter_glow inverse = 1
+			std::vector<uint32_t> glow_out;		// Window sums of mask * playspace, inverse = 0
+			std::vector<int32_t> distance;		// Squared distance to the nearest texel in mask * playspace
+
+			void build(const soft_mask& mask, const soft_mask& playspace, int glow_r, const std::vector<int>& xs, const std::vector<int>& ys) {
+				size_t count = mask.mask.size();
+				std::vector<uint32_t> outside(count);
+				this->inside.resize(count);
+				for (size_t i = 0; i < count; i++) {
+					uint32_t m = mask.mask[i], p = playspace.mask[i];
+					this->inside[i] = m * p;
+					outside[i] = (1U - m) * p;
+				}
+
+				window_sums(outside, mask.width, mask.height, glow_r, xs, ys, this->glow_in);
+				window_sums(this->inside, mask.width, mask.height, glow_r, xs, ys, this->glow_out);
+				distance_transform(this->inside, mask.width, mask.height, this->distance);
+			}
+		};
+
+		/* The 256 sample loop: sample = base + TBN * samples[i] * ssaoScale, moved to the plane with projection * view,
+		   occluded where the height there is 3 units or more above it. The radar view is orthographic, so the projection
+		   is affine and each sample only costs three dot products: texture u, v and the height it is compared against */
+		struct ao_samples_soa {
+			float x[ao_samples], y[ao_samples], z[ao_samples];
+		};
+
+		inline int occlusion(const ao_samples_soa& s, const glm::mat4& pv, float scale, const glm::vec3& base, const glm::vec3& tangent,
+			const glm::vec3& bitangent, const glm::vec3& normal, const float* heights, int width, int height) {
+			// Row r of projection * view applied to a direction d, halved for the * 0.5 + 0.5 into texture space
+			auto row = [&](int r, const glm::vec3& d) { return 0.5f * (pv[0][r] * d.x + pv[1][r] * d.y + pv[2][r] * d.z); };
+
+			simd::f4 cu(row(0, base) + 0.5f * pv[3][0] + 0.5f), cv(row(1, base) + 0.5f * pv[3][1] + 0.5f), ch(base.y + 3.0f);
+			simd::f4 ux(row(0, tangent) * scale), uy(row(0, bitangent) * scale), uz(row(0, normal) * scale);
+			simd::f4 vx(row(1, tangent) * scale), vy(row(1, bitangent) * scale), vz(row(1, normal) * scale);
+			simd::f4 hx(tangent.y * scale), hy(bitangent.y * scale), hz(normal.y * scale);
+			simd::f4 fw((float)width), fh((float)height);
+
+			int count = 0;
+			int32_t ix[4], iy[4];
+			float h[4];
+			for (int i = 0; i < ao_samples; i += 4) {
+				simd::f4 sx = simd::f4::load(s.x + i), sy = simd::f4::load(s.y + i), sz = simd::f4::load(s.z + i);
+
+				simd::f4 u = simd::madd(uz, sz, simd::madd(uy, sy, simd::madd(ux, sx, cu)));
+				simd::f4 v = simd::madd(vz, sz, simd::madd(vy, sy, simd::madd(vx, sx, cv)));
+				simd::f4 sample_y = simd::madd(hz, sz, simd::madd(hy, sy, simd::madd(hx, sx, ch)));
+
+				// GL_REPEAT, nearest
+				simd::store_int((u - simd::floor(u)) * fw, ix);
+				simd::store_int((v - simd::floor(v)) * fh, iy);
+				for (int k = 0; k < 4; k++) {
+					int x = ix[k] < 0 ? 0 : (ix[k] < width ? ix[k] : width - 1);
+					int y = iy[k] < 0 ? 0 : (iy[k] < height ? iy[k] : height - 1);
+					h[k] = heights[(size_t)y * width + x];
+				}
+
+				count += simd::count_bits(simd::mask_ge(simd::f4::load(h), sample_y));
+			}
+			return count;
+		}
+
+		/* rgb2hsv / hsv2rgb from ss_comp_multilayer_blend.fs */
+		inline glm::vec3 rgb2hsv(const glm::vec3& c) {
+			glm::vec4 p = c.y >= c.z ? glm::vec4(c.y, c.z, 0.0f, -1.0f / 3.0f) : glm::vec4(c.z, c.y, -1.0f, 2.0f / 3.0f);
+			glm::vec4 q = c.x >= p.x ? glm::vec4(c.x, p.y, p.z, p.x) : glm::vec4(p.x, p.y, p.w, c.x);
+
+			float d = q.x - std::min(q.w, q.y);
+			float e = 1.0e-10f;
+			return glm::vec3(std::abs(q.z + (q.w - q.y) / (6.0f * d + e)), d / (q.x + e), q.x);
+		}
+
+		inline glm::vec3 hsv2rgb(const glm::vec3& c) {
+			const float k[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			glm::vec3 out;
+			for (int i = 0; i < 3; i++) {
+				float f = c.x + k[i];
+				float p = std::abs((f - std::floor(f)) * 6.0f - 3.0f);
+				out[i] = c.z * (1.0f * (1.0f - c.y) + clamp01(p - 1.0f) * c.y);
+			}
+			return out;
+		}
+	}
+
+	/* fullscreenbase.fs into out, which is the size of the layer FBuffer. The planes are mssascale times larger and
+	   are read at the texel under each pixel center, like the shader does */
+	inline void soft_composite(const composite_uniforms& u, soft_image& out) {
+		using namespace composite;
+
+		const soft_gbuffer& gbuffer = *u.gbuffer;
+		const soft_gbuffer& clean = *u.gbuffer_clean;
+		int tw = gbuffer.width, th = gbuffer.height;
+		int m = u.mssascale;
+
+		glm::mat4 pv = u.projection * u.view;
+		if (pv[0][3] != 0.0f || pv[1][3] != 0.0f || pv[2][3] != 0.0f || pv[3][3] != 1.0f)
+			throw std::exception("Software composite needs an orthographic view");
+
+		const float* half = half_table();
+
+		std::vector<int> xs(out.width), ys(out.height);
+		for (int x = 0; x < out.width; x++) xs[x] = texel_repeat((x + 0.5f) / out.width, tw);
+		for (int y = 0; y < out.height; y++) ys[y] = texel_repeat((y + 0.5f) / out.height, th);
+
+		// Height each ssao sample is tested against: gbuffer_position, or gbuffer_clean_position under cover
+		std::vector<float> ao_heights;
+		ao_samples_soa samples;
+		std::vector<glm::vec3> rotations;
+		if (u.blend_ao != 0.0f) {
+			ao_heights.resize((size_t)tw * th);
+			threadpool::global()->parallel_for(th, [&](size_t y) {
+				for (size_t i = y * tw; i < (y + 1) * tw; i++)
+					ao_heights[i] = lerp(half[gbuffer.position[i * 3 + 1]], half[clean.position[i * 3 + 1]], (float)((clean.info[i] >> 7) & 0x1U));
+			});
+
+			for (int i = 0; i < ao_samples; i++) {
+				glm::vec3 s = i < (int)u.samples->size() ? (*u.samples)[i] : glm::vec3(0, 0, 0); // Unset uniforms are 0
+				samples.x[i] = s.x; samples.y[i] = s.y; samples.z[i] = s.z;
+			}
+
+			// RGB16F
+			rotations.resize(u.ssaoRotations->size());
+			for (size_t i = 0; i < rotations.size(); i++) {
+				const glm::vec3& r = (*u.ssaoRotations)[i];
+				rotations[i] = glm::vec3(from_half(to_half(r.x)), from_half(to_half(r.y)), from_half(to_half(r.z)));
+			}
+		}
+
+		int glow_r = 13 * m, outline_r = 3 * m;
+		float glow_div = (float)(2 * glow_r * 2 * glow_r);
+
+		zone_kernels objectives, buyzone;
+		objectives.build(*u.umask_objectives, *u.umask_playspace, glow_r, xs, ys);
+		buyzone.build(*u.umask_buyzone, *u.umask_playspace, glow_r, xs, ys);
+
+		auto glow = [&](uint32_t sum) { float r = (float)sum / glow_div; return r * r; };
+
+		threadpool::global()->parallel_for(out.height, [&](size_t y) {
+			for (int x = 0; x < out.width; x++) {
+				size_t k = y * out.width + x; // Index into the kernel sums
+				size_t t = (size_t)ys[y] * tw + xs[x];
+				glm::vec2 tc((x + 0.5f) / out.width, (y + 0.5f) / out.height);
+
+				glm::vec3 s_position(half[gbuffer.position[t * 3]], half[gbuffer.position[t * 3 + 1]], half[gbuffer.position[t * 3 + 2]]);
+				glm::vec3 s_position_clean(half[clean.position[t * 3]], half[clean.position[t * 3 + 1]], half[clean.position[t * 3 + 2]]);
+				float s_modulate = sample(u.tex_modulate, tc.x, tc.y).x;
+				float s_modulate_1_5 = sample(u.tex_modulate, tc.x * 1.5f, tc.y * 1.5f).x;
+
+				uint32_t s_um_playspace = u.umask_playspace->mask[t];
+				uint32_t s_info = clean.info[t];
+				float m_objectives = (float)u.umask_objectives->mask[t];
+				float m_buyzones = (float)u.umask_buyzone->mask[t];
+				float m_playspace = (float)((s_um_playspace & 0x1U) | ((s_info >> 1) & 0x1U));
+				float cover = (float)((s_info >> 7) & 0x1U);
+				float inner = (float)((s_info >> 1) & 0x1U);
+
+				auto gradient = [&](float height) { return sample(u.tex_gradient, (height - u.bounds_SEL.y) / (u.bounds_NWU.y - u.bounds_SEL.y), 0.0f); };
+
+				glm::vec4 final(0, 0, 0, 0);
+				final = blend_normal(final, gradient(lerp(s_position_clean.y, s_position.y, clamp01(1 - s_modulate))), m_playspace);
+
+				// Cover, shaded by the height difference to the floor it stands on
+				glm::vec4 origin = pv * glm::vec4(half[clean.origin[t * 2]], 0.0f, half[clean.origin[t * 2 + 1]], 1.0f);
+				size_t ot = (size_t)texel_repeat(origin.y * 0.5f + 0.5f, th) * tw + texel_repeat(origin.x * 0.5f + 0.5f, tw);
+				float origin_height = half[gbuffer.position[ot * 3 + 1]];
+
+				float htt = clamp01((s_position_clean.y - origin_height) / 130.0f);
+				final = blend_normal(final, lerp(gradient(origin_height), u.color_cover, htt), cover * m_playspace);
+
+				if (u.blend_ao != 0.0f && m_playspace != 0.0f) {
+					float pick = clamp01((1 - s_modulate) + (1 - inner));
+
+					glm::vec3 n(half[gbuffer.normal[t * 3]], half[gbuffer.normal[t * 3 + 1]], half[gbuffer.normal[t * 3 + 2]]);
+					glm::vec3 n_clean(half[clean.normal[t * 3]], half[clean.normal[t * 3 + 1]], half[clean.normal[t * 3 + 2]]);
+					glm::vec3 s_normal = lerp(lerp(n, n_clean, pick), n_clean, cover);
+
+					glm::vec3 randVec = rotations[(size_t)texel_repeat(tc.y * 4.0f, 256) * 256 + texel_repeat(tc.x * 4.0f, 256)];
+					glm::vec3 tangent = glm::normalize(randVec - s_normal * glm::dot(randVec, s_normal));
+					glm::vec3 bitangent = glm::cross(s_normal, tangent);
+
+					glm::vec3 base = lerp(lerp(s_position_clean, s_position, pick), s_position_clean, cover);
+					int occluded = occlusion(samples, pv, u.ssaoScale, base, tangent, bitangent, s_normal, &ao_heights[0], tw, th);
+
+					final = blend_normal(final, u.color_ao, (occluded / 200.0f) * m_playspace * u.blend_ao);
+				}
+
+				// Objectives and buyzones: glow inwards inside, outwards outside, an outline and a faint fill
+				float outline_obj = outline(objectives.distance[t], outline_r, (float)objectives.inside[t]);
+				final = blend_normal(final, u.color_objective,
+					glow(objectives.glow_in[k]) * m_objectives * (1 - cover)
+					+ outline_obj * 0.9f * (1 - cover) * clamp01(s_modulate_1_5 + u.blend_objective_stripes)
+					+ glow(objectives.glow_out[k]) * (1 - m_objectives) * (1 - cover)
+					+ (float)objectives.inside[t] * 0.08f);
+
+				float outline_buy = outline(buyzone.distance[t], outline_r, (float)buyzone.inside[t]);
+				final = blend_normal(final, u.color_buyzone,
+					glow(buyzone.glow_in[k]) * m_buyzones * (1 - cover)
+					+ outline_buy * 0.9f * (1 - cover)
+					+ glow(buyzone.glow_out[k]) * (1 - m_buyzones) * (1 - cover)
+					+ (float)buyzone.inside[t] * 0.07f);
+
+				store(&out.rgba[0], k, final);
+			}
+		});
+	}
+
+	/* One draw of ss_comp_multilayer_blend.fs into dst with alpha blending on. Inactive layers are desaturated and darkened.
+	   (The shader's saturation and value are plain globals, so the values main2 sets never reach it) */
+	inline void soft_blend_layer(const soft_image& layer, bool active, soft_image& dst) {
+		using namespace composite;
+
+		threadpool::global()->parallel_for(dst.height, [&](size_t y) {
+			for (int x = 0; x < dst.width; x++) {
+				glm::vec4 s_layer = sample(layer, (x + 0.5f) / dst.width, (y + 0.5f) / dst.height);
+				glm::vec3 rgb(s_layer.x, s_layer.y, s_layer.z);
+
+				if (!active) {
+					glm::vec3 hsv = rgb2hsv(rgb);
+					hsv.y *= 0.1f;
+					hsv.z *= 0.333f;
+					rgb = lerp(rgb, hsv2rgb(hsv), 1.0f);
+				}
+
+				store_blended(&dst.rgba[0], y * dst.width + x, glm::vec4(rgb.x, rgb.y, rgb.z, s_layer.w));
+			}
+		});
+	}
+
+	/* ss_comp_multilayer_finalstage.fs: background, drop shadow, optional outline, then the layers on top. Blended into out */
+	inline void soft_final_stage(const soft_image& layer, const Texture* background, float blend_outline, const glm::vec4& color_outline,
+		int outline_width, soft_image& out) {
+		using namespace composite;
+
+		int w = layer.width, h = layer.height;
+		std::vector<int> xs(w), ys(h);
+		for (int x = 0; x < w; x++) xs[x] = x;
+		for (int y = 0; y < h; y++) ys[y] = y;
+
+		std::vector<uint32_t> alpha((size_t)w * h);
+		for (size_t i = 0; i < alpha.size(); i++) alpha[i] = layer.rgba[i * 4 + 3];
+
+		const int shadow_r = 16;
+		std::vector<uint32_t> shadow;
+		window_sums(alpha, w, h, shadow_r, xs, ys, shadow);
+
+		// The layer's alpha is soft at the edges, the outline goes around where it is at least half covered
+		std::vector<int32_t> distance;
+		if (blend_outline != 0.0f) {
+			std::vector<uint8_t> covered(alpha.size());
+			for (size_t i = 0; i < alpha.size(); i++) covered[i] = alpha[i] >= 128;
+			distance_transform(covered, w, h, distance);
+		}
+
+		threadpool::global()->parallel_for(h, [&](size_t y) {
+			for (int x = 0; x < w; x++) {
+				size_t i = y * w + x;
+
+				glm::vec4 final = sample(background, (x + 0.5f) / w, (y + 0.5f) / h);
+				final = blend_normal(final, glm::vec4(0, 0, 0, 1), shadow[i] / 255.0f / (float)(2 * shadow_r * 2 * shadow_r));
+
+				if (blend_outline != 0.0f)
+					final = blend_normal(final, color_outline, outline(distance[i], outline_width, alpha[i] / 255.0f) * blend_outline);
+
+				final = blend_normal(final, fetch(&layer.rgba[0], i), 1.0f);
+				store_blended(&out.rgba[0], i, final);
+			}
+		});
+	}
+
+	/* ss_fxaa.fs, same size in and out */
+	inline void soft_fxaa(const soft_image& in, soft_image& out) {
+		using namespace composite;
+
+		const float reduce_min = 1.0f / 128.0f, reduce_mul = 1.0f / 8.0f, span_max = 8.0f;
+		const glm::vec3 luma(0.299f, 0.587f, 0.114f);
+		glm::vec2 inv(1.0f / out.width, 1.0f / out.height);
+
+		threadpool::global()->parallel_for(out.height, [&](size_t y) {
+			for (int x = 0; x < out.width; x++) {
+				glm::vec2 tc((x + 0.5f) / out.width, (y + 0.5f) / out.height);
+				auto rgb = [&](float dx, float dy) {
+					glm::vec4 c = sample(in, tc.x + dx, tc.y + dy);
+					return glm::vec3(c.x, c.y, c.z);
+				};
+
+				float lumaNW = glm::dot(rgb(-inv.x, -inv.y), luma);
+				float lumaNE = glm::dot(rgb(inv.x, -inv.y), luma);
+				float lumaSW = glm::dot(rgb(-inv.x, inv.y), luma);
+				float lumaSE = glm::dot(rgb(inv.x, inv.y), luma);
+				float lumaM = glm::dot(rgb(0, 0), luma);
+				float lumaMin = std::min(lumaM, std::min(std::min(lumaNW, lumaNE), std::min(lumaSW, lumaSE)));
+				float lumaMax = std::max(lumaM, std::max(std::max(lumaNW, lumaNE), std::max(lumaSW, lumaSE)));
+
+				glm::vec2 dir(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), ((lumaNW + lumaSW) - (lumaNE + lumaSE)));
+				float dirReduce = std::max((lumaNW + lumaNE + lumaSW + lumaSE) * (0.25f * reduce_mul), reduce_min);
+				float rcpDirMin = 1.0f / (std::min(std::abs(dir.x), std::abs(dir.y)) + dirReduce);
+				dir.x = std::min(span_max, std::max(-span_max, dir.x * rcpDirMin)) * inv.x;
+				dir.y = std::min(span_max, std::max(-span_max, dir.y * rcpDirMin)) * inv.y;
+
+				glm::vec3 rgbA = (rgb(dir.x * (1.0f / 3.0f - 0.5f), dir.y * (1.0f / 3.0f - 0.5f)) + rgb(dir.x * (2.0f / 3.0f - 0.5f), dir.y * (2.0f / 3.0f - 0.5f))) * 0.5f;
+				glm::vec3 rgbB = rgbA * 0.5f + (rgb(dir.x * -0.5f, dir.y * -0.5f) + rgb(dir.x * 0.5f, dir.y * 0.5f)) * 0.25f;
+				float lumaB = glm::dot(rgbB, luma);
+
+				glm::vec3 c = (lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB;
+				store(&out.rgba[0], y * out.width + x, glm::vec4(c.x, c.y, c.z, 1.0f));
+			}
+		});
+	}
+
+	/* ss_msaa.fs: one linear sample per output pixel from the larger image */
+	inline void soft_resolve(const soft_image& in, soft_image& out) {
+		using namespace composite;
+
+		threadpool::global()->parallel_for(out.height, [&](size_t y) {
+			for (int x = 0; x < out.width; x++)
+				store(&out.rgba[0], y * out.width + x, sample(in, (x + 0.5f) / out.width, (y + 0.5f) / out.height));
+		});
+	}
+}
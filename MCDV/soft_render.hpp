@@ -0,0 +1,608 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+
+#include <glm\glm.hpp>
+
+#include "render.hpp"
+#include "Mesh.hpp"
+#include "threadpool.hpp"
+
+/* CPU backend for the radar geometry passes, so radars can be made without a GPU or a display.
+
+   Draws are only recorded. When the target is read, cleared or swapped, the recorded triangles are transformed on the
+   thread pool, binned into square tiles, and every tile is rasterized by one thread in submission order, so the result
+   does not depend on the thread count. Rasterization matches what the GL path asks for: pixel centers at +0.5,
+   8 bits of sub pixel precision with a top-left fill rule, clockwise front faces, GL_LESS depth and the near/far planes
+   of the projection. Planes are stored bottom row first in the same formats as the GL frame buffers, half floats
+   included, so output can be compared pixel for pixel. The projection must be orthographic, attributes are
+   interpolated linearly in screen space.
+
+   Layered targets take the draws of several radar layers at once: each draw names the slices it belongs to, and a
+   triangle is set up, binned and tested for coverage once whatever the number of slices. Only depth testing and
+   writing happen per slice. */
+namespace render
+{
+	const int soft_tile_size = 64;
+	const int soft_block_size = 8;	// Depth bounds are kept per block, tiles are whole blocks
+	const int soft_subpixel_bits = 8;
+	const float soft_guard_band = 2097152.0f; // Triangles reaching further out than this (pixels) are dropped
+
+	/* Float to half float bits, rounding to nearest even (what GL_RGB16F stores) */
+	inline uint16_t to_half(float f) {
+		uint32_t x;
+		std::memcpy(&x, &f, 4);
+
+		uint32_t sign = (x >> 16) & 0x8000;
+		uint32_t mant = x & 0x7fffff;
+		int exp = (int)((x >> 23) & 0xff);
+
+		if (exp == 0xff) return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 : 0));
+
+		int e = exp - 127 + 15;
+		if (e >= 31) return (uint16_t)(sign | 0x7c00);
+
+		if (e <= 0) {
+			if (e < -10) return (uint16_t)sign;
+
+			mant |= 0x800000;
+			int shift = 14 - e;
+			uint32_t h = mant >> shift;
+			uint32_t rem = mant & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (rem > halfway || (rem == halfway && (h & 1))) h++;
+			return (uint16_t)(sign | h);
+		}
+
+		uint32_t h = ((uint32_t)e << 10) | (mant >> 13);
+		uint32_t rem = mant & 0x1fff;
+		if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++; // Carries into the exponent correctly
+		return (uint16_t)(sign | h);
+	}
+
+	inline float from_half(uint16_t h) {
+		uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		uint32_t exp = (h >> 10) & 0x1f;
+		uint32_t mant = h & 0x3ff;
+
+		if (exp == 0) {
+			float f = std::ldexp((float)mant, -24);
+			return sign ? -f : f;
+		}
+
+		uint32_t x = exp == 31 ?
+			sign | 0x7f800000 | (mant << 13) :
+			sign | ((exp + 112) << 23) | (mant << 13);
+
+		float f;
+		std::memcpy(&f, &x, 4);
+		return f;
+	}
+
+	class soft_target : public target {
+	public:
+		std::vector<float> depth;
+		std::vector<float> block_depth;	// Farthest depth in each block, lets hidden triangles skip whole blocks
+		int blocks_x;
+
+		soft_target(target_type _type, int _width, int _height) : target(_type, _width, _height),
+			depth((size_t)_width * _height, 1.0f),
+			blocks_x((_width + soft_block_size - 1) / soft_block_size) {
+			this->block_depth.assign((size_t)this->blocks_x * ((_height + soft_block_size - 1) / soft_block_size), 1.0f);
+		}
+
+		size_t index(int x, int y) const { return (size_t)y * this->width + x; }
+
+		void clear_depth() {
+			std::fill(this->depth.begin(), this->depth.end(), 1.0f);
+			std::fill(this->block_depth.begin(), this->block_depth.end(), 1.0f);
+		}
+
+		/* Refresh the bound of the block holding pixel (x, y) */
+		void update_block(int x, int y) {
+			int bx = x / soft_block_size * soft_block_size, by = y / soft_block_size * soft_block_size;
+			int ex = std::min(bx + soft_block_size, this->width), ey = std::min(by + soft_block_size, this->height);
+
+			float far_z = 0.0f;
+			for (int yy = by; yy < ey; yy++)
+				for (int xx = bx; xx < ex; xx++)
+					far_z = std::max(far_z, this->depth[this->index(xx, yy)]);
+
+			this->block_depth[(size_t)(by / soft_block_size) * this->blocks_x + bx / soft_block_size] = far_z;
+		}
+	};
+
+	/* Same planes as GBuffer */
+	class soft_gbuffer : public soft_target {
+	public:
+		std::vector<uint16_t> position;	// RGB16F
+		std::vector<uint16_t> normal;	// RGB16F
+		std::vector<uint32_t> info;		// R32UI
+		std::vector<uint16_t> origin;	// RG16F
+
+		soft_gbuffer(int _width, int _height) : soft_target(TARGET_GBUFFER, _width, _height),
+			position((size_t)_width * _height * 3),
+			normal((size_t)_width * _height * 3),
+			info((size_t)_width * _height),
+			origin((size_t)_width * _height * 2) {}
+
+		glm::vec3 get_position(int x, int y) const {
+			const uint16_t* p = &this->position[this->index(x, y) * 3];
+			return glm::vec3(from_half(p[0]), from_half(p[1]), from_half(p[2]));
+		}
+
+		glm::vec3 get_normal(int x, int y) const {
+			const uint16_t* p = &this->normal[this->index(x, y) * 3];
+			return glm::vec3(from_half(p[0]), from_half(p[1]), from_half(p[2]));
+		}
+
+		glm::vec2 get_origin(int x, int y) const {
+			const uint16_t* p = &this->origin[this->index(x, y) * 2];
+			return glm::vec2(from_half(p[0]), from_half(p[1]));
+		}
+	};
+
+	/* Same plane as MBuffer */
+	class soft_mask : public soft_target {
+	public:
+		std::vector<uint8_t> mask;	// R8UI
+
+		soft_mask(int _width, int _height) : soft_target(TARGET_MASK, _width, _height),
+			mask((size_t)_width * _height) {}
+	};
+
+	/* Targets of one kind drawn in the same pass, one per layer. Draws go to the slices set_layers picks. The slices
+	   belong to the caller and are ordinary targets, read them like any other */
+	class soft_layered : public target {
+	public:
+		std::vector<soft_target*> slices;
+
+		soft_layered(const std::vector<soft_target*>& _slices) : target(first(_slices).type, first(_slices).width, first(_slices).height), slices(_slices) {
+			if (_slices.size() > 32) throw std::exception("soft_layered: at most 32 slices");
+		}
+
+	private:
+		/* Checked before the target is set up from it */
+		static const soft_target& first(const std::vector<soft_target*>& _slices) {
+			if (_slices.empty()) throw std::exception("soft_layered: no slices");
+			return *_slices[0];
+		}
+	};
+
+	/* Index of the lowest set bit, bits must not be 0 */
+	inline int lowest_bit(uint32_t bits) {
+		int l = 0;
+		while (!(bits & 1)) { bits >>= 1; l++; }
+		return l;
+	}
+
+	class soft_context : public context {
+		struct uniforms {
+			glm::mat4 model;
+			glm::mat4 view;
+			glm::mat4 projection;
+			unsigned int info = 0;
+			unsigned int src = 0;
+			glm::vec2 origin;
+		};
+
+		struct draw_call {
+			const float* vertices;	// POS_XYZ_NORMAL_XYZ
+			const uint32_t* indices;	// Three per triangle, or NULL for vertices in triangle order
+			size_t triangles;
+			program prog;
+			uniforms u;
+			uint32_t layers;
+			size_t first;	// First slot in m_triangles
+		};
+
+		/* Screen space triangle, counter clockwise after setup */
+		struct triangle {
+			int64_t x[3], y[3];		// Window coordinates, fixed point
+			float z[3];				// Window depth, 0..1 inside the near and far planes
+			float z_min, z_max;
+			glm::vec3 position[3];
+			glm::vec3 normal[3];
+			glm::vec2 origin;
+			uint32_t value;			// Info or srcChr
+			uint32_t layers;		// Slices it is drawn to
+			int min_x, min_y, max_x, max_y;	// Covered pixels, empty if min > max
+		};
+
+		std::vector<soft_target*> m_slices;	// The bound target, or every slice of a layered one
+		uint32_t m_layers = 1;
+		bool m_cull = true;
+
+		program m_program = PROGRAM_GBUFFER;
+		uniforms m_uniforms[2];
+
+		std::vector<draw_call> m_draws;
+		std::vector<triangle> m_triangles;
+		std::vector<std::vector<std::vector<uint32_t>>> m_bins; // [chunk][tile] triangle indices
+
+		std::atomic<size_t> m_dropped;
+
+		void setup(const draw_call& dc, triangle* out) {
+			size_t count = dc.triangles;
+
+			glm::mat4 mvp = dc.u.projection * dc.u.view * dc.u.model;
+			glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(dc.u.model)));
+
+			float w = (float)this->m_slices[0]->width;
+			float h = (float)this->m_slices[0]->height;
+			uint32_t layers = dc.layers & (this->m_slices.size() >= 32 ? ~0u : (1u << this->m_slices.size()) - 1);
+			float sub = (float)(1 << soft_subpixel_bits);
+
+			for (size_t t = 0; t < count; t++) {
+				triangle& tri = out[t];
+				tri.min_x = 1; tri.max_x = 0;
+				if (layers == 0) continue;
+
+				float sx[3], sy[3];
+				bool valid = true;
+				for (int k = 0; k < 3; k++) {
+					size_t index = dc.indices != NULL ? dc.indices[t * 3 + k] : t * 3 + k;
+					const float* vert = &dc.vertices[index * 6];
+					glm::vec4 p(vert[0], vert[1], vert[2], 1.0f);
+					glm::vec4 clip = mvp * p;
+					if (!(clip.w > 0.0f)) { valid = false; break; }
+
+					sx[k] = (clip.x / clip.w * 0.5f + 0.5f) * w;
+					sy[k] = (clip.y / clip.w * 0.5f + 0.5f) * h;
+					tri.z[k] = clip.z / clip.w * 0.5f + 0.5f;
+
+					if (!(std::abs(sx[k]) < soft_guard_band && std::abs(sy[k]) < soft_guard_band)) { valid = false; break; }
+
+					glm::vec4 world = dc.u.model * p;
+					tri.position[k] = glm::vec3(world.x, world.y, world.z);
+					tri.normal[k] = normal_matrix * glm::vec3(vert[3], vert[4], vert[5]);
+					tri.x[k] = (int64_t)std::llround(sx[k] * sub);
+					tri.y[k] = (int64_t)std::llround(sy[k] * sub);
+				}
+
+				if (!valid) { this->m_dropped++; continue; }
+
+				// Positive area is counter clockwise. Front faces are clockwise (glFrontFace(GL_CW))
+				int64_t area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+				if (area == 0) continue;
+				if (this->m_cull && area > 0) continue;
+
+				if (area < 0) {
+					std::swap(tri.x[1], tri.x[2]); std::swap(tri.y[1], tri.y[2]); std::swap(tri.z[1], tri.z[2]);
+					std::swap(tri.position[1], tri.position[2]); std::swap(tri.normal[1], tri.normal[2]);
+				}
+
+				tri.z_min = std::min({ tri.z[0], tri.z[1], tri.z[2] });
+				tri.z_max = std::max({ tri.z[0], tri.z[1], tri.z[2] });
+				tri.value = dc.prog == PROGRAM_GBUFFER ? dc.u.info : dc.u.src;
+				tri.origin = dc.u.origin;
+				tri.layers = layers;
+
+				// Pixels whose centers can be inside
+				int64_t half = 1 << (soft_subpixel_bits - 1);
+				int64_t lx = std::min({ tri.x[0], tri.x[1], tri.x[2] }) - half;
+				int64_t hx = std::max({ tri.x[0], tri.x[1], tri.x[2] }) - half;
+				int64_t ly = std::min({ tri.y[0], tri.y[1], tri.y[2] }) - half;
+				int64_t hy = std::max({ tri.y[0], tri.y[1], tri.y[2] }) - half;
+
+				tri.min_x = (int)std::max<int64_t>(0, (lx + (1 << soft_subpixel_bits) - 1) >> soft_subpixel_bits);
+				tri.min_y = (int)std::max<int64_t>(0, (ly + (1 << soft_subpixel_bits) - 1) >> soft_subpixel_bits);
+				tri.max_x = (int)std::min<int64_t>(this->m_slices[0]->width - 1, hx >> soft_subpixel_bits);
+				tri.max_y = (int)std::min<int64_t>(this->m_slices[0]->height - 1, hy >> soft_subpixel_bits);
+			}
+		}
+
+		/* Edge a->b of a counter clockwise triangle. Pixels exactly on it belong to it if it is a top or left edge */
+		static int64_t edge_bias(int64_t ax, int64_t ay, int64_t bx, int64_t by) {
+			int64_t dx = bx - ax, dy = by - ay;
+			bool top_left = dy < 0 || (dy == 0 && dx < 0);
+			return top_left ? 0 : -1;
+		}
+
+		/* Pixels of tri inside the rectangle, which has to lie in one tile */
+		void raster(const triangle& tri, int x0, int y0, int x1, int y1) {
+			x0 = std::max(x0, tri.min_x); x1 = std::min(x1, tri.max_x);
+			y0 = std::max(y0, tri.min_y); y1 = std::min(y1, tri.max_y);
+			if (x0 > x1 || y0 > y1) return;
+
+			soft_target* const* slices = this->m_slices.data();
+			const soft_target* first = slices[0];
+			bool gbuffer = first->type == TARGET_GBUFFER;
+
+			const int64_t one = 1 << soft_subpixel_bits;
+			const int64_t half = one >> 1;
+
+			// e0 is opposite vertex 0 and so on. Evaluated at the center of pixel (x0, y0)
+			int64_t ax[3] = { tri.x[1], tri.x[2], tri.x[0] }, ay[3] = { tri.y[1], tri.y[2], tri.y[0] };
+			int64_t bx[3] = { tri.x[2], tri.x[0], tri.x[1] }, by[3] = { tri.y[2], tri.y[0], tri.y[1] };
+
+			int64_t origin[3], step_x[3], step_y[3], bias[3];
+			int64_t px = (int64_t)x0 * one + half, py = (int64_t)y0 * one + half;
+			for (int e = 0; e < 3; e++) {
+				origin[e] = (bx[e] - ax[e]) * (py - ay[e]) - (by[e] - ay[e]) * (px - ax[e]);
+				step_x[e] = -(by[e] - ay[e]) * one;
+				step_y[e] = (bx[e] - ax[e]) * one;
+				bias[e] = edge_bias(ax[e], ay[e], bx[e], by[e]);
+			}
+
+			// Sum of the edge functions is constant, so depth is a plane in pixel steps
+			double inv_area = 1.0 / (double)(origin[0] + origin[1] + origin[2]);
+			double z_origin = (origin[0] * (double)tri.z[0] + origin[1] * (double)tri.z[1] + origin[2] * (double)tri.z[2]) * inv_area;
+			double z_dx = (step_x[0] * (double)tri.z[0] + step_x[1] * (double)tri.z[1] + step_x[2] * (double)tri.z[2]) * inv_area;
+			double z_dy = (step_y[0] * (double)tri.z[0] + step_y[1] * (double)tri.z[1] + step_y[2] * (double)tri.z[2]) * inv_area;
+
+			for (int block_y = y0 / soft_block_size * soft_block_size; block_y <= y1; block_y += soft_block_size) {
+				for (int block_x = x0 / soft_block_size * soft_block_size; block_x <= x1; block_x += soft_block_size) {
+					int cx0 = std::max(block_x, x0), cx1 = std::min(block_x + soft_block_size - 1, x1);
+					int cy0 = std::max(block_y, y0), cy1 = std::min(block_y + soft_block_size - 1, y1);
+
+					// Slices where not everything already drawn in the block is closer
+					size_t block = (size_t)(block_y / soft_block_size) * first->blocks_x + block_x / soft_block_size;
+					uint32_t live = 0;
+					for (uint32_t bits = tri.layers; bits; bits &= bits - 1) {
+						int l = lowest_bit(bits);
+						if (tri.z_min < slices[l]->block_depth[block]) live |= 1u << l;
+					}
+					if (live == 0) continue;
+
+					// Block is outside an edge at all four corners
+					bool outside = false;
+					for (int e = 0; e < 3 && !outside; e++) {
+						int64_t c00 = origin[e] + step_x[e] * (cx0 - x0) + step_y[e] * (cy0 - y0);
+						int64_t dx = step_x[e] * (cx1 - cx0), dy = step_y[e] * (cy1 - cy0);
+						int64_t best = c00 + std::max<int64_t>(dx, 0) + std::max<int64_t>(dy, 0);
+						outside = best + bias[e] < 0;
+					}
+					if (outside) continue;
+
+					uint32_t wrote = 0;
+					for (int y = cy0; y <= cy1; y++) {
+						int64_t e[3];
+						for (int k = 0; k < 3; k++) e[k] = origin[k] + step_x[k] * (cx0 - x0) + step_y[k] * (y - y0);
+						float z_row = (float)(z_origin + z_dx * (cx0 - x0) + z_dy * (y - y0));
+
+						for (int x = cx0; x <= cx1; x++) {
+							if (e[0] + bias[0] >= 0 && e[1] + bias[1] >= 0 && e[2] + bias[2] >= 0) {
+								float z = std::min(std::max(z_row + (float)z_dx * (x - cx0), tri.z_min), tri.z_max);
+								size_t i = first->index(x, y);
+
+								// Attributes are interpolated once, for the first slice the pixel lands in
+								bool shaded = false;
+								uint16_t p[3], n[3], o[2];
+
+								for (uint32_t bits = z >= 0.0f && z <= 1.0f ? live : 0; bits; bits &= bits - 1) {
+									int l = lowest_bit(bits);
+									soft_target* target = slices[l];
+									if (!(z < target->depth[i])) continue;
+
+									target->depth[i] = z;
+									wrote |= 1u << l;
+
+									if (gbuffer) {
+										if (!shaded) {
+											float w1 = (float)(e[1] * inv_area);
+											float w2 = (float)(e[2] * inv_area);
+											float w0 = 1.0f - w1 - w2;
+
+											glm::vec3 pv = tri.position[0] * w0 + tri.position[1] * w1 + tri.position[2] * w2;
+											glm::vec3 nv = glm::normalize(tri.normal[0] * w0 + tri.normal[1] * w1 + tri.normal[2] * w2);
+											p[0] = to_half(pv.x); p[1] = to_half(pv.y); p[2] = to_half(pv.z);
+											n[0] = to_half(nv.x); n[1] = to_half(nv.y); n[2] = to_half(nv.z);
+											o[0] = to_half(tri.origin.x); o[1] = to_half(tri.origin.y);
+											shaded = true;
+										}
+
+										soft_gbuffer* g = static_cast<soft_gbuffer*>(target);
+										std::memcpy(&g->position[i * 3], p, sizeof(p));
+										std::memcpy(&g->normal[i * 3], n, sizeof(n));
+										g->info[i] = tri.value;
+										std::memcpy(&g->origin[i * 2], o, sizeof(o));
+									}
+									else static_cast<soft_mask*>(target)->mask[i] = (uint8_t)tri.value;
+								}
+							}
+
+							e[0] += step_x[0]; e[1] += step_x[1]; e[2] += step_x[2];
+						}
+					}
+
+					for (uint32_t bits = wrote; bits; bits &= bits - 1)
+						slices[lowest_bit(bits)]->update_block(block_x, block_y);
+				}
+			}
+		}
+
+		/* Rasterize everything recorded since the last flush into the bound target */
+		void flush() {
+			if (this->m_draws.empty() || this->m_slices.empty()) {
+				this->m_draws.clear();
+				return;
+			}
+
+			threadpool* pool = threadpool::global();
+
+			// Setup, one draw per job
+			size_t total = 0;
+			for (auto && dc : this->m_draws) {
+				dc.first = total;
+				total += dc.triangles;
+			}
+			this->m_triangles.resize(total);
+
+			pool->parallel_for(this->m_draws.size(), [&](size_t i) {
+				this->setup(this->m_draws[i], this->m_triangles.data() + this->m_draws[i].first);
+			});
+
+			// Binning, contiguous chunks so each tile can walk the chunks in order
+			int width = this->m_slices[0]->width, height = this->m_slices[0]->height;
+			int tiles_x = (width + soft_tile_size - 1) / soft_tile_size;
+			int tiles_y = (height + soft_tile_size - 1) / soft_tile_size;
+			size_t tiles = (size_t)tiles_x * tiles_y;
+
+			size_t chunks = std::max<size_t>(1, std::min<size_t>(pool->size() * 4, total / 4096 + 1));
+			this->m_bins.resize(chunks);
+
+			pool->parallel_for(chunks, [&](size_t c) {
+				std::vector<std::vector<uint32_t>>& bins = this->m_bins[c];
+				bins.resize(tiles);
+				for (auto && b : bins) b.clear();
+
+				size_t begin = total * c / chunks, end = total * (c + 1) / chunks;
+				for (size_t t = begin; t < end; t++) {
+					const triangle& tri = this->m_triangles[t];
+					if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) continue;
+
+					for (int ty = tri.min_y / soft_tile_size; ty <= tri.max_y / soft_tile_size; ty++)
+						for (int tx = tri.min_x / soft_tile_size; tx <= tri.max_x / soft_tile_size; tx++)
+							bins[(size_t)ty * tiles_x + tx].push_back((uint32_t)t);
+				}
+			});
+
+			// Raster, one tile per job
+			pool->parallel_for(tiles, [&](size_t tile) {
+				int x0 = (int)(tile % tiles_x) * soft_tile_size;
+				int y0 = (int)(tile / tiles_x) * soft_tile_size;
+				int x1 = std::min(x0 + soft_tile_size, width) - 1;
+				int y1 = std::min(y0 + soft_tile_size, height) - 1;
+
+				for (size_t c = 0; c < chunks; c++)
+					for (uint32_t t : this->m_bins[c][tile])
+						this->raster(this->m_triangles[t], x0, y0, x1, y1);
+			});
+
+			this->m_draws.clear();
+		}
+
+	public:
+		soft_context() : m_dropped(0) {}
+
+		void bind(target* t) override {
+			this->flush();
+			this->m_slices.clear();
+
+			if (soft_layered* layered = dynamic_cast<soft_layered*>(t)) this->m_slices = layered->slices;
+			else if (t != NULL) this->m_slices.push_back(static_cast<soft_target*>(t));
+		}
+
+		void clear(float value) override {
+			this->flush();
+
+			for (soft_target* target : this->m_slices) {
+				target->clear_depth();
+
+				if (target->type == TARGET_GBUFFER) {
+					soft_gbuffer* g = static_cast<soft_gbuffer*>(target);
+					uint16_t h = to_half(value);
+					std::fill(g->position.begin(), g->position.end(), h);
+					std::fill(g->normal.begin(), g->normal.end(), h);
+					std::fill(g->origin.begin(), g->origin.end(), h);
+					std::fill(g->info.begin(), g->info.end(), 0); // Float clears of integer planes are undefined in GL
+				}
+				else {
+					soft_mask* m = static_cast<soft_mask*>(target);
+					std::fill(m->mask.begin(), m->mask.end(), value > 0.0f ? (uint8_t)value : 0);
+				}
+			}
+		}
+
+		void clear_depth() override {
+			this->flush();
+			for (soft_target* target : this->m_slices) target->clear_depth();
+		}
+
+		void set_culling(bool cull_back) override {
+			if (cull_back != this->m_cull) this->flush();
+			this->m_cull = cull_back;
+		}
+
+		void use(program p) override {
+			this->m_program = p;
+		}
+
+		void set_matrix(const std::string& name, const glm::mat4& value) override {
+			uniforms& u = this->m_uniforms[this->m_program];
+			if (name == "model") u.model = value;
+			else if (name == "view") u.view = value;
+			else if (name == "projection") u.projection = value;
+		}
+
+		void set_unsigned(const std::string& name, unsigned int value) override {
+			uniforms& u = this->m_uniforms[this->m_program];
+			if (name == "Info" && this->m_program == PROGRAM_GBUFFER) u.info = value;
+			else if (name == "srcChr" && this->m_program == PROGRAM_MASK) u.src = value;
+		}
+
+		void set_vec2(const std::string& name, const glm::vec2& value) override {
+			if (name == "origin" && this->m_program == PROGRAM_GBUFFER)
+				this->m_uniforms[this->m_program].origin = value;
+		}
+
+		void set_layers(uint32_t mask) override {
+			this->m_layers = mask;
+		}
+
+		/* A draw of the whole mesh with the current uniforms. False for meshes without what the geometry programs read,
+		   only POS_XYZ_NORMAL_XYZ ones carry it */
+		bool mesh_draw(Mesh* mesh, draw_call& dc) {
+			if (mesh == NULL || mesh->mode != MeshMode::POS_XYZ_NORMAL_XYZ || mesh->vertices.empty()) return false;
+
+			dc.vertices = &mesh->vertices[0];
+			dc.indices = mesh->indices.empty() ? NULL : &mesh->indices[0];
+			dc.triangles = mesh->indices.empty() ? mesh->vertices.size() / 18 : mesh->indices.size() / 3;
+			dc.prog = this->m_program;
+			dc.u = this->m_uniforms[this->m_program];
+			dc.layers = this->m_layers;
+			dc.first = 0;
+			return dc.triangles != 0;
+		}
+
+		void draw(Mesh* mesh) override {
+			draw_call dc;
+			if (this->mesh_draw(mesh, dc)) this->m_draws.push_back(dc);
+		}
+
+		void draw_batch(MeshBatch* batch, const std::vector<batch_draw>& draws) override {
+			draw_call dc;
+			dc.prog = this->m_program;
+			dc.u = this->m_uniforms[this->m_program];
+			dc.first = 0;
+
+			for (auto && d : draws) {
+				const MeshBatch::part& p = batch->parts[d.part];
+				if (p.count < 3) continue;
+
+				dc.vertices = &batch->vertices[0];
+				dc.indices = &batch->indices[p.first];
+				dc.triangles = p.count / 3;
+				dc.u.origin = p.origin;
+				dc.layers = d.layers;
+				this->m_draws.push_back(dc);
+			}
+		}
+
+		/* Binned like any other draws, so this is one draw call per instance sharing the mesh's vertices */
+		void draw_instances(Mesh* mesh, const std::vector<instance>& instances) override {
+			draw_call dc;
+			if (instances.empty() || !this->mesh_draw(mesh, dc)) return;
+
+			glm::mat4 model = dc.u.model;
+			for (auto && inst : instances) {
+				dc.u.model = model * inst.model;
+				dc.u.origin = inst.origin;
+				dc.layers = inst.layers;
+				this->m_draws.push_back(dc);
+			}
+		}
+
+		void finish() override {
+			this->flush();
+		}
+
+		/* Triangles dropped for leaving the guard band or being behind the eye */
+		size_t dropped() const { return this->m_dropped; }
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <ios>
+#include <cstring>
+#include <cstdint>
+
+/* The part of std::istream the model parsers use, over a block of memory that is already loaded (a mapped vpk archive,
+   preload bytes, a mapped loose file). Reads never go outside the block: a short read zero fills what is missing and
+   sets the fail flag, like a stream running into end of file. The memory must outlive the reader */
+class span_reader {
+	const char* m_data;
+	size_t m_size;
+	int64_t m_pos = 0;
+	bool m_fail = false;
+
+public:
+	span_reader(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+	span_reader& read(char* dst, size_t count) {
+		size_t left = (this->m_pos >= 0 && (uint64_t)this->m_pos < this->m_size) ? this->m_size - (size_t)this->m_pos : 0;
+		size_t n = count < left ? count : left;
+
+		if (n) memcpy(dst, this->m_data + this->m_pos, n);
+		if (n < count) {
+			memset(dst + n, 0, count - n);
+			this->m_fail = true;
+		}
+
+		this->m_pos += count;
+		return *this;
+	}
+
+	span_reader& seekg(int64_t pos) {
+		this->m_pos = pos;
+		return *this;
+	}
+
+	span_reader& seekg(int64_t off, std::ios::seekdir dir) {
+		if (dir == std::ios::beg) this->m_pos = off;
+		else if (dir == std::ios::cur) this->m_pos += off;
+		else this->m_pos = (int64_t)this->m_size + off;
+		return *this;
+	}
+
+	int64_t tellg() const { return this->m_pos; }
+
+	/* count packed Ts in place at offset, NULL unless they are all inside the block */
+	template<typename T>
+	const T* at(int64_t offset, int64_t count = 1) const {
+		if (offset < 0 || count < 0 || (uint64_t)offset > this->m_size) return NULL;
+		if ((uint64_t)count > (this->m_size - (size_t)offset) / sizeof(T)) return NULL;
+		return reinterpret_cast<const T*>(this->m_data + offset);
+	}
+
+	bool fail() const { return this->m_fail; }
+	explicit operator bool() const { return !this->m_fail; }
+
+	const char* data() const { return this->m_data; }
+	size_t size() const { return this->m_size; }
+};
@@ -0,0 +1,154 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <memory>
+
+/* Fixed set of worker threads that run parallel_for jobs. The calling thread helps out, so a pool
+   of N threads keeps N + 1 cores busy. One job runs at a time; parallel_for called from inside a job
+   runs serially instead of waiting on itself. */
+class threadpool {
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_job_lock;	// Serializes callers
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	const std::function<void(size_t)>* m_job = NULL;
+	std::atomic<size_t> m_next;
+	size_t m_count = 0;
+	size_t m_pending = 0;
+	unsigned long long m_generation = 0;
+	bool m_stop = false;
+	std::exception_ptr m_error;
+
+	static bool& in_pool() {
+		thread_local bool inside = false;
+		return inside;
+	}
+
+	static unsigned& configured_threads() {
+		static unsigned threads = 0;
+		return threads;
+	}
+
+	static std::unique_ptr<threadpool>& global_instance() {
+		static std::unique_ptr<threadpool> pool;
+		return pool;
+	}
+
+	void work(const std::function<void(size_t)>& fn) {
+		bool was_inside = in_pool();
+		in_pool() = true;
+
+		size_t i;
+		while ((i = this->m_next++) < this->m_count) {
+			try {
+				fn(i);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lk(this->m_lock);
+				if (!this->m_error) this->m_error = std::current_exception();
+			}
+		}
+
+		in_pool() = was_inside;
+	}
+
+	void worker() {
+		unsigned long long seen = 0;
+		while (true) {
+			std::unique_lock<std::mutex> lk(this->m_lock);
+			this->m_wake.wait(lk, [&] { return this->m_stop || this->m_generation != seen; });
+			if (this->m_stop) return;
+
+			seen = this->m_generation;
+			const std::function<void(size_t)>* job = this->m_job;
+			lk.unlock();
+
+			this->work(*job);
+
+			lk.lock();
+			if (--this->m_pending == 0) this->m_done.notify_all();
+		}
+	}
+
+public:
+	/* threads: total threads including the caller. 0 picks one per hardware thread */
+	threadpool(unsigned threads = 0) : m_next(0) {
+		if (threads == 0) threads = std::thread::hardware_concurrency();
+		if (threads == 0) threads = 1;
+
+		for (unsigned i = 1; i < threads; i++)
+			this->m_workers.push_back(std::thread(&threadpool::worker, this));
+	}
+
+	~threadpool() {
+		{
+			std::lock_guard<std::mutex> lk(this->m_lock);
+			this->m_stop = true;
+		}
+		this->m_wake.notify_all();
+
+		for (auto && t : this->m_workers) t.join();
+	}
+
+	threadpool(const threadpool&) = delete;
+	threadpool& operator=(const threadpool&) = delete;
+
+	unsigned size() const { return (unsigned)this->m_workers.size() + 1; }
+
+	/* Calls fn(i) for every i in [0, count). Indices are handed out one at a time, so uneven work balances itself.
+	   The first exception thrown by fn is rethrown here once every index is done. */
+	void parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+		if (count == 0) return;
+
+		if (this->m_workers.empty() || count == 1 || in_pool()) {
+			for (size_t i = 0; i < count; i++) fn(i);
+			return;
+		}
+
+		std::lock_guard<std::mutex> job(this->m_job_lock);
+
+		{
+			std::lock_guard<std::mutex> lk(this->m_lock);
+			this->m_job = &fn;
+			this->m_count = count;
+			this->m_next = 0;
+			this->m_pending = this->m_workers.size();
+			this->m_error = nullptr;
+			this->m_generation++;
+		}
+		this->m_wake.notify_all();
+
+		this->work(fn);
+
+		std::unique_lock<std::mutex> lk(this->m_lock);
+		this->m_done.wait(lk, [&] { return this->m_pending == 0; });
+		this->m_job = NULL;
+
+		if (this->m_error) {
+			std::exception_ptr e = this->m_error;
+			this->m_error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+
+	/* Shared pool, created on first use */
+	static threadpool* global() {
+		std::unique_ptr<threadpool>& pool = global_instance();
+		if (!pool) pool.reset(new threadpool(configured_threads()));
+		return pool.get();
+	}
+
+	/* Thread count for the shared pool (0 = hardware threads). Call before any work is queued */
+	static void set_global_threads(unsigned threads) {
+		configured_threads() = threads;
+		global_instance().reset();
+	}
+};
@@ -5,13 +5,22 @@
 #include <vector>
 #include <map>
 #include <regex>
+#include <string_view>
+#include <algorithm>
+#include <cstdint>
 
 #include <chrono>
 
 #include "Util.h"
+#include "arena.hpp"
+#include "perf.hpp"
+#include "threadpool.hpp"
 
 #define _USE_REGEX
 
+// Define to make FileData use the old line based parser (see DataBlock(std::istringstream*))
+//#define KV_LEGACY_PARSER
+
 namespace kv
 {
 	//const std::regex reg_kv("(\"([^=\"]*)\")|([^=\\s]+)");
@@ -38,6 +47,286 @@ namespace kv
 		return list;
 	}
 
+	enum token_type {
+		TOKEN_STRING,
+		TOKEN_BLOCK_OPEN,
+		TOKEN_BLOCK_CLOSE,
+		TOKEN_EOF
+	};
+
+	struct token {
+		token_type type;
+		std::string_view value; // View into the source buffer (quotes not included)
+		bool quoted;
+	};
+
+	/* Progress callbacks are void(size_t bytes_done, size_t bytes_total), called about once every progress_step bytes
+	   and once more when the end of the buffer is reached */
+	const size_t progress_step = 1 << 20;
+
+	/* Single pass tokenizer over a contiguous buffer. Tokens point into the buffer, so it has to outlive them */
+	class tokenizer {
+		const char* m_begin;
+		const char* m_cur;
+		const char* m_end;
+		void* m_progress_callback;
+		size_t m_report_at;
+
+		void report() {
+			size_t done = this->offset(), total = this->m_end - this->m_begin;
+			util::CastFunctionPtr(this->m_progress_callback, done, total);
+			this->m_report_at = done >= total ? SIZE_MAX : done + progress_step;
+		}
+
+	public:
+		tokenizer(const char* data, size_t length, void* progress_callback = NULL)
+			:
+			m_begin(data),
+			m_cur(data),
+			m_end(data + length),
+			m_progress_callback(progress_callback),
+			m_report_at(progress_callback == NULL ? SIZE_MAX : 0) {}
+
+		size_t offset() const { return this->m_cur - this->m_begin; }
+
+		token next() {
+			if (this->offset() >= this->m_report_at) this->report();
+
+			while (this->m_cur < this->m_end) {
+				switch (*this->m_cur) {
+				case '\n':
+				case ' ': case '\t': case '\r': case '\v': case '\f':
+					this->m_cur++;
+					continue;
+
+				case '{':
+					this->m_cur++;
+					return { TOKEN_BLOCK_OPEN, std::string_view(), false };
+
+				case '}':
+					this->m_cur++;
+					return { TOKEN_BLOCK_CLOSE, std::string_view(), false };
+
+				case '"': {
+					const char* start = ++this->m_cur;
+					while (this->m_cur < this->m_end && *this->m_cur != '"') this->m_cur++;
+
+					token t = { TOKEN_STRING, std::string_view(start, this->m_cur - start), true };
+					if (this->m_cur < this->m_end) this->m_cur++; // Skip closing quote
+					return t;
+				}
+
+				case '/':
+					// Line comment, skip up to (not including) the newline
+					if (this->m_cur + 1 < this->m_end && this->m_cur[1] == '/') {
+						while (this->m_cur < this->m_end && *this->m_cur != '\n') this->m_cur++;
+						continue;
+					}
+
+				default: {
+					const char* start = this->m_cur;
+					while (this->m_cur < this->m_end) {
+						char c = *this->m_cur;
+						if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f' ||
+							c == '{' || c == '}' || c == '"') break;
+						if (c == '/' && this->m_cur + 1 < this->m_end && this->m_cur[1] == '/') break;
+						this->m_cur++;
+					}
+					return { TOKEN_STRING, std::string_view(start, this->m_cur - start), false };
+				}
+				}
+			}
+
+			if (this->m_report_at != SIZE_MAX) this->report();
+			return { TOKEN_EOF, std::string_view(), false };
+		}
+	};
+
+	/* Platform conditionals ( "key" "value" [$WIN32] ) */
+	inline bool is_conditional(const token& t) {
+		return t.type == TOKEN_STRING && !t.quoted && t.value.size() > 0 && t.value[0] == '[';
+	}
+
+	/* Insert a value, renaming repeated keys to key1, key2... */
+	inline void add_value(std::map<std::string, std::string>& values, const std::string& keyname, const std::string& value) {
+		// Fix for multiply defined key-values (THANKS VALVE APPRECIATE THAT)
+		if (!values.count(keyname)) {
+			values.insert({ keyname, value });
+			return;
+		}
+
+		int i = 0;
+		while (values.count(keyname + std::to_string(++i)));
+
+		values.insert({ keyname + std::to_string(i), value });
+	}
+
+	/* Receives parser events from kv::parse. Views point into the source buffer and are only valid during the call */
+	class visitor {
+	public:
+		virtual ~visitor() {}
+
+		virtual void on_block_begin(std::string_view name) = 0;
+		virtual void on_key_value(std::string_view key, std::string_view value) = 0;
+		virtual void on_block_end() = 0;
+	};
+
+	/* Event driven parse, same grammar as DataBlock(tokenizer*). Quoted block names are passed with their quotes,
+	   blocks still open at EOF get their on_block_end, and a stray } at the top level ends the parse. */
+	void parse(const char* data, size_t length, visitor* v, void* progress_callback = NULL) {
+		tokenizer tk(data, length, progress_callback);
+		int depth = 0;
+
+		token t = tk.next();
+		while (t.type != TOKEN_EOF) {
+			if (t.type == TOKEN_BLOCK_CLOSE) {
+				if (depth == 0) return;
+
+				depth--;
+				v->on_block_end();
+				t = tk.next();
+				continue;
+			}
+
+			if (t.type == TOKEN_BLOCK_OPEN) { // Unnamed block
+				depth++;
+				v->on_block_begin(std::string_view());
+				t = tk.next();
+				continue;
+			}
+
+			token n = tk.next();
+
+			if (n.type == TOKEN_BLOCK_OPEN) {
+				depth++;
+				// The closing quote is always there, otherwise the string would have run to EOF
+				v->on_block_begin(t.quoted ? std::string_view(t.value.data() - 1, t.value.size() + 2) : t.value);
+				t = tk.next();
+				continue;
+			}
+
+			if (n.type == TOKEN_STRING && !is_conditional(n)) {
+				token k = t;
+				t = tk.next();
+
+				// Conditional key-values are dropped, same as the line parser
+				if (is_conditional(t)) { t = tk.next(); continue; }
+
+				v->on_key_value(k.value, n.value);
+				continue;
+			}
+
+			t = n;
+		}
+
+		while (depth-- > 0) v->on_block_end();
+	}
+
+	/* Byte offsets of one block, as found by scan_blocks */
+	struct block_range {
+		std::string_view name;	// Quotes included, same as DataBlock names. Empty for unnamed blocks
+		size_t begin;			// Start of the name token (the brace for unnamed blocks)
+		size_t body_begin;		// After the {
+		size_t body_end;		// At the }, or the end of the scanned range if the block is never closed
+		size_t end;				// After the }
+	};
+
+	inline bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+	}
+
+	/* Finds the blocks directly inside [begin, end) without tokenizing their contents. Quotes and // comments are
+	   skipped the same way the tokenizer does, and tokens outside of blocks are paired up the same way as in
+	   kv::parse so a value is never taken for a block name. A stray } stops the scan like it stops kv::parse.
+	   stop receives the offset where scanning ended. */
+	inline std::vector<block_range> scan_blocks(const char* data, size_t begin, size_t end, size_t* stop = NULL) {
+		std::vector<block_range> blocks;
+		block_range cur = {};
+		size_t name_begin = 0, name_end = 0;
+		bool have_name = false;		// A key is waiting for its value (or brace)
+		bool after_value = false;	// A conditional here belongs to the previous key-value
+		int depth = 0;
+
+		size_t i = begin;
+		while (i < end) {
+			char c = data[i];
+
+			if (is_space(c)) { i++; continue; }
+
+			if (c == '{') {
+				if (depth == 0) {
+					cur.name = have_name ? std::string_view(data + name_begin, name_end - name_begin) : std::string_view();
+					cur.begin = have_name ? name_begin : i;
+					cur.body_begin = i + 1;
+				}
+				depth++;
+				have_name = false;
+				after_value = false;
+				i++;
+				continue;
+			}
+
+			if (c == '}') {
+				if (depth == 0) {
+					if (stop != NULL) *stop = i;
+					return blocks;
+				}
+				if (--depth == 0) {
+					cur.body_end = i;
+					cur.end = i + 1;
+					blocks.push_back(cur);
+				}
+				i++;
+				continue;
+			}
+
+			if (c == '/' && i + 1 < end && data[i + 1] == '/') {
+				while (i < end && data[i] != '\n') i++;
+				continue;
+			}
+
+			size_t s = i;
+			if (c == '"') {
+				i++;
+				while (i < end && data[i] != '"') i++;
+				if (i < end) i++;
+			}
+			else {
+				while (i < end) {
+					c = data[i];
+					if (is_space(c) || c == '{' || c == '}' || c == '"') break;
+					if (c == '/' && i + 1 < end && data[i + 1] == '/') break;
+					i++;
+				}
+			}
+
+			if (depth > 0) continue;
+
+			bool conditional = data[s] == '[';
+			if (after_value && conditional) { after_value = false; continue; }
+			after_value = false;
+
+			if (have_name && !conditional) {
+				have_name = false;
+				after_value = true;
+				continue;
+			}
+
+			name_begin = s;
+			name_end = i;
+			have_name = true;
+		}
+
+		if (depth > 0) {
+			cur.body_end = end;
+			cur.end = end;
+			blocks.push_back(cur);
+		}
+
+		if (stop != NULL) *stop = end;
+		return blocks;
+	}
+
 	class DataBlock
 	{
 	public:
@@ -52,7 +341,10 @@ namespace kv
 
 			std::string line, prev = "";
 			while (std::getline(*stream, line)) {
-				if(progress_callback != NULL) util::CastFunctionPtr(progress_callback); //Increment line counter
+				if (progress_callback != NULL) { // Bytes read so far, and in total
+					size_t done = (size_t)stream->tellg();
+					util::CastFunctionPtr(progress_callback, done, done + (size_t)stream->rdbuf()->in_avail());
+				}
 
 				line = split(line, "//")[0];
 
@@ -88,18 +380,66 @@ namespace kv
 				}
 
 				if (strings.size() == 2) {
-					// Fix for multiply defined key-values (THANKS VALVE APPRECIATE THAT)
-					std::string keyname = strings[0];
-					int i = -1;
-					while (this->Values.count((++i > 0 ? keyname + std::to_string(i) : keyname)));
-
-					this->Values.insert({ i > 0 ? keyname + std::to_string(i) : keyname, strings[1] });
+					this->AddValue(strings[0], strings[1]);
 				}
 
 				prev = line;
 			}
 		}
 
+		DataBlock(tokenizer* tk, std::string name = "") {
+			this->name = name;
+
+			token t = tk->next();
+			while (t.type != TOKEN_EOF) {
+				if (t.type == TOKEN_BLOCK_CLOSE) return;
+
+				if (t.type == TOKEN_BLOCK_OPEN) { // Unnamed block
+					this->SubBlocks.push_back(DataBlock(tk));
+					t = tk->next();
+					continue;
+				}
+
+				token n = tk->next();
+
+				if (n.type == TOKEN_BLOCK_OPEN) {
+					// Block names keep their quotes, same as the line parser ( "GameInfo" )
+					this->SubBlocks.push_back(DataBlock(tk, t.quoted ? "\"" + std::string(t.value) + "\"" : std::string(t.value)));
+					t = tk->next();
+					continue;
+				}
+
+				if (n.type == TOKEN_STRING && !is_conditional(n)) {
+					token k = t;
+					t = tk->next();
+
+					// Conditional key-values are dropped, same as the line parser
+					if (is_conditional(t)) { t = tk->next(); continue; }
+
+					this->AddValue(std::string(k.value), std::string(n.value));
+					continue;
+				}
+
+				t = n;
+			}
+		}
+
+		void AddValue(const std::string& keyname, const std::string& value) {
+			add_value(this->Values, keyname, value);
+		}
+
+		/* Deep compare of names, values and sub blocks */
+		bool Equals(const DataBlock& other) const {
+			if (this->name != other.name) return false;
+			if (this->Values != other.Values) return false;
+			if (this->SubBlocks.size() != other.SubBlocks.size()) return false;
+
+			for (int i = 0; i < this->SubBlocks.size(); i++)
+				if (!this->SubBlocks[i].Equals(other.SubBlocks[i])) return false;
+
+			return true;
+		}
+
 		void Serialize(std::ofstream& stream, int depth = 0)
 		{
 			//Build indentation levels
@@ -164,25 +504,109 @@ namespace kv
 		}
 	};
 
+	/* Adds the key-values found in a stretch of text that has no blocks in it */
+	class value_reader : public visitor {
+		DataBlock* m_target;
+	public:
+		value_reader(DataBlock* target) : m_target(target) {}
+
+		void on_block_begin(std::string_view name) override {}
+		void on_key_value(std::string_view key, std::string_view value) override { this->m_target->AddValue(std::string(key), std::string(value)); }
+		void on_block_end() override {}
+	};
+
+	/* Key-values between the blocks of a range, in file order */
+	inline void read_gap_values(const char* data, size_t body_begin, size_t body_end, const std::vector<block_range>& blocks, DataBlock* target) {
+		value_reader reader(target);
+
+		size_t from = body_begin;
+		for (auto && b : blocks) {
+			if (b.begin > from) parse(data + from, b.begin - from, &reader);
+			from = b.end;
+		}
+		if (body_end > from) parse(data + from, body_end - from, &reader);
+	}
+
+	/* Parses the top-level blocks, and the children of very large ones (world), concurrently. The pre-scan fixes every
+	   block's slot up front so the tree comes out in file order no matter which thread finishes first.
+	   Gives the same tree as DataBlock(tokenizer*) for well formed files. */
+	inline DataBlock parse_parallel(const char* data, size_t length, threadpool* pool) {
+		struct task {
+			size_t begin, end;
+			DataBlock* out;
+		};
+
+		DataBlock head;
+		size_t stop;
+		std::vector<block_range> top = scan_blocks(data, 0, length, &stop);
+		read_gap_values(data, 0, stop, top, &head);
+
+		// Blocks bigger than this get their children spread out instead
+		size_t split_size = std::max<size_t>(length / (pool->size() * 4), 1 << 16);
+
+		std::vector<task> tasks;
+		head.SubBlocks.resize(top.size());
+		for (size_t i = 0; i < top.size(); i++) {
+			const block_range& r = top[i];
+			if (r.end - r.begin < split_size) {
+				tasks.push_back({ r.begin, r.end, &head.SubBlocks[i] });
+				continue;
+			}
+
+			DataBlock& block = head.SubBlocks[i];
+			block.name = std::string(r.name);
+
+			std::vector<block_range> children = scan_blocks(data, r.body_begin, r.body_end);
+			read_gap_values(data, r.body_begin, r.body_end, children, &block);
+
+			block.SubBlocks.resize(children.size());
+			for (size_t j = 0; j < children.size(); j++)
+				tasks.push_back({ children[j].begin, children[j].end, &block.SubBlocks[j] });
+		}
+
+		pool->parallel_for(tasks.size(), [&](size_t i) {
+			const task& t = tasks[i];
+			tokenizer tk(data + t.begin, t.end - t.begin);
+			DataBlock wrapper(&tk);
+			if (!wrapper.SubBlocks.empty()) *t.out = std::move(wrapper.SubBlocks[0]);
+		});
+
+		return head;
+	}
+
 	class FileData
 	{
 	public:
 		DataBlock headNode;
 
-		FileData(std::string filestring, void* progress_callback = NULL)
+		FileData(const char* data, size_t length, void* progress_callback = NULL)
 		{
-			std::istringstream sr(filestring);
-
 			auto start = std::chrono::high_resolution_clock::now();
 
+#ifdef KV_LEGACY_PARSER
+			std::istringstream sr(std::string(data, length));
 			this->headNode = DataBlock(&sr, "", progress_callback);
+#else
+			// Progress is only reported by the serial parse
+			threadpool* pool = threadpool::global();
+			if (pool->size() > 1) {
+				this->headNode = parse_parallel(data, length, pool);
+			}
+			else {
+				tokenizer tk(data, length, progress_callback);
+				this->headNode = DataBlock(&tk);
+			}
+#endif
 
 
 			auto elapsed = std::chrono::high_resolution_clock::now() - start;
 			long long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
-			std::cout << "KV Read time: " << milliseconds << "ms" << std::endl;
+			std::cout << "KV Read time: " << milliseconds << "ms (" << threadpool::global()->size() << " threads, peak RSS: " << perf::format_mb(perf::peak_rss()) << ")" << std::endl;
 		}
 
+		FileData(const std::string& filestring, void* progress_callback = NULL)
+			: FileData(filestring.data(), filestring.size(), progress_callback) {}
+
 		FileData()
 		{
 
@@ -190,4 +614,261 @@ namespace kv
 
 		~FileData() {}
 	};
+
+	struct doc_value {
+		unsigned int key;  // Interned key
+		const char* value; // NUL terminated
+	};
+
+	/* Node of a kv::document. Names, keys, values and child arrays all live in the document's arena */
+	struct doc_node {
+		const string_table* strings;
+		unsigned int name;
+
+		doc_node* children;
+		unsigned int num_children;
+
+		doc_value* values; // Sorted by key id, repeated keys stay in file order
+		unsigned int num_values;
+
+		const char* get_name() const { return this->strings->name(this->name); }
+
+		std::pair<const doc_value*, const doc_value*> range(const char* key) const {
+			int id = this->strings->find(key);
+			if (id < 0) return { this->values, this->values };
+
+			return std::equal_range(this->values, this->values + this->num_values, doc_value{ static_cast<unsigned int>(id), NULL },
+				[](const doc_value& a, const doc_value& b) { return a.key < b.key; });
+		}
+
+		/* First value with this key */
+		const char* get(const char* key, const char* default_value = "") const {
+			auto r = this->range(key);
+			if (r.first == r.second) return default_value;
+			return r.first->value;
+		}
+
+		bool has(const char* key) const {
+			auto r = this->range(key);
+			return r.first != r.second;
+		}
+
+		/* All values with this key, in file order */
+		std::vector<const char*> get_all(const char* key) const {
+			std::vector<const char*> list;
+			auto r = this->range(key);
+			for (const doc_value* v = r.first; v != r.second; v++) list.push_back(v->value);
+			return list;
+		}
+
+		doc_node* first(const char* _name) {
+			int id = this->strings->find(_name);
+			if (id < 0) return NULL;
+
+			for (unsigned int i = 0; i < this->num_children; i++)
+				if (this->children[i].name == static_cast<unsigned int>(id)) return &this->children[i];
+			return NULL;
+		}
+
+		std::vector<doc_node*> all(const char* _name) {
+			std::vector<doc_node*> c;
+			int id = this->strings->find(_name);
+			if (id < 0) return c;
+
+			for (unsigned int i = 0; i < this->num_children; i++)
+				if (this->children[i].name == static_cast<unsigned int>(id)) c.push_back(&this->children[i]);
+			return c;
+		}
+
+		/* Values in the same layout as DataBlock::Values (repeated keys get suffixed 1, 2, 3...) */
+		std::map<std::string, std::string> to_map() const {
+			std::map<std::string, std::string> map;
+			for (unsigned int i = 0; i < this->num_values; i++)
+				add_value(map, this->strings->name(this->values[i].key), this->values[i].value);
+			return map;
+		}
+	};
+
+	/* Alternative to FileData. The whole tree is bump allocated from one arena and key names are interned,
+	   so parsing does very few heap allocations and dropping the document frees everything at once. */
+	class document {
+		arena m_arena;
+		string_table m_strings;
+		doc_node m_root;
+
+		// Collects parser events into arena nodes. Children and values of open blocks are kept in scratch
+		// vectors and copied into the arena once their block closes.
+		class builder : public visitor {
+			struct frame {
+				unsigned int name;
+				size_t first_child;
+				size_t first_value;
+			};
+
+			document* m_doc;
+			std::vector<frame> m_stack;
+			std::vector<doc_node> m_children; // Finished children of every open block
+			std::vector<doc_value> m_values;  // Values of every open block
+
+			doc_node close_block(const frame& f) {
+				doc_node node;
+				node.strings = &this->m_doc->m_strings;
+				node.name = f.name;
+
+				node.num_children = static_cast<unsigned int>(this->m_children.size() - f.first_child);
+				node.children = this->m_doc->m_arena.alloc_array<doc_node>(node.num_children);
+				std::copy(this->m_children.begin() + f.first_child, this->m_children.end(), node.children);
+				this->m_children.resize(f.first_child);
+
+				std::stable_sort(this->m_values.begin() + f.first_value, this->m_values.end(), [](const doc_value& a, const doc_value& b) { return a.key < b.key; });
+				node.num_values = static_cast<unsigned int>(this->m_values.size() - f.first_value);
+				node.values = this->m_doc->m_arena.alloc_array<doc_value>(node.num_values);
+				std::copy(this->m_values.begin() + f.first_value, this->m_values.end(), node.values);
+				this->m_values.resize(f.first_value);
+
+				return node;
+			}
+
+		public:
+			builder(document* doc) : m_doc(doc) {
+				this->m_stack.push_back({ doc->m_strings.intern(""), 0, 0 });
+			}
+
+			void on_block_begin(std::string_view name) override {
+				this->m_stack.push_back({ this->m_doc->m_strings.intern(name), this->m_children.size(), this->m_values.size() });
+			}
+
+			void on_key_value(std::string_view key, std::string_view value) override {
+				this->m_values.push_back({ this->m_doc->m_strings.intern(key), this->m_doc->m_arena.copy_string(value) });
+			}
+
+			void on_block_end() override {
+				frame f = this->m_stack.back(); this->m_stack.pop_back();
+				this->m_children.push_back(this->close_block(f));
+			}
+
+			doc_node finish() { return this->close_block(this->m_stack.back()); }
+		};
+
+	public:
+		document(const char* data, size_t length, void* progress_callback = NULL)
+			:
+			m_strings(&m_arena)
+		{
+			perf::timer t;
+
+			builder b(this);
+			parse(data, length, &b, progress_callback);
+			this->m_root = b.finish();
+
+			std::cout << "KV Read time (arena): " << t.ms() << "ms (peak RSS: " << perf::format_mb(perf::peak_rss())
+				<< ", arena: " << perf::format_mb(this->m_arena.reserved())
+				<< ", " << this->m_strings.size() << " unique names)" << std::endl;
+		}
+
+		document(const std::string& filestring, void* progress_callback = NULL)
+			: document(filestring.data(), filestring.size(), progress_callback) {}
+
+		document(const document&) = delete;
+		document& operator=(const document&) = delete;
+
+		doc_node* root() { return &this->m_root; }
+
+		size_t arena_bytes() const { return this->m_arena.reserved(); }
+	};
+
+	/* Which tree the map loaders build */
+	enum tree_mode {
+		TREE_DATABLOCK,
+		TREE_ARENA,
+		TREE_NONE // No tree, the loader consumes kv::parse events directly
+	};
+
+	/* Accessors with the same shape for both trees, so loaders can be written once for DataBlock* and doc_node* */
+	inline const char* value(DataBlock* block, const char* key) {
+		auto it = block->Values.find(key);
+		if (it == block->Values.end()) return "";
+		return it->second.c_str();
+	}
+
+	inline const char* value(doc_node* node, const char* key) { return node->get(key); }
+
+	inline bool has_value(DataBlock* block, const char* key) { return block->Values.count(key) > 0; }
+	inline bool has_value(doc_node* node, const char* key) { return node->has(key); }
+
+	/* All values of a repeated key (key, key1, key2... in a DataBlock) */
+	inline std::vector<const char*> value_list(DataBlock* block, const char* key) {
+		std::vector<const char*> list;
+
+		int vc = -1;
+		std::map<std::string, std::string>::iterator it;
+		while ((it = block->Values.find(key + (++vc > 0 ? std::to_string(vc) : ""))) != block->Values.end()) list.push_back(it->second.c_str());
+
+		return list;
+	}
+
+	inline std::vector<const char*> value_list(doc_node* node, const char* key) { return node->get_all(key); }
+
+	inline std::map<std::string, std::string> value_map(DataBlock* block) { return block->Values; }
+	inline std::map<std::string, std::string> value_map(doc_node* node) { return node->to_map(); }
+
+	inline DataBlock* first_block(DataBlock* block, const char* name) { return block->_GetFirstByName(name); }
+	inline doc_node* first_block(doc_node* node, const char* name) { return node->first(name); }
+
+	inline std::vector<DataBlock*> blocks(DataBlock* block, const char* name) { return block->_GetAllByName(name); }
+	inline std::vector<doc_node*> blocks(doc_node* node, const char* name) { return node->all(name); }
+
+	inline const char* block_name(DataBlock* block) { return block->name.c_str(); }
+	inline const char* block_name(doc_node* node) { return node->get_name(); }
+
+	/* Deep compare of a DataBlock tree against a document tree */
+	bool equals(DataBlock* block, doc_node* node) {
+		if (block->name != node->get_name()) return false;
+		if (block->Values != node->to_map()) return false;
+		if (block->SubBlocks.size() != node->num_children) return false;
+
+		for (unsigned int i = 0; i < node->num_children; i++)
+			if (!equals(&block->SubBlocks[i], &node->children[i])) return false;
+
+		return true;
+	}
+
+	/* Parse the same source with the line parser, the tokenizer, the arena document and the parallel parse, report timings and whether the trees match */
+	bool compare_parsers(const char* data, size_t length) {
+		auto start = std::chrono::high_resolution_clock::now();
+		std::istringstream sr(std::string(data, length));
+		DataBlock legacy(&sr);
+		long long ms_legacy = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		tokenizer tk(data, length);
+		DataBlock tokenized(&tk);
+		long long ms_tokenizer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		document arena_doc(data, length);
+		long long ms_arena = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		DataBlock parallel = parse_parallel(data, length, threadpool::global());
+		long long ms_parallel = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		bool match = legacy.Equals(tokenized);
+		bool match_arena = equals(&tokenized, arena_doc.root());
+		bool match_parallel = tokenized.Equals(parallel);
+
+#ifdef _USE_REGEX
+		std::cout << "KV line parser (regex): " << ms_legacy << "ms\n";
+#else
+		std::cout << "KV line parser (split): " << ms_legacy << "ms\n";
+#endif
+		std::cout << "KV tokenizer:           " << ms_tokenizer << "ms\n";
+		std::cout << "KV tokenizer (arena):   " << ms_arena << "ms\n";
+		std::cout << "KV tokenizer (" << threadpool::global()->size() << " threads): " << ms_parallel << "ms\n";
+		std::cout << "Output " << (match ? "matches" : "DIFFERS") << "\n";
+		std::cout << "Arena output " << (match_arena ? "matches" : "DIFFERS") << "\n";
+		std::cout << "Parallel output " << (match_parallel ? "matches" : "DIFFERS") << "\n";
+
+		return match && match_arena && match_parallel;
+	}
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
 #include "vpk.hpp"
+#include "span_reader.hpp"
+#include "mapped_file.hpp"
 #include "vdf.hpp"
 #include "vvd.hpp"
 #include "vtx.hpp"
@@ -9,7 +11,7 @@
 class vfilesys : public util::verboseControl {
 public:
 	// Cached items
-	vpk::index* vpkIndex;
+	vpk::index* vpkIndex = NULL;
 	kv::DataBlock* gameinfo;
 
 	// Paths
@@ -95,7 +97,9 @@ public:
 		std::cout << "\n";
 	}
 
-	/* Create a file handle on an existing resource file. Could be from vpk, could be from custom. Returns null if not found */
+	/* Parse an existing resource file into a new T. Could be from vpk, could be from custom. T is constructed from a
+	   span_reader over the file's bytes, which are only valid during the constructor. Returns null if not found.
+	   Safe to call from several threads at once */
 	template<typename T>
 	T* get_resource_handle(std::string relpath) {
 		// Order of importantness:
@@ -106,26 +110,39 @@ public:
 			vpk::vEntry* vEntry = this->vpkIndex->find(relpath);
 
 			if (vEntry != NULL) {
-				std::string pakDir = this->dir_exedir + "csgo/pak01_" + sutil::pad0(std::to_string(vEntry->entryInfo.ArchiveIndex), 3) + ".vpk";
+				vpk::file contents = this->vpkIndex->open(*vEntry);
+				if (!contents.good) return NULL;
 
-				std::ifstream pkHandle(pakDir, std::ios::in | std::ios::binary);
-
-				pkHandle.seekg(vEntry->entryInfo.EntryOffset); // set that ifstream to read from the correct location
-				return new T(&pkHandle);
+				span_reader reader(contents.data, contents.size);
+				return new T(&reader);
 			}
 		}
 		
 		// Check all search paths for custom content
 		for (auto && sp : this->searchPaths) {
 			if (fs::checkFileExist((sp + relpath).c_str())) {
-				std::ifstream pkHandle(sp + relpath, std::ios::in | std::ios::binary);
-				return new T(&pkHandle);
+				mapped_file contents(sp + relpath);
+				if (!contents.good()) return NULL;
+
+				span_reader reader(contents.data(), contents.size());
+				return new T(&reader);
 			}
 		}
 
 		return NULL;
 	}
 
+	/* CRC of a file that get_resource_handle would read out of the vpk. False for files that are not in it */
+	bool get_vpk_crc(const std::string& relpath, uint32_t& crc) {
+		if (this->vpkIndex == NULL) return false;
+
+		vpk::vEntry* vEntry = this->vpkIndex->find(relpath);
+		if (vEntry == NULL) return false;
+
+		crc = vEntry->entryInfo.CRC;
+		return true;
+	}
+
 	/* Generate a path to a file inside the gamedir. Optionally automatically create new directories (shell). */
 	std::string create_output_filepath(std::string relpath, bool mkdr = false, bool verbose = true) {
 		this->use_verbose = verbose;
@@ -13,15 +13,18 @@
 #include "Util.h"
 #include "vfilesys.hpp"
 #include "vdf.hpp"
+#include "mapped_file.hpp"
 #include "plane.h"
 #include "Mesh.hpp"
 #include "convexPolytope.h"
+#include "displacement.hpp"
 #include "fuzzy_select.h"
 #include "interpolation.h"
 #include "vpk.hpp"
 
 #include "vtx.hpp"
 #include "vvd.hpp"
+#include "model_loader.hpp"
 
 #include <algorithm>
 
@@ -107,15 +110,8 @@ namespace vmf_parse {
 
 namespace vmf {
 
-	int current_line = 0;
-	int line_count = 0;
-	void progress_callback() {
-		current_line++;
-
-		if (current_line == line_count - 1)
-			std::cout << "Line " << current_line << "/" << line_count << "\n";
-		if(((current_line % 10000) == 0))
-			std::cout << "Line " << current_line << "/" << line_count << "\r";
+	void progress_callback(size_t done, size_t total) {
+		std::cout << "Read " << perf::format_mb(done) << "/" << perf::format_mb(total) << (done >= total ? "\n" : "\r");
 	}
 
 	enum team {
@@ -129,14 +125,12 @@ namespace vmf {
 	};
 
 	struct DispInfo {
-		int power;
 		glm::vec3 startposition;
 
-		std::vector<std::vector<glm::vec3>> normals;
-		std::vector<std::vector<float>> distances;
+		displacement::grid grid; // Power, normals and distances
 
 		// OpenGL generated mesh
-		Mesh* glMesh;
+		Mesh* glMesh = NULL;
 	};
 
 	struct Side {
@@ -162,7 +156,7 @@ namespace vmf {
 
 		BoundingBox bounds;
 
-		Mesh* mesh;
+		Mesh* mesh = NULL;
 	};
 
 	struct BuyZone {
@@ -210,44 +204,41 @@ namespace vmf {
 
 		std::string filepath;
 
-		vmf(std::string path){
+		/* Empty map, filled in by vmfc::load */
+		vmf() {}
+
+		vmf(std::string path, kv::tree_mode mode = kv::TREE_DATABLOCK){
 			this->filepath = path;
 
 			std::cout << "Opening: " << path << "\n";
 
-			std::ifstream ifs(path);
-			if (!ifs) {
+			mapped_file file(path);
+			if (!file.good()) {
 				std::cout << "Could not open file... " << path << std::endl;
 				throw std::exception("File read error");
 			}
 
-			std::cout << "Initializing VMF read\n";
-			std::ifstream _ifs(path);
-
-			// new lines will be skipped unless we stop it from happening:    
-			_ifs.unsetf(std::ios_base::skipws);
-
-			// count the newlines with an algorithm specialized for counting:
-			line_count = std::count(
-				std::istream_iterator<char>(_ifs),
-				std::istream_iterator<char>(),
-				'\n');
-
-			_ifs.close();
-
-			std::cout << "Reading raw VMF\n";
-			std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-
-			std::cout << "Processing VMF data\n";
-			kv::FileData data(str, &progress_callback);
+			std::cout << "Processing VMF data (" << perf::format_mb(file.size()) << (file.is_mapped() ? ", mapped" : ", buffered") << ")\n";
+			if (mode == kv::TREE_ARENA) {
+				kv::document data(file.data(), file.size(), &progress_callback);
+				this->load(data.root());
+			}
+			else {
+				if (mode == kv::TREE_NONE) std::cout << "Streaming load is not supported by this loader, reading DataBlocks\n";
 
-			this->internal = data;
+				this->internal = kv::FileData(file.data(), file.size(), &progress_callback);
+				this->load(&this->internal.headNode);
+			}
+		}
 
+		// Build solids, entities and visgroups from either KV tree (kv::DataBlock or kv::doc_node)
+		template<typename B>
+		void load(B* head) {
 #pragma region Solids
 			std::cout << "Processing solids\n";
 
 			//Process solids list
-			std::vector<kv::DataBlock> SolidList = data.headNode.GetFirstByName("world")->GetAllByName("solid");
+			std::vector<B*> SolidList = kv::blocks(kv::first_block(head, "world"), "solid");
 			int total = SolidList.size();
 
 			for (int i = 0; i < SolidList.size(); i++){
@@ -257,22 +248,24 @@ namespace vmf {
 				{
 					std::cout << "last\n";
 				}
-				kv::DataBlock cBlock = SolidList[i];
+				B* cBlock = SolidList[i];
 
 				Solid solid;
+				solid.fileorder_id = i;
+				solid.ID = ::atoi(kv::value(cBlock, "id"));
 				bool valid = true;
 
-				std::vector<kv::DataBlock> Sides = cBlock.GetAllByName("side");
+				std::vector<B*> Sides = kv::blocks(cBlock, "side");
 				for (int j = 0; j < Sides.size(); j++)
 				{
-					kv::DataBlock cSide = Sides[j];
+					B* cSide = Sides[j];
 
 					Side side;
-					side.ID = ::atof(cSide.Values["id"].c_str());
-					side.texture = cSide.Values["material"];
+					side.ID = ::atof(kv::value(cSide, "id"));
+					side.texture = kv::value(cSide, "material");
 
 					Plane plane;
-					if (!vmf_parse::plane(cSide.Values["plane"], &plane))
+					if (!vmf_parse::plane(kv::value(cSide, "plane"), &plane))
 					{
 						valid = false; break;
 					}
@@ -285,37 +278,21 @@ namespace vmf {
 
 					DispInfo* dispInfo = new DispInfo;
 
-					kv::DataBlock* dblockInfo = cSide.GetFirstByName("dispinfo");
+					B* dblockInfo = kv::first_block(cSide, "dispinfo");
 
 					if (dblockInfo != NULL){
 						solid.containsDisplacements = true; // Mark we have displacements here
 
-						kv::DataBlock* dblockNormals = dblockInfo->GetFirstByName("normals");
-						kv::DataBlock* dblockDistances = dblockInfo->GetFirstByName("distances");
-						dispInfo->power = std::stoi(dblockInfo->Values["power"]);
-						vmf_parse::Vector3fS(dblockInfo->Values["startposition"], &dispInfo->startposition);
-
-						int i_target = glm::pow(2, dispInfo->power) + 1;
-
-						for (int x = 0; x < i_target; x++) { //Row
-							dispInfo->normals.push_back(std::vector<glm::vec3>()); //Create row container
-							dispInfo->distances.push_back(std::vector<float>()); //Create distances container
-
-							//Parse in the normals
-							std::vector<std::string> values = split(dblockNormals->Values["row" + std::to_string(x)]);
-							std::vector<float> list;
-							for (auto && v : values) list.push_back(::atof(v.c_str()));
+						B* dblockNormals = kv::first_block(dblockInfo, "normals");
+						B* dblockDistances = kv::first_block(dblockInfo, "distances");
+						dispInfo->grid.resize(std::stoi(kv::value(dblockInfo, "power")));
+						vmf_parse::Vector3fS(kv::value(dblockInfo, "startposition"), &dispInfo->startposition);
 
-							//Parse in the distances
-							std::vector<std::string> _values = split(dblockDistances->Values["row" + std::to_string(x)]);
-							for (auto && v : _values) dispInfo->distances[x].push_back(std::stof(v.c_str()));
+						for (int x = 0; x < dispInfo->grid.size; x++) { //Row
+							std::string row = "row" + std::to_string(x);
 
-							for (int xx = 0; xx < i_target; xx++) { //Column
-								dispInfo->normals[x].push_back(
-									glm::vec3(list[xx * 3 + 0], 
-										list[xx * 3 + 1], 
-										list[xx * 3 + 2]));
-							}
+							dispInfo->grid.read_normals(x, kv::value(dblockNormals, row.c_str()));
+							dispInfo->grid.read_distances(x, kv::value(dblockDistances, row.c_str()));
 						}
 
 						side.displacement = dispInfo;
@@ -325,16 +302,15 @@ namespace vmf {
 					solid.faces.push_back(side);
 				}
 
-				kv::DataBlock* editorValues = cBlock.GetFirstByName("editor");
+				B* editorValues = kv::first_block(cBlock, "editor");
 
 				if (editorValues != NULL) {
 					//Gather up the visgroups
-					int viscount = -1;
-					while (editorValues->Values.count("visgroupid" + (++viscount > 0 ? std::to_string(viscount) : "")))
-						solid.visgroupids.push_back(std::stoi(editorValues->Values["visgroupid" + (viscount > 0 ? std::to_string(viscount) : "")]));
+					for (auto && vgroup : kv::value_list(editorValues, "visgroupid"))
+						solid.visgroupids.push_back(std::stoi(vgroup));
 
 					glm::vec3 color;
-					if (vmf_parse::Vector3f(editorValues->Values["color"], &color))
+					if (vmf_parse::Vector3f(kv::value(editorValues, "color"), &color))
 						solid.color = glm::vec3(color.x / 255.0f, color.y / 255.0f, color.z / 255.0f);
 					else
 					solid.color = glm::vec3(1, 0, 0);
@@ -353,52 +329,53 @@ namespace vmf {
 			std::cout << "Processing entites\n";
 
 			//Process entities list
-			std::vector<kv::DataBlock> EntitiesList = data.headNode.GetAllByName("entity");
+			std::vector<B*> EntitiesList = kv::blocks(head, "entity");
 			for (auto && block : EntitiesList) {
 				//Check wether origin can be resolved for entity
-				if ((block.GetFirstByName("solid") == NULL) && (block.Values.count("origin") == 0)) {
-					std::cout << "Origin could not be resolved for entity with ID " << block.Values["id"]; continue;
+				if ((kv::first_block(block, "solid") == NULL) && !kv::has_value(block, "origin")) {
+					std::cout << "Origin could not be resolved for entity with ID " << kv::value(block, "id"); continue;
 				}
 
 				Entity ent;
-				ent.classname = block.Values["classname"];
-				ent.ID = (int)::atof(block.Values["id"].c_str());
-				ent.keyValues = block.Values;
+				ent.classname = kv::value(block, "classname");
+				ent.ID = (int)::atof(kv::value(block, "id"));
+				ent.keyValues = kv::value_map(block);
 
 				//Gather up the visgroups
-				kv::DataBlock* editorValues = block.GetFirstByName("editor");
-				int viscount = -1;
-				while (editorValues->Values.count("visgroupid" + (++viscount > 0 ? std::to_string(viscount) : ""))) {
-					ent.visgroupids.push_back(std::stoi(editorValues->Values["visgroupid" + (viscount > 0 ? std::to_string(viscount) : "")]));
+				B* editorValues = kv::first_block(block, "editor");
+				std::vector<const char*> ent_visgroups = kv::value_list(editorValues, "visgroupid");
+				for (auto && vgroup : ent_visgroups) {
+					ent.visgroupids.push_back(std::stoi(vgroup));
 				}
 
 				glm::vec3 loc = glm::vec3();
-				if (block.Values.count("origin")) {							//Start with hammer origin
-					vmf_parse::Vector3f(block.Values["origin"], &loc);
+				if (kv::has_value(block, "origin")) {							//Start with hammer origin
+					vmf_parse::Vector3f(kv::value(block, "origin"), &loc);
 					ent.origin = glm::vec3(loc.x, loc.y, loc.z);
 				}
-				else if (block.GetFirstByName("solid") != NULL) {			//Try to process it from solid
+				else if (kv::first_block(block, "solid") != NULL) {			//Try to process it from solid
 					//Get all solids
-					std::vector<kv::DataBlock> _solids = block.GetAllByName("solid");
+					std::vector<B*> _solids = kv::blocks(block, "solid");
 					//std::vector<Solid> _solids_ent;
 					for (int i = 0; i < _solids.size(); i++)
 					{
-						kv::DataBlock cBlock = _solids[i];
+						B* cBlock = _solids[i];
 
 						Solid solid;
+						solid.ID = ::atoi(kv::value(cBlock, "id"));
 						bool valid = true;
 
-						std::vector<kv::DataBlock> Sides = cBlock.GetAllByName("side");
+						std::vector<B*> Sides = kv::blocks(cBlock, "side");
 						for (int j = 0; j < Sides.size(); j++)
 						{
-							kv::DataBlock cSide = Sides[j];
+							B* cSide = Sides[j];
 
 							Side side;
-							side.ID = ::atof(cSide.Values["id"].c_str());
-							side.texture = cSide.Values["material"];
+							side.ID = ::atof(kv::value(cSide, "id"));
+							side.texture = kv::value(cSide, "material");
 
 							Plane plane;
-							if (!vmf_parse::plane(cSide.Values["plane"], &plane))
+							if (!vmf_parse::plane(kv::value(cSide, "plane"), &plane))
 							{
 								valid = false; break;
 							}
@@ -411,14 +388,13 @@ namespace vmf {
 						//Gather up the visgroups
 						//TODO: move this dupe code away from solid processing
 						// add reference to source entity, to provide link to visgroups.
-						int viscount = -1;
-						while (editorValues->Values.count("visgroupid" + (++viscount > 0 ? std::to_string(viscount) : ""))) {
-							solid.visgroupids.push_back(std::stoi(editorValues->Values["visgroupid" + (viscount > 0 ? std::to_string(viscount) : "")]));
-							ent.visgroupids.push_back(std::stoi(editorValues->Values["visgroupid" + (viscount > 0 ? std::to_string(viscount) : "")]));
+						for (auto && vgroup : ent_visgroups) {
+							solid.visgroupids.push_back(std::stoi(vgroup));
+							ent.visgroupids.push_back(std::stoi(vgroup));
 						}
 
 						glm::vec3 color;
-						if (vmf_parse::Vector3f(editorValues->Values["color"], &color))
+						if (vmf_parse::Vector3f(kv::value(editorValues, "color"), &color))
 							solid.color = glm::vec3(color.x / 255.0f, color.y / 255.0f, color.z / 255.0f);
 						else
 							solid.color = glm::vec3(1, 0, 0);
@@ -460,11 +436,11 @@ namespace vmf {
 			std::cout << "Processing visgroups\n";
 
 			//Process Visgroups
-			std::vector<kv::DataBlock> VisList = data.headNode.GetFirstByName("visgroups")->GetAllByName("visgroup");
+			std::vector<B*> VisList = kv::blocks(kv::first_block(head, "visgroups"), "visgroup");
 			for (auto v : VisList) {
-				this->visgroups.insert({ std::stoi(v.Values["visgroupid"]), v.Values["name"] });
+				this->visgroups.insert({ std::stoi(kv::value(v, "visgroupid")), kv::value(v, "name") });
 
-				std::cout << "Visgroup {" << std::stoi(v.Values["visgroupid"]) << "} = '" << v.Values["name"] << "'\n";
+				std::cout << "Visgroup {" << std::stoi(kv::value(v, "visgroupid")) << "} = '" << kv::value(v, "name") << "'\n";
 			}
 		}
 
@@ -589,77 +565,84 @@ namespace vmf {
 		void ComputeGLMeshes() {
 			auto start = std::chrono::high_resolution_clock::now();
 
+			std::vector<Solid*> brushes;
+			for (auto && solid : this->solids) brushes.push_back(&solid);
+			for (auto && ent : this->entities)
+				for (auto && _solid : ent.internal_solids) brushes.push_back(&_solid);
+
+			// Geometry only, every brush on its own. GL calls have to wait for the thread that owns the context
 			std::cout << "Processing solid meshes... ";
-			for (int i = 0; i < this->solids.size(); i++) {
+			std::vector<std::vector<float>> meshData(brushes.size());
+			threadpool* pool = threadpool::global();
+			pool->parallel_for(brushes.size(), [&](size_t i) {
 				std::vector<Plane> sidePlanes;
-				for (int j = 0; j < this->solids[i].faces.size(); j++)
-					sidePlanes.push_back(this->solids[i].faces[j].plane);
-
-				Polytope p = Polytope(sidePlanes);
-				this->solids[i].mesh = p.GeneratedMesh;
-				this->solids[i].origin = (p.NWU + p.SEL) * 0.5f;
-				this->solids[i].bounds.NWU = p.NWU;
-				this->solids[i].bounds.SEL = p.SEL;
-			}
+				for (auto && f : brushes[i]->faces)
+					sidePlanes.push_back(f.plane);
+
+				Polytope p = Polytope(sidePlanes, false);
+				meshData[i].swap(p.meshData);
+				brushes[i]->origin = (p.NWU + p.SEL) * 0.5f;
+				brushes[i]->bounds.NWU = p.NWU;
+				brushes[i]->bounds.SEL = p.SEL;
+			});
 			std::cout << "done\n";
 
-			std::cout << "Processing entity solid meshes... ";
-			for (auto && ent : this->entities) {
-				for (auto && _solid : ent.internal_solids) {
-					std::vector<Plane> sidePlanes;
-					for (auto f : _solid.faces)
-						sidePlanes.push_back(f.plane);
-
-					Polytope p = Polytope(sidePlanes);
-					_solid.mesh = p.GeneratedMesh;
-					_solid.origin = (p.NWU + p.SEL) * 0.5f;
-					_solid.bounds.NWU = p.NWU;
-					_solid.bounds.SEL = p.SEL;
-				}
+			auto geometry = std::chrono::high_resolution_clock::now();
+
+			std::cout << "Uploading solid meshes... ";
+			for (int i = 0; i < brushes.size(); i++) {
+				brushes[i]->mesh = meshData[i].empty() ? NULL : new Mesh(meshData[i], MeshMode::POS_XYZ_NORMAL_XYZ);
+				std::vector<float>().swap(meshData[i]);
 			}
 			std::cout << "done\n";
 
-			auto elapsed = std::chrono::high_resolution_clock::now() - start;
-			long long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+			auto end = std::chrono::high_resolution_clock::now();
 
-			std::cout << "GL mesh computation: " << milliseconds << "ms" << std::endl;
+			std::cout << "Solid geometry: " << std::chrono::duration_cast<std::chrono::milliseconds>(geometry - start).count() << "ms ("
+				<< brushes.size() << " brushes, " << pool->size() << " threads)" << std::endl;
+			std::cout << "GL upload: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - geometry).count() << "ms" << std::endl;
 		}
 
-		/* Collect all references to model strings, and build their models */
+		/* Collect all references to model strings, and build their models (parsed in parallel, uploaded in order) */
 		void populateModelDict(vfilesys* filesystem) {
 			std::cout << "Populating model dictionary & caching model data...\n";
 
-			unsigned int mIndex = 0;
+			std::vector<std::string> names;
 			for (auto && ent : this->findEntitiesByClassName("prop_static")) {
 				std::string modelName = kv::tryGetStringValue(ent->keyValues, "model", "error.mdl");
-				std::string baseName = split(modelName, ".")[0];
 				if (this->modelDict.count(modelName)) continue; // Skip already defined models
 
-				this->modelDict.insert({ modelName, mIndex++ }); // Add to our list
-
-				vtx_mesh* vtx = filesystem->get_resource_handle<vtx_mesh>(baseName + ".dx90.vtx");
-				vvd_data* vvd = filesystem->get_resource_handle<vvd_data>(baseName + ".vvd");
-
-				if (vvd == NULL || vtx == NULL) {
-					this->modelCache.push_back(NULL);
-					std::cout << "Failed to load resource: " << baseName << "\n";
-					continue;
-				}
+				this->modelDict.insert({ modelName, (unsigned int)(this->modelCache.size() + names.size()) }); // Add to our list
+				names.push_back(modelName);
+			}
 
+			models::load_stats stats;
+			auto loads = models::load_all<std::vector<float>>(filesystem, names, [](const std::string& name, const vtx_mesh& vtx, vvd_data& vvd, std::vector<float>& meshData) {
 				// GENERATE MESH TING
-				std::vector<float> meshData;
-				for (auto && vert : vtx->vertexSequence) {
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecPosition.x);
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecPosition.y);
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecPosition.z);
+				for (auto && vert : vtx.lods[0].vertexSequence) {
+					if (vert >= vvd.vertex_count()) throw std::exception("vtx index past the end of the .vvd");
+					meshData.push_back(vvd.vertices[vert * 6 + 0]);
+					meshData.push_back(vvd.vertices[vert * 6 + 1]);
+					meshData.push_back(vvd.vertices[vert * 6 + 2]);
 					meshData.push_back(0);
 					meshData.push_back(0);
 					meshData.push_back(1);
 				}
+			}, &stats);
 
-				Mesh* m = new Mesh(meshData, MeshMode::POS_XYZ_NORMAL_XYZ);
+			for (auto && l : loads) {
+				if (!l.ok) {
+					this->modelCache.push_back(NULL);
+					std::cout << "Failed to load resource: " << l.name << " (" << l.error << ")\n";
+					continue;
+				}
+
+				Mesh* m = new Mesh(l.data, MeshMode::POS_XYZ_NORMAL_XYZ);
 				this->modelCache.push_back(m);
 			}
+
+			std::cout << "Models: " << stats.loaded << " loaded, " << stats.failed << " failed in " << stats.ms << "ms ("
+				<< stats.model_ms << "ms of work over " << stats.threads << " threads)" << std::endl;
 		}
 
 		/* Calls all other setup functions in order... */
@@ -699,195 +682,86 @@ namespace vmf {
 
 			std::cout << "Computing displacements...\n";
 
-			for (auto && v :this->solids) {
-				if (v.containsDisplacements) {
-
-					std::vector<Plane> planes;
-					for (auto && face : v.faces) planes.push_back(face.plane);
-
-					Polytope polyTope = Polytope(planes, true, false); // Generate polytope so we can look at the individual ngon points
-
-					for (auto && side :v.faces) {
-						if (side.displacement != NULL) {
-							DispInfo* info = side.displacement;
-
-							BrushPolygon* bpoly = NULL;
-
-							std::map<float, BrushPolygon*> normalCorrelations;
-
-							//Sort planes by their similarity to the face's normal direction
-							for (auto && fuck : polyTope.ngons)
-								normalCorrelations.insert({ glm::distance(fuck.plane.normal, side.plane.normal), &fuck });
-
-							bpoly = normalCorrelations.begin()->second;
-
-							if (bpoly->vertices.size() != 4) {
-								std::cout << "Displacement info matched to face with {" << bpoly->vertices.size() << "} vertices!!!\n"; continue;
-							}
-
-							// Match the 'starting point' of dispinfo
-							std::map<float, glm::vec3*> distancesToStart;
-							for (auto && point : bpoly->vertices)
-								distancesToStart.insert({ glm::distance(info->startposition, point), &point });
-
-							// The corners of the displacement
-							glm::vec3* SW = distancesToStart.begin()->second;
-
-							// Find what point in the vector it was
-							int pos = 0;
-							for (auto && point : bpoly->vertices)
-								if (&point == SW) break; else pos++;
+			// Every displacement gets a slot up front, so solids can be tessellated in any order
+			std::vector<Solid*> jobs;
+			std::vector<size_t> firstDisp;
+			std::vector<DispInfo*> disps;
+			for (auto && v : this->solids) {
+				if (!v.containsDisplacements) continue;
 
-							// Get the rest of the points, in clockwise order (they should already be sorted by polytope generation)
-							glm::vec3* NW = &bpoly->vertices[(pos + 1) % 4];
-							glm::vec3* NE = &bpoly->vertices[(pos + 2) % 4];
-							glm::vec3* SE = &bpoly->vertices[(pos + 3) % 4];
+				jobs.push_back(&v);
+				firstDisp.push_back(disps.size());
+				for (auto && side : v.faces)
+					if (side.displacement != NULL) disps.push_back(side.displacement);
+			}
 
-							int points = glm::pow(2, info->power) + 1; // calculate the point count (5, 9, 17)
+			std::vector<std::vector<float>> meshData(disps.size());
+			std::vector<size_t> faceSizes(disps.size(), 4);
 
-							// Initialize list for floats
-							std::vector<float> meshPoints;
+			threadpool* pool = threadpool::global();
+			pool->parallel_for(jobs.size(), [&](size_t j) {
+				Solid& v = *jobs[j];
 
-							std::vector<glm::vec3> finalPoints;
-							std::vector<glm::vec3> finalNormals;
+				std::vector<Plane> planes;
+				for (auto && face : v.faces) planes.push_back(face.plane);
 
-							glm::vec3* NWU = &v.bounds.NWU;
-							glm::vec3* SEL = &v.bounds.SEL;
+				std::vector<std::vector<glm::vec3>> windings = brush::windings(planes);
 
-							for (int row = 0; row < points; row++) {
-								for (int col = 0; col < points; col++) {
-									//Generate original base points
+				size_t d = firstDisp[j];
+				for (auto && side : v.faces) {
+					if (side.displacement == NULL) continue;
+					DispInfo* info = side.displacement;
+					size_t slot = d++;
 
-									float dx = (float)col / (float)(points-1); //Time values for linear interpolation
-									float dy = (float)row / (float)(points-1);
+					// Face whose normal is closest to the side's own
+					size_t match = 0;
+					float closest = glm::distance(planes[0].normal, side.plane.normal);
+					for (size_t i = 1; i < planes.size(); i++) {
+						float dist = glm::distance(planes[i].normal, side.plane.normal);
+						if (dist < closest) { closest = dist; match = i; }
+					}
 
-									glm::vec3 LWR = lerp(*SW, *SE, dx);
-									glm::vec3 UPR = lerp(*NW, *NE, dx);
-									glm::vec3 P = lerp(LWR, UPR, dy); // Original point location
+					std::vector<glm::vec3>& face = windings[match];
+					if (face.size() != 4) { faceSizes[slot] = face.size(); continue; }
 
-									glm::vec3 offset = info->normals[col][row] * info->distances[col][row]; // Calculate offset
-									P = P + offset; //Add offset to P
+					const glm::vec3* points = displacement::build_points(info->grid, face.data(), info->startposition);
 
-									finalPoints.push_back(P);
-									finalNormals.push_back(info->normals[col][row]);
+					//Recompute bounds while we are at it
+					glm::vec3* NWU = &v.bounds.NWU;
+					glm::vec3* SEL = &v.bounds.SEL;
+					for (size_t i = 0; i < info->grid.normals.size(); i++) {
+						const glm::vec3& P = points[i];
+						NWU->x = glm::max(-P.x, NWU->x);
+						NWU->y = glm::max(P.z, NWU->y);
+						NWU->z = glm::max(P.y, NWU->z);
 
-									//Recompute bounds while we are at it
-									NWU->x = glm::max(-P.x, NWU->x);
-									NWU->y = glm::max(P.z, NWU->y);
-									NWU->z = glm::max(P.y, NWU->z);
+						SEL->x = glm::min(-P.x, SEL->x);
+						SEL->y = glm::min(P.z, SEL->y);
+						SEL->z = glm::min(P.y, SEL->z);
+					}
 
-									SEL->x = glm::min(-P.x, SEL->x);
-									SEL->y = glm::min(P.z, SEL->y);
-									SEL->z = glm::min(P.y, SEL->z);
-								}
-							}
+					meshData[slot].resize(displacement::float_count(info->grid));
+					if (!meshData[slot].empty())
+						displacement::tessellate_smooth(info->grid, points, meshData[slot].data());
+				}
+			});
 
-							int i_condition = 0;
-							for (int row = 0; row < points - 1; row++) {
-								for (int col = 0; col < points - 1; col++) {
-
-									// Gather point pointers
-									// hehe :(
-									glm::vec3* SW   =	&finalPoints	[((row + 0) * points) + (col + 0)];
-									glm::vec3* SW_N =	&finalNormals	[((row + 0) * points) + (col + 0)];
-									glm::vec3* SE   =	&finalPoints	[((row + 0) * points) + (col + 1)];
-									glm::vec3* SE_N =	&finalNormals	[((row + 0) * points) + (col + 1)];
-									glm::vec3* NW   =	&finalPoints	[((row + 1) * points) + (col + 0)];
-									glm::vec3* NW_N =	&finalNormals	[((row + 1) * points) + (col + 0)];
-									glm::vec3* NE   =	&finalPoints	[((row + 1) * points) + (col + 1)];
-									glm::vec3* NE_N =	&finalNormals	[((row + 1) * points) + (col + 1)];
-									
-									if (i_condition++ % 2 == 0) {//Condition 0
-										meshPoints.push_back(-SW->x);
-										meshPoints.push_back(SW->z);
-										meshPoints.push_back(SW->y);
-										meshPoints.push_back(-SW_N->x);
-										meshPoints.push_back(SW_N->z);
-										meshPoints.push_back(SW_N->y);
-										meshPoints.push_back(-NW->x);
-										meshPoints.push_back(NW->z);
-										meshPoints.push_back(NW->y);
-										meshPoints.push_back(-NW_N->x);
-										meshPoints.push_back(NW_N->z);
-										meshPoints.push_back(NW_N->y);
-										meshPoints.push_back(-NE->x);
-										meshPoints.push_back(NE->z);
-										meshPoints.push_back(NE->y);
-										meshPoints.push_back(-NE_N->x);
-										meshPoints.push_back(NE_N->z);
-										meshPoints.push_back(NE_N->y);
-										meshPoints.push_back(-SW->x); // tri2
-										meshPoints.push_back(SW->z);
-										meshPoints.push_back(SW->y);
-										meshPoints.push_back(-SW_N->x);
-										meshPoints.push_back(SW_N->z);
-										meshPoints.push_back(SW_N->y);
-										meshPoints.push_back(-NE->x);
-										meshPoints.push_back(NE->z);
-										meshPoints.push_back(NE->y);
-										meshPoints.push_back(-NE_N->x);
-										meshPoints.push_back(NE_N->z);
-										meshPoints.push_back(NE_N->y);
-										meshPoints.push_back(-SE->x);
-										meshPoints.push_back(SE->z);
-										meshPoints.push_back(SE->y);
-										meshPoints.push_back(-SE_N->x);
-										meshPoints.push_back(SE_N->z);
-										meshPoints.push_back(SE_N->y);
-									}
-									else { //Condition 1
-										meshPoints.push_back(-SW->x);
-										meshPoints.push_back(SW->z);
-										meshPoints.push_back(SW->y);
-										meshPoints.push_back(-SW_N->x);
-										meshPoints.push_back(SW_N->z);
-										meshPoints.push_back(SW_N->y);
-										meshPoints.push_back(-NW->x);
-										meshPoints.push_back(NW->z);
-										meshPoints.push_back(NW->y);
-										meshPoints.push_back(-NW_N->x);
-										meshPoints.push_back(NW_N->z);
-										meshPoints.push_back(NW_N->y);
-										meshPoints.push_back(-SE->x);
-										meshPoints.push_back(SE->z);
-										meshPoints.push_back(SE->y);
-										meshPoints.push_back(-SE_N->x);
-										meshPoints.push_back(SE_N->z);
-										meshPoints.push_back(SE_N->y);
-										meshPoints.push_back(-NW->x); //tri2
-										meshPoints.push_back(NW->z);
-										meshPoints.push_back(NW->y);
-										meshPoints.push_back(-NW_N->x);
-										meshPoints.push_back(NW_N->z);
-										meshPoints.push_back(NW_N->y);
-										meshPoints.push_back(-NE->x);
-										meshPoints.push_back(NE->z);
-										meshPoints.push_back(NE->y);
-										meshPoints.push_back(-NE_N->x);
-										meshPoints.push_back(NE_N->z);
-										meshPoints.push_back(NE_N->y);
-										meshPoints.push_back(-SE->x);
-										meshPoints.push_back(SE->z);
-										meshPoints.push_back(SE->y);
-										meshPoints.push_back(-SE_N->x);
-										meshPoints.push_back(SE_N->z);
-										meshPoints.push_back(SE_N->y);
-									}
-								}
-								i_condition++;
-							}
+			auto geometry = std::chrono::high_resolution_clock::now();
 
-							Mesh* _glMesh = new Mesh(meshPoints);
-							info->glMesh = _glMesh;
-						}
-					}
+			for (size_t i = 0; i < disps.size(); i++) {
+				if (faceSizes[i] != 4) {
+					std::cout << "Displacement info matched to face with {" << faceSizes[i] << "} vertices!!!\n"; continue;
 				}
+
+				disps[i]->glMesh = new Mesh(meshData[i]);
+				std::vector<float>().swap(meshData[i]);
 			}
 
-			auto elapsed = std::chrono::high_resolution_clock::now() - start;
-			long long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+			auto end = std::chrono::high_resolution_clock::now();
 
-			std::cout << "Displacement computation: " << milliseconds << "ms" << std::endl;
+			std::cout << "Displacement computation: " << std::chrono::duration_cast<std::chrono::milliseconds>(geometry - start).count() << "ms ("
+				<< disps.size() << " displacements, " << pool->size() << " threads)" << std::endl;
+			std::cout << "Displacement upload: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - geometry).count() << "ms" << std::endl;
 		}
 
 		/* Load all vmf instances. */
@@ -4,11 +4,14 @@
 #include <fstream>
 #include <sstream>
 #include "vdf.hpp"
+#include "mapped_file.hpp"
 
 // stl containers
 #include <vector>
 #include <map>
 #include <set>
+#include <memory>
+#include <mutex>
 
 // opengl
 #include <glad\glad.h>
@@ -20,6 +23,8 @@
 //engine
 #include "Util.h"
 #include "plane.h"
+#include "brush.hpp"
+#include "displacement.hpp"
 #include "Mesh.hpp"
 #include "Shader.hpp"
 #include "IRenderable.hpp"
@@ -30,6 +35,9 @@
 
 // Source sdk
 #include "vfilesys.hpp"
+#include "model_loader.hpp"
+#include "model_cache.hpp"
+#include "model_lod.hpp"
 
 // UINT16 buffer bit definitions ================
 // Byte 0
@@ -160,6 +168,7 @@ namespace vmf_parse {
 class material {
 public:
 	static std::map<std::string, material*> m_index;
+	static std::mutex m_index_lock; // Sides are read from several threads
 
 	std::string name;
 	bool draw = true;
@@ -172,6 +181,7 @@ public:
 	}
 
 	static material* get(const std::string& tex) {
+		std::lock_guard<std::mutex> lk(material::m_index_lock);
 		if (material::m_index.count(tex)) return material::m_index[tex];
 
 		material::m_index.insert({ tex, new material(tex) });
@@ -189,7 +199,8 @@ public:
 	dispinfo* m_dispinfo = NULL;
 	std::vector<glm::vec3> m_vertices;
 
-	static side* create(kv::DataBlock* dataSrc);
+	template<typename B>
+	static side* create(B* dataSrc);
 
 	void howmany() {
 		debug(this->m_vertices.size());
@@ -198,259 +209,91 @@ public:
 
 class dispinfo : public IRenderable{
 public:
-	unsigned int power;
 	glm::vec3 startposition;
-
-	std::vector<std::vector<glm::vec3>> normals;
-	std::vector<std::vector<float>> distances;
+	displacement::grid m_grid;
 
 	side* m_source_side = NULL;
+	IndexedMesh m_mesh_data; // Built by compute_mesh_data, freed once uploaded
 
-	dispinfo(kv::DataBlock* dataSrc, side* src_side) {
+	dispinfo(side* src_side) {
 		this->m_source_side = src_side;
+	}
 
-		kv::DataBlock* kv_normals = dataSrc->_GetFirstByName("normals");
-		kv::DataBlock* kv_distances = dataSrc->_GetFirstByName("distances");
-
-		this->power = std::stoi(dataSrc->Values["power"]);
-		vmf_parse::Vector3fS(dataSrc->Values["startposition"], &this->startposition);
-
-		int i_target = glm::pow(2, this->power) + 1;
+	template<typename B>
+	dispinfo(B* dataSrc, side* src_side) {
+		this->m_source_side = src_side;
 
-		for (int x = 0; x < i_target; x++) {
-			this->normals.push_back(std::vector<glm::vec3>());
-			this->distances.push_back(std::vector<float>());
+		B* kv_normals = kv::first_block(dataSrc, "normals");
+		B* kv_distances = kv::first_block(dataSrc, "distances");
 
-			// Read normals
-			std::vector<float> list;
-			for (auto && v : split(kv_normals->Values["row" + std::to_string(x)])) 
-				list.push_back(::atof(v.c_str()));
+		this->set_power(std::stoi(kv::value(dataSrc, "power")));
+		vmf_parse::Vector3fS(kv::value(dataSrc, "startposition"), &this->startposition);
 
-			for (int xx = 0; xx < i_target; xx++) {
-				this->normals[x].push_back(
-					glm::vec3(
-						list[xx * 3 + 0],
-						list[xx * 3 + 1],
-						list[xx * 3 + 2])
-				);
-			}
+		for (int x = 0; x < this->m_grid.size; x++) {
+			std::string row = "row" + std::to_string(x);
 
-			// Read distances
-			for (auto && v : split(kv_distances->Values["row" + std::to_string(x)]))
-				this->distances[x].push_back(std::stof(v.c_str()));
+			this->read_normals(x, kv::value(kv_normals, row.c_str()));
+			this->read_distances(x, kv::value(kv_distances, row.c_str()));
 		}
 	}
 
-	// internal draw method
-	void IRenderable::_Draw(Shader* shader, std::vector<glm::mat4> transform_stack = {}) { 
-		this->m_mesh->Draw();
+	/* Sizes the grid, power has to be known before any rows are read */
+	void set_power(unsigned int _power) {
+		this->m_grid.resize(_power);
 	}
 
-	// Compute GL Mesh
-	void IRenderable::SetupDrawable() {
-		if (this->m_source_side->m_vertices.size() != 4) {
-			debug("Displacement info matched to face with {", this->m_source_side->m_vertices.size(), "} vertices!!!");
-			return;
-		}
-
-		// Match 'starting point'
-		std::map<float, glm::vec3*> distancesToStart;
-		for (auto && p : this->m_source_side->m_vertices)
-			distancesToStart.insert({ glm::distance(this->startposition, p), &p });
-
-		// The corners of displacement
-		glm::vec3* SW = distancesToStart.begin()->second;
-
-		// Find what point in vector it was
-		int pos = 0;
-		for (auto && point : this->m_source_side->m_vertices)
-			if (&point == SW) break; else pos++;
-
-		// Get the rest of the points, in clockwise order (they should already be sorted by polytope generation)
-		glm::vec3* NW = &this->m_source_side->m_vertices[(pos + 1) % 4];
-		glm::vec3* NE = &this->m_source_side->m_vertices[(pos + 2) % 4];
-		glm::vec3* SE = &this->m_source_side->m_vertices[(pos + 3) % 4];
-
-		int points = glm::pow(2, this->power) + 1; // calculate the point count (5, 9, 17)
-
-												   // Initialize list for floats
-		std::vector<float> meshData;
-
-		std::vector<glm::vec3> finalPoints;
-		std::vector<glm::vec3> finalNormals;
-
-		for (int row = 0; row < points; row++) {
-			for (int col = 0; col < points; col++) {
-				//Generate original base points
-
-				float dx = (float)col / (float)(points - 1); //Time values for linear interpolation
-				float dy = (float)row / (float)(points - 1);
-
-				glm::vec3 LWR = lerp(*SW, *SE, dx);
-				glm::vec3 UPR = lerp(*NW, *NE, dx);
-				glm::vec3 P = lerp(LWR, UPR, dy); // Original point location
-
-				glm::vec3 offset = this->normals[col][row] * this->distances[col][row]; // Calculate offset
-				P = P + offset; //Add offset to P
+	void read_normals(int row, const std::string& str) {
+		this->m_grid.read_normals(row, str.c_str());
+	}
 
-				finalPoints.push_back(P);
-			}
-		}
+	void read_distances(int row, const std::string& str) {
+		this->m_grid.read_distances(row, str.c_str());
+	}
 
-		for (int row = 0; row < points; row++) {
-			for (int col = 0; col < points; col++) {
-				std::vector<glm::vec3*> kernalpts = { NULL, NULL, NULL, NULL };
+	// internal draw method
+	void IRenderable::_Draw(render::context* ctx, std::vector<glm::mat4> transform_stack = {}) { 
+		ctx->draw(this->m_mesh);
+	}
 
-				if(row + 1 < points)	kernalpts[0] = &finalPoints[((row + 1) * points) + (col + 0)];
-				if(col - 1 > 0)			kernalpts[1] = &finalPoints[((row + 0) * points) + (col - 1)];
-				
-				if(row - 1 > 0)			kernalpts[2] = &finalPoints[((row - 1) * points) + (col + 0)];
-				if(col + 1 < points)	kernalpts[3] = &finalPoints[((row + 0) * points) + (col + 1)];
+	/* Tessellate into m_mesh_data, welding the corners neighbouring triangles share. Needs the source side's vertices,
+	   safe to run on any thread */
+	void compute_mesh_data() {
+		this->m_mesh_data.clear();
+		if (this->m_source_side->m_vertices.size() != 4) return;
 
-				glm::vec3* A = &finalPoints[((row + 0) * points) + (col + 0)];
-				glm::vec3 cNorm = glm::vec3(1, 0, 0);
+		const glm::vec3* points = displacement::build_points(this->m_grid, this->m_source_side->m_vertices.data(), this->startposition);
 
-				for (int t = 0; t < 1; t++) {
-					glm::vec3* B = kernalpts[(t + 0) % 4];
-					glm::vec3* C = kernalpts[(t + 1) % 4];
+		thread_local std::vector<float> flat;
+		flat.resize(displacement::float_count(this->m_grid));
+		if (flat.empty()) return;
 
-					if ((B != NULL) && (C != NULL)) {
-						glm::vec3 v0 = *A - *C;
-						glm::vec3 v1 = *B - *C;
-						glm::vec3 n = glm::cross(v0, v1);
-						cNorm += glm::normalize(n);
-					}
-				}
+		displacement::tessellate_flat(this->m_grid, points, flat.data());
+		this->m_mesh_data.weld(flat.data(), flat.size() / displacement::floats_per_vertex);
+	}
 
-				finalNormals.push_back(glm::normalize(cNorm));
-			}
+	// Compute GL Mesh
+	void IRenderable::SetupDrawable() {
+		if (this->m_source_side->m_vertices.size() != 4) {
+			debug("Displacement info matched to face with {", this->m_source_side->m_vertices.size(), "} vertices!!!");
+			return;
 		}
 
-		int i_condition = 0;
-		for (int row = 0; row < points - 1; row++) {
-			for (int col = 0; col < points - 1; col++) {
-				// Gather point pointers
-				// hehe :(
-				glm::vec3* SW	=	&finalPoints	[((row + 0) * points) + (col + 0)];
-				glm::vec3* SW_N =	&finalNormals	[((row + 0) * points) + (col + 0)];
-				glm::vec3* SE	=	&finalPoints	[((row + 0) * points) + (col + 1)];
-				glm::vec3* SE_N =	&finalNormals	[((row + 0) * points) + (col + 1)];
-				glm::vec3* NW	=	&finalPoints	[((row + 1) * points) + (col + 0)];
-				glm::vec3* NW_N =	&finalNormals	[((row + 1) * points) + (col + 0)];
-				glm::vec3* NE	=	&finalPoints	[((row + 1) * points) + (col + 1)];
-				glm::vec3* NE_N =	&finalNormals	[((row + 1) * points) + (col + 1)];
-
-#pragma region lots of triangles
-				// Insert triangles.
-				if (i_condition++ % 2 == 0) {//Condition 0
-					glm::vec3 n1 = get_normal(*SW, *NW, *NE);
-					meshData.push_back(-NE->x);
-					meshData.push_back(NE->z);
-					meshData.push_back(NE->y);
-					meshData.push_back(-n1.x);
-					meshData.push_back(n1.z);
-					meshData.push_back(n1.y);
-
-					meshData.push_back(-NW->x);
-					meshData.push_back(NW->z);
-					meshData.push_back(NW->y);
-					meshData.push_back(-n1.x);
-					meshData.push_back(n1.z);
-					meshData.push_back(n1.y);
-
-					meshData.push_back(-SW->x);
-					meshData.push_back(SW->z);
-					meshData.push_back(SW->y);
-					meshData.push_back(-n1.x);
-					meshData.push_back(n1.z);
-					meshData.push_back(n1.y);
-
-					glm::vec3 n2 = get_normal(*SW, *NE, *SE);
-					meshData.push_back(-SE->x);
-					meshData.push_back(SE->z);
-					meshData.push_back(SE->y);
-					meshData.push_back(-n2.x);
-					meshData.push_back(n2.z);
-					meshData.push_back(n2.y);
-
-					meshData.push_back(-NE->x);
-					meshData.push_back(NE->z);
-					meshData.push_back(NE->y);
-					meshData.push_back(-n2.x);
-					meshData.push_back(n2.z);
-					meshData.push_back(n2.y);
-
-					meshData.push_back(-SW->x); // tri2
-					meshData.push_back(SW->z);
-					meshData.push_back(SW->y);
-					meshData.push_back(-n2.x);
-					meshData.push_back(n2.z);
-					meshData.push_back(n2.y);
-				}
-				else { //Condition 1
-					glm::vec3 n1 = get_normal(*SW, *NW, *SE);
-					meshData.push_back(-SE->x);
-					meshData.push_back(SE->z);
-					meshData.push_back(SE->y);
-					meshData.push_back(-n1.x);
-					meshData.push_back(n1.z);
-					meshData.push_back(n1.y);
-
-					meshData.push_back(-NW->x);
-					meshData.push_back(NW->z);
-					meshData.push_back(NW->y);
-					meshData.push_back(-n1.x);
-					meshData.push_back(n1.z);
-					meshData.push_back(n1.y);
-
-					meshData.push_back(-SW->x);
-					meshData.push_back(SW->z);
-					meshData.push_back(SW->y);
-					meshData.push_back(-n1.x);
-					meshData.push_back(n1.z);
-					meshData.push_back(n1.y);
-
-
-					glm::vec3 n2 = get_normal(*NW, *NE, *SE);
-					meshData.push_back(-SE->x);
-					meshData.push_back(SE->z);
-					meshData.push_back(SE->y);
-					meshData.push_back(-n2.x);
-					meshData.push_back(n2.z);
-					meshData.push_back(n2.y);
-
-					meshData.push_back(-NE->x);
-					meshData.push_back(NE->z);
-					meshData.push_back(NE->y);
-					meshData.push_back(-n2.x);
-					meshData.push_back(n2.z);
-					meshData.push_back(n2.y);
-
-					meshData.push_back(-NW->x); //tri2
-					meshData.push_back(NW->z);
-					meshData.push_back(NW->y);
-					meshData.push_back(-n2.x);
-					meshData.push_back(n2.z);
-					meshData.push_back(n2.y);
-				}
-#pragma endregion
-
-			}
-			i_condition++;
-		}
+		if (this->m_mesh_data.empty()) this->compute_mesh_data();
 
-		this->m_mesh = new Mesh(meshData, MeshMode::POS_XYZ_NORMAL_XYZ);
+		this->m_mesh = new Mesh(this->m_mesh_data);
+		this->m_mesh_data.clear();
 	}
 };
 
-side* side::create(kv::DataBlock* dataSrc) {
+template<typename B>
+side* side::create(B* dataSrc) {
 	side* s = new side();
-	s->m_ID = ::atof(dataSrc->Values["id"].c_str());
-	s->m_texture = material::get(dataSrc->Values["material"]);
+	s->m_ID = ::atof(kv::value(dataSrc, "id"));
+	s->m_texture = material::get(kv::value(dataSrc, "material"));
 
-	if (!vmf_parse::plane(dataSrc->Values["plane"], &s->m_plane)) return s;
+	if (!vmf_parse::plane(kv::value(dataSrc, "plane"), &s->m_plane)) return s;
 
-	kv::DataBlock* kv_dispInfo = dataSrc->_GetFirstByName("dispinfo");
+	B* kv_dispInfo = kv::first_block(dataSrc, "dispinfo");
 	if (kv_dispInfo != NULL) s->m_dispinfo = new dispinfo(kv_dispInfo, s);
 	return s;
 }
@@ -465,19 +308,27 @@ public:
 	TAR_MIBUFFER_FLAGS m_miflags;
 
 	editorvalues(){}
-	editorvalues(kv::DataBlock* dataSrc) {
+	template<typename B>
+	editorvalues(B* dataSrc) {
 		if (dataSrc == NULL) return;
 
-		for (auto && vgroup : kv::getList(dataSrc->Values, "visgroupid")) {
-			unsigned int vgroupid = std::stoi(vgroup);
-			this->m_visgroups.push_back(vgroupid);
+		for (auto && vgroup : kv::value_list(dataSrc, "visgroupid"))
+			this->add_visgroup(std::stoi(vgroup));
 
-			if (g_visgroup_flag_translations.count(vgroupid))
-				this->m_miflags |= g_visgroup_flag_translations[vgroupid];
-		}
+		this->read_color(kv::value(dataSrc, "color"));
+	}
+
+	void add_visgroup(unsigned int vgroupid) {
+		this->m_visgroups.push_back(vgroupid);
+
+		auto flags = g_visgroup_flag_translations.find(vgroupid);
+		if (flags != g_visgroup_flag_translations.end())
+			this->m_miflags |= flags->second;
+	}
 
+	void read_color(const std::string& str) {
 #ifdef VMF_READ_SOLID_COLORS
-		if (vmf_parse::Vector3f(dataSrc->Values["color"], &this->m_editorcolor))
+		if (vmf_parse::Vector3f(str, &this->m_editorcolor))
 			this->m_editorcolor = this->m_editorcolor / 255.0f;
 		else
 			this->m_editorcolor = glm::vec3(1, 0, 0);
@@ -491,78 +342,49 @@ public:
 	editorvalues m_editorvalues;
 	glm::vec3 NWU;
 	glm::vec3 SEL;
+	int m_fileorder_id = -1; // Index in the world block
+	int m_batch_part = -1;	// Part of vmf::m_world_batch, -1 when there is nothing to draw
+	IndexedMesh m_mesh_data; // Built by compute_mesh_data, freed once uploaded
 
-	solid(kv::DataBlock* dataSrc) {
+	solid() {}
+
+	template<typename B>
+	solid(B* dataSrc) {
 		// Read editor values
-		this->m_editorvalues = editorvalues(dataSrc->_GetFirstByName("editor"));
+		this->m_editorvalues = editorvalues(kv::first_block(dataSrc, "editor"));
 
 		// Read solids
-		for (auto && s : dataSrc->_GetAllByName("side")) {
+		for (auto && s : kv::blocks(dataSrc, "side")) {
 			m_sides.push_back(side::create(s));
 		}
+	}
 
-		// Process polytope problem. (still questionable why this is a thing)
-		std::vector<glm::vec3> intersecting;
+	/* Clip the side planes against each other to get face vertices and bounds. Call once all sides are read */
+	void compute_polytope() {
+		std::vector<Plane> planes;
+		for (auto && side : this->m_sides) planes.push_back(side->m_plane);
+
+		// Ordered, welded face windings. Vertices shared by more than three planes end up on every face that touches them
+		std::vector<std::vector<glm::vec3>> windings = brush::windings(planes);
 
 		float x, _x, y, _y, z, _z;
 		x = _y = _z = 99999.0f;// std::numeric_limits<float>::max();
 		_x = y = z = -99999.0f;// std::numeric_limits<float>::min();
 
-		for (int i = 0; i < m_sides.size(); i++) {
-			for (int j = 0; j < m_sides.size(); j++) {
-				for (int k = 0; k < m_sides.size(); k++) {
-					// skip common planes
-					if (i == j || i == k || j == k) continue;
-
-					// Calculate intersection of 3 planes
-					// will return false if unable to solve (planes are parralel)
-					glm::vec3 p(0, 0, 0);
-					if (!Plane::FinalThreePlaneIntersection(
-						this->m_sides[i]->m_plane,
-						this->m_sides[j]->m_plane,
-						this->m_sides[k]->m_plane,
-						&p)) continue;
-
-					// Check if we are part of the solid using simple polarity checks
-					bool inbounds = true;
-					for (auto && m : this->m_sides) {
-						if (Plane::EvalPointPolarity(m->m_plane, p) < -0.01f) {
-							inbounds = false;
-							break;
-						}
-					} if (!inbounds) continue;
-
-					// Check if there is already a very similar vertex, and skip it
-					bool similar = false;
-					for (auto && v : intersecting) 
-						if (glm::distance(v, p) < 0.5f) {
-							similar = true; break;
-					}
-					if (similar) continue;
-
-					// Add points to all surfaces
-					this->m_sides[i]->m_vertices.push_back(p);
-					this->m_sides[j]->m_vertices.push_back(p);
-					this->m_sides[k]->m_vertices.push_back(p);
-
-					intersecting.push_back(p);
-
-					// Calculate bounds
-					_x = glm::round(glm::max(_x, p.x));
-					_y = glm::round(glm::min(_y, p.y));
-					_z = glm::round(glm::min(_z, p.z));
-					x = glm::round(glm::min(x, p.x));
-					y = glm::round(glm::max(y, p.y));
-					z = glm::round(glm::max(z, p.z));
-				}
+		for (int i = 0; i < this->m_sides.size(); i++) {
+			this->m_sides[i]->m_vertices = windings[i];
+
+			// Calculate bounds
+			for (auto && p : windings[i]) {
+				_x = glm::round(glm::max(_x, p.x));
+				_y = glm::round(glm::min(_y, p.y));
+				_z = glm::round(glm::min(_z, p.z));
+				x = glm::round(glm::min(x, p.x));
+				y = glm::round(glm::max(y, p.y));
+				z = glm::round(glm::max(z, p.z));
 			}
 		}
 
-		for (auto && side : this->m_sides) {
-			// Sort out deez rascals
-			Plane::InPlaceOrderCoplanarClockWise(side->m_plane, &side->m_vertices);
-		}
-
 		// Append bounds data
 		this->NWU = glm::vec3(-x, z, y);
 		this->SEL = glm::vec3(-_x, _z, _y);
@@ -577,60 +399,57 @@ public:
 		return false;
 	}
 
-	void IRenderable::_Draw(Shader* shader, std::vector<glm::mat4> transform_stack = {}) {
+	void IRenderable::_Draw(render::context* ctx, std::vector<glm::mat4> transform_stack = {}) {
 		bool dispDrawn = false;
 		for (auto && s : this->m_sides) {
 			if (s->m_dispinfo != NULL) {
-				s->m_dispinfo->Draw(shader);
+				s->m_dispinfo->Draw(ctx);
 				dispDrawn = true;
 			}
 		}
 
 		// Only draw solid if thre is no displacement info
 		if (!dispDrawn) {
-			this->m_mesh->Draw();
+			ctx->draw(this->m_mesh);
 		}
 	}
 
-	void IRenderable::SetupDrawable() {
-		std::vector<float> verts;
+	/* Triangles for every drawn face that is not a displacement, fanned out from each face's first vertex. Faces keep
+	   their own vertices since their normals differ. CPU only, safe to run on any thread */
+	void compute_mesh_data() {
+		std::vector<float>& verts = this->m_mesh_data.vertices;
+		std::vector<uint32_t>& indices = this->m_mesh_data.indices;
+		this->m_mesh_data.clear();
+
 		for (auto && s : this->m_sides) {
 			if (s->m_dispinfo != NULL) continue;
 			if (s->m_vertices.size() < 3) continue;
 			if (!s->m_texture->draw) continue;
 
-			for (int j = 0; j < s->m_vertices.size() - 2; j++) {
-				glm::vec3* c = &s->m_vertices[0];
-				glm::vec3* b = &s->m_vertices[j + 1];
-				glm::vec3* a = &s->m_vertices[j + 2];
-
-				verts.push_back(-a->x);
-				verts.push_back(a->z);
-				verts.push_back(a->y);
-
-				verts.push_back(s->m_plane.normal.x);
-				verts.push_back(-s->m_plane.normal.z);
-				verts.push_back(-s->m_plane.normal.y);
-
-				verts.push_back(-b->x);
-				verts.push_back(b->z);
-				verts.push_back(b->y);
+			uint32_t base = (uint32_t)(verts.size() / 6);
+			for (auto && v : s->m_vertices) {
+				verts.push_back(-v.x);
+				verts.push_back(v.z);
+				verts.push_back(v.y);
 
 				verts.push_back(s->m_plane.normal.x);
 				verts.push_back(-s->m_plane.normal.z);
 				verts.push_back(-s->m_plane.normal.y);
+			}
 
-				verts.push_back(-c->x);
-				verts.push_back(c->z);
-				verts.push_back(c->y);
-
-				verts.push_back(s->m_plane.normal.x);
-				verts.push_back(-s->m_plane.normal.z);
-				verts.push_back(-s->m_plane.normal.y);
+			for (uint32_t j = 0; j < s->m_vertices.size() - 2; j++) {
+				indices.push_back(base + j + 2);
+				indices.push_back(base + j + 1);
+				indices.push_back(base);
 			}
 		}
+	}
 
-		this->m_mesh = new Mesh(verts, MeshMode::POS_XYZ_NORMAL_XYZ);
+	void IRenderable::SetupDrawable() {
+		if (this->m_mesh_data.empty()) this->compute_mesh_data();
+
+		this->m_mesh = new Mesh(this->m_mesh_data);
+		this->m_mesh_data.clear();
 	}
 };
 
@@ -643,40 +462,60 @@ public:
 	std::vector<solid> m_internal_solids;
 	glm::vec3 m_origin;
 
-	entity (kv::DataBlock* dataSrc) {
+	entity() {}
+
+	template<typename B>
+	entity (B* dataSrc) {
 		
 
-		if ((dataSrc->_GetFirstByName("solid") == NULL) && (dataSrc->Values.count("origin") == 0))
-			throw std::exception(("origin could not be resolved for entity ID: " + dataSrc->Values["id"]).c_str());
+		if ((kv::first_block(dataSrc, "solid") == NULL) && !kv::has_value(dataSrc, "origin"))
+			throw std::exception(("origin could not be resolved for entity ID: " + std::string(kv::value(dataSrc, "id"))).c_str());
 
-		this->m_classname = dataSrc->Values["classname"];
-		this->m_id = (int)::atof(dataSrc->Values["id"].c_str());
-		this->m_keyvalues = dataSrc->Values;
-		this->m_editorvalues = editorvalues(dataSrc->_GetFirstByName("editor"));
-		
-		if (dataSrc->_GetFirstByName("solid") == NULL) {
-			vmf_parse::Vector3f(dataSrc->Values["origin"], &this->m_origin);
-			this->m_origin = glm::vec3(-this->m_origin.x, this->m_origin.z, this->m_origin.y);
+		this->m_keyvalues = kv::value_map(dataSrc);
+		this->m_editorvalues = editorvalues(kv::first_block(dataSrc, "editor"));
+
+		for (auto && s : kv::blocks(dataSrc, "solid")) {
+			this->m_internal_solids.push_back(solid(s));
 		}
-		else {
-			for (auto && s : dataSrc->_GetAllByName("solid")) {
-				this->m_internal_solids.push_back(solid(s));
-			}
 
-			// Calculate origin
-			glm::vec3 NWU = this->m_internal_solids[0].NWU;
-			glm::vec3 SEL = this->m_internal_solids[0].SEL;
-			for (auto && i : this->m_internal_solids) {
-				NWU.z = glm::max(NWU.z, i.NWU.z);
-				NWU.y = glm::max(NWU.y, i.NWU.y);
-				NWU.x = glm::max(NWU.x, i.NWU.x);
-				SEL.z = glm::min(SEL.z, i.SEL.z);
-				SEL.y = glm::min(SEL.y, i.SEL.y);
-				SEL.x = glm::min(SEL.x, i.SEL.x);
-			}
+		this->resolve();
+	}
+
+	/* Fill in classname, id and point entity origin once keyvalues are read. Brush entities get theirs from compute_origin */
+	void resolve() {
+		auto get = [this](const char* key) -> std::string {
+			auto it = this->m_keyvalues.find(key);
+			return it == this->m_keyvalues.end() ? "" : it->second;
+		};
+
+		if (this->m_internal_solids.empty() && !this->m_keyvalues.count("origin"))
+			throw std::exception(("origin could not be resolved for entity ID: " + get("id")).c_str());
+
+		this->m_classname = get("classname");
+		this->m_id = (int)::atof(get("id").c_str());
+
+		if (this->m_internal_solids.empty()) {
+			vmf_parse::Vector3f(get("origin"), &this->m_origin);
+			this->m_origin = glm::vec3(-this->m_origin.x, this->m_origin.z, this->m_origin.y);
+		}
+	}
 
-			this->m_origin = (NWU + SEL) * 0.5f;
+	/* Brush entities take their origin from the bounds of their solids, so this waits for vmf::compute_geometry */
+	void compute_origin() {
+		if (this->m_internal_solids.empty()) return;
+
+		glm::vec3 NWU = this->m_internal_solids[0].NWU;
+		glm::vec3 SEL = this->m_internal_solids[0].SEL;
+		for (auto && i : this->m_internal_solids) {
+			NWU.z = glm::max(NWU.z, i.NWU.z);
+			NWU.y = glm::max(NWU.y, i.NWU.y);
+			NWU.x = glm::max(NWU.x, i.NWU.x);
+			SEL.z = glm::min(SEL.z, i.SEL.z);
+			SEL.y = glm::min(SEL.y, i.SEL.y);
+			SEL.x = glm::min(SEL.x, i.SEL.x);
 		}
+
+		this->m_origin = (NWU + SEL) * 0.5f;
 	}
 };
 
@@ -685,7 +524,7 @@ struct BoundingBox {
 	glm::vec3 SEL;
 };
 
-bool check_in_whitelist(std::vector<unsigned int>* visgroups_in, std::set<unsigned int> filter) {
+bool check_in_whitelist(const std::vector<unsigned int>* visgroups_in, const std::set<unsigned int>& filter) {
 	if (filter.count(0xBEEEEEEE)) return true;
 
 	for (auto && vgroup : *visgroups_in)
@@ -695,9 +534,32 @@ bool check_in_whitelist(std::vector<unsigned int>* visgroups_in, std::set<unsign
 	return false;
 }
 
+/* Classnames drawn from the model dictionary, in the order prop_instance::prop_class counts them */
+const char* const g_prop_classnames[] = { "prop_static", "prop_dynamic", "prop_physics" };
+
 class vmf {
 private:
 	static vfilesys* s_fileSystem;
+	static models::cache* s_model_cache;
+
+	/* A placed prop, with its transform worked out from the keyvalues once instead of every draw */
+	struct prop_instance {
+		const std::vector<unsigned int>* visgroups;
+		uint8_t prop_class;		// Into g_prop_classnames
+		float height;			// For LayerMask
+		render::instance instance;
+	};
+
+	/* Every prop of one model, drawn in a single instanced call per pass */
+	struct prop_batch {
+		Mesh* mesh;
+		std::vector<prop_instance> props;
+	};
+
+	std::vector<prop_batch> m_prop_batches;		// In the order each model first shows up, see build_prop_batches
+	std::vector<entity*> m_brush_entities;		// Entities with solids, which go in the world batch
+	bool m_props_built = false;
+	std::vector<render::instance> m_instance_scratch;
 	
 public:
 	// Static setup functions
@@ -705,6 +567,11 @@ public:
 		vmf::s_fileSystem = sys;
 	}
 
+	/* Optional, models are parsed from the game files every time without one */
+	static void LinkModelCache(models::cache* cache) {
+		vmf::s_model_cache = cache;
+	}
+
 	vmf() {}
 
 	std::vector<solid> m_solids;
@@ -714,11 +581,12 @@ public:
 
 	std::set<unsigned int> m_whitelist_visgroups;
 	std::set<std::string> m_whitelist_classnames;
-	float m_render_h_max = 10000.0f;
-	float m_render_h_min = -10000.0f;
+	std::vector<glm::vec2> m_render_layers = { glm::vec2(-10000.0f, 10000.0f) }; // (min, max) height filter of each slice
 	
 	static std::map<std::string, Mesh*> s_model_dict;
 
+	MeshBatch* m_world_batch = NULL; // Every solid, world and entity alike, see upload_meshes
+
 	void LinkVisgroupFlagTranslations(std::map<std::string, TAR_MIBUFFER_FLAGS> map) {
 		for (auto && translation : map) {
 			if (this->m_visgroups.count(translation.first)) {
@@ -727,50 +595,369 @@ public:
 		}
 	}
 
-	static vmf* from_file(const std::string& path, std::map<std::string, TAR_MIBUFFER_FLAGS> translations = {}) {
+	static vmf* from_file(const std::string& path, std::map<std::string, TAR_MIBUFFER_FLAGS> translations = {}, kv::tree_mode mode = kv::TREE_DATABLOCK) {
 		vmf* v = new vmf();
 		prefix = "vmf [" + path + "] ";
 		use_verbose = true;
 		debug("Opening");
 
-		std::ifstream ifs(path);
-		if (!ifs) throw std::exception("355 VMF File read error.");
+		mapped_file file(path);
+		if (!file.good()) throw std::exception("355 VMF File read error.");
+
+		debug("Processing VMF data (", perf::format_mb(file.size()), file.is_mapped() ? ", mapped)" : ", buffered)");
+		if (mode == kv::TREE_NONE) {
+			perf::timer t;
+			threadpool* pool = threadpool::global();
+			if (pool->size() > 1) {
+				v->stream_parallel(file.data(), file.size(), translations, pool);
+			}
+			else {
+				stream_builder builder(v, translations);
+				kv::parse(file.data(), file.size(), &builder);
+			}
+
+			debug("Streamed in ", t.ms(), "ms (", pool->size(), " threads, peak RSS: ", perf::format_mb(perf::peak_rss()), ")");
+		}
+		else if (mode == kv::TREE_ARENA) {
+			kv::document file_kv(file.data(), file.size());
+			v->load(file_kv.root(), translations);
+		}
+		else {
+			kv::FileData file_kv(file.data(), file.size());
+			v->load(&file_kv.headNode, translations);
+		}
+
+		for (int i = 0; i < v->m_solids.size(); i++)
+			v->m_solids[i].m_fileorder_id = i;
+
+		v->compute_geometry();
+
+		debug("Done!");
+		return v;
+	}
+
+	/* Face windings, bounds and triangle data for every brush, world and entity alike. Brushes don't depend on
+	   each other so they are spread over the thread pool; nothing here touches GL. */
+	void compute_geometry() {
+		std::vector<solid*> brushes;
+		for (auto && s : this->m_solids) brushes.push_back(&s);
+		for (auto && e : this->m_entities)
+			for (auto && s : e.m_internal_solids) brushes.push_back(&s);
 
-		std::string file_str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		perf::timer t;
+		threadpool* pool = threadpool::global();
+		pool->parallel_for(brushes.size(), [&](size_t i) {
+			brushes[i]->compute_polytope();
+			brushes[i]->compute_mesh_data();
 
-		debug("Processing VMF data");
-		kv::FileData file_kv(file_str);
+			for (auto && side : brushes[i]->m_sides)
+				if (side->m_dispinfo != NULL) side->m_dispinfo->compute_mesh_data();
+		});
 
+		for (auto && e : this->m_entities)
+			e.compute_origin();
+
+		debug("Brush geometry: ", t.ms(), "ms (", brushes.size(), " brushes, ", pool->size(), " threads)");
+	}
+
+	/* Packs the triangle data from compute_geometry into the world batch and hands it to GL. One part per solid: its
+	   displacements if it has any, its faces otherwise, which is what solid::Draw would draw. Needs the GL context,
+	   so this stays on the calling thread */
+	void upload_meshes() {
+		perf::timer t;
+		this->m_world_batch = new MeshBatch();
+		size_t unindexed = 0;
+
+		auto add = [&](solid& s, glm::vec2 origin) {
+			s.m_batch_part = this->m_world_batch->AddPart(origin);
+
+			if (s.containsDisplacements()) {
+				for (auto && side : s.m_sides) {
+					dispinfo* disp = side->m_dispinfo;
+					if (disp == NULL || side->m_vertices.size() != 4) continue;
+
+					unindexed += disp->m_mesh_data.unindexed_bytes();
+					this->m_world_batch->Append(disp->m_mesh_data);
+					disp->m_mesh_data.clear();
+				}
+			}
+			else {
+				unindexed += s.m_mesh_data.unindexed_bytes();
+				this->m_world_batch->Append(s.m_mesh_data);
+				s.m_mesh_data.clear();
+			}
+
+			if (this->m_world_batch->parts.back().count == 0) s.m_batch_part = -1;
+		};
+
+		for (auto && s : this->m_solids)
+			add(s, glm::vec2(s.NWU.x + s.SEL.x, s.NWU.z + s.SEL.z) / 2.0f);
+		for (auto && e : this->m_entities)
+			for (auto && s : e.m_internal_solids) add(s, glm::vec2(e.m_origin.x, e.m_origin.z));
+
+		this->m_world_batch->Upload();
+		size_t bytes = this->m_world_batch->vertices.size() * sizeof(float) + this->m_world_batch->indices.size() * sizeof(uint32_t);
+		debug("World batch: ", t.ms(), "ms (", this->m_world_batch->parts.size(), " parts, ", this->m_world_batch->vertices.size() / 6, " vertices, ",
+			this->m_world_batch->indices.size() / 3, " triangles, ", bytes / 1024, "KB indexed, ", unindexed / 1024, "KB flat)");
+	}
+
+	/* Builds the world straight from kv::parse events. Only the solid or entity currently being read is held,
+	   there is no KV tree. Expects visgroups before world, which is the order hammer writes them in. */
+	class stream_builder : public kv::visitor {
+		enum scope {
+			SCOPE_IGNORE,
+			SCOPE_VISGROUPS,
+			SCOPE_VISGROUP,
+			SCOPE_WORLD,
+			SCOPE_ENTITY,
+			SCOPE_SOLID,
+			SCOPE_SIDE,
+			SCOPE_DISPINFO,
+			SCOPE_NORMALS,
+			SCOPE_DISTANCES,
+			SCOPE_EDITOR
+		};
+
+		vmf* m_vmf;
+		std::map<std::string, TAR_MIBUFFER_FLAGS> m_translations;
+		std::vector<scope> m_scopes;
+
+		// Objects being read
+		std::string m_visgroup_name;
+		std::string m_visgroup_id;
+		std::unique_ptr<entity> m_entity;
+		std::unique_ptr<solid> m_solid;
+		side* m_side = NULL;
+		bool m_side_plane = false;
+		editorvalues* m_editor = NULL;
+
+		scope parent() { return this->m_scopes.empty() ? SCOPE_IGNORE : this->m_scopes.back(); }
+
+		scope enter(std::string_view name) {
+			if (this->m_scopes.empty()) {
+				if (name == "visgroups") return SCOPE_VISGROUPS;
+				if (name == "world") return SCOPE_WORLD;
+				if (name == "entity") { this->m_entity.reset(new entity()); return SCOPE_ENTITY; }
+				return SCOPE_IGNORE;
+			}
+
+			switch (this->parent()) {
+			case SCOPE_VISGROUPS:
+				if (name == "visgroup") { this->m_visgroup_name.clear(); this->m_visgroup_id.clear(); return SCOPE_VISGROUP; }
+				break;
+			case SCOPE_WORLD:
+			case SCOPE_ENTITY:
+				if (name == "solid") { this->m_solid.reset(new solid()); return SCOPE_SOLID; }
+				if (name == "editor" && this->parent() == SCOPE_ENTITY) { this->m_editor = &this->m_entity->m_editorvalues; return SCOPE_EDITOR; }
+				break;
+			case SCOPE_SOLID:
+				if (name == "side") { this->m_side = new side(); this->m_side_plane = false; return SCOPE_SIDE; }
+				if (name == "editor") { this->m_editor = &this->m_solid->m_editorvalues; return SCOPE_EDITOR; }
+				break;
+			case SCOPE_SIDE:
+				// Same as side::create, displacements on sides without a valid plane are skipped
+				if (name == "dispinfo" && this->m_side_plane && this->m_side->m_dispinfo == NULL) {
+					this->m_side->m_dispinfo = new dispinfo(this->m_side);
+					return SCOPE_DISPINFO;
+				}
+				break;
+			case SCOPE_DISPINFO:
+				if (name == "normals") return SCOPE_NORMALS;
+				if (name == "distances") return SCOPE_DISTANCES;
+				break;
+			}
+
+			return SCOPE_IGNORE;
+		}
+
+		static int row_index(std::string_view key) {
+			if (key.substr(0, 3) != "row") return -1;
+			return std::atoi(std::string(key.substr(3)).c_str());
+		}
+
+	public:
+		stream_builder(vmf* target, const std::map<std::string, TAR_MIBUFFER_FLAGS>& translations)
+			:
+			m_vmf(target),
+			m_translations(translations) {}
+
+		/* Reads the contents of a world block, for when the world is split up between threads */
+		static stream_builder world_contents(vmf* target) {
+			stream_builder b(target, {});
+			b.m_scopes.push_back(SCOPE_WORLD);
+			return b;
+		}
+
+		void on_block_begin(std::string_view name) override {
+			// Nothing under an ignored block is read
+			if (!this->m_scopes.empty() && this->parent() == SCOPE_IGNORE) { this->m_scopes.push_back(SCOPE_IGNORE); return; }
+
+			this->m_scopes.push_back(this->enter(name));
+		}
+
+		void on_key_value(std::string_view key, std::string_view value) override {
+			switch (this->parent()) {
+			case SCOPE_VISGROUP:
+				if (key == "name") this->m_visgroup_name = value;
+				else if (key == "visgroupid") this->m_visgroup_id = value;
+				break;
+			case SCOPE_ENTITY:
+				kv::add_value(this->m_entity->m_keyvalues, std::string(key), std::string(value));
+				break;
+			case SCOPE_SIDE:
+				if (key == "id") this->m_side->m_ID = ::atof(std::string(value).c_str());
+				else if (key == "material") this->m_side->m_texture = material::get(std::string(value));
+				else if (key == "plane") this->m_side_plane = vmf_parse::plane(std::string(value), &this->m_side->m_plane);
+				break;
+			case SCOPE_DISPINFO:
+				if (key == "power") this->m_side->m_dispinfo->set_power(std::stoi(std::string(value)));
+				else if (key == "startposition") vmf_parse::Vector3fS(std::string(value), &this->m_side->m_dispinfo->startposition);
+				break;
+			case SCOPE_NORMALS:
+				this->m_side->m_dispinfo->read_normals(row_index(key), std::string(value));
+				break;
+			case SCOPE_DISTANCES:
+				this->m_side->m_dispinfo->read_distances(row_index(key), std::string(value));
+				break;
+			case SCOPE_EDITOR:
+				if (key == "visgroupid") this->m_editor->add_visgroup(std::stoi(std::string(value)));
+				else if (key == "color") this->m_editor->read_color(std::string(value));
+				break;
+			}
+		}
+
+		void on_block_end() override {
+			scope closed = this->parent();
+			this->m_scopes.pop_back();
+
+			switch (closed) {
+			case SCOPE_VISGROUP:
+				this->m_vmf->m_visgroups.insert({ this->m_visgroup_name, std::stoi(this->m_visgroup_id) });
+				std::cout << "'" << this->m_visgroup_name << "': " << std::stoi(this->m_visgroup_id) << "\n";
+				break;
+			case SCOPE_VISGROUPS:
+				this->m_vmf->LinkVisgroupFlagTranslations(this->m_translations);
+				break;
+			case SCOPE_SIDE:
+				this->m_solid->m_sides.push_back(this->m_side);
+				this->m_side = NULL;
+				break;
+			case SCOPE_SOLID:
+				if (this->parent() == SCOPE_WORLD) this->m_vmf->m_solids.push_back(*this->m_solid);
+				else this->m_entity->m_internal_solids.push_back(*this->m_solid);
+				this->m_solid.reset();
+				break;
+			case SCOPE_ENTITY:
+				try {
+					this->m_entity->resolve();
+					this->m_vmf->m_entities.push_back(*this->m_entity);
+				} catch (std::exception e) {
+					debug("374 ENTITY::EXCEPTION ( ", e.what(), ") ");
+				}
+				this->m_entity.reset();
+				break;
+			}
+		}
+	};
+
+	/* Streamed load split over a thread pool. Visgroups are read first, on this thread, since solids need their flag
+	   translations. The world's children and the remaining top-level blocks are then cut into runs that are streamed
+	   into separate vmfs and appended back in file order. */
+	void stream_parallel(const char* data, size_t length, const std::map<std::string, TAR_MIBUFFER_FLAGS>& translations, threadpool* pool) {
+		struct run {
+			size_t begin, end;
+			bool world;
+			vmf result;
+		};
+
+		std::vector<kv::block_range> top = kv::scan_blocks(data, 0, length);
+
+		for (auto && r : top) {
+			if (r.name != "visgroups") continue;
+			stream_builder builder(this, translations);
+			kv::parse(data + r.begin, r.end - r.begin, &builder);
+		}
+
+		// Aim for a few runs per thread so uneven solids still balance out
+		size_t run_size = std::max<size_t>(length / (pool->size() * 8), 1 << 14);
+
+		std::vector<run> runs;
+		auto add = [&](size_t begin, size_t end, bool world) {
+			if (!runs.empty() && runs.back().world == world && runs.back().end - runs.back().begin < run_size) {
+				runs.back().end = end;
+				return;
+			}
+			runs.emplace_back();
+			runs.back().begin = begin;
+			runs.back().end = end;
+			runs.back().world = world;
+		};
+
+		for (auto && r : top) {
+			if (r.name == "visgroups") continue;
+			if (r.name != "world") { add(r.begin, r.end, false); continue; }
+
+			for (auto && child : kv::scan_blocks(data, r.body_begin, r.body_end))
+				add(child.begin, child.end, true);
+		}
+
+		pool->parallel_for(runs.size(), [&](size_t i) {
+			run& r = runs[i];
+			if (r.world) {
+				stream_builder builder = stream_builder::world_contents(&r.result);
+				kv::parse(data + r.begin, r.end - r.begin, &builder);
+			}
+			else {
+				stream_builder builder(&r.result, translations);
+				kv::parse(data + r.begin, r.end - r.begin, &builder);
+			}
+		});
+
+		for (auto && r : runs) {
+			for (auto && s : r.result.m_solids) this->m_solids.push_back(std::move(s));
+			for (auto && e : r.result.m_entities) this->m_entities.push_back(std::move(e));
+		}
+	}
+
+	// Build the world from either KV tree (kv::DataBlock or kv::doc_node)
+	template<typename B>
+	void load(B* head, std::map<std::string, TAR_MIBUFFER_FLAGS> translations) {
 		debug("Processing visgroups");
 		// Process visgroup list
-		for (auto && vg : file_kv.headNode._GetFirstByName("visgroups")->_GetAllByName("visgroup")) {
-			v->m_visgroups.insert({ vg->Values["name"], std::stoi(vg->Values["visgroupid"]) });
-			std::cout << "'" << vg->Values["name"] << "': " << std::stoi(vg->Values["visgroupid"]) << "\n";
+		for (auto && vg : kv::blocks(kv::first_block(head, "visgroups"), "visgroup")) {
+			this->m_visgroups.insert({ kv::value(vg, "name"), std::stoi(kv::value(vg, "visgroupid")) });
+			std::cout << "'" << kv::value(vg, "name") << "': " << std::stoi(kv::value(vg, "visgroupid")) << "\n";
 		}
-		v->LinkVisgroupFlagTranslations(translations);
+		this->LinkVisgroupFlagTranslations(translations);
 
 		debug("Processing solids");
-		// Solids
-		for (auto && kv_solid : file_kv.headNode._GetFirstByName("world")->_GetAllByName("solid")) {
-			v->m_solids.push_back(solid(kv_solid));
-		}
+		// Solids, built in parallel into slots that keep file order
+		std::vector<B*> kv_solids = kv::blocks(kv::first_block(head, "world"), "solid");
+		size_t first = this->m_solids.size();
+		this->m_solids.resize(first + kv_solids.size());
+		threadpool::global()->parallel_for(kv_solids.size(), [&](size_t i) {
+			this->m_solids[first + i] = solid(kv_solids[i]);
+		});
 
 		debug("Processing entities");
 		// Entities
-		for (auto && kv_entity : file_kv.headNode._GetAllByName("entity")) {
+		for (auto && kv_entity : kv::blocks(head, "entity")) {
 			try {
 				entity ent = entity(kv_entity);
-				v->m_entities.push_back(ent);
+				this->m_entities.push_back(ent);
 			} catch (std::exception e) {
 				debug("374 ENTITY::EXCEPTION ( ", e.what(), ") ");
 			}
 		}
-
-		debug("Done!");
-		return v;
 	}
 
-	void InitModelDict() {
+	/* Load every prop model the map uses. The files are parsed and turned into meshes in parallel, then uploaded here.
+	   Each model gets its coarsest LOD that stays within tolerance of LOD 0 (world units, 0 keeps LOD 0) at the
+	   largest scale the map places it at */
+	void InitModelDict(float tolerance = 0.0f) {
+		std::vector<std::string> names;
+		std::map<std::string, std::pair<size_t, float>> placed; // Instances and largest uniformscale of each model
+
 		for (auto && i : this->m_entities) {
 			switch (hash(i.m_classname.c_str())) {
 			case hash("prop_static"):
@@ -778,32 +965,155 @@ public:
 			case hash("prop_physics"):
 
 				std::string modelName = kv::tryGetStringValue(i.m_keyvalues, "model", "error.mdl");
-				std::string baseName = split(modelName, ".")[0];
+				float scale = (float)::atof(kv::tryGetStringValue(i.m_keyvalues, "uniformscale", "1").c_str());
+
+				auto it = placed.find(modelName);
+				if (it == placed.end()) it = placed.insert({ modelName, { 0, 0.0f } }).first;
+				it->second.first++;
+				it->second.second = glm::max(it->second.second, glm::abs(scale));
+
 				if (vmf::s_model_dict.count(modelName)) continue; // Skip already defined models
+				if (it->second.first == 1) names.push_back(modelName);
+				break;
+			}
+		}
 
-				vtx_mesh* vtx = vmf::s_fileSystem->get_resource_handle<vtx_mesh>(baseName + ".dx90.vtx");
-				vvd_data* vvd = vmf::s_fileSystem->get_resource_handle<vvd_data>(baseName + ".vvd");
+		// In model units, so a prop scaled up needs a finer LOD
+		std::map<std::string, float> tolerances;
+		for (auto && p : placed) tolerances[p.first] = p.second.second > 0.0f ? tolerance / p.second.second : 0.0f;
+
+		// Models already in the cache, from the same vpk files, skip parsing
+		perf::timer t;
+		std::vector<models::load<models::geometry>> cached;
+		std::vector<std::string> missing;
+		std::map<std::string, models::cache_key> keys;
+
+		for (auto && name : names) {
+			std::string baseName = name.substr(0, name.find('.'));
+
+			models::cache_key key;
+			vpk::normalize(name, key.name);
+			if (vmf::s_model_cache == NULL
+				|| !vmf::s_fileSystem->get_vpk_crc(baseName + ".dx90.vtx", key.crc_vtx)
+				|| !vmf::s_fileSystem->get_vpk_crc(baseName + ".vvd", key.crc_vvd)) {
+				missing.push_back(name);
+				continue;
+			}
 
-				if (vvd == NULL || vtx == NULL) {
-					debug( "Failed to load resource: ", baseName, "\n");
+			// The LOD table of any cached LOD says which one this map wants
+			std::vector<models::lod_info> lods;
+			if (vmf::s_model_cache->find_lods(key, lods)) key.lod = models::select_lod(lods, tolerances[name]);
+
+			models::load<models::geometry> l;
+			if (vmf::s_model_cache->find(key, l.data)) {
+				l.name = name;
+				l.ok = true;
+				cached.push_back(std::move(l));
+			}
+			else {
+				keys.insert({ name, key });
+				missing.push_back(name);
+			}
+		}
+		double cache_ms = t.ms_precise();
+
+		models::load_stats stats;
+		std::vector<models::load<models::geometry>> loads = models::load_all<models::geometry>(vmf::s_fileSystem, missing, [&tolerances](const std::string& name, const vtx_mesh& vtx, vvd_data& vvd, models::geometry& model) {
+			models::build_geometry(vtx, vvd, tolerances.at(name), model);
+		}, &stats);
+
+		t.reset();
+		size_t bytes = 0, unindexed = 0;
+		size_t reduced = 0, triangles_full = 0, triangles_drawn = 0;
+		for (auto * set : { &cached, &loads }) {
+			for (auto && l : *set) {
+				if (!l.ok) {
+					debug("Failed to load resource: ", l.name, " (", l.error, ")");
 					continue;
 				}
 
-				// GENERATE MESH TING
-				std::vector<float> meshData;
-				for (auto && vert : vtx->vertexSequence) {
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecPosition.x);
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecPosition.y);
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecPosition.z);
-					meshData.push_back(-vvd->verticesLOD0[vert].m_vecNormal.x);
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecNormal.z);
-					meshData.push_back(vvd->verticesLOD0[vert].m_vecNormal.y);
+				const models::geometry& g = l.data;
+				if (set == &loads) {
+					debug("Model ", l.name, ": ", l.ms, "ms, LOD ", g.lod, " of ", g.lods.size());
+					if (keys.count(l.name)) {
+						keys[l.name].lod = g.lod;
+						vmf::s_model_cache->add(keys[l.name], &g);
+					}
 				}
 
-				vmf::s_model_dict.insert({ modelName, new Mesh(meshData, MeshMode::POS_XYZ_NORMAL_XYZ) }); // Add to our list
-				break;
+				if (g.lod != 0) reduced++;
+				if (g.lod < g.lods.size()) {
+					triangles_full += placed[l.name].first * g.lods[0].triangles;
+					triangles_drawn += placed[l.name].first * g.lods[g.lod].triangles;
+				}
+
+				bytes += g.mesh.bytes();
+				unindexed += g.mesh.unindexed_bytes();
+				vmf::s_model_dict.insert({ l.name, new Mesh(g.mesh) }); // Add to our list
 			}
 		}
+		double upload_ms = t.ms_precise();
+
+		if (vmf::s_model_cache != NULL) {
+			t.reset();
+			vmf::s_model_cache->flush();
+			debug("Model cache: ", cached.size(), " hits in ", cache_ms, "ms, ", keys.size(), " added in ", t.ms_precise(), "ms");
+		}
+
+		debug("Models: ", stats.loaded, " loaded, ", stats.failed, " failed in ", stats.ms, "ms (", stats.model_ms, "ms of work over ", stats.threads,
+			" threads), upload ", upload_ms, "ms, ", bytes / 1024, "KB indexed, ", unindexed / 1024, "KB flat");
+		debug("Model LODs: ", reduced, " models below LOD 0 (tolerance ", tolerance, " units), ", triangles_drawn, " of ", triangles_full,
+			" prop triangles drawn, ", triangles_full - triangles_drawn, " saved");
+
+		this->build_prop_batches();
+	}
+
+	/* Group props by model with their model matrices, and note which entities have solids, so DrawEntities only filters
+	   lists. Props whose model did not load are left out, they would not draw anyway */
+	void build_prop_batches() {
+		perf::timer t;
+		this->m_prop_batches.clear();
+		this->m_brush_entities.clear();
+
+		std::map<Mesh*, size_t> batch_of;
+		size_t props = 0;
+		for (auto && ent : this->m_entities) {
+			if (!ent.m_internal_solids.empty()) this->m_brush_entities.push_back(&ent);
+
+			uint8_t prop_class = 0;
+			while (prop_class < 3 && ent.m_classname != g_prop_classnames[prop_class]) prop_class++;
+			if (prop_class == 3) continue;
+
+			auto model = vmf::s_model_dict.find(kv::tryGetStringValue(ent.m_keyvalues, "model", "error.mdl"));
+			if (model == vmf::s_model_dict.end()) continue;
+
+			auto it = batch_of.find(model->second);
+			if (it == batch_of.end()) {
+				it = batch_of.insert({ model->second, this->m_prop_batches.size() }).first;
+				this->m_prop_batches.push_back({ model->second, {} });
+			}
+
+			glm::vec3 rot;
+			vmf_parse::Vector3f(kv::tryGetStringValue(ent.m_keyvalues, "angles", "0 0 0"), &rot);
+			glm::mat4 transform = glm::translate(glm::mat4(), ent.m_origin);
+			transform = glm::rotate(transform, glm::radians(rot.y), glm::vec3(0, 1, 0)); // Yaw
+			transform = glm::rotate(transform, glm::radians(rot.x), glm::vec3(0, 0, 1)); // Roll
+			transform = glm::rotate(transform, -glm::radians(rot.z), glm::vec3(1, 0, 0)); // Pitch
+			transform = glm::scale(transform, glm::vec3(::atof(kv::tryGetStringValue(ent.m_keyvalues, "uniformscale", "1").c_str())));
+
+			prop_instance prop;
+			prop.visgroups = &ent.m_editorvalues.m_visgroups;
+			prop.prop_class = prop_class;
+			prop.height = ent.m_origin.y;
+			prop.instance.model = transform;
+			prop.instance.origin = glm::vec2(ent.m_origin.x, ent.m_origin.z);
+			prop.instance.layers = 0;
+			this->m_prop_batches[it->second].props.push_back(prop);
+			props++;
+		}
+
+		this->m_props_built = true;
+		debug("Prop batches: ", props, " props over ", this->m_prop_batches.size(), " models, ", this->m_brush_entities.size(), " brush entities in ", t.ms_precise(), "ms");
 	}
 
 	void SetFilters(std::set<std::string> visgroups, std::set<std::string> classnames){
@@ -818,81 +1128,95 @@ public:
 	}
 
 	void SetMinMax(float min, float max) {
-		this->m_render_h_min = min;
-		this->m_render_h_max = max;
+		this->m_render_layers = { glm::vec2(min, max) };
+	}
+
+	/* Draw every layer at once into the slices of a layered target, slice i takes what SetMinMax(layers[i]) would */
+	void SetLayers(const std::vector<glm::vec2>& layers) {
+		this->m_render_layers = layers;
+	}
+
+	/* Slices something at this height is drawn to */
+	uint32_t LayerMask(float height) const {
+		uint32_t mask = 0;
+		for (size_t i = 0; i < this->m_render_layers.size(); i++)
+			if (!(height > this->m_render_layers[i].x || height < this->m_render_layers[i].y)) mask |= 1u << i;
+		return mask;
 	}
 
-	void DrawWorld(Shader* shader, std::vector<glm::mat4> transform_stack = {}, unsigned int infoFlags = 0x00) {
+	void DrawWorld(render::context* ctx, std::vector<glm::mat4> transform_stack = {}, unsigned int infoFlags = 0x00) {
 		glm::mat4 model = glm::mat4();
-		shader->setMatrix("model", model);
-		shader->setUnsigned("Info", infoFlags);
+		ctx->set_matrix("model", model);
+		ctx->set_unsigned("Info", infoFlags);
 
-		// Draw solids
+		// Every solid that passes the filters, in one batch draw
+		std::vector<render::batch_draw> draws;
 		for (auto && solid : this->m_solids) {
-			if (solid.NWU.y < this->m_render_h_max || solid.NWU.y > this->m_render_h_min) continue;
+			if (solid.m_batch_part < 0) continue;
 
-			if (check_in_whitelist(&solid.m_editorvalues.m_visgroups, this->m_whitelist_visgroups)) {
-				shader->setUnsigned("Info", infoFlags);
-				glm::vec2 orgin = glm::vec2(solid.NWU.x + solid.SEL.x, solid.NWU.z + solid.SEL.z) / 2.0f;
-				shader->setVec2("origin", glm::vec2(orgin.x, orgin.y));
-				solid.Draw(shader);
-			}
+			uint32_t layers = this->LayerMask(solid.NWU.y);
+			if (layers == 0) continue;
+
+			if (check_in_whitelist(&solid.m_editorvalues.m_visgroups, this->m_whitelist_visgroups))
+				draws.push_back({ solid.m_batch_part, layers });
 		}
 
-		model = glm::mat4();
-		shader->setMatrix("model", model);
-		// Draw 
+		if (this->m_world_batch == NULL) this->upload_meshes();
+		ctx->draw_batch(this->m_world_batch, draws);
 	}
 
-	void DrawEntities(Shader* shader, std::vector<glm::mat4> transform_stack = {}, unsigned int infoFlags = 0x00) {
+	/* Solids of brush entities in one batch draw, then every model's props in one instanced draw each */
+	void DrawEntities(render::context* ctx, std::vector<glm::mat4> transform_stack = {}, unsigned int infoFlags = 0x00) {
 		glm::mat4 model = glm::mat4();
-		shader->setMatrix("model", model);
-		shader->setUnsigned("Info", infoFlags);
+		ctx->set_matrix("model", model);
+		ctx->set_unsigned("Info", infoFlags);
 
-		// Draw props
-		for (auto && ent : this->m_entities) {
-			// Visgroup pre-check
-			if (check_in_whitelist(&ent.m_editorvalues.m_visgroups, this->m_whitelist_visgroups)) {
-				if (this->m_whitelist_classnames.count(ent.m_classname)) {
-					if (ent.m_classname == "prop_static" ||
-						ent.m_classname == "prop_dynamic" ||
-						ent.m_classname == "prop_physics" ) {
-						if (ent.m_origin.y > this->m_render_h_min || ent.m_origin.y < this->m_render_h_max) continue;
-
-						model = glm::mat4();
-						model = glm::translate(model, ent.m_origin);
-						glm::vec3 rot;
-						vmf_parse::Vector3f(kv::tryGetStringValue(ent.m_keyvalues, "angles", "0 0 0"), &rot);
-						model = glm::rotate(model, glm::radians(rot.y), glm::vec3(0, 1, 0)); // Yaw 
-						model = glm::rotate(model, glm::radians(rot.x), glm::vec3(0, 0, 1)); // ROOOOOLLLLL
-						model = glm::rotate(model, -glm::radians(rot.z), glm::vec3(1, 0, 0)); // Pitch 
-						model = glm::scale(model, glm::vec3(::atof(kv::tryGetStringValue(ent.m_keyvalues, "uniformscale", "1").c_str())));
-						shader->setMatrix("model", model);
-						shader->setUnsigned("Info", infoFlags);
-						shader->setVec2("origin", glm::vec2(ent.m_origin.x, ent.m_origin.z));
-
-						if(vmf::s_model_dict.count(kv::tryGetStringValue(ent.m_keyvalues, "model", "error.mdl")))
-							vmf::s_model_dict[kv::tryGetStringValue(ent.m_keyvalues, "model", "error.mdl")]->Draw();
-					}
-					else {
-						model = glm::mat4();
-						shader->setMatrix("model", model);
-						shader->setUnsigned("Info", infoFlags);
-
-						for (auto && s : ent.m_internal_solids) {
-							if (s.NWU.y > this->m_render_h_min || s.NWU.y < this->m_render_h_max) continue;
-							shader->setVec2("origin", glm::vec2(ent.m_origin.x, ent.m_origin.z));
-							s.Draw(shader);
-						}
-					}
+		if (this->m_world_batch == NULL) this->upload_meshes();
+		if (!this->m_props_built) this->build_prop_batches();
+
+		std::vector<render::batch_draw> draws;
+		for (auto * ent : this->m_brush_entities) {
+			if (!this->m_whitelist_classnames.count(ent->m_classname)) continue;
+			if (!check_in_whitelist(&ent->m_editorvalues.m_visgroups, this->m_whitelist_visgroups)) continue;
+
+			for (auto && s : ent->m_internal_solids) {
+				if (s.m_batch_part < 0) continue;
+
+				uint32_t layers = this->LayerMask(s.NWU.y);
+				if (layers == 0) continue;
+				draws.push_back({ s.m_batch_part, layers });
+			}
+		}
+		if (!draws.empty()) ctx->draw_batch(this->m_world_batch, draws);
+
+		bool allowed[3];
+		bool any = false;
+		for (int i = 0; i < 3; i++) any |= allowed[i] = this->m_whitelist_classnames.count(g_prop_classnames[i]) != 0;
+
+		if (any) {
+			for (auto && batch : this->m_prop_batches) {
+				std::vector<render::instance>& instances = this->m_instance_scratch;
+				instances.clear();
+
+				for (auto && prop : batch.props) {
+					if (!allowed[prop.prop_class]) continue;
+
+					uint32_t layers = this->LayerMask(prop.height);
+					if (layers == 0) continue;
+					if (!check_in_whitelist(prop.visgroups, this->m_whitelist_visgroups)) continue;
+
+					instances.push_back(prop.instance);
+					instances.back().layers = layers;
 				}
+
+				ctx->draw_instances(batch.mesh, instances);
 			}
 		}
 
 		// Resets 
 		model = glm::mat4();
-		shader->setMatrix("model", model);
-		shader->setUnsigned("Info", infoFlags);
+		ctx->set_matrix("model", model);
+		ctx->set_unsigned("Info", infoFlags);
 	}
 
 	BoundingBox getVisgroupBounds(const std::string& visgroup) {
@@ -967,5 +1291,7 @@ public:
 };
 
 vfilesys* vmf::s_fileSystem = NULL;
+models::cache* vmf::s_model_cache = NULL;
 std::map<std::string, Mesh*> vmf::s_model_dict;
-std::map<std::string, material*> material::m_index;
\ No newline at end of file
+std::map<std::string, material*> material::m_index;
+std::mutex material::m_index_lock;
\ No newline at end of file
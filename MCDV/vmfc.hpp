@@ -0,0 +1,688 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "vmf.hpp"
+#include "mapped_file.hpp"
+#include "perf.hpp"
+
+/* Compiled VMF cache (.vmfc)
+
+   Binary snapshot of a vmf::vmf after ComputeGLMeshes and ComputeDisplacements: solids, planes, displacement data,
+   generated vertex buffers, bounds, visgroups and entity keyvalues. The cache is keyed by a hash of the source VMF
+   and is rejected on a version mismatch. When only the hash differs, the content hash stored for every solid and
+   entity block lets unchanged blocks (matched by id) be reused, and only the edited ones are parsed again.
+
+   Layout: header, then one section per record type. Records only hold plain values and ranges into the pools, so
+   loading is mapping the file and turning section offsets into pointers. */
+namespace vmfc
+{
+	const char magic[4] = { 'V', 'M', 'F', 'C' };
+	const uint32_t version = 4;
+
+	enum section_id {
+		SECTION_STRINGS,	// char
+		SECTION_FLOATS,		// float
+		SECTION_U32,		// uint32_t, visgroup ids
+		SECTION_VISGROUPS,	// visgroup_rec
+		SECTION_SOLIDS,		// solid_rec, world solids first
+		SECTION_SIDES,		// side_rec
+		SECTION_DISPS,		// disp_rec
+		SECTION_ENTITIES,	// entity_rec
+		SECTION_KEYVALUES,	// kv_rec
+		SECTION_BLOCKS,		// block_rec, source blocks in file order
+		SECTION_COUNT
+	};
+
+	struct section {
+		uint64_t offset;
+		uint64_t count;
+	};
+
+	struct header {
+		char magic[4];
+		uint32_t version;
+		uint64_t source_hash;
+		uint64_t source_size;
+		uint32_t world_solids;
+		uint32_t pad;
+		section sections[SECTION_COUNT];
+	};
+
+	struct range { uint32_t first, count; };
+	struct str_ref { uint32_t offset, length; };
+
+	struct visgroup_rec {
+		uint32_t id;
+		str_ref name;
+	};
+
+	struct solid_rec {
+		int32_t fileorder_id;
+		int32_t id;
+		uint32_t contains_displacements;
+		uint32_t hidden;
+		float color[3];
+		float origin[3];
+		float nwu[3];
+		float sel[3];
+		range sides;
+		range visgroups;
+		range mesh;
+	};
+
+	struct side_rec {
+		int32_t id;
+		str_ref texture;
+		float normal[3];
+		float offset;
+		int32_t texture_id;
+		int32_t disp;		// Index into SECTION_DISPS, -1 if none
+	};
+
+	struct disp_rec {
+		int32_t power;
+		float start[3];
+		range normals;		// SECTION_FLOATS, the whole grid row after row
+		range distances;
+		range mesh;
+		uint32_t has_mesh;
+	};
+
+	struct entity_rec {
+		int32_t id;
+		str_ref classname;
+		float origin[3];
+		uint32_t hidden;
+		range keyvalues;
+		range solids;
+		range visgroups;
+	};
+
+	struct kv_rec {
+		str_ref key;
+		str_ref value;
+	};
+
+	enum block_kind {
+		BLOCK_SOLID,	// Solid in the world block
+		BLOCK_ENTITY
+	};
+
+	struct block_rec {
+		uint32_t kind;
+		int32_t id;
+		uint64_t hash;		// Of the block's text, name to closing brace
+		int32_t record;		// Index into SECTION_SOLIDS (world solids) or SECTION_ENTITIES, -1 if it can't be reused
+		uint32_t pad;
+	};
+
+	/* Identity of the source file the cache was built from */
+	struct source_key {
+		bool good = false;
+		uint64_t hash = 0;
+		uint64_t size = 0;
+	};
+
+	/* FNV-1a, 64 bit */
+	inline uint64_t hash_bytes(const char* data, size_t length) {
+		uint64_t h = 14695981039346656037ULL;
+		for (size_t i = 0; i < length; i++) {
+			h ^= (unsigned char)data[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	inline source_key key_for(const std::string& source_path) {
+		source_key key;
+		mapped_file file(source_path);
+		if (!file.good()) return key;
+
+		key.good = true;
+		key.hash = hash_bytes(file.data(), file.size());
+		key.size = file.size();
+		return key;
+	}
+
+	/* Value of the first "id" key directly inside a block, 0 if there is none */
+	inline int block_id(const char* data, const kv::block_range& r) {
+		kv::tokenizer tk(data + r.body_begin, r.body_end - r.body_begin);
+
+		int depth = 0;
+		bool have_key = false;
+		bool is_id = false;
+		for (kv::token t = tk.next(); t.type != kv::TOKEN_EOF; t = tk.next()) {
+			if (t.type != kv::TOKEN_STRING) {
+				depth += t.type == kv::TOKEN_BLOCK_OPEN ? 1 : -1;
+				have_key = false;
+				continue;
+			}
+			if (depth != 0) continue;
+
+			if (!have_key) { have_key = true; is_id = t.value == "id"; continue; }
+			if (is_id) return ::atoi(std::string(t.value).c_str());
+			have_key = false;
+		}
+		return 0;
+	}
+
+	struct source_block {
+		block_kind kind;
+		int id;
+		uint64_t hash;
+		kv::block_range range;
+	};
+
+	/* World solids and entities of a VMF, in file order. visgroups receives the visgroups block if there is one */
+	inline std::vector<source_block> scan_source(const char* data, size_t length, kv::block_range* visgroups = NULL) {
+		std::vector<source_block> blocks;
+		if (visgroups != NULL) *visgroups = kv::block_range();
+
+		auto add = [&](block_kind kind, const kv::block_range& r) {
+			blocks.push_back({ kind, block_id(data, r), hash_bytes(data + r.begin, r.end - r.begin), r });
+		};
+
+		for (auto && top : kv::scan_blocks(data, 0, length)) {
+			if (top.name == "visgroups" && visgroups != NULL) *visgroups = top;
+			else if (top.name == "entity") add(BLOCK_ENTITY, top);
+			else if (top.name == "world") {
+				for (auto && child : kv::scan_blocks(data, top.body_begin, top.body_end))
+					if (child.name == "solid") add(BLOCK_SOLID, child);
+			}
+		}
+
+		return blocks;
+	}
+
+	/* Appends records to the sections */
+	class writer {
+		std::vector<char> m_strings;
+		std::vector<float> m_floats;
+		std::vector<uint32_t> m_u32;
+		std::vector<visgroup_rec> m_visgroups;
+		std::vector<solid_rec> m_solids;
+		std::vector<side_rec> m_sides;
+		std::vector<disp_rec> m_disps;
+		std::vector<entity_rec> m_entities;
+		std::vector<kv_rec> m_keyvalues;
+		std::vector<block_rec> m_blocks;
+
+		str_ref add_string(const std::string& str) {
+			str_ref r = { (uint32_t)this->m_strings.size(), (uint32_t)str.size() };
+			this->m_strings.insert(this->m_strings.end(), str.begin(), str.end());
+			return r;
+		}
+
+		range add_floats(const std::vector<float>& values) {
+			range r = { (uint32_t)this->m_floats.size(), (uint32_t)values.size() };
+			this->m_floats.insert(this->m_floats.end(), values.begin(), values.end());
+			return r;
+		}
+
+		range add_visgroup_ids(const std::vector<unsigned short>& ids) {
+			range r = { (uint32_t)this->m_u32.size(), (uint32_t)ids.size() };
+			for (auto && id : ids) this->m_u32.push_back(id);
+			return r;
+		}
+
+		static void put(float* dst, const glm::vec3& v) { dst[0] = v.x; dst[1] = v.y; dst[2] = v.z; }
+
+		int32_t add_disp(const vmf::DispInfo* info) {
+			disp_rec d = {};
+			d.power = info->grid.power;
+			put(d.start, info->startposition);
+
+			d.normals.first = (uint32_t)this->m_floats.size();
+			for (auto && n : info->grid.normals) { this->m_floats.push_back(n.x); this->m_floats.push_back(n.y); this->m_floats.push_back(n.z); }
+			d.normals.count = (uint32_t)this->m_floats.size() - d.normals.first;
+
+			d.distances = this->add_floats(info->grid.distances);
+
+			// Faces matched to a polygon that isn't a quad never get a mesh
+			d.has_mesh = info->glMesh != NULL;
+			if (d.has_mesh) d.mesh = this->add_floats(info->glMesh->vertices);
+
+			this->m_disps.push_back(d);
+			return (int32_t)this->m_disps.size() - 1;
+		}
+
+		void add_solid(const vmf::Solid& s) {
+			solid_rec r = {};
+			r.fileorder_id = s.fileorder_id;
+			r.id = s.ID;
+			r.contains_displacements = s.containsDisplacements;
+			r.hidden = s.hidden;
+			put(r.color, s.color);
+			put(r.origin, s.origin);
+			put(r.nwu, s.bounds.NWU);
+			put(r.sel, s.bounds.SEL);
+			r.visgroups = this->add_visgroup_ids(s.visgroupids);
+			if (s.mesh != NULL) r.mesh = this->add_floats(s.mesh->vertices);
+
+			r.sides.first = (uint32_t)this->m_sides.size();
+			for (auto && f : s.faces) {
+				side_rec side = {};
+				side.id = f.ID;
+				side.texture = this->add_string(f.texture);
+				put(side.normal, f.plane.normal);
+				side.offset = f.plane.offset;
+				side.texture_id = f.plane.textureID;
+				side.disp = f.displacement != NULL ? this->add_disp(f.displacement) : -1;
+				this->m_sides.push_back(side);
+			}
+			r.sides.count = (uint32_t)s.faces.size();
+
+			this->m_solids.push_back(r);
+		}
+
+		template<typename T>
+		static void write_section(std::ofstream& out, header& h, section_id id, const std::vector<T>& data) {
+			// 8 byte alignment so the mapped records can be read in place
+			uint64_t pos = (uint64_t)out.tellp();
+			static const char zeros[8] = {};
+			if (pos % 8) { out.write(zeros, 8 - pos % 8); pos += 8 - pos % 8; }
+
+			h.sections[id].offset = pos;
+			h.sections[id].count = data.size();
+			if (!data.empty()) out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+		}
+
+	public:
+		writer(const vmf::vmf& v, const std::vector<block_rec>& blocks) : m_blocks(blocks) {
+			for (auto && vg : v.visgroups)
+				this->m_visgroups.push_back({ vg.first, this->add_string(vg.second) });
+
+			for (auto && s : v.solids) this->add_solid(s);
+
+			for (auto && ent : v.entities) {
+				entity_rec e = {};
+				e.id = ent.ID;
+				e.classname = this->add_string(ent.classname);
+				put(e.origin, ent.origin);
+				e.hidden = ent.hidden;
+				e.visgroups = this->add_visgroup_ids(ent.visgroupids);
+
+				e.keyvalues.first = (uint32_t)this->m_keyvalues.size();
+				for (auto && kv : ent.keyValues)
+					this->m_keyvalues.push_back({ this->add_string(kv.first), this->add_string(kv.second) });
+				e.keyvalues.count = (uint32_t)ent.keyValues.size();
+
+				e.solids.first = (uint32_t)this->m_solids.size();
+				for (auto && s : ent.internal_solids) this->add_solid(s);
+				e.solids.count = (uint32_t)ent.internal_solids.size();
+
+				this->m_entities.push_back(e);
+			}
+		}
+
+		bool write(const std::string& path, const source_key& key, uint32_t world_solids) {
+			std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!out) return false;
+
+			header h = {};
+			memcpy(h.magic, magic, 4);
+			h.version = version;
+			h.source_hash = key.hash;
+			h.source_size = key.size;
+			h.world_solids = world_solids;
+			out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+			write_section(out, h, SECTION_STRINGS, this->m_strings);
+			write_section(out, h, SECTION_FLOATS, this->m_floats);
+			write_section(out, h, SECTION_U32, this->m_u32);
+			write_section(out, h, SECTION_VISGROUPS, this->m_visgroups);
+			write_section(out, h, SECTION_SOLIDS, this->m_solids);
+			write_section(out, h, SECTION_SIDES, this->m_sides);
+			write_section(out, h, SECTION_DISPS, this->m_disps);
+			write_section(out, h, SECTION_ENTITIES, this->m_entities);
+			write_section(out, h, SECTION_KEYVALUES, this->m_keyvalues);
+			write_section(out, h, SECTION_BLOCKS, this->m_blocks);
+
+			// Header again, now with the section table filled in
+			out.seekp(0);
+			out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			return out.good();
+		}
+	};
+
+	/* Section pointers into a mapped cache file, with range checks for everything the records point at */
+	class reader {
+		const mapped_file& m_file;
+		const header* m_header = NULL;
+
+		template<typename T>
+		bool fixup(section_id id, const T** ptr, uint64_t* count) {
+			const section& s = this->m_header->sections[id];
+			if (s.offset % alignof(T) || s.offset > this->m_file.size() || s.count > (this->m_file.size() - s.offset) / sizeof(T)) return false;
+
+			*ptr = reinterpret_cast<const T*>(this->m_file.data() + s.offset);
+			*count = s.count;
+			return true;
+		}
+
+		static bool in(range r, uint64_t count) { return (uint64_t)r.first + r.count <= count; }
+		bool in(str_ref r) const { return (uint64_t)r.offset + r.length <= this->num_strings; }
+
+		std::string str(str_ref r) const { return std::string(this->strings + r.offset, r.length); }
+		static glm::vec3 vec(const float* v) { return glm::vec3(v[0], v[1], v[2]); }
+
+		std::vector<float> floats_of(range r) const { return std::vector<float>(this->floats + r.first, this->floats + r.first + r.count); }
+
+		std::vector<unsigned short> visgroups_of(range r) const {
+			std::vector<unsigned short> ids;
+			for (uint32_t i = 0; i < r.count; i++) ids.push_back((unsigned short)this->u32[r.first + i]);
+			return ids;
+		}
+
+		bool valid_disp(const disp_rec& d) const {
+			if (!in(d.normals, this->num_floats) || !in(d.distances, this->num_floats) || !in(d.mesh, this->num_floats)) return false;
+			if (d.power < 0 || d.power > 8) return false;
+
+			uint64_t points = ((1ULL << d.power) + 1) * ((1ULL << d.power) + 1);
+			return d.normals.count == points * 3 && d.distances.count == points;
+		}
+
+		bool valid_solid(const solid_rec& s) const {
+			if (!in(s.sides, this->num_sides) || !in(s.visgroups, this->num_u32) || !in(s.mesh, this->num_floats)) return false;
+
+			for (uint32_t i = 0; i < s.sides.count; i++) {
+				const side_rec& side = this->sides[s.sides.first + i];
+				if (!this->in(side.texture)) return false;
+				if (side.disp >= 0 && ((uint64_t)side.disp >= this->num_disps || !this->valid_disp(this->disps[side.disp]))) return false;
+			}
+			return true;
+		}
+
+	public:
+		const char* strings; uint64_t num_strings;
+		const float* floats; uint64_t num_floats;
+		const uint32_t* u32; uint64_t num_u32;
+		const visgroup_rec* visgroups; uint64_t num_visgroups;
+		const solid_rec* solids; uint64_t num_solids;
+		const side_rec* sides; uint64_t num_sides;
+		const disp_rec* disps; uint64_t num_disps;
+		const entity_rec* entities; uint64_t num_entities;
+		const kv_rec* keyvalues; uint64_t num_keyvalues;
+		const block_rec* blocks; uint64_t num_blocks;
+
+		reader(const mapped_file& file) : m_file(file) {}
+
+		/* Checks the header and sets up the section pointers. Returns why the cache can't be used, or "" */
+		std::string open() {
+			if (this->m_file.size() < sizeof(header)) return "file too small";
+
+			this->m_header = reinterpret_cast<const header*>(this->m_file.data());
+			if (memcmp(this->m_header->magic, magic, 4) != 0) return "not a vmfc file";
+			if (this->m_header->version != version) return "version " + std::to_string(this->m_header->version) + ", expected " + std::to_string(version);
+
+			if (!this->fixup(SECTION_STRINGS, &this->strings, &this->num_strings) ||
+				!this->fixup(SECTION_FLOATS, &this->floats, &this->num_floats) ||
+				!this->fixup(SECTION_U32, &this->u32, &this->num_u32) ||
+				!this->fixup(SECTION_VISGROUPS, &this->visgroups, &this->num_visgroups) ||
+				!this->fixup(SECTION_SOLIDS, &this->solids, &this->num_solids) ||
+				!this->fixup(SECTION_SIDES, &this->sides, &this->num_sides) ||
+				!this->fixup(SECTION_DISPS, &this->disps, &this->num_disps) ||
+				!this->fixup(SECTION_ENTITIES, &this->entities, &this->num_entities) ||
+				!this->fixup(SECTION_KEYVALUES, &this->keyvalues, &this->num_keyvalues) ||
+				!this->fixup(SECTION_BLOCKS, &this->blocks, &this->num_blocks))
+				return "bad section table";
+
+			if (this->m_header->world_solids > this->num_solids) return "bad solid count";
+
+			for (uint64_t i = 0; i < this->num_visgroups; i++)
+				if (!this->in(this->visgroups[i].name)) return "bad visgroup";
+
+			for (uint64_t i = 0; i < this->num_solids; i++)
+				if (!this->valid_solid(this->solids[i])) return "bad solid";
+
+			for (uint64_t i = 0; i < this->num_entities; i++) {
+				const entity_rec& e = this->entities[i];
+				if (!this->in(e.classname) || !in(e.keyvalues, this->num_keyvalues) || !in(e.solids, this->num_solids) || !in(e.visgroups, this->num_u32))
+					return "bad entity";
+				for (uint32_t k = 0; k < e.keyvalues.count; k++)
+					if (!this->in(this->keyvalues[e.keyvalues.first + k].key) || !this->in(this->keyvalues[e.keyvalues.first + k].value)) return "bad keyvalue";
+			}
+
+			for (uint64_t i = 0; i < this->num_blocks; i++) {
+				const block_rec& b = this->blocks[i];
+				uint64_t records = b.kind == BLOCK_SOLID ? this->world_solids() : this->num_entities;
+				if (b.kind > BLOCK_ENTITY || (b.record >= 0 && (uint64_t)b.record >= records)) return "bad block";
+			}
+
+			return "";
+		}
+
+		/* True if the cache was built from exactly this source */
+		bool matches(const source_key& key) const {
+			return this->m_header->source_hash == key.hash && this->m_header->source_size == key.size;
+		}
+
+		uint32_t world_solids() const { return this->m_header->world_solids; }
+
+		vmf::Solid solid(uint32_t index) const {
+			const solid_rec& r = this->solids[index];
+
+			vmf::Solid s;
+			s.fileorder_id = r.fileorder_id;
+			s.ID = r.id;
+			s.containsDisplacements = r.contains_displacements != 0;
+			s.hidden = r.hidden != 0;
+			s.color = vec(r.color);
+			s.origin = vec(r.origin);
+			s.bounds.NWU = vec(r.nwu);
+			s.bounds.SEL = vec(r.sel);
+			s.visgroupids = this->visgroups_of(r.visgroups);
+			s.mesh = r.mesh.count ? new Mesh(this->floats_of(r.mesh), MeshMode::POS_XYZ_NORMAL_XYZ) : NULL; // Solids with no faces left get no mesh
+
+			for (uint32_t i = 0; i < r.sides.count; i++) {
+				const side_rec& sr = this->sides[r.sides.first + i];
+
+				vmf::Side side;
+				side.ID = sr.id;
+				side.texture = this->str(sr.texture);
+				side.plane = Plane(vec(sr.normal), sr.offset);
+				side.plane.textureID = sr.texture_id;
+
+				if (sr.disp >= 0) {
+					const disp_rec& d = this->disps[sr.disp];
+					vmf::DispInfo* info = new vmf::DispInfo;
+					info->startposition = vec(d.start);
+
+					info->grid.resize(d.power);
+					const float* n = this->floats + d.normals.first;
+					for (auto && normal : info->grid.normals) { normal = vec(n); n += 3; }
+					std::copy(this->floats + d.distances.first, this->floats + d.distances.first + d.distances.count, info->grid.distances.begin());
+
+					info->glMesh = d.has_mesh ? new Mesh(this->floats_of(d.mesh)) : NULL;
+					side.displacement = info;
+				}
+
+				s.faces.push_back(side);
+			}
+
+			return s;
+		}
+
+		vmf::Entity entity(uint32_t index) const {
+			const entity_rec& e = this->entities[index];
+
+			vmf::Entity ent;
+			ent.ID = e.id;
+			ent.classname = this->str(e.classname);
+			ent.origin = vec(e.origin);
+			ent.angles = NULL;
+			ent.hidden = e.hidden != 0;
+			ent.visgroupids = this->visgroups_of(e.visgroups);
+
+			for (uint32_t k = 0; k < e.keyvalues.count; k++) {
+				const kv_rec& kv = this->keyvalues[e.keyvalues.first + k];
+				ent.keyValues.insert({ this->str(kv.key), this->str(kv.value) });
+			}
+
+			for (uint32_t k = 0; k < e.solids.count; k++) ent.internal_solids.push_back(this->solid(e.solids.first + k));
+			return ent;
+		}
+
+		std::string visgroup_name(uint64_t index) const { return this->str(this->visgroups[index].name); }
+	};
+
+	/* Builds a vmf from the cache, parsing only the solid and entity blocks that are new or were edited since the cache
+	   was written. Blocks are matched by kind and id, and reused when their text hashes the same. */
+	inline vmf::vmf* load_changed(const reader& r, const std::string& source_path) {
+		perf::timer t;
+		mapped_file source(source_path);
+		if (!source.good()) return NULL;
+
+		kv::block_range visgroups;
+		std::vector<source_block> blocks = scan_source(source.data(), source.size(), &visgroups);
+
+		// Previous blocks by kind and id. Ids used more than once can't be told apart, so those are always rebuilt
+		std::map<std::pair<uint32_t, int32_t>, const block_rec*> previous;
+		for (uint64_t i = 0; i < r.num_blocks; i++) {
+			auto key = std::make_pair(r.blocks[i].kind, r.blocks[i].id);
+			if (previous.count(key)) previous[key] = NULL;
+			else previous.insert({ key, &r.blocks[i] });
+		}
+
+		auto parse_block = [&](const kv::block_range& range) {
+			kv::tokenizer tk(source.data() + range.begin, range.end - range.begin);
+			kv::DataBlock wrapper(&tk);
+			return wrapper.SubBlocks.empty() ? kv::DataBlock() : std::move(wrapper.SubBlocks[0]);
+		};
+
+		// Changed blocks go into a small KV tree of their own, and are loaded and meshed like a full map
+		kv::DataBlock head;
+		kv::DataBlock world;
+		world.name = "world";
+		if (visgroups.end > visgroups.begin) head.SubBlocks.push_back(parse_block(visgroups));
+
+		std::vector<int32_t> reuse(blocks.size(), -1);
+		size_t reused = 0;
+		for (size_t i = 0; i < blocks.size(); i++) {
+			const source_block& b = blocks[i];
+			auto prev = previous.find(std::make_pair((uint32_t)b.kind, (int32_t)b.id));
+			if (prev != previous.end() && prev->second != NULL && prev->second->hash == b.hash && prev->second->record >= 0) {
+				reuse[i] = prev->second->record;
+				reused++;
+				continue;
+			}
+
+			if (b.kind == BLOCK_SOLID) world.SubBlocks.push_back(parse_block(b.range));
+			else head.SubBlocks.push_back(parse_block(b.range));
+		}
+		head.SubBlocks.push_back(std::move(world));
+
+		vmf::vmf changed;
+		changed.load(&head);
+		changed.ComputeGLMeshes();
+		changed.ComputeDisplacements();
+
+		// Rebuilt entities by id, in file order. Entities the loader dropped simply aren't there
+		std::map<int, std::vector<size_t>> changed_entities;
+		for (size_t i = 0; i < changed.entities.size(); i++) changed_entities[changed.entities[i].ID].push_back(i);
+
+		vmf::vmf* v = new vmf::vmf();
+		v->filepath = source_path;
+		v->visgroups = changed.visgroups;
+
+		size_t next_solid = 0;
+		for (size_t i = 0; i < blocks.size(); i++) {
+			if (blocks[i].kind == BLOCK_SOLID) {
+				v->solids.push_back(reuse[i] >= 0 ? r.solid(reuse[i]) : std::move(changed.solids[next_solid++]));
+				v->solids.back().fileorder_id = (int)v->solids.size() - 1;
+				continue;
+			}
+
+			if (reuse[i] >= 0) {
+				v->entities.push_back(r.entity(reuse[i]));
+				continue;
+			}
+
+			auto found = changed_entities.find(blocks[i].id);
+			if (found == changed_entities.end() || found->second.empty()) continue;
+			v->entities.push_back(std::move(changed.entities[found->second.front()]));
+			found->second.erase(found->second.begin());
+		}
+
+		std::cout << "Incremental vmf load: " << reused << " blocks reused, " << blocks.size() - reused << " rebuilt (" << t.ms() << "ms)\n";
+		return v;
+	}
+
+	/* Loads a cached vmf, reparsing whatever changed in the source since. Returns NULL (and says why) if there is no
+	   usable cache. exact is set when the cache matched the source as a whole and nothing was reparsed. */
+	inline vmf::vmf* load(const std::string& cache_path, const std::string& source_path, const source_key& key, bool* exact = NULL) {
+		if (exact != NULL) *exact = false;
+		if (!key.good) return NULL;
+
+		perf::timer t;
+		mapped_file file(cache_path);
+		if (!file.good()) {
+			std::cout << "No vmf cache at " << cache_path << "\n";
+			return NULL;
+		}
+
+		reader r(file);
+		std::string error = r.open();
+		if (error != "") {
+			std::cout << "Ignoring vmf cache " << cache_path << " (" << error << ")\n";
+			return NULL;
+		}
+
+		if (!r.matches(key)) return load_changed(r, source_path);
+
+		vmf::vmf* v = new vmf::vmf();
+		v->filepath = source_path;
+
+		for (uint64_t i = 0; i < r.num_visgroups; i++)
+			v->visgroups.insert({ (unsigned short)r.visgroups[i].id, r.visgroup_name(i) });
+
+		v->solids.reserve(r.world_solids());
+		for (uint32_t i = 0; i < r.world_solids(); i++) v->solids.push_back(r.solid(i));
+
+		for (uint64_t i = 0; i < r.num_entities; i++) v->entities.push_back(r.entity((uint32_t)i));
+
+		std::cout << "Loaded vmf cache in " << t.ms() << "ms (" << v->solids.size() << " solids, " << v->entities.size() << " entities)\n";
+		if (exact != NULL) *exact = true;
+		return v;
+	}
+
+	/* Writes the cache for a vmf that has had its meshes and displacements computed. The source is scanned again to
+	   record the text hash of every solid and entity block */
+	inline bool save(const vmf::vmf& v, const std::string& cache_path, const std::string& source_path, const source_key& key) {
+		if (!key.good) return false;
+
+		perf::timer t;
+		mapped_file source(source_path);
+		if (!source.good()) return false;
+
+		// Records by id, -1 where an id is used more than once
+		std::map<int, int32_t> solid_records, entity_records;
+		auto index = [](std::map<int, int32_t>& records, int id, int32_t i) {
+			auto r = records.insert({ id, i });
+			if (!r.second) r.first->second = -1;
+		};
+		for (size_t i = 0; i < v.solids.size(); i++) index(solid_records, v.solids[i].ID, (int32_t)i);
+		for (size_t i = 0; i < v.entities.size(); i++) index(entity_records, v.entities[i].ID, (int32_t)i);
+
+		std::vector<block_rec> blocks;
+		for (auto && b : scan_source(source.data(), source.size())) {
+			std::map<int, int32_t>& records = b.kind == BLOCK_SOLID ? solid_records : entity_records;
+			auto found = records.find(b.id);
+			blocks.push_back({ (uint32_t)b.kind, b.id, b.hash, found == records.end() ? -1 : found->second, 0 });
+		}
+
+		writer w(v, blocks);
+		if (!w.write(cache_path, key, (uint32_t)v.solids.size())) {
+			std::cout << "Could not write vmf cache " << cache_path << "\n";
+			return false;
+		}
+
+		std::cout << "Wrote vmf cache " << cache_path << " in " << t.ms() << "ms\n";
+		return true;
+	}
+}
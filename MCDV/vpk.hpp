@@ -1,24 +1,22 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
 
+#include "mapped_file.hpp"
+#include "perf.hpp"
 
-#pragma pack(push, 1)
 namespace vpk
 {
-	std::string get_sz(std::ifstream* stream) {
-		std::string out = "";
-		while (true) {
-			char c;
-			stream->read(&c, 1);
-			if (c == 0x00) break;
-			out += c;
-		}
-		return out;
-	}
-
+#pragma pack(push, 1)
 	struct Header_v2
 	{
 		unsigned int Signature = 0x55aa1234;
@@ -59,62 +57,188 @@ namespace vpk
 
 		unsigned short Terminator = 0xffff;
 	};
+#pragma pack(pop)
 
 	struct vEntry
 	{
 		VPKDirectoryEntry entryInfo;
-		std::string entryString;
+		std::string_view entryString; // Points into index::names
+		std::string_view preload; // Points into index::preload_data
 	};
 
+	const unsigned short archive_dir = 0x7fff; // ArchiveIndex of data stored in the directory file itself
+
+	/* The bytes of one file out of the vpk. Usually a view into a mapped archive or the preload data, only copied when a
+	   file is split between the two */
+	struct file {
+		const char* data = NULL;
+		size_t size = 0;
+		bool good = false;
+
+		std::vector<char> joined;
+
+		file() {}
+
+		// data may point into joined, so a copy would point into the original. Moves keep it pointing at their own
+		file(const file&) = delete;
+		file& operator=(const file&) = delete;
+
+		file(file&& o) : data(o.data), size(o.size), good(o.good), joined(std::move(o.joined)) {
+			if (!this->joined.empty()) this->data = this->joined.data();
+		}
+
+		file& operator=(file&& o) {
+			this->data = o.data;
+			this->size = o.size;
+			this->good = o.good;
+			this->joined = std::move(o.joined);
+			if (!this->joined.empty()) this->data = this->joined.data();
+			return *this;
+		}
+	};
+
+	/* Paths as the directory stores them: lowercase with forward slashes */
+	inline void normalize(std::string_view in, std::string& out) {
+		out.resize(in.size());
+		for (size_t i = 0; i < in.size(); i++) {
+			char c = in[i];
+			if (c == '\\') c = '/';
+			else if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+			out[i] = c;
+		}
+	}
+
+	/* FNV-1a */
+	inline uint32_t hash(std::string_view str) {
+		uint32_t h = 2166136261u;
+		for (char c : str) h = (h ^ (uint8_t)c) * 16777619u;
+		return h;
+	}
+
+	/* The directory of a pak01_dir.vpk. Every path is kept once in a shared name blob, and looked up through an open
+	   addressing hash table (linear probing, at most half full). Archives are memory mapped the first time a file in them
+	   is opened and stay mapped, so find and open are safe to call from any number of threads */
 	class index {
+		struct slot {
+			uint32_t hash;
+			uint32_t entry; // Index into entries + 1, 0 for an empty slot
+		};
+
+		std::vector<slot> m_slots;
+
+		std::string m_archive_prefix; // pak01_ for pak01_dir.vpk
+		size_t m_data_start = 0; // Where archive_dir data starts in the directory file
+
+		std::mutex m_archive_lock;
+		std::vector<std::unique_ptr<mapped_file>> m_archives;
+		std::unique_ptr<mapped_file> m_dir_archive;
+
+		/* NULL if the archive could not be opened */
+		const mapped_file* archive(unsigned short archive_index) {
+			std::lock_guard<std::mutex> lock(this->m_archive_lock);
+
+			std::unique_ptr<mapped_file>* slot = &this->m_dir_archive;
+			std::string path = this->m_archive_prefix + "dir.vpk";
+
+			if (archive_index != archive_dir) {
+				if (archive_index >= this->m_archives.size()) this->m_archives.resize(archive_index + 1);
+				slot = &this->m_archives[archive_index];
+
+				char number[8];
+				snprintf(number, sizeof(number), "%03u", (unsigned)archive_index);
+				path = this->m_archive_prefix + number + ".vpk";
+			}
+
+			if (*slot == nullptr) slot->reset(new mapped_file(path));
+			return (*slot)->good() ? slot->get() : NULL;
+		}
+
+		/* Next NUL terminated string in the tree, empty at the end of a list. Fails if it runs off the end */
+		static bool read_sz(const char*& p, const char* end, std::string_view& out) {
+			const char* s = p;
+			const char* nul = (const char*)memchr(s, 0x00, end - s);
+			if (nul == NULL) return false;
+
+			out = std::string_view(s, nul - s);
+			p = nul + 1;
+			return true;
+		}
+
+		void build_table() {
+			size_t capacity = 16;
+			while (capacity < this->entries.size() * 2) capacity <<= 1;
+			this->m_slots.assign(capacity, slot{ 0, 0 });
+
+			for (size_t i = 0; i < this->entries.size(); i++) {
+				uint32_t h = hash(this->entries[i].entryString);
+				size_t s = h & (capacity - 1);
+				while (this->m_slots[s].entry != 0) s = (s + 1) & (capacity - 1);
+
+				this->m_slots[s].hash = h;
+				this->m_slots[s].entry = (uint32_t)i + 1;
+			}
+		}
+
 	public:
 		Header_v2 header;
 		std::vector<vEntry> entries;
+		std::vector<char> names; // Every entry's path, back to back
+		std::vector<char> preload_data; // Every entry's preload bytes, back to back
+
+		double load_ms = 0.0;
 
 		index(std::string path) {
-			//Create main file handle
-			std::ifstream reader(path, std::ios::in | std::ios::binary);
+			perf::timer t;
 
-			if (!reader) {
+			// The tree is walked straight out of the mapping, nothing is copied but the paths
+			mapped_file file(path);
+			if (!file.good() || file.size() < 12) {
 				throw std::exception("VPK::LOAD Failed"); return;
 			}
 
-			//Read header
-			reader.read((char*)&this->header, sizeof(this->header));
+			memset(&this->header, 0, sizeof(this->header));
+			memcpy(&this->header, file.data(), std::min(file.size(), sizeof(this->header)));
 
 			std::cout << "Version: " << this->header.Version << "\n";
 			std::cout << "TreeSize: " << this->header.TreeSize << "\n";
 
-			std::ofstream f;
-			f.open("vpk.txt");
-
-			while (true) {
-				std::string extension = get_sz(&reader);
-				std::cout << "   *." << extension << "\n";
-				if (extension == "") break;
+			size_t tree_start = this->header.Version == 1 ? 12 : sizeof(Header_v2);
+			this->m_data_start = tree_start + this->header.TreeSize;
+			this->m_archive_prefix = path.size() >= 7 && path.compare(path.size() - 7, 7, "dir.vpk") == 0 ? path.substr(0, path.size() - 7) : path + "_";
+			const char* p = file.data() + tree_start;
+			const char* end = file.data() + std::min(file.size(), tree_start + this->header.TreeSize);
 
-				while (true) {
-					std::string folder = get_sz(&reader);
-					if (folder == "") break;
+			// Paths and preload bytes go in by offset first, the blobs move while they grow
+			std::vector<size_t> offsets, preload_offsets;
+			std::string_view extension, folder, filename;
 
-					while (true) {
-						std::string filename = get_sz(&reader);
-						if (filename == "") break;
+			while (p < end) {
+				if (!read_sz(p, end, extension) || extension.empty()) break;
 
-						if(this->header.Version > 0)
-						if (reader.tellg() > this->header.TreeSize + sizeof(Header_v2)) goto IL_EXIT; // Get out of f
+				while (read_sz(p, end, folder) && !folder.empty()) {
+					while (read_sz(p, end, filename) && !filename.empty()) {
+						if (end - p < (ptrdiff_t)sizeof(VPKDirectoryEntry)) goto IL_EXIT; // Get out of f
 
 						vEntry entry;
-						reader.read((char*)&entry.entryInfo, sizeof(VPKDirectoryEntry));
-
-						if (entry.entryInfo.PreloadBytes) {
-							char* arr = new char[entry.entryInfo.PreloadBytes];
-							reader.read(arr, entry.entryInfo.PreloadBytes);
-							delete arr;
+						memcpy(&entry.entryInfo, p, sizeof(VPKDirectoryEntry));
+						p += sizeof(VPKDirectoryEntry);
+
+						if (end - p < entry.entryInfo.PreloadBytes) goto IL_EXIT;
+						preload_offsets.push_back(this->preload_data.size());
+						this->preload_data.insert(this->preload_data.end(), p, p + entry.entryInfo.PreloadBytes);
+						p += entry.entryInfo.PreloadBytes;
+
+						// A single space stands for the root folder, or no extension
+						offsets.push_back(this->names.size());
+						if (folder != " ") {
+							this->names.insert(this->names.end(), folder.begin(), folder.end());
+							this->names.push_back('/');
+						}
+						this->names.insert(this->names.end(), filename.begin(), filename.end());
+						if (extension != " ") {
+							this->names.push_back('.');
+							this->names.insert(this->names.end(), extension.begin(), extension.end());
 						}
-
-						entry.entryString = folder + "/" + filename + "." + extension;
-						f << folder + "/" + filename + "." + extension << "\n";
 
 						this->entries.push_back(entry);
 					}
@@ -122,26 +246,88 @@ namespace vpk
 			}
 
 		IL_EXIT:
+			offsets.push_back(this->names.size());
+			for (size_t i = 0; i < this->entries.size(); i++) {
+				this->entries[i].entryString = std::string_view(this->names.data() + offsets[i], offsets[i + 1] - offsets[i]);
+				this->entries[i].preload = std::string_view(this->preload_data.data() + preload_offsets[i], this->entries[i].entryInfo.PreloadBytes);
+			}
 
-			f.close();
+			this->build_table();
+			this->load_ms = t.ms_precise();
 
 			std::cout << "Done reading\n";
-			std::cout << this->entries.size() << " entries read\n";
-
-			reader.close();
+			std::cout << this->entries.size() << " entries read in " << this->load_ms << "ms (" << perf::format_mb(this->names.size()) << " of paths)\n";
 		}
 
-		vEntry* find(std::string name) {
-			// All files in vpk are stored in lowercase.
-			std::string search = sutil::to_lower(name);
-			for (auto && v : this->entries) {
-				if (v.entryString == search) {
-					return &v;
-				}
+		index(const index&) = delete;
+		index& operator=(const index&) = delete;
+
+		/* Case and slash direction do not matter. NULL if the file is not in the directory */
+		vEntry* find(std::string_view name) {
+			thread_local std::string search;
+			normalize(name, search);
+
+			uint32_t h = hash(search);
+			size_t mask = this->m_slots.size() - 1;
+			for (size_t s = h & mask; this->m_slots[s].entry != 0; s = (s + 1) & mask) {
+				if (this->m_slots[s].hash != h) continue;
+
+				vEntry& e = this->entries[this->m_slots[s].entry - 1];
+				if (e.entryString == search) return &e;
 			}
 
 			return NULL;
 		}
+
+		/* Same result as find, by comparing against every entry. Only here to check and time find against */
+		vEntry* find_linear(std::string_view name) {
+			std::string search;
+			normalize(name, search);
+
+			for (auto && v : this->entries)
+				if (v.entryString == search) return &v;
+
+			return NULL;
+		}
+
+		/* The contents of an entry: its preload bytes followed by EntryLength bytes from its archive */
+		file open(const vEntry& entry) {
+			file f;
+			const VPKDirectoryEntry& info = entry.entryInfo;
+
+			const char* stored = NULL;
+			if (info.EntryLength) {
+				const mapped_file* source = this->archive(info.ArchiveIndex);
+				if (source == NULL) return f;
+
+				size_t offset = info.EntryOffset + (info.ArchiveIndex == archive_dir ? this->m_data_start : 0);
+				if (offset + info.EntryLength > source->size()) return f;
+				stored = source->data() + offset;
+			}
+
+			if (entry.preload.empty()) {
+				f.data = stored;
+				f.size = info.EntryLength;
+			}
+			else if (stored == NULL) {
+				f.data = entry.preload.data();
+				f.size = entry.preload.size();
+			}
+			else {
+				f.joined.assign(entry.preload.begin(), entry.preload.end());
+				f.joined.insert(f.joined.end(), stored, stored + info.EntryLength);
+				f.data = f.joined.data();
+				f.size = f.joined.size();
+			}
+
+			f.good = true;
+			return f;
+		}
+
+		/* Write every path in the directory to a text file, one per line */
+		void dump(const std::string& path) const {
+			std::ofstream f(path);
+			for (auto && v : this->entries) f << v.entryString << "\n";
+		}
 	};
 }
-#pragma pack(pop)
\ No newline at end of file
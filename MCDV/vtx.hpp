@@ -3,8 +3,13 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 #include "util.h"
+#include "span_reader.hpp"
+
+//StudioMDL constants
+#define MAX_NUM_LODS 8
 
 namespace vtx
 {
@@ -146,22 +151,134 @@ namespace vtx
 #pragma pack(pop)
 }
 
+/* One level of detail out of a .vtx */
+struct vtx_lod {
+	float switchPoint = 0.0f;				// Where the game switches to this LOD, as stored in the file
+	std::vector<uint32_t> vertexSequence;	// Triangles, as indices into the vvd vertices of this LOD
+};
+
 class vtx_mesh : public util::verboseControl
 {
+	/* Appends the triangles of one LOD to out. Every header is used in place and checked against the end of the file
+	   first; false as soon as anything points outside it. Models with fewer LODs give their last one */
+	bool decode_lod(const span_reader& file, int lod, vtx_lod& out) {
+		const vtx::FileHeader* fh = &this->header;
+		const vtx::BodyPartHeader* bodies = file.at<vtx::BodyPartHeader>(fh->bodyPartOffset, fh->numBodyParts);
+		if (bodies == NULL) return false;
+
+		bool switch_found = false;
+
+		for (int body = 0; body < fh->numBodyParts; body++) {
+			int64_t body_at = fh->bodyPartOffset + body * (int64_t)sizeof(vtx::BodyPartHeader);
+			int64_t models_at = body_at + bodies[body].modelOffset;
+			const vtx::ModelHeader* models = file.at<vtx::ModelHeader>(models_at, bodies[body].numModels);
+			if (models == NULL) return false;
+
+			int total_verts = 0;
+
+			for (int model = 0; model < bodies[body].numModels; model++) {
+				int64_t model_at = models_at + model * (int64_t)sizeof(vtx::ModelHeader);
+				if (models[model].numLODs < 1) continue;
+
+				int model_lod = std::min(lod, models[model].numLODs - 1);
+				int64_t lod_at = model_at + models[model].lodOffset + model_lod * (int64_t)sizeof(vtx::ModelLODHeader);
+				const vtx::ModelLODHeader* lodh = file.at<vtx::ModelLODHeader>(lod_at);
+				if (lodh == NULL) return false;
+
+				if (!switch_found) {
+					out.switchPoint = lodh->switchPoint;
+					switch_found = true;
+				}
+
+				int64_t meshes_at = lod_at + lodh->meshOffset;
+				const vtx::MeshHeader* meshes = file.at<vtx::MeshHeader>(meshes_at, lodh->numMeshes);
+				if (meshes == NULL) return false;
+
+				for (int mesh = 0; mesh < lodh->numMeshes; mesh++) {
+					int64_t groups_at = meshes_at + mesh * (int64_t)sizeof(vtx::MeshHeader) + meshes[mesh].stripGroupHeaderOffset;
+					const vtx::StripGroupHeader* groups = file.at<vtx::StripGroupHeader>(groups_at, meshes[mesh].numStripGroups);
+					if (groups == NULL) return false;
+
+					for (int sgroup = 0; sgroup < meshes[mesh].numStripGroups; sgroup++) {
+						const vtx::StripGroupHeader& g = groups[sgroup];
+						int64_t group_at = groups_at + sgroup * (int64_t)sizeof(vtx::StripGroupHeader);
+
+						const vtx::Vertex* verts = file.at<vtx::Vertex>(group_at + g.vertOffset, g.numVerts);
+						const uint16_t* indices = file.at<uint16_t>(group_at + g.indexOffset, g.numIndices);
+						const vtx::StripHeader* strips = file.at<vtx::StripHeader>(group_at + g.stripOffset, g.numStrips);
+						if ((verts == NULL && g.numVerts) || (indices == NULL && g.numIndices) || (strips == NULL && g.numStrips)) return false;
+
+						for (int strip = 0; strip < g.numStrips; strip++) {
+							const vtx::StripHeader& st = strips[strip];
+							if (st.vertOffset < 0 || st.numVerts < 0 || st.vertOffset + st.numVerts > g.numVerts) return false;
+							if (st.indexOffset < 0 || st.numIndices < 0 || st.indexOffset + st.numIndices > g.numIndices) return false;
+
+							const vtx::Vertex* strip_verts = verts + st.vertOffset;
+							const uint16_t* strip_indices = indices + st.indexOffset;
+
+							size_t base = out.vertexSequence.size();
+							out.vertexSequence.resize(base + st.numIndices);
+							uint32_t* dst = &out.vertexSequence[base];
+
+							for (int i = 0; i < st.numIndices; i++) {
+								if (strip_indices[i] >= st.numVerts) return false;
+								dst[i] = strip_verts[strip_indices[i]].origMeshVertID + total_verts;
+							}
+						}
+
+						total_verts += g.numVerts;
+					}
+				}
+
+				// Like the stream reader this came from, a model with more than one LOD ends the walk
+				if (models[model].numLODs > 1) return true;
+			}
+		}
+
+		return true;
+	}
+
+	bool decode(const span_reader& file) {
+		const vtx::FileHeader* fh = file.at<vtx::FileHeader>(0);
+		if (fh == NULL) return false;
+		this->header = *fh;
+
+		this->debug("VTX version:", this->header.version);
+		this->debug("Num LODS:", this->header.numLODs);
+
+		// A broken LOD past the first just ends the list
+		this->lods.resize(std::max(1, std::min(this->header.numLODs, MAX_NUM_LODS)));
+		for (int lod = 0; lod < (int)this->lods.size(); lod++) {
+			if (this->decode_lod(file, lod, this->lods[lod])) continue;
+			if (lod == 0) return false;
+
+			this->lods.resize(lod);
+			break;
+		}
+
+		return true;
+	}
+
 public:
-	std::vector<unsigned short> vertexSequence;
+	std::vector<vtx_lod> lods; // At least one, LOD 0 is the full model
 	vtx::FileHeader header;
 	bool read_success = true;
 
-	vtx_mesh(std::ifstream* stream, bool verbost = false) {
+	vtx_mesh(span_reader* stream, bool verbost = false) {
 		this->use_verbose = verbost;
 
+		this->read_success = this->decode(*stream);
+		if (!this->read_success) this->lods.assign(1, vtx_lod());
+	}
+
+	/* The seek and read walk decode replaced, kept to check it against (--benchModels). Throws on bad strips */
+	static void reference_sequence(span_reader* stream, std::vector<uint32_t>& out) {
+		vtx::FileHeader header;
+
 		unsigned int offset = stream->tellg();
 
 		//Read header
-		stream->read((char*)&this->header, sizeof(this->header));
-		this->debug("VTX version:", this->header.version);
-		this->debug("Num LODS:", this->header.numLODs);
+		stream->read((char*)&header, sizeof(header));
 
 		/* Read bulk of .VTX file */
 
@@ -292,7 +409,9 @@ public:
 
 								for (int i = 0; i < v_indices.size(); i++)
 								{
-									this->vertexSequence.push_back(v_verts[v_indices[i]].origMeshVertID + total_verts);
+									if (v_indices[i] >= v_verts.size())
+										throw std::exception("VTX::DECOMPILE::STRIP_VERT OUT OF RANGE");
+									out.push_back(v_verts[v_indices[i]].origMeshVertID + total_verts);
 								}
 							}
 
@@ -302,7 +421,7 @@ public:
 				}
 			}
 		}
-	IL_EXIT: stream->close();
+	IL_EXIT:;
 	}
 
 	virtual ~vtx_mesh() {}
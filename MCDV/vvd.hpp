@@ -9,6 +9,8 @@
 #include <glm\gtc\type_ptr.hpp>
 
 #include "util.h"
+#include "span_reader.hpp"
+#include "simd.hpp"
 
 //StudioMDL constants
 #define MAX_NUM_LODS 8
@@ -33,11 +35,18 @@ struct Vertex
 	glm::vec2 m_vecTexCoord;
 };
 
+struct Fixup
+{
+	int lod;			// Vertices used by every LOD up to this one
+	int sourceVertexID;
+	int numVertexes;
+};
+
 struct Header
 {
 	int id;
 	int version;
-	long checksum;
+	int checksum;
 	int numLods;
 	int numLodVertexes[MAX_NUM_LODS];
 	int numFixups;
@@ -52,38 +61,129 @@ struct Header
 class vvd_data : public util::verboseControl
 {
 private:
+	/* Copies count vertices starting at src into out as POS_XYZ_NORMAL_XYZ, doing the sorce->opengl flipperoo
+	   (x, y, z) -> (-x, z, y) on both. Bone weights, texture coordinates and tangents are left behind */
+	static void swizzle(const VVD::Vertex* src, size_t count, float* out) {
+		const simd::f4 flip(-1.0f, 1.0f, 1.0f, -1.0f);
+
+		for (size_t i = 0; i < count; i++) {
+			const float* p = &src[i].m_vecPosition.x;
+			float* o = out + i * 6;
+
+			// (px, py, pz, nx) -> (-px, pz, py, -nx)
+			(simd::shuffle<0, 2, 1, 3>(simd::f4::load(p)) * flip).store(o);
+
+			// (pz, nx, ny, nz) -> (nz, ny), the other two lanes land on the next vertex before it is written
+			if (i + 1 < count) simd::shuffle<3, 2, 0, 0>(simd::f4::load(p + 2)).store(o + 4);
+			else {
+				o[4] = p[5];
+				o[5] = p[4];
+			}
+		}
+	}
+
+	/* Vertex ranges in the order the given LOD sees them. Without fixups every LOD shares the LOD 0 block */
+	bool lod_ranges(const span_reader& file, int lod, std::vector<VVD::Fixup>& ranges) {
+		if (this->header.numFixups <= 0) {
+			ranges.push_back({ 0, 0, this->header.numLodVertexes[0] });
+			return true;
+		}
+
+		const VVD::Fixup* fixups = file.at<VVD::Fixup>(this->header.fixupTableStart, this->header.numFixups);
+		if (fixups == NULL) return false;
+
+		this->fixups.assign(fixups, fixups + this->header.numFixups);
+		for (auto && f : this->fixups)
+			if (f.lod >= lod) ranges.push_back(f);
+		return true;
+	}
+
+	bool decode(const span_reader& file, int lod) {
+		const VVD::Header* h = file.at<VVD::Header>(0);
+		if (h == NULL) return false;
+		this->header = *h;
+		this->debug("VVD Version:", this->header.version);
+
+		if (this->header.numLods < 1 || this->header.numLods > MAX_NUM_LODS) return false;
+		this->lod = std::max(0, std::min(lod, this->header.numLods - 1));
+
+		std::vector<VVD::Fixup> ranges;
+		if (!this->lod_ranges(file, this->lod, ranges)) return false;
+
+		size_t total = 0;
+		for (auto && r : ranges) {
+			if (r.numVertexes < 0 || file.at<VVD::Vertex>(this->header.vertexDataStart + r.sourceVertexID * (int64_t)sizeof(VVD::Vertex), r.numVertexes) == NULL) return false;
+			total += r.numVertexes;
+		}
+
+		this->vertices.resize(total * 6);
+		float* out = this->vertices.data();
+		for (auto && r : ranges) {
+			swizzle(file.at<VVD::Vertex>(this->header.vertexDataStart + r.sourceVertexID * (int64_t)sizeof(VVD::Vertex), r.numVertexes), r.numVertexes, out);
+			out += (size_t)r.numVertexes * 6;
+		}
+
+		return true;
+	}
+
 public:
 	VVD::Header header;
+	int lod = 0;				// The LOD that was read, clamped to the ones the file has
+	bool read_success = true;
 
-	std::vector<VVD::Vertex> verticesLOD0;
+	std::vector<float> vertices; // POS_XYZ_NORMAL_XYZ, already in GL space
+	std::vector<VVD::Fixup> fixups; // Empty when every LOD uses the same vertices
 
-	vvd_data(std::ifstream* stream, bool verbost = false) {
+	vvd_data(span_reader* stream, int lod = 0, bool verbost = false) {
 		this->use_verbose = verbost;
 
-		unsigned int offset = stream->tellg();
+		this->read_success = this->decode(*stream, lod);
+		if (!this->read_success) this->vertices.clear();
 
-		stream->read((char*)&this->header, sizeof(this->header));
-		this->debug("VVD Version:", this->header.version);
+		this->debug("Data length: ", this->vertex_count());
+	}
 
-		//Read vertex data
-		stream->seekg(offset + header.vertexDataStart);
+	size_t vertex_count() const { return this->vertices.size() / 6; }
 
-		//Read LOD0
-		for (int i = 0; i < header.numLodVertexes[0]; i++)
-		{
+	/* Where each vertex of a coarser LOD is in vertices. A LOD sees a subset of the ranges the one before it does, so
+	   its .vtx triangles can be drawn from the vertices that were read instead of decoding it again */
+	std::vector<uint32_t> lod_remap(int lod) const {
+		std::vector<uint32_t> remap;
+		if (this->fixups.empty()) {
+			remap.resize(this->vertex_count());
+			for (size_t i = 0; i < remap.size(); i++) remap[i] = (uint32_t)i;
+			return remap;
+		}
+
+		uint32_t at = 0;
+		for (auto && f : this->fixups) {
+			if (f.lod < this->lod) continue;
+			if (f.lod >= lod)
+				for (int i = 0; i < f.numVertexes; i++) remap.push_back(at + i);
+			at += f.numVertexes;
+		}
+		return remap;
+	}
+
+	/* LOD 0 read the way vvd_data used to: numLodVertexes[0] vertices straight from the vertex block, fixups ignored,
+	   read through the stream and flipped one at a time. Kept to check the decoder against */
+	static void reference_vertices(span_reader* stream, std::vector<float>& out) {
+		VVD::Header header;
+		stream->read((char*)&header, sizeof(header));
+
+		stream->seekg(header.vertexDataStart);
+		for (int i = 0; i < header.numLodVertexes[0] && !stream->fail(); i++) {
 			VVD::Vertex vert;
 			stream->read((char*)&vert, sizeof(vert));
 
-			// Do the sorce->opengl flipperoo
-			glm::vec3 temp = vert.m_vecPosition;
-			vert.m_vecPosition = glm::vec3(-temp.x, temp.z, temp.y);
-
-			this->verticesLOD0.push_back(vert);
+			glm::vec3 p = vert.m_vecPosition;
+			glm::vec3 n = vert.m_vecNormal;
+			float v[6] = { -p.x, p.z, p.y, -n.x, n.z, n.y };
+			out.insert(out.end(), v, v + 6);
 		}
 
-		this->debug("Data length: ", this->verticesLOD0.size());
-		stream->close();
+		if (stream->fail()) throw std::exception("VVD data runs past the end of the file");
 	}
 
 	~vvd_data() {};
-};
\ No newline at end of file
+};